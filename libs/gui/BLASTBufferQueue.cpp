@@ -27,6 +27,7 @@
 #include <gui/BufferQueueProducer.h>
 #include <gui/GLConsumer.h>
 #include <gui/IProducerListener.h>
+#include <gui/OccupancyTracker.h>
 #include <gui/Surface.h>
 #include <gui/TraceUtils.h>
 #include <utils/Singleton.h>
@@ -34,6 +35,7 @@
 
 #include <private/gui/ComposerService.h>
 
+#include <algorithm>
 #include <chrono>
 
 using namespace std::chrono_literals;
@@ -92,6 +94,14 @@ void BLASTBufferItemConsumer::addAndGetFrameTimestamps(const NewFrameEventsEntry
     }
 }
 
+status_t BLASTBufferItemConsumer::getFrameTimestampsRing(base::unique_fd* outRing) {
+    if (mTimestampsRing == nullptr) {
+        return INVALID_OPERATION;
+    }
+    *outRing = mTimestampsRing->dupFd();
+    return outRing->ok() ? NO_ERROR : NO_MEMORY;
+}
+
 void BLASTBufferItemConsumer::updateFrameTimestamps(uint64_t frameNumber, nsecs_t refreshStartTime,
                                                     const sp<Fence>& glDoneFence,
                                                     const sp<Fence>& presentFence,
@@ -165,6 +175,9 @@ BLASTBufferQueue::BLASTBufferQueue(const std::string& name, bool updateDestinati
     mCurrentMaxAcquiredBufferCount = mMaxAcquiredBuffers;
     mNumAcquired = 0;
     mNumFrameAvailable = 0;
+    // acquireNextBufferLocked holds at most mMaxAcquiredBuffers + 2 buffers at once.
+    mSubmitted.reserve(static_cast<size_t>(mMaxAcquiredBuffers) + 2);
+    mPendingFrameTimelines.reserve(kExpectedPendingFrameTimelines);
 
     TransactionCompletedListener::getInstance()->addQueueStallListener(
         [&]() {
@@ -421,7 +434,7 @@ void BLASTBufferQueue::releaseBufferCallbackLocked(
     // on a lower refresh rate than the max supported. We only do that for EGL
     // clients as others don't care about latency
     const bool isEGL = [&] {
-        const auto it = mSubmitted.find(id);
+        const auto it = findSubmittedLocked(id);
         return it != mSubmitted.end() && it->second.mApi == NATIVE_WINDOW_API_EGL;
     }();
 
@@ -462,9 +475,15 @@ void BLASTBufferQueue::releaseBufferCallbackLocked(
     mCallbackCV.notify_all();
 }
 
+BLASTBufferQueue::SubmittedBuffers::iterator BLASTBufferQueue::findSubmittedLocked(
+        const ReleaseCallbackId& id) {
+    return std::find_if(mSubmitted.begin(), mSubmitted.end(),
+                        [&id](const auto& submitted) { return submitted.first == id; });
+}
+
 void BLASTBufferQueue::releaseBuffer(const ReleaseCallbackId& callbackId,
                                      const sp<Fence>& releaseFence) {
-    auto it = mSubmitted.find(callbackId);
+    auto it = findSubmittedLocked(callbackId);
     if (it == mSubmitted.end()) {
         BQA_LOGE("ERROR: releaseBufferCallback without corresponding submitted buffer %s",
                  callbackId.to_string().c_str());
@@ -474,7 +493,11 @@ void BLASTBufferQueue::releaseBuffer(const ReleaseCallbackId& callbackId,
     BBQ_TRACE("frame=%" PRIu64, callbackId.framenumber);
     BQA_LOGV("released %s", callbackId.to_string().c_str());
     mBufferItemConsumer->releaseBuffer(it->second, releaseFence);
-    mSubmitted.erase(it);
+    // The order of the submitted buffers doesn't matter, so fill the hole with the last one.
+    if (it != mSubmitted.end() - 1) {
+        *it = std::move(mSubmitted.back());
+    }
+    mSubmitted.pop_back();
     // Remove the frame number from mSyncedFrameNumbers since we can get a release callback
     // without getting a transaction committed if the buffer was dropped.
     mSyncedFrameNumbers.erase(callbackId.framenumber);
@@ -502,9 +525,8 @@ status_t BLASTBufferQueue::acquireNextBufferLocked(
         return NAME_NOT_FOUND;
     }
 
-    SurfaceComposerClient::Transaction localTransaction;
     bool applyTransaction = true;
-    SurfaceComposerClient::Transaction* t = &localTransaction;
+    SurfaceComposerClient::Transaction* t = &*mBufferTransaction;
     if (transaction) {
         t = *transaction;
         applyTransaction = false;
@@ -544,7 +566,11 @@ status_t BLASTBufferQueue::acquireNextBufferLocked(
     mNumAcquired++;
     mLastAcquiredFrameNumber = bufferItem.mFrameNumber;
     ReleaseCallbackId releaseCallbackId(buffer->getId(), mLastAcquiredFrameNumber);
-    mSubmitted[releaseCallbackId] = bufferItem;
+    if (auto it = findSubmittedLocked(releaseCallbackId); it != mSubmitted.end()) {
+        it->second = bufferItem;
+    } else {
+        mSubmitted.emplace_back(releaseCallbackId, bufferItem);
+    }
 
     bool needsDisconnect = false;
     mBufferItemConsumer->getConnectionEvents(bufferItem.mFrameNumber, &needsDisconnect);
@@ -568,6 +594,10 @@ status_t BLASTBufferQueue::acquireNextBufferLocked(
                       std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
     sp<Fence> fence = bufferItem.mFence ? new Fence(bufferItem.mFence->dup()) : Fence::NO_FENCE;
     t->setBuffer(mSurfaceControl, buffer, fence, bufferItem.mFrameNumber, releaseBufferCallback);
+    OccupancyHistogram::Snapshot occupancyDelta;
+    if (OccupancyHistogram::takeProcessHistogramDelta(systemTime(), &occupancyDelta)) {
+        t->setBufferOccupancyDelta(mSurfaceControl, occupancyDelta);
+    }
     t->setDataspace(mSurfaceControl, static_cast<ui::Dataspace>(bufferItem.mDataSpace));
     t->setHdrMetadata(mSurfaceControl, bufferItem.mHdrMetadata);
     t->setSurfaceDamageRegion(mSurfaceControl, bufferItem.mSurfaceDamage);
@@ -593,23 +623,23 @@ status_t BLASTBufferQueue::acquireNextBufferLocked(
     }
 
     // Drop stale frame timeline infos
-    while (!mPendingFrameTimelines.empty() &&
-           mPendingFrameTimelines.front().first < bufferItem.mFrameNumber) {
+    auto frameTimeline = mPendingFrameTimelines.begin();
+    while (frameTimeline != mPendingFrameTimelines.end() &&
+           frameTimeline->first < bufferItem.mFrameNumber) {
         ATRACE_FORMAT_INSTANT("dropping stale frameNumber: %" PRIu64 " vsyncId: %" PRId64,
-                              mPendingFrameTimelines.front().first,
-                              mPendingFrameTimelines.front().second.vsyncId);
-        mPendingFrameTimelines.pop();
+                              frameTimeline->first, frameTimeline->second.vsyncId);
+        ++frameTimeline;
     }
 
-    if (!mPendingFrameTimelines.empty() &&
-        mPendingFrameTimelines.front().first == bufferItem.mFrameNumber) {
+    if (frameTimeline != mPendingFrameTimelines.end() &&
+        frameTimeline->first == bufferItem.mFrameNumber) {
         ATRACE_FORMAT_INSTANT("Transaction::setFrameTimelineInfo frameNumber: %" PRIu64
                               " vsyncId: %" PRId64,
-                              bufferItem.mFrameNumber,
-                              mPendingFrameTimelines.front().second.vsyncId);
-        t->setFrameTimelineInfo(mPendingFrameTimelines.front().second);
-        mPendingFrameTimelines.pop();
+                              bufferItem.mFrameNumber, frameTimeline->second.vsyncId);
+        t->setFrameTimelineInfo(frameTimeline->second);
+        ++frameTimeline;
     }
+    mPendingFrameTimelines.erase(mPendingFrameTimelines.begin(), frameTimeline);
 
     {
         std::unique_lock _lock{mTimestampMutex};
@@ -625,7 +655,10 @@ status_t BLASTBufferQueue::acquireNextBufferLocked(
     mergePendingTransactions(t, bufferItem.mFrameNumber);
     if (applyTransaction) {
         // All transactions on our apply token are one-way. See comment on mAppliedLastTransaction
-        t->setApplyToken(mApplyToken).apply(false, true);
+        if (t->setApplyToken(mApplyToken).apply(false, true) != NO_ERROR) {
+            // A failed transaction keeps its state and error, so don't reuse it.
+            mBufferTransaction.emplace();
+        }
         mAppliedLastTransaction = true;
         mLastAppliedFrameNumber = bufferItem.mFrameNumber;
     } else {
@@ -912,7 +945,7 @@ status_t BLASTBufferQueue::setFrameTimelineInfo(uint64_t frameNumber,
     ATRACE_FORMAT("%s(%s) frameNumber: %" PRIu64 " vsyncId: %" PRId64, __func__, mName.c_str(),
                   frameNumber, frameTimelineInfo.vsyncId);
     std::unique_lock _lock{mMutex};
-    mPendingFrameTimelines.push({frameNumber, frameTimelineInfo});
+    mPendingFrameTimelines.emplace_back(frameNumber, frameTimelineInfo);
     return OK;
 }
 
@@ -1093,6 +1126,7 @@ void BLASTBufferQueue::createBufferQueue(sp<IGraphicBufferProducer>* outProducer
 
     sp<BufferQueueConsumer> consumer(new BufferQueueConsumer(core));
     consumer->setAllowExtraAcquire(true);
+    consumer->setPreallocationBudget(kPreallocationBudget);
     LOG_ALWAYS_FATAL_IF(consumer == nullptr,
                         "BLASTBufferQueue: failed to create BufferQueueConsumer");
 
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gui/BufferAllocationPredictor.h>
+
+#include <limits>
+
+namespace android {
+
+void BufferAllocationPredictor::onAllocation(const BufferAllocationConfig& config) {
+    if (!mHistory.empty() && mHistory.back().config == config) {
+        mHistory.back().count++;
+        return;
+    }
+    if (mHistory.size() == kHistorySize) {
+        mHistory.pop_front();
+    }
+    mHistory.push_back({config, 1});
+}
+
+std::optional<BufferAllocationPredictor::Prediction> BufferAllocationPredictor::predict() const {
+    const size_t size = mHistory.size();
+    if (size < 2) {
+        return std::nullopt;
+    }
+    const BufferAllocationConfig& last = mHistory[size - 1].config;
+    const BufferAllocationConfig& previous = mHistory[size - 2].config;
+
+    // The size changed twice in a row by the same step, with the same format and usage.
+    if (size >= 3) {
+        const BufferAllocationConfig& first = mHistory[size - 3].config;
+        const int64_t widthStep = int64_t{last.width} - previous.width;
+        const int64_t heightStep = int64_t{last.height} - previous.height;
+        if (last.format == previous.format && last.usage == previous.usage &&
+            previous.format == first.format && previous.usage == first.usage &&
+            widthStep == int64_t{previous.width} - first.width &&
+            heightStep == int64_t{previous.height} - first.height) {
+            const int64_t width = last.width + widthStep;
+            const int64_t height = last.height + heightStep;
+            constexpr int64_t kMaxSize = std::numeric_limits<uint32_t>::max();
+            if (width <= 0 || height <= 0 || width > kMaxSize || height > kMaxSize) {
+                return std::nullopt;
+            }
+            BufferAllocationConfig next = last;
+            next.width = static_cast<uint32_t>(width);
+            next.height = static_cast<uint32_t>(height);
+            // As many buffers as for the previous size, the allocations of the last one being
+            // possibly still under way.
+            return Prediction{next, mHistory[size - 2].count};
+        }
+    }
+
+    // The last configuration was seen before: predict the one which followed it the last time.
+    for (size_t i = size - 1; i-- > 0;) {
+        if (mHistory[i].config == last) {
+            return Prediction{mHistory[i + 1].config, mHistory[i + 1].count};
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace android
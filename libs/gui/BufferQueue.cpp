@@ -103,6 +103,14 @@ void BufferQueue::ProxyConsumerListener::addAndGetFrameTimestamps(
     }
 }
 
+status_t BufferQueue::ProxyConsumerListener::getFrameTimestampsRing(base::unique_fd* outRing) {
+    sp<ConsumerListener> listener(mConsumerListener.promote());
+    if (listener != nullptr) {
+        return listener->getFrameTimestampsRing(outRing);
+    }
+    return NO_INIT;
+}
+
 void BufferQueue::createBufferQueue(sp<IGraphicBufferProducer>* outProducer,
         sp<IGraphicBufferConsumer>* outConsumer,
         bool consumerIsSurfaceFlinger) {
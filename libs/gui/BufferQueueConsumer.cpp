@@ -83,6 +83,7 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
     sp<IProducerListener> listener;
     {
         std::unique_lock<std::mutex> lock(mCore->mMutex);
+        mCore->applyPendingReleasesLocked();
 
         // Check that the consumer doesn't currently have the maximum number of
         // buffers acquired. We allow the max buffer count to be exceeded by one
@@ -199,7 +200,7 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
                     ++numDroppedBuffers;
                 }
 
-                mCore->mQueue.erase(front);
+                mCore->mQueue.pop_front();
                 front = mCore->mQueue.begin();
             }
 
@@ -281,6 +282,7 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
                 mSlots[slot].mBufferState.acquire();
             }
             mSlots[slot].mFence = Fence::NO_FENCE;
+            mCore->setReleasableLocked(slot, mSlots[slot].mFrameNumber);
         }
 
         // If the buffer has previously been acquired by the consumer, set
@@ -290,7 +292,10 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
             outBuffer->mGraphicBuffer = nullptr;
         }
 
-        mCore->mQueue.erase(front);
+        // In shared buffer mode, the shared buffer may have been acquired without being queued.
+        if (!mCore->mQueue.empty()) {
+            mCore->mQueue.pop_front();
+        }
 
         // We might have freed a slot while dropping old buffers, or the producer
         // may be blocked waiting for the number of buffers in the queue to
@@ -301,6 +306,10 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
                 static_cast<int32_t>(mCore->mQueue.size()));
 #ifndef NO_BINDER
         mCore->mOccupancyTracker.registerOccupancyChange(mCore->mQueue.size());
+        if (outBuffer->mQueuedBuffer && !outBuffer->mIsStale) {
+            mCore->mOccupancyTracker.registerQueueToAcquireLatency(
+                    systemTime() - mSlots[slot].mQueueTime);
+        }
 #endif
         VALIDATE_CONSISTENCY();
     }
@@ -319,6 +328,7 @@ status_t BufferQueueConsumer::detachBuffer(int slot) {
     ATRACE_BUFFER_INDEX(slot);
     BQ_LOGV("detachBuffer: slot %d", slot);
     std::lock_guard<std::mutex> lock(mCore->mMutex);
+    mCore->applyPendingReleasesLocked();
 
     if (mCore->mIsAbandoned) {
         BQ_LOGE("detachBuffer: BufferQueue has been abandoned");
@@ -363,6 +373,7 @@ status_t BufferQueueConsumer::attachBuffer(int* outSlot,
     }
 
     std::lock_guard<std::mutex> lock(mCore->mMutex);
+    mCore->applyPendingReleasesLocked();
 
     if (mCore->mSharedBufferMode) {
         BQ_LOGE("attachBuffer: cannot attach a buffer in shared buffer mode");
@@ -452,9 +463,17 @@ status_t BufferQueueConsumer::releaseBuffer(int slot, uint64_t frameNumber,
         return BAD_VALUE;
     }
 
+    // Most releases don't need mMutex, see BufferQueueCore::setReleasableLocked.
+    if (eglDisplay == EGL_NO_DISPLAY && eglFence == EGL_NO_SYNC_KHR &&
+            mCore->releaseWithoutLock(slot, frameNumber, releaseFence)) {
+        BQ_LOGV("releaseBuffer: releasing slot %d without lock", slot);
+        return NO_ERROR;
+    }
+
     sp<IProducerListener> listener;
     { // Autolock scope
         std::lock_guard<std::mutex> lock(mCore->mMutex);
+        mCore->applyPendingReleasesLocked();
 
         // If the frame number has changed because the buffer has been reallocated,
         // we can ignore this releaseBuffer for the old buffer.
@@ -473,6 +492,7 @@ status_t BufferQueueConsumer::releaseBuffer(int slot, uint64_t frameNumber,
             return BAD_VALUE;
         }
 
+        mCore->revokeReleasableLocked(slot);
         mSlots[slot].mEglDisplay = eglDisplay;
         mSlots[slot].mEglFence = eglFence;
         mSlots[slot].mFence = releaseFence;
@@ -659,6 +679,7 @@ status_t BufferQueueConsumer::setMaxAcquiredBufferCount(
     { // Autolock scope
         std::unique_lock<std::mutex> lock(mCore->mMutex);
         mCore->waitWhileAllocatingLocked(lock);
+        mCore->applyPendingReleasesLocked();
 
         if (mCore->mIsAbandoned) {
             BQ_LOGE("setMaxAcquiredBufferCount: consumer is abandoned");
@@ -785,6 +806,7 @@ status_t BufferQueueConsumer::getOccupancyHistory(bool forceFlush,
 
 status_t BufferQueueConsumer::discardFreeBuffers() {
     std::lock_guard<std::mutex> lock(mCore->mMutex);
+    mCore->applyPendingReleasesLocked();
     mCore->discardFreeBuffersLocked();
     return NO_ERROR;
 }
@@ -835,4 +857,9 @@ void BufferQueueConsumer::setAllowExtraAcquire(bool allow) {
     mCore->mAllowExtraAcquire = allow;
 }
 
+void BufferQueueConsumer::setPreallocationBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mCore->mMutex);
+    mCore->setPreallocationBudgetLocked(bytes);
+}
+
 } // namespace android
@@ -38,6 +38,10 @@
 
 #include <system/window.h>
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
 namespace android {
 
 // Macros for include BufferQueueCore information in log messages
@@ -141,7 +145,16 @@ BufferQueueCore::BufferQueueCore()
     }
 }
 
-BufferQueueCore::~BufferQueueCore() {}
+BufferQueueCore::~BufferQueueCore() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPreallocationThreadStopped = true;
+        mPreallocationThreadCondition.notify_one();
+    }
+    if (mPreallocationThread.joinable()) {
+        mPreallocationThread.join();
+    }
+}
 
 void BufferQueueCore::dumpState(const String8& prefix, String8* outResult) const {
     std::lock_guard<std::mutex> lock(mMutex);
@@ -159,6 +172,17 @@ void BufferQueueCore::dumpState(const String8& prefix, String8* outResult) const
                             mTransformHint, mFrameCounter);
     outResult->appendFormat("%s  mTransformHintInUse=%02x mAutoPrerotation=%d\n", prefix.string(),
                             mTransformHintInUse, mAutoPrerotation);
+    outResult->appendFormat("%s  preallocation: budget=%zu held=%zu (%zu buffers) allocated=%" PRIu64
+                            " hits=%" PRIu64 " misses=%" PRIu64 "\n",
+                            prefix.string(), mPreallocationBudget, mPreallocatedBytes,
+                            mPreallocatedBuffers.size(), mPreallocationCount,
+                            mPreallocationHitCount, mPreallocationMissCount);
+#ifndef NO_BINDER
+    std::string histogram;
+    mOccupancyTracker.getHistogram().getSnapshot().dump(histogram,
+            std::string(prefix.string()) + "  ");
+    outResult->append(histogram.c_str());
+#endif
 
     outResult->appendFormat("%sFIFO(%zu):\n", prefix.string(), mQueue.size());
 
@@ -256,6 +280,7 @@ int BufferQueueCore::getMaxBufferCountLocked() const {
 void BufferQueueCore::clearBufferSlotLocked(int slot) {
     BQ_LOGV("clearBufferSlotLocked: slot %d", slot);
 
+    revokeReleasableLocked(slot);
     mSlots[slot].mGraphicBuffer.clear();
     mSlots[slot].mBufferState.reset();
     mSlots[slot].mRequestBufferCalled = false;
@@ -276,6 +301,91 @@ void BufferQueueCore::clearBufferSlotLocked(int slot) {
     }
 }
 
+static_assert(BufferQueueDefs::NUM_BUFFER_SLOTS <= 64,
+              "mPendingReleases needs a bit for each slot");
+
+void BufferQueueCore::setReleasableLocked(int slot, uint64_t frameNumber) {
+    if (mSharedBufferMode || mBufferReleasedCbEnabled || mSlots[slot].mBufferState.isShared()) {
+        return;
+    }
+    mReleaseStates[slot] = frameNumber;
+}
+
+uint64_t BufferQueueCore::takeReleaseStateLocked(int slot) {
+    uint64_t state = mReleaseStates[slot];
+    while (true) {
+        if (state == RELEASE_CLAIMED) {
+            std::this_thread::yield();
+            state = mReleaseStates[slot];
+        } else if (mReleaseStates[slot].compare_exchange_weak(state, RELEASE_NOT_ALLOWED)) {
+            return state;
+        }
+    }
+}
+
+void BufferQueueCore::revokeReleasableLocked(int slot) {
+    if (takeReleaseStateLocked(slot) == RELEASE_PENDING) {
+        mReleaseFences[slot].clear();
+    }
+}
+
+void BufferQueueCore::revokeAllReleasableLocked() {
+    for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; s++) {
+        if (takeReleaseStateLocked(s) == RELEASE_PENDING) {
+            releasePendingSlotLocked(s);
+        }
+    }
+}
+
+bool BufferQueueCore::releaseWithoutLock(int slot, uint64_t frameNumber,
+        const sp<Fence>& releaseFence) {
+    if (frameNumber == RELEASE_NOT_ALLOWED || frameNumber >= RELEASE_CLAIMED) {
+        return false;
+    }
+    uint64_t state = frameNumber;
+    if (!mReleaseStates[slot].compare_exchange_strong(state, RELEASE_CLAIMED)) {
+        return false;
+    }
+    mReleaseFences[slot] = releaseFence;
+    mReleaseStates[slot] = RELEASE_PENDING;
+    mPendingReleases.fetch_or(uint64_t(1) << slot);
+
+    // A thread waiting on mDequeueCondition counts itself in mDequeueWaiters
+    // before it checks mPendingReleases, so either it sees this release or
+    // this sees it waiting.
+    if (mDequeueWaiters != 0) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDequeueCondition.notify_all();
+    }
+    return true;
+}
+
+void BufferQueueCore::applyPendingReleasesLocked() {
+    uint64_t pending = mPendingReleases.exchange(0);
+    while (pending != 0) {
+        int slot = __builtin_ctzll(pending);
+        pending &= pending - 1;
+
+        // The bit of a slot whose release was revoked may still be set.
+        uint64_t state = RELEASE_PENDING;
+        if (mReleaseStates[slot].compare_exchange_strong(state, RELEASE_NOT_ALLOWED)) {
+            releasePendingSlotLocked(slot);
+        }
+    }
+}
+
+void BufferQueueCore::releasePendingSlotLocked(int slot) {
+    BQ_LOGV("releasePendingSlotLocked: slot %d", slot);
+
+    mSlots[slot].mEglDisplay = EGL_NO_DISPLAY;
+    mSlots[slot].mEglFence = EGL_NO_SYNC_KHR;
+    mSlots[slot].mFence = mReleaseFences[slot];
+    mReleaseFences[slot].clear();
+    mSlots[slot].mBufferState.release();
+    mActiveBuffers.erase(slot);
+    mFreeBuffers.push_back(slot);
+}
+
 void BufferQueueCore::freeAllBuffersLocked() {
     for (int s : mFreeSlots) {
         clearBufferSlotLocked(s);
@@ -293,6 +403,8 @@ void BufferQueueCore::freeAllBuffersLocked() {
     }
     mActiveBuffers.clear();
 
+    discardPreallocatedBuffersLocked();
+
     for (auto& b : mQueue) {
         b.mIsStale = true;
 
@@ -319,6 +431,7 @@ void BufferQueueCore::discardFreeBuffersLocked() {
         clearBufferSlotLocked(s);
     }
     mFreeBuffers.clear();
+    discardPreallocatedBuffersLocked();
 
     VALIDATE_CONSISTENCY();
 }
@@ -371,6 +484,193 @@ void BufferQueueCore::waitWhileAllocatingLocked(std::unique_lock<std::mutex>& lo
     }
 }
 
+// The bytes a buffer with the given attributes is accounted for in the
+// preallocation budget. Formats without a fixed pixel size, like the YUV ones,
+// are accounted for 4 bytes per pixel.
+static size_t getPreallocationBytes(const BufferAllocationConfig& config) {
+    const uint32_t pixelBytes = bytesPerPixel(config.format);
+    return static_cast<size_t>(config.width) * config.height * (pixelBytes ? pixelBytes : 4);
+}
+
+void BufferQueueCore::onBufferAllocatedLocked(const BufferAllocationConfig& config) {
+    mAllocationPredictor.onAllocation(config);
+    mLastAllocationConfig = config;
+    if (mPreallocationBudget == 0 || !mAllowAllocation || mSharedBufferMode || mIsAbandoned) {
+        return;
+    }
+    // Finish allocating the buffers the producer is still dequeueing before
+    // moving on to the next prediction.
+    if (mPendingPreallocationCount > 0 && mPendingPreallocationConfig == config) {
+        return;
+    }
+    const std::optional<BufferAllocationPredictor::Prediction> prediction =
+            mAllocationPredictor.predict();
+    if (!prediction) {
+        return;
+    }
+
+    // The buffers allocated for an earlier prediction won't be dequeued,
+    // unless the producer is still allocating buffers of their size.
+    auto stale = std::partition(mPreallocatedBuffers.begin(), mPreallocatedBuffers.end(),
+            [&](const PreallocatedBuffer& preallocated) {
+                return preallocated.config == prediction->config ||
+                        preallocated.config == config;
+            });
+    for (auto it = stale; it != mPreallocatedBuffers.end(); ++it) {
+        mPreallocatedBytes -= it->bytes;
+        mPreallocationMissCount++;
+        mBuffersToFree.push_back(std::move(it->buffer));
+    }
+    mPreallocatedBuffers.erase(stale, mPreallocatedBuffers.end());
+
+    // Allocate as many buffers as the producer allocated of that size the
+    // last time, less the ones already allocated or being allocated.
+    size_t count = prediction->count;
+    for (const PreallocatedBuffer& preallocated : mPreallocatedBuffers) {
+        if (count > 0 && preallocated.config == prediction->config) {
+            count--;
+        }
+    }
+    if (count > 0 && mIsPreallocating && mPreallocatingConfig == prediction->config) {
+        count--;
+    }
+    mPendingPreallocationConfig = prediction->config;
+    mPendingPreallocationCount = count;
+    if (!mPreallocationThread.joinable()) {
+        mPreallocationThread = std::thread(&BufferQueueCore::preallocationThreadMain, this);
+    }
+    mPreallocationThreadCondition.notify_one();
+}
+
+sp<GraphicBuffer> BufferQueueCore::takePreallocatedBufferLocked(
+        std::unique_lock<std::mutex>& lock, const BufferAllocationConfig& config) {
+    while (true) {
+        auto it = std::find_if(mPreallocatedBuffers.begin(), mPreallocatedBuffers.end(),
+                [&config](const PreallocatedBuffer& preallocated) {
+                    return preallocated.config == config;
+                });
+        if (it != mPreallocatedBuffers.end()) {
+            sp<GraphicBuffer> buffer = std::move(it->buffer);
+            mPreallocatedBytes -= it->bytes;
+            mPreallocatedBuffers.erase(it);
+            mPreallocationHitCount++;
+            BQ_LOGV("takePreallocatedBufferLocked: using buffer allocated ahead (%u x %u)",
+                    config.width, config.height);
+            return buffer;
+        }
+
+        const bool isPreallocating = mIsPreallocating && mPreallocatingConfig == config;
+        const bool isPending = mPendingPreallocationCount > 0 &&
+                mPendingPreallocationConfig == config;
+        if (!isPreallocating && !isPending) {
+            return nullptr;
+        }
+        mPreallocationCondition.wait(lock);
+    }
+}
+
+void BufferQueueCore::discardPreallocatedBuffersLocked() {
+    mPreallocationMissCount += mPreallocatedBuffers.size();
+    for (PreallocatedBuffer& preallocated : mPreallocatedBuffers) {
+        mBuffersToFree.push_back(std::move(preallocated.buffer));
+    }
+    mPreallocatedBuffers.clear();
+    mPreallocatedBytes = 0;
+    mPendingPreallocationCount = 0;
+    mPreallocationCondition.notify_all();
+    mPreallocationThreadCondition.notify_one();
+}
+
+void BufferQueueCore::setPreallocationBudgetLocked(size_t bytes) {
+    mPreallocationBudget = bytes;
+    if (mPreallocatedBytes > bytes) {
+        discardPreallocatedBuffersLocked();
+    }
+}
+
+void BufferQueueCore::preallocationThreadMain() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mPreallocationThreadStopped) {
+        // Free the buffers the producer didn't dequeue in time.
+        const nsecs_t now = systemTime();
+        auto expired = std::partition(mPreallocatedBuffers.begin(), mPreallocatedBuffers.end(),
+                [now](const PreallocatedBuffer& preallocated) {
+                    return now - preallocated.allocationTime < PREALLOCATION_TIMEOUT;
+                });
+        for (auto it = expired; it != mPreallocatedBuffers.end(); ++it) {
+            mPreallocatedBytes -= it->bytes;
+            mPreallocationMissCount++;
+            mBuffersToFree.push_back(std::move(it->buffer));
+        }
+        mPreallocatedBuffers.erase(expired, mPreallocatedBuffers.end());
+
+        if (!mBuffersToFree.empty()) {
+            std::vector<sp<GraphicBuffer>> buffersToFree;
+            std::swap(buffersToFree, mBuffersToFree);
+            lock.unlock();
+            buffersToFree.clear();
+            lock.lock();
+            continue;
+        }
+
+        if (mPendingPreallocationCount > 0) {
+            const BufferAllocationConfig config = mPendingPreallocationConfig;
+            const size_t bytes = getPreallocationBytes(config);
+            if (mPreallocatedBytes + bytes > mPreallocationBudget) {
+                mPendingPreallocationCount = 0;
+                mPreallocationCondition.notify_all();
+                continue;
+            }
+            mPendingPreallocationCount--;
+            mIsPreallocating = true;
+            mPreallocatingConfig = config;
+            const std::string name(mConsumerName.string(), mConsumerName.size());
+
+            lock.unlock();
+            sp<GraphicBuffer> buffer = new GraphicBuffer(config.width, config.height,
+                    config.format, BQ_LAYER_COUNT, config.usage, name);
+            const status_t result = buffer->initCheck();
+            lock.lock();
+
+            mIsPreallocating = false;
+            mPreallocationCondition.notify_all();
+            if (result != NO_ERROR) {
+                BQ_LOGE("preallocationThreadMain: failed to allocate buffer (%u x %u, "
+                        "format %d, usage %#" PRIx64 ")", config.width, config.height,
+                        config.format, config.usage);
+                mPendingPreallocationCount = 0;
+                mBuffersToFree.push_back(std::move(buffer));
+                continue;
+            }
+
+            // The prediction may have changed, the producer gone, or the
+            // budget lowered, while allocating.
+            const bool isWanted = config == mPendingPreallocationConfig ||
+                    config == mLastAllocationConfig;
+            if (!isWanted || mIsAbandoned || mConnectedApi == NO_CONNECTED_API ||
+                    mPreallocatedBytes + bytes > mPreallocationBudget) {
+                mBuffersToFree.push_back(std::move(buffer));
+                continue;
+            }
+            mPreallocatedBuffers.push_back({config, std::move(buffer), bytes, systemTime()});
+            mPreallocatedBytes += bytes;
+            mPreallocationCount++;
+            continue;
+        }
+
+        if (mPreallocatedBuffers.empty()) {
+            mPreallocationThreadCondition.wait(lock);
+        } else {
+            nsecs_t oldest = mPreallocatedBuffers.front().allocationTime;
+            for (const PreallocatedBuffer& preallocated : mPreallocatedBuffers) {
+                oldest = std::min(oldest, preallocated.allocationTime);
+            }
+            mPreallocationThreadCondition.wait_for(lock,
+                    std::chrono::nanoseconds(oldest + PREALLOCATION_TIMEOUT - now));
+        }
+    }
+}
+
 #if DEBUG_ONLY_CODE
 void BufferQueueCore::validateConsistencyLocked() const {
     static const useconds_t PAUSE_TIME = 0;
@@ -66,7 +66,6 @@ namespace android {
           mCore->mUniqueId, mCore->mConnectedApi, mCore->mConnectedPid, (mCore->mUniqueId) >> 32, \
           ##__VA_ARGS__)
 
-static constexpr uint32_t BQ_LAYER_COUNT = 1;
 ProducerListener::~ProducerListener() = default;
 
 BufferQueueProducer::BufferQueueProducer(const sp<BufferQueueCore>& core,
@@ -89,8 +88,26 @@ BufferQueueProducer::~BufferQueueProducer() {}
 
 status_t BufferQueueProducer::requestBuffer(int slot, sp<GraphicBuffer>* buf) {
     ATRACE_CALL();
-    BQ_LOGV("requestBuffer: slot %d", slot);
     std::lock_guard<std::mutex> lock(mCore->mMutex);
+    return requestBufferLocked(slot, buf);
+}
+
+status_t BufferQueueProducer::requestBuffers(const std::vector<int32_t>& slots,
+                                             std::vector<RequestBufferOutput>* outputs) {
+    ATRACE_CALL();
+    outputs->clear();
+    outputs->reserve(slots.size());
+
+    std::lock_guard<std::mutex> lock(mCore->mMutex);
+    for (int32_t slot : slots) {
+        RequestBufferOutput& output = outputs->emplace_back();
+        output.result = requestBufferLocked(static_cast<int>(slot), &output.buffer);
+    }
+    return NO_ERROR;
+}
+
+status_t BufferQueueProducer::requestBufferLocked(int slot, sp<GraphicBuffer>* buf) {
+    BQ_LOGV("requestBuffer: slot %d", slot);
 
     if (mCore->mIsAbandoned) {
         BQ_LOGE("requestBuffer: BufferQueue has been abandoned");
@@ -282,6 +299,8 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
             return NO_INIT;
         }
 
+        mCore->applyPendingReleasesLocked();
+
         int dequeuedCount = 0;
         int acquiredCount = 0;
         for (int s : mCore->mActiveBuffers) {
@@ -362,14 +381,22 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
                     (acquiredCount <= mCore->mMaxAcquiredBufferCount)) {
                 return WOULD_BLOCK;
             }
-            if (mDequeueTimeout >= 0) {
-                std::cv_status result = mCore->mDequeueCondition.wait_for(lock,
-                        std::chrono::nanoseconds(mDequeueTimeout));
-                if (result == std::cv_status::timeout) {
-                    return TIMED_OUT;
+            // A buffer released without mMutex held only wakes up the
+            // threads counted in mDequeueWaiters, so look for one released
+            // since applyPendingReleasesLocked after being counted.
+            std::cv_status result = std::cv_status::no_timeout;
+            mCore->mDequeueWaiters++;
+            if (mCore->mPendingReleases == 0) {
+                if (mDequeueTimeout >= 0) {
+                    result = mCore->mDequeueCondition.wait_for(lock,
+                            std::chrono::nanoseconds(mDequeueTimeout));
+                } else {
+                    mCore->mDequeueCondition.wait(lock);
                 }
-            } else {
-                mCore->mDequeueCondition.wait(lock);
+            }
+            mCore->mDequeueWaiters--;
+            if (result == std::cv_status::timeout) {
+                return TIMED_OUT;
             }
         }
     } // while (tryAgain)
@@ -382,215 +409,324 @@ status_t BufferQueueProducer::dequeueBuffer(int* outSlot, sp<android::Fence>* ou
                                             uint64_t usage, uint64_t* outBufferAge,
                                             FrameEventHistoryDelta* outTimestamps) {
     ATRACE_CALL();
+    DequeueOperation dequeue;
+    dequeue.width = width;
+    dequeue.height = height;
+    dequeue.format = format;
+    dequeue.usage = usage;
     { // Autolock scope
-        std::lock_guard<std::mutex> lock(mCore->mMutex);
-        mConsumerName = mCore->mConsumerName;
-
-        if (mCore->mIsAbandoned) {
-            BQ_LOGE("dequeueBuffer: BufferQueue has been abandoned");
-            return NO_INIT;
-        }
-
-        if (mCore->mConnectedApi == BufferQueueCore::NO_CONNECTED_API) {
-            BQ_LOGE("dequeueBuffer: BufferQueue has no connected producer");
-            return NO_INIT;
+        std::unique_lock<std::mutex> lock(mCore->mMutex);
+        waitForAllocationBeforeDequeueLocked(lock);
+        status_t status = dequeueBufferLocked(lock, &dequeue, outFence);
+        if (status != NO_ERROR) {
+            return status;
         }
     } // Autolock scope
 
-    BQ_LOGV("dequeueBuffer: w=%u h=%u format=%#x, usage=%#" PRIx64, width, height, format, usage);
+    if (dequeue.returnFlags & BUFFER_NEEDS_REALLOCATION) {
+        allocateDequeuedBuffer(&dequeue);
 
-    if ((width && !height) || (!width && height)) {
-        BQ_LOGE("dequeueBuffer: invalid size: w=%u h=%u", width, height);
-        return BAD_VALUE;
+        std::lock_guard<std::mutex> lock(mCore->mMutex);
+        status_t status = attachDequeuedBufferLocked(&dequeue);
+        mCore->mIsAllocating = false;
+        mCore->mIsAllocatingCondition.notify_all();
+        if (status != NO_ERROR) {
+            return status;
+        }
     }
 
-    status_t returnFlags = NO_ERROR;
-    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
-    EGLSyncKHR eglFence = EGL_NO_SYNC_KHR;
-    bool attachedByConsumer = false;
+    *outSlot = dequeue.slot;
+    return finishDequeue(dequeue, outBufferAge, outTimestamps);
+}
 
+status_t BufferQueueProducer::dequeueBuffers(const std::vector<DequeueBufferInput>& inputs,
+                                             std::vector<DequeueBufferOutput>* outputs) {
+    ATRACE_CALL();
+    outputs->clear();
+    outputs->resize(inputs.size());
+
+    std::vector<DequeueOperation> dequeues(inputs.size());
+    bool needsAllocation = false;
     { // Autolock scope
         std::unique_lock<std::mutex> lock(mCore->mMutex);
-
-        // If we don't have a free buffer, but we are currently allocating, we wait until allocation
-        // is finished such that we don't allocate in parallel.
-        if (mCore->mFreeBuffers.empty() && mCore->mIsAllocating) {
-            mDequeueWaitingForAllocation = true;
-            mCore->waitWhileAllocatingLocked(lock);
-            mDequeueWaitingForAllocation = false;
-            mDequeueWaitingForAllocationCondition.notify_all();
+        // Only wait for an allocation in progress before the batch, as the
+        // batch doesn't allocate until all its slots are found.
+        waitForAllocationBeforeDequeueLocked(lock);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            const DequeueBufferInput& input = inputs[i];
+            DequeueOperation& dequeue = dequeues[i];
+            dequeue.width = input.width;
+            dequeue.height = input.height;
+            dequeue.format = input.format;
+            dequeue.usage = input.usage;
+            DequeueBufferOutput& output = (*outputs)[i];
+            output.result = dequeueBufferLocked(lock, &dequeue, &output.fence);
+            needsAllocation |= output.result == NO_ERROR &&
+                    (dequeue.returnFlags & BUFFER_NEEDS_REALLOCATION);
         }
+    } // Autolock scope
 
-        if (format == 0) {
-            format = mCore->mDefaultBufferFormat;
+    if (needsAllocation) {
+        // Allocate the buffers of the whole batch in a single pass.
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if ((*outputs)[i].result == NO_ERROR &&
+                (dequeues[i].returnFlags & BUFFER_NEEDS_REALLOCATION)) {
+                allocateDequeuedBuffer(&dequeues[i]);
+            }
         }
 
-        // Enable the usage bits the consumer requested
-        usage |= mCore->mConsumerUsageBits;
-
-        const bool useDefaultSize = !width && !height;
-        if (useDefaultSize) {
-            width = mCore->mDefaultWidth;
-            height = mCore->mDefaultHeight;
-            if (mCore->mAutoPrerotation &&
-                (mCore->mTransformHintInUse & NATIVE_WINDOW_TRANSFORM_ROT_90)) {
-                std::swap(width, height);
+        std::lock_guard<std::mutex> lock(mCore->mMutex);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if ((*outputs)[i].result == NO_ERROR &&
+                (dequeues[i].returnFlags & BUFFER_NEEDS_REALLOCATION)) {
+                (*outputs)[i].result = attachDequeuedBufferLocked(&dequeues[i]);
             }
         }
+        // The batch is allocating until all its buffers are attached.
+        mCore->mIsAllocating = false;
+        mCore->mIsAllocatingCondition.notify_all();
+    }
 
-        int found = BufferItem::INVALID_BUFFER_SLOT;
-        while (found == BufferItem::INVALID_BUFFER_SLOT) {
-            status_t status = waitForFreeSlotThenRelock(FreeSlotCaller::Dequeue, lock, &found);
-            if (status != NO_ERROR) {
-                return status;
-            }
+    for (size_t i = 0; i < inputs.size(); i++) {
+        DequeueBufferOutput& output = (*outputs)[i];
+        if (output.result != NO_ERROR) {
+            continue;
+        }
+        output.slot = dequeues[i].slot;
+        output.result = finishDequeue(dequeues[i], &output.bufferAge,
+                                      inputs[i].getTimestamps ? &output.timestamps.emplace()
+                                                              : nullptr);
+    }
+    return NO_ERROR;
+}
 
-            // This should not happen
-            if (found == BufferQueueCore::INVALID_BUFFER_SLOT) {
-                BQ_LOGE("dequeueBuffer: no available buffer slots");
-                return -EBUSY;
-            }
+void BufferQueueProducer::waitForAllocationBeforeDequeueLocked(
+        std::unique_lock<std::mutex>& lock) {
+    // If we don't have a free buffer, but we are currently allocating, we wait until allocation
+    // is finished such that we don't allocate in parallel.
+    if (mCore->mFreeBuffers.empty() && mCore->mIsAllocating) {
+        mDequeueWaitingForAllocation = true;
+        mCore->waitWhileAllocatingLocked(lock);
+        mDequeueWaitingForAllocation = false;
+        mDequeueWaitingForAllocationCondition.notify_all();
+    }
+}
 
-            const sp<GraphicBuffer>& buffer(mSlots[found].mGraphicBuffer);
+status_t BufferQueueProducer::dequeueBufferLocked(std::unique_lock<std::mutex>& lock,
+                                                  DequeueOperation* dequeue,
+                                                  sp<Fence>* outFence) {
+    mConsumerName = mCore->mConsumerName;
 
-            // If we are not allowed to allocate new buffers,
-            // waitForFreeSlotThenRelock must have returned a slot containing a
-            // buffer. If this buffer would require reallocation to meet the
-            // requested attributes, we free it and attempt to get another one.
-            if (!mCore->mAllowAllocation) {
-                if (buffer->needsReallocation(width, height, format, BQ_LAYER_COUNT, usage)) {
-                    if (mCore->mSharedBufferSlot == found) {
-                        BQ_LOGE("dequeueBuffer: cannot re-allocate a sharedbuffer");
-                        return BAD_VALUE;
-                    }
-                    mCore->mFreeSlots.insert(found);
-                    mCore->clearBufferSlotLocked(found);
-                    found = BufferItem::INVALID_BUFFER_SLOT;
-                    continue;
-                }
-            }
-        }
+    if (mCore->mIsAbandoned) {
+        BQ_LOGE("dequeueBuffer: BufferQueue has been abandoned");
+        return NO_INIT;
+    }
 
-        const sp<GraphicBuffer>& buffer(mSlots[found].mGraphicBuffer);
-        if (mCore->mSharedBufferSlot == found &&
-                buffer->needsReallocation(width, height, format, BQ_LAYER_COUNT, usage)) {
-            BQ_LOGE("dequeueBuffer: cannot re-allocate a shared"
-                    "buffer");
+    if (mCore->mConnectedApi == BufferQueueCore::NO_CONNECTED_API) {
+        BQ_LOGE("dequeueBuffer: BufferQueue has no connected producer");
+        return NO_INIT;
+    }
 
-            return BAD_VALUE;
+    uint32_t width = dequeue->width;
+    uint32_t height = dequeue->height;
+    BQ_LOGV("dequeueBuffer: w=%u h=%u format=%#x, usage=%#" PRIx64, width, height,
+            dequeue->format, dequeue->usage);
+
+    if ((width && !height) || (!width && height)) {
+        BQ_LOGE("dequeueBuffer: invalid size: w=%u h=%u", width, height);
+        return BAD_VALUE;
+    }
+
+    PixelFormat format = dequeue->format;
+    if (format == 0) {
+        format = mCore->mDefaultBufferFormat;
+    }
+
+    // Enable the usage bits the consumer requested
+    const uint64_t usage = dequeue->usage | mCore->mConsumerUsageBits;
+
+    const bool useDefaultSize = !width && !height;
+    if (useDefaultSize) {
+        width = mCore->mDefaultWidth;
+        height = mCore->mDefaultHeight;
+        if (mCore->mAutoPrerotation &&
+            (mCore->mTransformHintInUse & NATIVE_WINDOW_TRANSFORM_ROT_90)) {
+            std::swap(width, height);
         }
+    }
 
-        if (mCore->mSharedBufferSlot != found) {
-            mCore->mActiveBuffers.insert(found);
+    int found = BufferItem::INVALID_BUFFER_SLOT;
+    while (found == BufferItem::INVALID_BUFFER_SLOT) {
+        status_t status = waitForFreeSlotThenRelock(FreeSlotCaller::Dequeue, lock, &found);
+        if (status != NO_ERROR) {
+            return status;
         }
-        *outSlot = found;
-        ATRACE_BUFFER_INDEX(found);
-
-        attachedByConsumer = mSlots[found].mNeedsReallocation;
-        mSlots[found].mNeedsReallocation = false;
-
-        mSlots[found].mBufferState.dequeue();
-
-        if ((buffer == nullptr) ||
-                buffer->needsReallocation(width, height, format, BQ_LAYER_COUNT, usage))
-        {
-            mSlots[found].mAcquireCalled = false;
-            mSlots[found].mGraphicBuffer = nullptr;
-            mSlots[found].mRequestBufferCalled = false;
-            mSlots[found].mEglDisplay = EGL_NO_DISPLAY;
-            mSlots[found].mEglFence = EGL_NO_SYNC_KHR;
-            mSlots[found].mFence = Fence::NO_FENCE;
-            mCore->mBufferAge = 0;
-            mCore->mIsAllocating = true;
 
-            returnFlags |= BUFFER_NEEDS_REALLOCATION;
-        } else {
-            // We add 1 because that will be the frame number when this buffer
-            // is queued
-            mCore->mBufferAge = mCore->mFrameCounter + 1 - mSlots[found].mFrameNumber;
+        // This should not happen
+        if (found == BufferQueueCore::INVALID_BUFFER_SLOT) {
+            BQ_LOGE("dequeueBuffer: no available buffer slots");
+            return -EBUSY;
         }
 
-        BQ_LOGV("dequeueBuffer: setting buffer age to %" PRIu64,
-                mCore->mBufferAge);
+        const sp<GraphicBuffer>& buffer(mSlots[found].mGraphicBuffer);
 
-        if (CC_UNLIKELY(mSlots[found].mFence == nullptr)) {
-            BQ_LOGE("dequeueBuffer: about to return a NULL fence - "
-                    "slot=%d w=%d h=%d format=%u",
-                    found, buffer->width, buffer->height, buffer->format);
+        // If we are not allowed to allocate new buffers,
+        // waitForFreeSlotThenRelock must have returned a slot containing a
+        // buffer. If this buffer would require reallocation to meet the
+        // requested attributes, we free it and attempt to get another one.
+        if (!mCore->mAllowAllocation) {
+            if (buffer->needsReallocation(width, height, format, BQ_LAYER_COUNT, usage)) {
+                if (mCore->mSharedBufferSlot == found) {
+                    BQ_LOGE("dequeueBuffer: cannot re-allocate a sharedbuffer");
+                    return BAD_VALUE;
+                }
+                mCore->mFreeSlots.insert(found);
+                mCore->clearBufferSlotLocked(found);
+                found = BufferItem::INVALID_BUFFER_SLOT;
+                continue;
+            }
         }
+    }
+
+    const sp<GraphicBuffer>& buffer(mSlots[found].mGraphicBuffer);
+    if (mCore->mSharedBufferSlot == found &&
+            buffer->needsReallocation(width, height, format, BQ_LAYER_COUNT, usage)) {
+        BQ_LOGE("dequeueBuffer: cannot re-allocate a shared"
+                "buffer");
+
+        return BAD_VALUE;
+    }
 
-        eglDisplay = mSlots[found].mEglDisplay;
-        eglFence = mSlots[found].mEglFence;
-        // Don't return a fence in shared buffer mode, except for the first
-        // frame.
-        *outFence = (mCore->mSharedBufferMode &&
-                mCore->mSharedBufferSlot == found) ?
-                Fence::NO_FENCE : mSlots[found].mFence;
+    if (mCore->mSharedBufferSlot != found) {
+        mCore->mActiveBuffers.insert(found);
+    }
+    dequeue->slot = found;
+    ATRACE_BUFFER_INDEX(found);
+
+    dequeue->attachedByConsumer = mSlots[found].mNeedsReallocation;
+    mSlots[found].mNeedsReallocation = false;
+
+    mSlots[found].mBufferState.dequeue();
+
+    if ((buffer == nullptr) ||
+            buffer->needsReallocation(width, height, format, BQ_LAYER_COUNT, usage))
+    {
+        mSlots[found].mAcquireCalled = false;
+        mSlots[found].mGraphicBuffer = nullptr;
+        mSlots[found].mRequestBufferCalled = false;
+        mSlots[found].mEglDisplay = EGL_NO_DISPLAY;
         mSlots[found].mEglFence = EGL_NO_SYNC_KHR;
         mSlots[found].mFence = Fence::NO_FENCE;
+        mCore->mBufferAge = 0;
+        mCore->mIsAllocating = true;
+
+        // Keep the attributes to allocate the buffer with.
+        dequeue->width = width;
+        dequeue->height = height;
+        dequeue->format = format;
+        dequeue->usage = usage;
+        dequeue->returnFlags |= BUFFER_NEEDS_REALLOCATION;
+
+        // Use the buffer allocated ahead for this dequeue, if any.
+        dequeue->allocatedBuffer =
+                mCore->takePreallocatedBufferLocked(lock, {width, height, format, usage});
+    } else {
+        // We add 1 because that will be the frame number when this buffer
+        // is queued
+        mCore->mBufferAge = mCore->mFrameCounter + 1 - mSlots[found].mFrameNumber;
+    }
+    dequeue->bufferAge = mCore->mBufferAge;
 
-        // If shared buffer mode has just been enabled, cache the slot of the
-        // first buffer that is dequeued and mark it as the shared buffer.
-        if (mCore->mSharedBufferMode && mCore->mSharedBufferSlot ==
-                BufferQueueCore::INVALID_BUFFER_SLOT) {
-            mCore->mSharedBufferSlot = found;
-            mSlots[found].mBufferState.mShared = true;
-        }
-
-        if (!(returnFlags & BUFFER_NEEDS_REALLOCATION)) {
-            if (mCore->mConsumerListener != nullptr) {
-                mCore->mConsumerListener->onFrameDequeued(mSlots[*outSlot].mGraphicBuffer->getId());
-            }
-        }
-    } // Autolock scope
+    BQ_LOGV("dequeueBuffer: setting buffer age to %" PRIu64,
+            mCore->mBufferAge);
 
-    if (returnFlags & BUFFER_NEEDS_REALLOCATION) {
-        BQ_LOGV("dequeueBuffer: allocating a new buffer for slot %d", *outSlot);
-        sp<GraphicBuffer> graphicBuffer = new GraphicBuffer(
-                width, height, format, BQ_LAYER_COUNT, usage,
-                {mConsumerName.string(), mConsumerName.size()});
+    if (CC_UNLIKELY(mSlots[found].mFence == nullptr)) {
+        BQ_LOGE("dequeueBuffer: about to return a NULL fence - "
+                "slot=%d w=%d h=%d format=%u",
+                found, buffer->width, buffer->height, buffer->format);
+    }
 
-        status_t error = graphicBuffer->initCheck();
+    dequeue->eglDisplay = mSlots[found].mEglDisplay;
+    dequeue->eglFence = mSlots[found].mEglFence;
+    // Don't return a fence in shared buffer mode, except for the first
+    // frame.
+    *outFence = (mCore->mSharedBufferMode &&
+            mCore->mSharedBufferSlot == found) ?
+            Fence::NO_FENCE : mSlots[found].mFence;
+    mSlots[found].mEglFence = EGL_NO_SYNC_KHR;
+    mSlots[found].mFence = Fence::NO_FENCE;
+
+    // If shared buffer mode has just been enabled, cache the slot of the
+    // first buffer that is dequeued and mark it as the shared buffer.
+    if (mCore->mSharedBufferMode && mCore->mSharedBufferSlot ==
+            BufferQueueCore::INVALID_BUFFER_SLOT) {
+        mCore->mSharedBufferSlot = found;
+        mSlots[found].mBufferState.mShared = true;
+    }
 
-        { // Autolock scope
-            std::lock_guard<std::mutex> lock(mCore->mMutex);
-
-            if (error == NO_ERROR && !mCore->mIsAbandoned) {
-                graphicBuffer->setGenerationNumber(mCore->mGenerationNumber);
-                mSlots[*outSlot].mGraphicBuffer = graphicBuffer;
-                if (mCore->mConsumerListener != nullptr) {
-                    mCore->mConsumerListener->onFrameDequeued(
-                            mSlots[*outSlot].mGraphicBuffer->getId());
-                }
-            }
+    if (!(dequeue->returnFlags & BUFFER_NEEDS_REALLOCATION)) {
+        if (mCore->mConsumerListener != nullptr) {
+            mCore->mConsumerListener->onFrameDequeued(mSlots[found].mGraphicBuffer->getId());
+        }
+    }
+    return NO_ERROR;
+}
 
-            mCore->mIsAllocating = false;
-            mCore->mIsAllocatingCondition.notify_all();
+void BufferQueueProducer::allocateDequeuedBuffer(DequeueOperation* dequeue) const {
+    if (dequeue->allocatedBuffer != nullptr) {
+        // The buffer was allocated ahead.
+        return;
+    }
+    BQ_LOGV("dequeueBuffer: allocating a new buffer for slot %d", dequeue->slot);
+    dequeue->allocatedBuffer = new GraphicBuffer(
+            dequeue->width, dequeue->height, dequeue->format, BQ_LAYER_COUNT, dequeue->usage,
+            {mConsumerName.string(), mConsumerName.size()});
+}
 
-            if (error != NO_ERROR) {
-                mCore->mFreeSlots.insert(*outSlot);
-                mCore->clearBufferSlotLocked(*outSlot);
-                BQ_LOGE("dequeueBuffer: createGraphicBuffer failed");
-                return error;
-            }
+status_t BufferQueueProducer::attachDequeuedBufferLocked(DequeueOperation* dequeue) {
+    const int slot = dequeue->slot;
+    sp<GraphicBuffer> graphicBuffer = std::move(dequeue->allocatedBuffer);
+    status_t error = graphicBuffer->initCheck();
+
+    if (error == NO_ERROR && !mCore->mIsAbandoned) {
+        graphicBuffer->setGenerationNumber(mCore->mGenerationNumber);
+        mSlots[slot].mGraphicBuffer = graphicBuffer;
+        if (mCore->mConsumerListener != nullptr) {
+            mCore->mConsumerListener->onFrameDequeued(
+                    mSlots[slot].mGraphicBuffer->getId());
+        }
+    }
 
-            if (mCore->mIsAbandoned) {
-                mCore->mFreeSlots.insert(*outSlot);
-                mCore->clearBufferSlotLocked(*outSlot);
-                BQ_LOGE("dequeueBuffer: BufferQueue has been abandoned");
-                return NO_INIT;
-            }
+    if (error != NO_ERROR) {
+        mCore->mFreeSlots.insert(slot);
+        mCore->clearBufferSlotLocked(slot);
+        BQ_LOGE("dequeueBuffer: createGraphicBuffer failed");
+        return error;
+    }
 
-            VALIDATE_CONSISTENCY();
-        } // Autolock scope
+    if (mCore->mIsAbandoned) {
+        mCore->mFreeSlots.insert(slot);
+        mCore->clearBufferSlotLocked(slot);
+        BQ_LOGE("dequeueBuffer: BufferQueue has been abandoned");
+        return NO_INIT;
     }
 
-    if (attachedByConsumer) {
+    mCore->onBufferAllocatedLocked({dequeue->width, dequeue->height, dequeue->format,
+                                    dequeue->usage});
+    VALIDATE_CONSISTENCY();
+    return NO_ERROR;
+}
+
+status_t BufferQueueProducer::finishDequeue(const DequeueOperation& dequeue,
+                                            uint64_t* outBufferAge,
+                                            FrameEventHistoryDelta* outTimestamps) {
+    status_t returnFlags = dequeue.returnFlags;
+    if (dequeue.attachedByConsumer) {
         returnFlags |= BUFFER_NEEDS_REALLOCATION;
     }
 
-    if (eglFence != EGL_NO_SYNC_KHR) {
-        EGLint result = eglClientWaitSyncKHR(eglDisplay, eglFence, 0,
+    if (dequeue.eglFence != EGL_NO_SYNC_KHR) {
+        EGLint result = eglClientWaitSyncKHR(dequeue.eglDisplay, dequeue.eglFence, 0,
                 1000000000);
         // If something goes wrong, log the error, but return the buffer without
         // synchronizing access to it. It's too late at this point to abort the
@@ -601,16 +737,16 @@ status_t BufferQueueProducer::dequeueBuffer(int* outSlot, sp<android::Fence>* ou
         } else if (result == EGL_TIMEOUT_EXPIRED_KHR) {
             BQ_LOGE("dequeueBuffer: timeout waiting for fence");
         }
-        eglDestroySyncKHR(eglDisplay, eglFence);
+        eglDestroySyncKHR(dequeue.eglDisplay, dequeue.eglFence);
     }
 
     BQ_LOGV("dequeueBuffer: returning slot=%d/%" PRIu64 " buf=%p flags=%#x",
-            *outSlot,
-            mSlots[*outSlot].mFrameNumber,
-            mSlots[*outSlot].mGraphicBuffer->handle, returnFlags);
+            dequeue.slot,
+            mSlots[dequeue.slot].mFrameNumber,
+            mSlots[dequeue.slot].mGraphicBuffer->handle, returnFlags);
 
     if (outBufferAge) {
-        *outBufferAge = mCore->mBufferAge;
+        *outBufferAge = dequeue.bufferAge;
     }
     addAndGetFrameTimestamps(nullptr, outTimestamps);
 
@@ -810,6 +946,63 @@ status_t BufferQueueProducer::queueBuffer(int slot,
     ATRACE_CALL();
     ATRACE_BUFFER_INDEX(slot);
 
+    QueueOperation queue;
+    int callbackTicket = 0;
+    { // Autolock scope
+        std::lock_guard<std::mutex> lock(mCore->mMutex);
+        status_t status = queueBufferLocked(slot, input, output, &queue);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        mCore->mDequeueCondition.notify_all();
+
+        // Take a ticket for the callback functions
+        callbackTicket = mNextCallbackTicket++;
+
+        VALIDATE_CONSISTENCY();
+    } // Autolock scope
+
+    onFramesQueued(&queue, 1, callbackTicket);
+    return NO_ERROR;
+}
+
+status_t BufferQueueProducer::queueBuffers(const std::vector<QueueBufferInput>& inputs,
+                                           std::vector<QueueBufferOutput>* outputs) {
+    ATRACE_CALL();
+    outputs->clear();
+    outputs->resize(inputs.size());
+
+    std::vector<QueueOperation> queues;
+    queues.reserve(inputs.size());
+    int callbackTicket = 0;
+    { // Autolock scope
+        std::lock_guard<std::mutex> lock(mCore->mMutex);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            QueueBufferOutput& output = (*outputs)[i];
+            QueueOperation queue;
+            output.result = queueBufferLocked(inputs[i].slot, inputs[i], &output, &queue);
+            if (output.result == NO_ERROR) {
+                queues.push_back(std::move(queue));
+            }
+        }
+        if (queues.empty()) {
+            return NO_ERROR;
+        }
+        mCore->mDequeueCondition.notify_all();
+
+        // Take a single ticket for the callback functions of the batch
+        callbackTicket = mNextCallbackTicket++;
+
+        VALIDATE_CONSISTENCY();
+    } // Autolock scope
+
+    onFramesQueued(queues.data(), queues.size(), callbackTicket);
+    return NO_ERROR;
+}
+
+status_t BufferQueueProducer::queueBufferLocked(int slot, const QueueBufferInput& input,
+                                                QueueBufferOutput* output,
+                                                QueueOperation* queue) {
     int64_t requestedPresentTimestamp;
     bool isAutoTimestamp;
     android_dataspace dataSpace;
@@ -830,8 +1023,6 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         return BAD_VALUE;
     }
 
-    auto acquireFenceTime = std::make_shared<FenceTime>(acquireFence);
-
     switch (scalingMode) {
         case NATIVE_WINDOW_SCALING_MODE_FREEZE:
         case NATIVE_WINDOW_SCALING_MODE_SCALE_TO_WINDOW:
@@ -843,201 +1034,200 @@ status_t BufferQueueProducer::queueBuffer(int slot,
             return BAD_VALUE;
     }
 
-    sp<IConsumerListener> frameAvailableListener;
-    sp<IConsumerListener> frameReplacedListener;
-    int callbackTicket = 0;
-    uint64_t currentFrameNumber = 0;
-    BufferItem item;
-    { // Autolock scope
-        std::lock_guard<std::mutex> lock(mCore->mMutex);
-
-        if (mCore->mIsAbandoned) {
-            BQ_LOGE("queueBuffer: BufferQueue has been abandoned");
-            return NO_INIT;
-        }
+    if (mCore->mIsAbandoned) {
+        BQ_LOGE("queueBuffer: BufferQueue has been abandoned");
+        return NO_INIT;
+    }
 
-        if (mCore->mConnectedApi == BufferQueueCore::NO_CONNECTED_API) {
-            BQ_LOGE("queueBuffer: BufferQueue has no connected producer");
-            return NO_INIT;
-        }
+    if (mCore->mConnectedApi == BufferQueueCore::NO_CONNECTED_API) {
+        BQ_LOGE("queueBuffer: BufferQueue has no connected producer");
+        return NO_INIT;
+    }
 
-        if (slot < 0 || slot >= BufferQueueDefs::NUM_BUFFER_SLOTS) {
-            BQ_LOGE("queueBuffer: slot index %d out of range [0, %d)",
-                    slot, BufferQueueDefs::NUM_BUFFER_SLOTS);
-            return BAD_VALUE;
-        } else if (!mSlots[slot].mBufferState.isDequeued()) {
-            BQ_LOGE("queueBuffer: slot %d is not owned by the producer "
-                    "(state = %s)", slot, mSlots[slot].mBufferState.string());
-            return BAD_VALUE;
-        } else if (!mSlots[slot].mRequestBufferCalled) {
-            BQ_LOGE("queueBuffer: slot %d was queued without requesting "
-                    "a buffer", slot);
-            return BAD_VALUE;
-        }
+    if (slot < 0 || slot >= BufferQueueDefs::NUM_BUFFER_SLOTS) {
+        BQ_LOGE("queueBuffer: slot index %d out of range [0, %d)",
+                slot, BufferQueueDefs::NUM_BUFFER_SLOTS);
+        return BAD_VALUE;
+    } else if (!mSlots[slot].mBufferState.isDequeued()) {
+        BQ_LOGE("queueBuffer: slot %d is not owned by the producer "
+                "(state = %s)", slot, mSlots[slot].mBufferState.string());
+        return BAD_VALUE;
+    } else if (!mSlots[slot].mRequestBufferCalled) {
+        BQ_LOGE("queueBuffer: slot %d was queued without requesting "
+                "a buffer", slot);
+        return BAD_VALUE;
+    }
 
-        // If shared buffer mode has just been enabled, cache the slot of the
-        // first buffer that is queued and mark it as the shared buffer.
-        if (mCore->mSharedBufferMode && mCore->mSharedBufferSlot ==
-                BufferQueueCore::INVALID_BUFFER_SLOT) {
-            mCore->mSharedBufferSlot = slot;
-            mSlots[slot].mBufferState.mShared = true;
-        }
+    // If shared buffer mode has just been enabled, cache the slot of the
+    // first buffer that is queued and mark it as the shared buffer.
+    if (mCore->mSharedBufferMode && mCore->mSharedBufferSlot ==
+            BufferQueueCore::INVALID_BUFFER_SLOT) {
+        mCore->mSharedBufferSlot = slot;
+        mSlots[slot].mBufferState.mShared = true;
+    }
 
-        BQ_LOGV("queueBuffer: slot=%d/%" PRIu64 " time=%" PRIu64 " dataSpace=%d"
-                " validHdrMetadataTypes=0x%x crop=[%d,%d,%d,%d] transform=%#x scale=%s",
-                slot, mCore->mFrameCounter + 1, requestedPresentTimestamp, dataSpace,
-                hdrMetadata.validTypes, crop.left, crop.top, crop.right, crop.bottom,
-                transform,
-                BufferItem::scalingModeName(static_cast<uint32_t>(scalingMode)));
-
-        const sp<GraphicBuffer>& graphicBuffer(mSlots[slot].mGraphicBuffer);
-        Rect bufferRect(graphicBuffer->getWidth(), graphicBuffer->getHeight());
-        Rect croppedRect(Rect::EMPTY_RECT);
-        crop.intersect(bufferRect, &croppedRect);
-        if (croppedRect != crop) {
-            BQ_LOGE("queueBuffer: crop rect is not contained within the "
-                    "buffer in slot %d", slot);
-            return BAD_VALUE;
-        }
+    BQ_LOGV("queueBuffer: slot=%d/%" PRIu64 " time=%" PRIu64 " dataSpace=%d"
+            " validHdrMetadataTypes=0x%x crop=[%d,%d,%d,%d] transform=%#x scale=%s",
+            slot, mCore->mFrameCounter + 1, requestedPresentTimestamp, dataSpace,
+            hdrMetadata.validTypes, crop.left, crop.top, crop.right, crop.bottom,
+            transform,
+            BufferItem::scalingModeName(static_cast<uint32_t>(scalingMode)));
+
+    const sp<GraphicBuffer>& graphicBuffer(mSlots[slot].mGraphicBuffer);
+    Rect bufferRect(graphicBuffer->getWidth(), graphicBuffer->getHeight());
+    Rect croppedRect(Rect::EMPTY_RECT);
+    crop.intersect(bufferRect, &croppedRect);
+    if (croppedRect != crop) {
+        BQ_LOGE("queueBuffer: crop rect is not contained within the "
+                "buffer in slot %d", slot);
+        return BAD_VALUE;
+    }
 
-        // Override UNKNOWN dataspace with consumer default
-        if (dataSpace == HAL_DATASPACE_UNKNOWN) {
-            dataSpace = mCore->mDefaultBufferDataSpace;
-        }
+    // Override UNKNOWN dataspace with consumer default
+    if (dataSpace == HAL_DATASPACE_UNKNOWN) {
+        dataSpace = mCore->mDefaultBufferDataSpace;
+    }
 
-        mSlots[slot].mFence = acquireFence;
-        mSlots[slot].mBufferState.queue();
-
-        // Increment the frame counter and store a local version of it
-        // for use outside the lock on mCore->mMutex.
-        ++mCore->mFrameCounter;
-        currentFrameNumber = mCore->mFrameCounter;
-        mSlots[slot].mFrameNumber = currentFrameNumber;
-
-        item.mAcquireCalled = mSlots[slot].mAcquireCalled;
-        item.mGraphicBuffer = mSlots[slot].mGraphicBuffer;
-        item.mCrop = crop;
-        item.mTransform = transform &
-                ~static_cast<uint32_t>(NATIVE_WINDOW_TRANSFORM_INVERSE_DISPLAY);
-        item.mTransformToDisplayInverse =
-                (transform & NATIVE_WINDOW_TRANSFORM_INVERSE_DISPLAY) != 0;
-        item.mScalingMode = static_cast<uint32_t>(scalingMode);
-        item.mTimestamp = requestedPresentTimestamp;
-        item.mIsAutoTimestamp = isAutoTimestamp;
-        item.mDataSpace = dataSpace;
-        item.mHdrMetadata = hdrMetadata;
-        item.mFrameNumber = currentFrameNumber;
-        item.mSlot = slot;
-        item.mFence = acquireFence;
-        item.mFenceTime = acquireFenceTime;
-        item.mIsDroppable = mCore->mAsyncMode ||
-                (mConsumerIsSurfaceFlinger && mCore->mQueueBufferCanDrop) ||
-                (mCore->mLegacyBufferDrop && mCore->mQueueBufferCanDrop) ||
-                (mCore->mSharedBufferMode && mCore->mSharedBufferSlot == slot);
-        item.mSurfaceDamage = surfaceDamage;
-        item.mQueuedBuffer = true;
-        item.mAutoRefresh = mCore->mSharedBufferMode && mCore->mAutoRefresh;
-        item.mApi = mCore->mConnectedApi;
-
-        mStickyTransform = stickyTransform;
-
-        // Cache the shared buffer data so that the BufferItem can be recreated.
-        if (mCore->mSharedBufferMode) {
-            mCore->mSharedBufferCache.crop = crop;
-            mCore->mSharedBufferCache.transform = transform;
-            mCore->mSharedBufferCache.scalingMode = static_cast<uint32_t>(
-                    scalingMode);
-            mCore->mSharedBufferCache.dataspace = dataSpace;
-        }
+    mSlots[slot].mFence = acquireFence;
+    mSlots[slot].mBufferState.queue();
+
+    // Increment the frame counter and store a local version of it
+    // for use outside the lock on mCore->mMutex.
+    ++mCore->mFrameCounter;
+    const uint64_t currentFrameNumber = mCore->mFrameCounter;
+    mSlots[slot].mFrameNumber = currentFrameNumber;
+    mSlots[slot].mQueueTime = systemTime();
+
+    BufferItem& item = queue->item;
+    item.mAcquireCalled = mSlots[slot].mAcquireCalled;
+    item.mGraphicBuffer = mSlots[slot].mGraphicBuffer;
+    item.mCrop = crop;
+    item.mTransform = transform &
+            ~static_cast<uint32_t>(NATIVE_WINDOW_TRANSFORM_INVERSE_DISPLAY);
+    item.mTransformToDisplayInverse =
+            (transform & NATIVE_WINDOW_TRANSFORM_INVERSE_DISPLAY) != 0;
+    item.mScalingMode = static_cast<uint32_t>(scalingMode);
+    item.mTimestamp = requestedPresentTimestamp;
+    item.mIsAutoTimestamp = isAutoTimestamp;
+    item.mDataSpace = dataSpace;
+    item.mHdrMetadata = hdrMetadata;
+    item.mFrameNumber = currentFrameNumber;
+    item.mSlot = slot;
+    item.mFence = acquireFence;
+    item.mFenceTime = std::make_shared<FenceTime>(acquireFence);
+    item.mIsDroppable = mCore->mAsyncMode ||
+            (mConsumerIsSurfaceFlinger && mCore->mQueueBufferCanDrop) ||
+            (mCore->mLegacyBufferDrop && mCore->mQueueBufferCanDrop) ||
+            (mCore->mSharedBufferMode && mCore->mSharedBufferSlot == slot);
+    item.mSurfaceDamage = surfaceDamage;
+    item.mQueuedBuffer = true;
+    item.mAutoRefresh = mCore->mSharedBufferMode && mCore->mAutoRefresh;
+    item.mApi = mCore->mConnectedApi;
+
+    queue->requestedPresentTimestamp = requestedPresentTimestamp;
+    queue->acquireFenceTime = item.mFenceTime;
+    queue->getFrameTimestamps = getFrameTimestamps;
+    queue->output = output;
+
+    mStickyTransform = stickyTransform;
+
+    // Cache the shared buffer data so that the BufferItem can be recreated.
+    if (mCore->mSharedBufferMode) {
+        mCore->mSharedBufferCache.crop = crop;
+        mCore->mSharedBufferCache.transform = transform;
+        mCore->mSharedBufferCache.scalingMode = static_cast<uint32_t>(
+                scalingMode);
+        mCore->mSharedBufferCache.dataspace = dataSpace;
+    }
 
-        output->bufferReplaced = false;
-        if (mCore->mQueue.empty()) {
-            // When the queue is empty, we can ignore mDequeueBufferCannotBlock
-            // and simply queue this buffer
-            mCore->mQueue.push_back(item);
-            frameAvailableListener = mCore->mConsumerListener;
-        } else {
-            // When the queue is not empty, we need to look at the last buffer
-            // in the queue to see if we need to replace it
-            const BufferItem& last = mCore->mQueue.itemAt(
-                    mCore->mQueue.size() - 1);
-            if (last.mIsDroppable) {
-
-                if (!last.mIsStale) {
-                    mSlots[last.mSlot].mBufferState.freeQueued();
-
-                    // After leaving shared buffer mode, the shared buffer will
-                    // still be around. Mark it as no longer shared if this
-                    // operation causes it to be free.
-                    if (!mCore->mSharedBufferMode &&
-                            mSlots[last.mSlot].mBufferState.isFree()) {
-                        mSlots[last.mSlot].mBufferState.mShared = false;
-                    }
-                    // Don't put the shared buffer on the free list.
-                    if (!mSlots[last.mSlot].mBufferState.isShared()) {
-                        mCore->mActiveBuffers.erase(last.mSlot);
-                        mCore->mFreeBuffers.push_back(last.mSlot);
-                        output->bufferReplaced = true;
-                    }
+    output->bufferReplaced = false;
+    if (mCore->mQueue.empty()) {
+        // When the queue is empty, we can ignore mDequeueBufferCannotBlock
+        // and simply queue this buffer
+        mCore->mQueue.push_back(item);
+        queue->frameAvailableListener = mCore->mConsumerListener;
+    } else {
+        // When the queue is not empty, we need to look at the last buffer
+        // in the queue to see if we need to replace it
+        const BufferItem& last = mCore->mQueue.back();
+        if (last.mIsDroppable) {
+
+            if (!last.mIsStale) {
+                mSlots[last.mSlot].mBufferState.freeQueued();
+
+                // After leaving shared buffer mode, the shared buffer will
+                // still be around. Mark it as no longer shared if this
+                // operation causes it to be free.
+                if (!mCore->mSharedBufferMode &&
+                        mSlots[last.mSlot].mBufferState.isFree()) {
+                    mSlots[last.mSlot].mBufferState.mShared = false;
                 }
-
-                // Make sure to merge the damage rect from the frame we're about
-                // to drop into the new frame's damage rect.
-                if (last.mSurfaceDamage.bounds() == Rect::INVALID_RECT ||
-                    item.mSurfaceDamage.bounds() == Rect::INVALID_RECT) {
-                    item.mSurfaceDamage = Region::INVALID_REGION;
-                } else {
-                    item.mSurfaceDamage |= last.mSurfaceDamage;
+                // Don't put the shared buffer on the free list.
+                if (!mSlots[last.mSlot].mBufferState.isShared()) {
+                    mCore->mActiveBuffers.erase(last.mSlot);
+                    mCore->mFreeBuffers.push_back(last.mSlot);
+                    output->bufferReplaced = true;
                 }
+            }
 
-                // Overwrite the droppable buffer with the incoming one
-                mCore->mQueue.editItemAt(mCore->mQueue.size() - 1) = item;
-                frameReplacedListener = mCore->mConsumerListener;
+            // Make sure to merge the damage rect from the frame we're about
+            // to drop into the new frame's damage rect.
+            if (last.mSurfaceDamage.bounds() == Rect::INVALID_RECT ||
+                item.mSurfaceDamage.bounds() == Rect::INVALID_RECT) {
+                item.mSurfaceDamage = Region::INVALID_REGION;
             } else {
-                mCore->mQueue.push_back(item);
-                frameAvailableListener = mCore->mConsumerListener;
+                item.mSurfaceDamage |= last.mSurfaceDamage;
             }
+
+            // Overwrite the droppable buffer with the incoming one
+            mCore->mQueue.back() = item;
+            queue->frameReplacedListener = mCore->mConsumerListener;
+        } else {
+            mCore->mQueue.push_back(item);
+            queue->frameAvailableListener = mCore->mConsumerListener;
         }
+    }
 
-        mCore->mBufferHasBeenQueued = true;
-        mCore->mDequeueCondition.notify_all();
-        mCore->mLastQueuedSlot = slot;
+    mCore->mBufferHasBeenQueued = true;
+    mCore->mLastQueuedSlot = slot;
 
-        output->width = mCore->mDefaultWidth;
-        output->height = mCore->mDefaultHeight;
-        output->transformHint = mCore->mTransformHintInUse = mCore->mTransformHint;
-        output->numPendingBuffers = static_cast<uint32_t>(mCore->mQueue.size());
-        output->nextFrameNumber = mCore->mFrameCounter + 1;
+    output->width = mCore->mDefaultWidth;
+    output->height = mCore->mDefaultHeight;
+    output->transformHint = mCore->mTransformHintInUse = mCore->mTransformHint;
+    output->numPendingBuffers = static_cast<uint32_t>(mCore->mQueue.size());
+    output->nextFrameNumber = mCore->mFrameCounter + 1;
 
-        ATRACE_INT(mCore->mConsumerName.string(),
-                static_cast<int32_t>(mCore->mQueue.size()));
+    ATRACE_INT(mCore->mConsumerName.string(),
+            static_cast<int32_t>(mCore->mQueue.size()));
 #ifndef NO_BINDER
-        mCore->mOccupancyTracker.registerOccupancyChange(mCore->mQueue.size());
+    mCore->mOccupancyTracker.registerOccupancyChange(mCore->mQueue.size());
 #endif
-        // Take a ticket for the callback functions
-        callbackTicket = mNextCallbackTicket++;
+    return NO_ERROR;
+}
 
-        VALIDATE_CONSISTENCY();
-    } // Autolock scope
+void BufferQueueProducer::onFramesQueued(QueueOperation* queues, size_t count,
+                                         int callbackTicket) {
+    // Update and get FrameEventHistory.
+    const nsecs_t postedTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < count; i++) {
+        QueueOperation& queue = queues[i];
+        // It is okay not to clear the GraphicBuffer when the consumer is SurfaceFlinger because
+        // it is guaranteed that the BufferQueue is inside SurfaceFlinger's process and
+        // there will be no Binder call
+        if (!mConsumerIsSurfaceFlinger) {
+            queue.item.mGraphicBuffer.clear();
+        }
 
-    // It is okay not to clear the GraphicBuffer when the consumer is SurfaceFlinger because
-    // it is guaranteed that the BufferQueue is inside SurfaceFlinger's process and
-    // there will be no Binder call
-    if (!mConsumerIsSurfaceFlinger) {
-        item.mGraphicBuffer.clear();
+        NewFrameEventsEntry newFrameEventsEntry = {
+            queue.item.mFrameNumber,
+            postedTime,
+            queue.requestedPresentTimestamp,
+            std::move(queue.acquireFenceTime)
+        };
+        addAndGetFrameTimestamps(&newFrameEventsEntry,
+                queue.getFrameTimestamps ? &queue.output->frameTimestamps : nullptr);
     }
 
-    // Update and get FrameEventHistory.
-    nsecs_t postedTime = systemTime(SYSTEM_TIME_MONOTONIC);
-    NewFrameEventsEntry newFrameEventsEntry = {
-        currentFrameNumber,
-        postedTime,
-        requestedPresentTimestamp,
-        std::move(acquireFenceTime)
-    };
-    addAndGetFrameTimestamps(&newFrameEventsEntry,
-            getFrameTimestamps ? &output->frameTimestamps : nullptr);
-
     // Call back without the main BufferQueue lock held, but with the callback
     // lock held so we can ensure that callbacks occur in order
 
@@ -1050,18 +1240,23 @@ status_t BufferQueueProducer::queueBuffer(int slot,
             mCallbackCondition.wait(lock);
         }
 
-        if (frameAvailableListener != nullptr) {
-            frameAvailableListener->onFrameAvailable(item);
-        } else if (frameReplacedListener != nullptr) {
-            frameReplacedListener->onFrameReplaced(item);
+        for (size_t i = 0; i < count; i++) {
+            const QueueOperation& queue = queues[i];
+            if (queue.frameAvailableListener != nullptr) {
+                queue.frameAvailableListener->onFrameAvailable(queue.item);
+            } else if (queue.frameReplacedListener != nullptr) {
+                queue.frameReplacedListener->onFrameReplaced(queue.item);
+            }
+
+            // Only the fence of the buffer queued before the last one of the
+            // batch is waited for below.
+            lastQueuedFence = std::move(mLastQueueBufferFence);
+            mLastQueueBufferFence = queue.item.mFence;
         }
 
         connectedApi = mCore->mConnectedApi;
-        lastQueuedFence = std::move(mLastQueueBufferFence);
-
-        mLastQueueBufferFence = std::move(acquireFence);
-        mLastQueuedCrop = item.mCrop;
-        mLastQueuedTransform = item.mTransform;
+        mLastQueuedCrop = queues[count - 1].item.mCrop;
+        mLastQueuedTransform = queues[count - 1].item.mTransform;
 
         ++mCurrentCallbackTicket;
         mCallbackCondition.notify_all();
@@ -1074,8 +1269,6 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         // small trade-off in favor of latency rather than throughput.
         lastQueuedFence->waitForever("Throttling EGL Production");
     }
-
-    return NO_ERROR;
 }
 
 status_t BufferQueueProducer::cancelBuffer(int slot, const sp<Fence>& fence) {
@@ -1247,6 +1440,8 @@ status_t BufferQueueProducer::connect(const sp<IProducerListener>& listener,
         case NATIVE_WINDOW_API_MEDIA:
         case NATIVE_WINDOW_API_CAMERA:
             mCore->mConnectedApi = api;
+            // The pattern of allocations is the new producer's own.
+            mCore->mAllocationPredictor.clear();
 
             output->width = mCore->mDefaultWidth;
             output->height = mCore->mDefaultHeight;
@@ -1273,6 +1468,9 @@ status_t BufferQueueProducer::connect(const sp<IProducerListener>& listener,
 #endif
                 mCore->mConnectedProducerListener = listener;
                 mCore->mBufferReleasedCbEnabled = listener->needsReleaseNotify();
+                if (mCore->mBufferReleasedCbEnabled) {
+                    mCore->revokeAllReleasableLocked();
+                }
             }
             break;
         default:
@@ -1552,6 +1750,9 @@ status_t BufferQueueProducer::setSharedBufferMode(bool sharedBufferMode) {
         mCore->mSharedBufferSlot = BufferQueueCore::INVALID_BUFFER_SLOT;
     }
     mCore->mSharedBufferMode = sharedBufferMode;
+    if (sharedBufferMode) {
+        mCore->revokeAllReleasableLocked();
+    }
     return NO_ERROR;
 }
 
@@ -1649,6 +1850,20 @@ void BufferQueueProducer::getFrameTimestamps(FrameEventHistoryDelta* outDelta) {
     addAndGetFrameTimestamps(nullptr, outDelta);
 }
 
+status_t BufferQueueProducer::getFrameTimestampsRing(base::unique_fd* outRing) {
+    ATRACE_CALL();
+    BQ_LOGV("getFrameTimestampsRing");
+    sp<IConsumerListener> listener;
+    {
+        std::lock_guard<std::mutex> lock(mCore->mMutex);
+        listener = mCore->mConsumerListener;
+    }
+    if (listener == nullptr) {
+        return NO_INIT;
+    }
+    return listener->getFrameTimestampsRing(outRing);
+}
+
 void BufferQueueProducer::addAndGetFrameTimestamps(
         const NewFrameEventsEntry* newTimestamps,
         FrameEventHistoryDelta* outDelta) {
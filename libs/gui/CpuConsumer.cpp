@@ -23,6 +23,19 @@
 #include <gui/BufferItem.h>
 #include <utils/Log.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define CC_LOGV(x, ...) ALOGV("[%s] " x, mName.string(), ##__VA_ARGS__)
 //#define CC_LOGD(x, ...) ALOGD("[%s] " x, mName.string(), ##__VA_ARGS__)
 //#define CC_LOGI(x, ...) ALOGI("[%s] " x, mName.string(), ##__VA_ARGS__)
@@ -228,4 +241,501 @@ status_t CpuConsumer::unlockBuffer(const LockedBuffer &nativeBuffer) {
     return OK;
 }
 
+// ----------------------------------------------------------------------------
+// Conversion to RGBA_8888
+//
+// Each row kernel converts as many pixels as it can with NEON or SSE2, and the
+// rest of the row, or all of it on other architectures, with a scalar loop
+// giving the same results.
+// ----------------------------------------------------------------------------
+
+namespace {
+
+// Converting a band of rows on another thread only pays off when the band is
+// large enough to amortize handing it over and waiting for it.
+constexpr size_t kMinPixelsPerThread = 128 * 1024;
+
+// Coefficients of the YCbCr to RGB conversion, scaled by 2^12.
+struct YuvCoefficients {
+    int32_t yOffset;
+    int32_t y;
+    int32_t crToR;
+    int32_t cbToG;
+    int32_t crToG;
+    int32_t cbToB;
+};
+
+#if defined(__ARM_NEON)
+
+uint32_t convertRgbxPixels(const uint8_t* src, uint8_t* dst, uint32_t width) {
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t pixels = vld4q_u8(src + x * 4);
+        pixels.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(dst + x * 4, pixels);
+    }
+    return x;
+}
+
+uint32_t convertRgb565Pixels(const uint8_t* src, uint8_t* dst, uint32_t width) {
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const uint16x8_t pixels = vreinterpretq_u16_u8(vld1q_u8(src + x * 2));
+        const uint16x8_t r = vshrq_n_u16(pixels, 11);
+        const uint16x8_t g = vandq_u16(vshrq_n_u16(pixels, 5), vdupq_n_u16(0x3f));
+        const uint16x8_t b = vandq_u16(pixels, vdupq_n_u16(0x1f));
+        uint8x8x4_t rgba;
+        rgba.val[0] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+        rgba.val[1] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+        rgba.val[2] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+        rgba.val[3] = vdup_n_u8(0xff);
+        vst4_u8(dst + x * 4, rgba);
+    }
+    return x;
+}
+
+// Returns the 8 channel values (y * k.y + 2^11 + cb * cbCoef + cr * crCoef) >> 12,
+// clamped to [0, 255].
+inline uint8x8_t convertYuvChannel(int32x4_t yLow, int32x4_t yHigh, int16x8_t cb,
+                                   int16x8_t cr, int16_t cbCoef, int16_t crCoef) {
+    int32x4_t low = vmlal_n_s16(vmlal_n_s16(yLow, vget_low_s16(cb), cbCoef), vget_low_s16(cr),
+                                crCoef);
+    int32x4_t high = vmlal_n_s16(vmlal_n_s16(yHigh, vget_high_s16(cb), cbCoef),
+                                 vget_high_s16(cr), crCoef);
+    return vqmovun_s16(vcombine_s16(vqshrn_n_s32(low, 12), vqshrn_n_s32(high, 12)));
+}
+
+template <uint32_t ChromaStep>
+uint32_t convertYuvPixels(const uint8_t* srcY, const uint8_t* srcCb, const uint8_t* srcCr,
+                          uint8_t* dst, uint32_t width, const YuvCoefficients& k) {
+    if (ChromaStep != 1 && ChromaStep != 2) {
+        return 0;
+    }
+    // Loading 8 interleaved chroma bytes reads one past the last sample used,
+    // which must still be in the row.
+    const uint32_t end = ChromaStep == 2 ? width - std::min(width, 1u) : width;
+    uint32_t x = 0;
+    for (; x + 8 <= end; x += 8) {
+        uint8x8_t cb8;
+        uint8x8_t cr8;
+        if (ChromaStep == 1) {
+            uint32_t cb4;
+            uint32_t cr4;
+            memcpy(&cb4, srcCb + x / 2, sizeof(cb4));
+            memcpy(&cr4, srcCr + x / 2, sizeof(cr4));
+            cb8 = vreinterpret_u8_u32(vdup_n_u32(cb4));
+            cr8 = vreinterpret_u8_u32(vdup_n_u32(cr4));
+            cb8 = vzip_u8(cb8, cb8).val[0];
+            cr8 = vzip_u8(cr8, cr8).val[0];
+        } else {
+            cb8 = vld1_u8(srcCb + x);
+            cr8 = vld1_u8(srcCr + x);
+            cb8 = vtrn_u8(cb8, cb8).val[0];
+            cr8 = vtrn_u8(cr8, cr8).val[0];
+        }
+        const int16x8_t y = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(srcY + x))),
+                                      vdupq_n_s16(static_cast<int16_t>(k.yOffset)));
+        const int16x8_t cb =
+                vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cb8)), vdupq_n_s16(128));
+        const int16x8_t cr =
+                vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cr8)), vdupq_n_s16(128));
+        const int16_t yCoef = static_cast<int16_t>(k.y);
+        const int32x4_t yLow = vmlal_n_s16(vdupq_n_s32(1 << 11), vget_low_s16(y), yCoef);
+        const int32x4_t yHigh = vmlal_n_s16(vdupq_n_s32(1 << 11), vget_high_s16(y), yCoef);
+
+        uint8x8x4_t rgba;
+        rgba.val[0] = convertYuvChannel(yLow, yHigh, cb, cr, 0,
+                                        static_cast<int16_t>(k.crToR));
+        rgba.val[1] = convertYuvChannel(yLow, yHigh, cb, cr, static_cast<int16_t>(-k.cbToG),
+                                        static_cast<int16_t>(-k.crToG));
+        rgba.val[2] = convertYuvChannel(yLow, yHigh, cb, cr, static_cast<int16_t>(k.cbToB),
+                                        0);
+        rgba.val[3] = vdup_n_u8(0xff);
+        vst4_u8(dst + x * 4, rgba);
+    }
+    return x;
+}
+
+#elif defined(__SSE2__)
+
+// Interleaves 8 red, green and blue values held in 16-bit lanes into 8 opaque
+// RGBA pixels, clamping them to [0, 255].
+inline void storeRgbaPixels(uint8_t* dst, __m128i r, __m128i g, __m128i b) {
+    const __m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+    const __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_set1_epi8(-1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(rg, ba));
+}
+
+uint32_t convertRgbxPixels(const uint8_t* src, uint8_t* dst, uint32_t width) {
+    // x86 is little-endian, so the alpha byte is the top one of each pixel.
+    const __m128i alpha = _mm_set1_epi32(static_cast<int32_t>(0xff000000));
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_or_si128(pixels, alpha));
+    }
+    return x;
+}
+
+uint32_t convertRgb565Pixels(const uint8_t* src, uint8_t* dst, uint32_t width) {
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 2));
+        const __m128i r = _mm_srli_epi16(pixels, 11);
+        const __m128i g = _mm_and_si128(_mm_srli_epi16(pixels, 5), _mm_set1_epi16(0x3f));
+        const __m128i b = _mm_and_si128(pixels, _mm_set1_epi16(0x1f));
+        storeRgbaPixels(dst + x * 4, _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2)),
+                        _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4)),
+                        _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2)));
+    }
+    return x;
+}
+
+// Returns the 8 channel values (y * k.y + 2^11 + cr * crCoef + cb * cbCoef) >> 12,
+// given the first term of the 4 low and 4 high pixels, and their chroma as
+// (cr, cb) pairs.
+inline __m128i convertYuvChannel(__m128i yLow, __m128i yHigh, __m128i crCbLow,
+                                 __m128i crCbHigh, int16_t crCoef, int16_t cbCoef) {
+    const __m128i coefs = _mm_set_epi16(cbCoef, crCoef, cbCoef, crCoef, cbCoef, crCoef, cbCoef,
+                                        crCoef);
+    const __m128i low = _mm_add_epi32(yLow, _mm_madd_epi16(crCbLow, coefs));
+    const __m128i high = _mm_add_epi32(yHigh, _mm_madd_epi16(crCbHigh, coefs));
+    return _mm_packs_epi32(_mm_srai_epi32(low, 12), _mm_srai_epi32(high, 12));
+}
+
+template <uint32_t ChromaStep>
+uint32_t convertYuvPixels(const uint8_t* srcY, const uint8_t* srcCb, const uint8_t* srcCr,
+                          uint8_t* dst, uint32_t width, const YuvCoefficients& k) {
+    if (ChromaStep != 1 && ChromaStep != 2) {
+        return 0;
+    }
+    // Loading 8 interleaved chroma bytes reads one past the last sample used,
+    // which must still be in the row.
+    const uint32_t end = ChromaStep == 2 ? width - std::min(width, 1u) : width;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yCoefs = _mm_set_epi16(1 << 11, static_cast<int16_t>(k.y), 1 << 11,
+                                         static_cast<int16_t>(k.y), 1 << 11,
+                                         static_cast<int16_t>(k.y), 1 << 11,
+                                         static_cast<int16_t>(k.y));
+    uint32_t x = 0;
+    for (; x + 8 <= end; x += 8) {
+        __m128i cb;
+        __m128i cr;
+        if (ChromaStep == 1) {
+            int32_t cb4;
+            int32_t cr4;
+            memcpy(&cb4, srcCb + x / 2, sizeof(cb4));
+            memcpy(&cr4, srcCr + x / 2, sizeof(cr4));
+            cb = _mm_cvtsi32_si128(cb4);
+            cr = _mm_cvtsi32_si128(cr4);
+            cb = _mm_unpacklo_epi8(_mm_unpacklo_epi8(cb, cb), zero);
+            cr = _mm_unpacklo_epi8(_mm_unpacklo_epi8(cr, cr), zero);
+        } else {
+            // Keep the even bytes, and copy each to the next lane.
+            const __m128i evenMask = _mm_set1_epi16(0xff);
+            cb = _mm_and_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcCb + x)),
+                               evenMask);
+            cr = _mm_and_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcCr + x)),
+                               evenMask);
+            cb = _mm_unpacklo_epi8(_mm_or_si128(cb, _mm_slli_epi16(cb, 8)), zero);
+            cr = _mm_unpacklo_epi8(_mm_or_si128(cr, _mm_slli_epi16(cr, 8)), zero);
+        }
+        cb = _mm_sub_epi16(cb, _mm_set1_epi16(128));
+        cr = _mm_sub_epi16(cr, _mm_set1_epi16(128));
+        const __m128i y = _mm_sub_epi16(
+                _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcY + x)),
+                                  zero),
+                _mm_set1_epi16(static_cast<int16_t>(k.yOffset)));
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i yLow = _mm_madd_epi16(_mm_unpacklo_epi16(y, one), yCoefs);
+        const __m128i yHigh = _mm_madd_epi16(_mm_unpackhi_epi16(y, one), yCoefs);
+        const __m128i crCbLow = _mm_unpacklo_epi16(cr, cb);
+        const __m128i crCbHigh = _mm_unpackhi_epi16(cr, cb);
+
+        storeRgbaPixels(dst + x * 4,
+                        convertYuvChannel(yLow, yHigh, crCbLow, crCbHigh,
+                                          static_cast<int16_t>(k.crToR), 0),
+                        convertYuvChannel(yLow, yHigh, crCbLow, crCbHigh,
+                                          static_cast<int16_t>(-k.crToG),
+                                          static_cast<int16_t>(-k.cbToG)),
+                        convertYuvChannel(yLow, yHigh, crCbLow, crCbHigh, 0,
+                                          static_cast<int16_t>(k.cbToB)));
+    }
+    return x;
+}
+
+#else
+
+uint32_t convertRgbxPixels(const uint8_t*, uint8_t*, uint32_t) {
+    return 0;
+}
+
+uint32_t convertRgb565Pixels(const uint8_t*, uint8_t*, uint32_t) {
+    return 0;
+}
+
+template <uint32_t ChromaStep>
+uint32_t convertYuvPixels(const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, uint32_t,
+                          const YuvCoefficients&) {
+    return 0;
+}
+
+#endif
+
+void convertRgbxRow(const uint8_t* src, uint8_t* dst, uint32_t width) {
+    const uint32_t start = convertRgbxPixels(src, dst, width);
+    memcpy(dst + start * 4, src + start * 4, (width - start) * 4);
+    // The alpha byte is the last one in memory, whatever the endianness.
+    for (uint32_t x = start; x < width; x++) {
+        dst[x * 4 + 3] = 0xff;
+    }
+}
+
+void convertRgb565Row(const uint8_t* src, uint8_t* dst, uint32_t width) {
+    for (uint32_t x = convertRgb565Pixels(src, dst, width); x < width; x++) {
+        uint16_t pixel;
+        memcpy(&pixel, src + x * 2, sizeof(pixel));
+        const uint32_t r = (pixel >> 11) & 0x1f;
+        const uint32_t g = (pixel >> 5) & 0x3f;
+        const uint32_t b = pixel & 0x1f;
+        dst[x * 4 + 0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+        dst[x * 4 + 1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+        dst[x * 4 + 2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+        dst[x * 4 + 3] = 0xff;
+    }
+}
+
+constexpr YuvCoefficients kBt601Limited = {16, 4769, 6537, 1605, 3330, 8263};
+constexpr YuvCoefficients kBt601Full = {0, 4096, 5743, 1410, 2925, 7258};
+constexpr YuvCoefficients kBt709Limited = {16, 4769, 7343, 873, 2183, 8652};
+constexpr YuvCoefficients kBt709Full = {0, 4096, 6450, 767, 1917, 7601};
+
+const YuvCoefficients& getYuvCoefficients(android_dataspace dataSpace) {
+    switch (dataSpace) {
+        case HAL_DATASPACE_JFIF:
+            return kBt601Full;
+        case HAL_DATASPACE_BT601_625:
+        case HAL_DATASPACE_BT601_525:
+            return kBt601Limited;
+        case HAL_DATASPACE_BT709:
+            return kBt709Limited;
+        default:
+            break;
+    }
+    const bool fullRange = (dataSpace & HAL_DATASPACE_RANGE_MASK) == HAL_DATASPACE_RANGE_FULL;
+    if ((dataSpace & HAL_DATASPACE_STANDARD_MASK) == HAL_DATASPACE_STANDARD_BT709) {
+        return fullRange ? kBt709Full : kBt709Limited;
+    }
+    return fullRange ? kBt601Full : kBt601Limited;
+}
+
+inline uint8_t clampToByte(int32_t value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+// ChromaStep is a template parameter, so that planar and semi-planar rows get
+// vector kernels. 0 stands for any other step, converted by the scalar loop.
+template <uint32_t ChromaStep>
+void convertYuvRow(const uint8_t* srcY, const uint8_t* srcCb, const uint8_t* srcCr,
+                   uint32_t chromaStep, uint8_t* dst, uint32_t width,
+                   const YuvCoefficients& k) {
+    const uint32_t step = ChromaStep != 0 ? ChromaStep : chromaStep;
+    for (uint32_t x = convertYuvPixels<ChromaStep>(srcY, srcCb, srcCr, dst, width, k);
+         x < width; x++) {
+        const int32_t y = (srcY[x] - k.yOffset) * k.y + (1 << 11);
+        const int32_t cb = srcCb[(x / 2) * step] - 128;
+        const int32_t cr = srcCr[(x / 2) * step] - 128;
+        dst[x * 4 + 0] = clampToByte((y + k.crToR * cr) >> 12);
+        dst[x * 4 + 1] = clampToByte((y - k.cbToG * cb - k.crToG * cr) >> 12);
+        dst[x * 4 + 2] = clampToByte((y + k.cbToB * cb) >> 12);
+        dst[x * 4 + 3] = 0xff;
+    }
+}
+
+void convertRows(const CpuConsumer::LockedBuffer& buffer, uint8_t* dst, size_t dstStride,
+                 uint32_t firstRow, uint32_t endRow) {
+    const uint32_t width = buffer.width;
+    if (buffer.flexFormat == HAL_PIXEL_FORMAT_YCbCr_420_888) {
+        const YuvCoefficients& k = getYuvCoefficients(buffer.dataSpace);
+        for (uint32_t row = firstRow; row < endRow; row++) {
+            const uint8_t* srcY = buffer.data + static_cast<size_t>(row) * buffer.stride;
+            const size_t chromaOffset = static_cast<size_t>(row / 2) * buffer.chromaStride;
+            const uint8_t* srcCb = buffer.dataCb + chromaOffset;
+            const uint8_t* srcCr = buffer.dataCr + chromaOffset;
+            uint8_t* dstRow = dst + row * dstStride;
+            switch (buffer.chromaStep) {
+                case 1:
+                    convertYuvRow<1>(srcY, srcCb, srcCr, 1, dstRow, width, k);
+                    break;
+                case 2:
+                    convertYuvRow<2>(srcY, srcCb, srcCr, 2, dstRow, width, k);
+                    break;
+                default:
+                    convertYuvRow<0>(srcY, srcCb, srcCr, buffer.chromaStep, dstRow, width, k);
+                    break;
+            }
+        }
+        return;
+    }
+
+    for (uint32_t row = firstRow; row < endRow; row++) {
+        uint8_t* dstRow = dst + row * dstStride;
+        switch (static_cast<int>(buffer.format)) {
+            case HAL_PIXEL_FORMAT_RGBA_8888:
+                memcpy(dstRow, buffer.data + static_cast<size_t>(row) * buffer.stride * 4,
+                       width * 4);
+                break;
+            case HAL_PIXEL_FORMAT_RGBX_8888:
+                convertRgbxRow(buffer.data + static_cast<size_t>(row) * buffer.stride * 4, dstRow,
+                               width);
+                break;
+            case HAL_PIXEL_FORMAT_RGB_565:
+                convertRgb565Row(buffer.data + static_cast<size_t>(row) * buffer.stride * 2,
+                                 dstRow, width);
+                break;
+        }
+    }
+}
+
+
+// Converts the bands of rows of a buffer on threads kept across conversions,
+// so that a conversion doesn't pay for starting them. The threads are started
+// as needed, up to one less than the number of CPUs, and never stopped.
+class RowConversionPool {
+public:
+    static RowConversionPool& getInstance() {
+        // Never destroyed, so that its threads never use it after exit().
+        static RowConversionPool* pool = new RowConversionPool;
+        return *pool;
+    }
+
+    // Converts bandCount bands of about the same height, the calling thread
+    // converting the first one and any the pool's threads haven't started.
+    void convert(const CpuConsumer::LockedBuffer& buffer, uint8_t* dst, size_t dstStride,
+                 uint32_t bandCount) {
+        Job job(buffer, dst, dstStride, bandCount);
+        std::unique_lock<std::mutex> lock(mMutex);
+        mJobs.push_back(&job);
+        while (mThreadCount < std::min<size_t>(bandCount - 1, mMaxThreadCount)) {
+            std::thread(&RowConversionPool::threadMain, this).detach();
+            mThreadCount++;
+        }
+        mJobAvailable.notify_all();
+        lock.unlock();
+
+        convertBand(job, 0);
+
+        lock.lock();
+        while (job.nextBand < job.bandCount) {
+            runNextBandLocked(lock, &job);
+        }
+        job.finished.wait(lock, [&job] { return job.unfinishedBands == 0; });
+    }
+
+private:
+    struct Job {
+        Job(const CpuConsumer::LockedBuffer& buffer, uint8_t* dst, size_t dstStride,
+            uint32_t bandCount)
+              : buffer(buffer),
+                dst(dst),
+                dstStride(dstStride),
+                bandCount(bandCount),
+                nextBand(1),
+                unfinishedBands(bandCount - 1) {}
+
+        const CpuConsumer::LockedBuffer& buffer;
+        uint8_t* const dst;
+        const size_t dstStride;
+        const uint32_t bandCount;
+        // The first band no thread has started converting yet, and the number
+        // of bands after the first one which aren't converted yet.
+        uint32_t nextBand;
+        uint32_t unfinishedBands;
+        std::condition_variable finished;
+    };
+
+    RowConversionPool()
+          : mMaxThreadCount(std::max(std::thread::hardware_concurrency(), 2u) - 1) {}
+
+    static void convertBand(const Job& job, uint32_t band) {
+        const uint32_t height = job.buffer.height;
+        const auto bandStart = [&](uint32_t band) {
+            return static_cast<uint32_t>(static_cast<uint64_t>(height) * band / job.bandCount);
+        };
+        convertRows(job.buffer, job.dst, job.dstStride, bandStart(band), bandStart(band + 1));
+    }
+
+    // Converts the next band of job, without mMutex held, and removes job from
+    // mJobs once all its bands are started.
+    void runNextBandLocked(std::unique_lock<std::mutex>& lock, Job* job) {
+        const uint32_t band = job->nextBand++;
+        if (job->nextBand == job->bandCount) {
+            mJobs.erase(std::find(mJobs.begin(), mJobs.end(), job));
+        }
+        lock.unlock();
+        convertBand(*job, band);
+        lock.lock();
+        if (--job->unfinishedBands == 0) {
+            job->finished.notify_one();
+        }
+    }
+
+    void threadMain() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mJobAvailable.wait(lock, [this] { return !mJobs.empty(); });
+            runNextBandLocked(lock, mJobs.front());
+        }
+    }
+
+    const size_t mMaxThreadCount;
+
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    // The jobs with bands no thread has started converting yet, oldest first.
+    std::deque<Job*> mJobs;
+    size_t mThreadCount = 0;
+};
+
+} // namespace
+
+status_t CpuConsumer::convertToRgba8888(const LockedBuffer& buffer, uint8_t* dst,
+        size_t dstStride, size_t threadCount) {
+    if (buffer.data == nullptr || dst == nullptr || dstStride < buffer.width * 4) {
+        return BAD_VALUE;
+    }
+    if (buffer.flexFormat == HAL_PIXEL_FORMAT_YCbCr_420_888) {
+        if (buffer.dataCb == nullptr || buffer.dataCr == nullptr || buffer.chromaStep == 0) {
+            return BAD_VALUE;
+        }
+    } else {
+        switch (static_cast<int>(buffer.format)) {
+            case HAL_PIXEL_FORMAT_RGBA_8888:
+            case HAL_PIXEL_FORMAT_RGBX_8888:
+            case HAL_PIXEL_FORMAT_RGB_565:
+                break;
+            default:
+                ALOGE("convertToRgba8888: unsupported format %#x", buffer.format);
+                return BAD_VALUE;
+        }
+    }
+
+    // Split the rows in bands of about the same height. Small buffers are
+    // converted on the calling thread only.
+    const uint32_t height = buffer.height;
+    const size_t pixelCount = static_cast<size_t>(buffer.width) * height;
+    const size_t maxBandCount =
+            std::min<size_t>(std::max<size_t>(pixelCount / kMinPixelsPerThread, 1),
+                             std::max(height, 1u));
+    const uint32_t bandCount =
+            static_cast<uint32_t>(std::clamp<size_t>(threadCount, 1, maxBandCount));
+    if (bandCount == 1) {
+        convertRows(buffer, dst, dstStride, 0, height);
+    } else {
+        RowConversionPool::getInstance().convert(buffer, dst, dstStride, bandCount);
+    }
+    return OK;
+}
+
 } // namespace android
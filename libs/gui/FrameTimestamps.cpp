@@ -20,13 +20,23 @@
 
 #include <LibGuiProperties.sysprop.h>
 #include <android-base/stringprintf.h>
+#include <cutils/ashmem.h>
 #include <cutils/compiler.h>  // For CC_[UN]LIKELY
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <utils/Log.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <limits>
 #include <numeric>
+#include <thread>
 
 namespace android {
 
@@ -152,6 +162,324 @@ void FrameEvents::dump(std::string& outString) const {
 }
 
 
+// ============================================================================
+// FrameTimestampsRing
+// ============================================================================
+
+namespace {
+
+constexpr uint32_t kTimestampsRingMagic = 0x46545352; // "FTSR"
+constexpr uint32_t kTimestampsRingVersion = 1;
+
+constexpr uint32_t kPostCompositeCalledFlag = 1 << 0;
+constexpr uint32_t kReleaseCalledFlag = 1 << 1;
+
+// Marks a slot no frame has been published to.
+constexpr uint64_t kNoFrameNumber = std::numeric_limits<uint64_t>::max();
+
+// The consumer only holds a slot for a few stores, so a reader losing the
+// race this many times in a row is better off asking for a delta.
+constexpr int kMaxReadAttempts = 3;
+
+// The slots are shared with another process, so their atomics must not need
+// a lock.
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<nsecs_t>::is_always_lock_free);
+
+// Waits for fences which are expected to signal in FIFO order, like the
+// fences of one timeline, and publishes their signal times. Like FenceMonitor
+// in Surface.cpp, the thread lives as long as the process.
+class SignalTimePublisher {
+public:
+    explicit SignalTimePublisher(const char* name) {
+        std::thread thread(&SignalTimePublisher::loop, this);
+        pthread_setname_np(thread.native_handle(), name);
+        thread.detach();
+    }
+
+    void queue(const std::shared_ptr<FrameTimestampsRing>& ring, uint64_t frameNumber,
+               FrameTimestampsRing::SignalTime which, const std::shared_ptr<FenceTime>& fence) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push_back({ring, frameNumber, which, fence});
+        mCondition.notify_one();
+    }
+
+private:
+    struct Entry {
+        std::weak_ptr<FrameTimestampsRing> ring;
+        uint64_t frameNumber;
+        FrameTimestampsRing::SignalTime which;
+        std::shared_ptr<FenceTime> fence;
+    };
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wmissing-noreturn"
+    void loop() {
+        while (true) {
+            threadLoop();
+        }
+    }
+#pragma clang diagnostic pop
+
+    void threadLoop() {
+        Entry entry;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while (mQueue.empty()) {
+                mCondition.wait(lock);
+            }
+            entry = std::move(mQueue.front());
+            mQueue.pop_front();
+        }
+        // Don't wait for a fence nobody can read the signal time of anymore.
+        if (entry.ring.expired()) {
+            return;
+        }
+        status_t result = entry.fence->wait(Fence::TIMEOUT_NEVER);
+        if (result != NO_ERROR) {
+            ALOGE("SignalTimePublisher: Error waiting for fence: %d", result);
+        }
+        const nsecs_t signalTime = entry.fence->getSignalTime();
+        if (signalTime == Fence::SIGNAL_TIME_PENDING) {
+            return;
+        }
+        if (std::shared_ptr<FrameTimestampsRing> ring = entry.ring.lock()) {
+            ring->publishSignalTime(entry.frameNumber, entry.which, signalTime);
+        }
+    }
+
+    std::deque<Entry> mQueue;
+    std::condition_variable mCondition;
+    std::mutex mMutex;
+};
+
+// The publishers are never destroyed, since their threads never exit.
+SignalTimePublisher& getSignalTimePublisher(FrameTimestampsRing::SignalTime which) {
+    static SignalTimePublisher* gpuCompositionDonePublisher =
+            new SignalTimePublisher("FTS GPU done");
+    static SignalTimePublisher* displayPresentPublisher = new SignalTimePublisher("FTS present");
+    static SignalTimePublisher* releasePublisher = new SignalTimePublisher("FTS release");
+    switch (which) {
+        case FrameTimestampsRing::SignalTime::GPU_COMPOSITION_DONE:
+            return *gpuCompositionDonePublisher;
+        case FrameTimestampsRing::SignalTime::DISPLAY_PRESENT:
+            return *displayPresentPublisher;
+        case FrameTimestampsRing::SignalTime::RELEASE:
+            return *releasePublisher;
+    }
+    LOG_ALWAYS_FATAL("Invalid signal time %d", static_cast<int>(which));
+}
+
+} // namespace
+
+// Written by the consumer before the region is shared, and never after.
+struct FrameTimestampsRing::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+};
+
+// Every field is atomic so that reading a slot while it is written is well
+// defined. The sequence is odd while the slot is written.
+struct FrameTimestampsRing::Slot {
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint32_t> flags{0};
+    std::atomic<uint64_t> frameNumber{kNoFrameNumber};
+    std::atomic<nsecs_t> latchTime{FrameEvents::TIMESTAMP_PENDING};
+    std::atomic<nsecs_t> firstRefreshStartTime{FrameEvents::TIMESTAMP_PENDING};
+    std::atomic<nsecs_t> lastRefreshStartTime{FrameEvents::TIMESTAMP_PENDING};
+    std::atomic<nsecs_t> dequeueReadyTime{FrameEvents::TIMESTAMP_PENDING};
+    std::atomic<nsecs_t> gpuCompositionDoneTime{Fence::SIGNAL_TIME_INVALID};
+    std::atomic<nsecs_t> displayPresentTime{Fence::SIGNAL_TIME_INVALID};
+    std::atomic<nsecs_t> releaseTime{Fence::SIGNAL_TIME_INVALID};
+};
+
+size_t FrameTimestampsRing::getRegionSize(size_t capacity) {
+    return sizeof(Header) + capacity * sizeof(Slot);
+}
+
+std::shared_ptr<FrameTimestampsRing> FrameTimestampsRing::create(size_t capacity) {
+    const size_t size = getRegionSize(capacity);
+    base::unique_fd fd(ashmem_create_region("FrameTimestampsRing", size));
+    if (fd < 0) {
+        ALOGE("FrameTimestampsRing: Failed to create region: %s", strerror(errno));
+        return nullptr;
+    }
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("FrameTimestampsRing: Failed to map region: %s", strerror(errno));
+        return nullptr;
+    }
+    // Only the consumer writes to the ring, through the mapping above.
+    if (ashmem_set_prot_region(fd, PROT_READ) < 0) {
+        ALOGE("FrameTimestampsRing: Failed to protect region: %s", strerror(errno));
+        munmap(base, size);
+        return nullptr;
+    }
+
+    Header* header = new (base) Header{kTimestampsRingMagic, kTimestampsRingVersion, capacity};
+    Slot* slots = reinterpret_cast<Slot*>(header + 1);
+    for (size_t i = 0; i < capacity; i++) {
+        new (&slots[i]) Slot;
+    }
+    return std::shared_ptr<FrameTimestampsRing>(
+            new FrameTimestampsRing(std::move(fd), base, size));
+}
+
+std::shared_ptr<const FrameTimestampsRing> FrameTimestampsRing::map(base::unique_fd fd) {
+    const int size = ashmem_get_size_region(fd);
+    if (size < static_cast<int>(sizeof(Header))) {
+        ALOGE("FrameTimestampsRing: Invalid region size %d", size);
+        return nullptr;
+    }
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("FrameTimestampsRing: Failed to map region: %s", strerror(errno));
+        return nullptr;
+    }
+    const Header* header = static_cast<const Header*>(base);
+    if (header->magic != kTimestampsRingMagic || header->version != kTimestampsRingVersion ||
+        header->capacity == 0 || header->capacity != (size - sizeof(Header)) / sizeof(Slot) ||
+        getRegionSize(header->capacity) != static_cast<size_t>(size)) {
+        ALOGE("FrameTimestampsRing: Region isn't a ring");
+        munmap(base, size);
+        return nullptr;
+    }
+    return std::shared_ptr<const FrameTimestampsRing>(
+            new FrameTimestampsRing(std::move(fd), base, size));
+}
+
+FrameTimestampsRing::FrameTimestampsRing(base::unique_fd fd, void* base, size_t size)
+      : mFd(std::move(fd)),
+        mBase(base),
+        mSize(size),
+        mCapacity(static_cast<const Header*>(base)->capacity),
+        mSlots(reinterpret_cast<Slot*>(static_cast<Header*>(base) + 1)) {}
+
+FrameTimestampsRing::~FrameTimestampsRing() {
+    munmap(mBase, mSize);
+}
+
+base::unique_fd FrameTimestampsRing::dupFd() const {
+    return base::unique_fd(fcntl(mFd, F_DUPFD_CLOEXEC, 0));
+}
+
+static void beginWrite(std::atomic<uint32_t>* sequence) {
+    sequence->store(sequence->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+static void endWrite(std::atomic<uint32_t>* sequence) {
+    sequence->store(sequence->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void FrameTimestampsRing::publish(const Record& record) {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    Slot& slot = mSlots[record.frameNumber % mCapacity];
+
+    // Keep the signal times the publishers got to first.
+    const bool sameFrame = slot.frameNumber.load(std::memory_order_relaxed) == record.frameNumber;
+    auto keepPublished = [sameFrame](const std::atomic<nsecs_t>& published, nsecs_t time) {
+        return (sameFrame && time == Fence::SIGNAL_TIME_PENDING)
+                ? published.load(std::memory_order_relaxed)
+                : time;
+    };
+    const nsecs_t gpuCompositionDoneTime =
+            keepPublished(slot.gpuCompositionDoneTime, record.gpuCompositionDoneTime);
+    const nsecs_t displayPresentTime =
+            keepPublished(slot.displayPresentTime, record.displayPresentTime);
+    const nsecs_t releaseTime = keepPublished(slot.releaseTime, record.releaseTime);
+
+    beginWrite(&slot.sequence);
+    slot.frameNumber.store(record.frameNumber, std::memory_order_relaxed);
+    slot.flags.store((record.addPostCompositeCalled ? kPostCompositeCalledFlag : 0) |
+                             (record.addReleaseCalled ? kReleaseCalledFlag : 0),
+                     std::memory_order_relaxed);
+    slot.latchTime.store(record.latchTime, std::memory_order_relaxed);
+    slot.firstRefreshStartTime.store(record.firstRefreshStartTime, std::memory_order_relaxed);
+    slot.lastRefreshStartTime.store(record.lastRefreshStartTime, std::memory_order_relaxed);
+    slot.dequeueReadyTime.store(record.dequeueReadyTime, std::memory_order_relaxed);
+    slot.gpuCompositionDoneTime.store(gpuCompositionDoneTime, std::memory_order_relaxed);
+    slot.displayPresentTime.store(displayPresentTime, std::memory_order_relaxed);
+    slot.releaseTime.store(releaseTime, std::memory_order_relaxed);
+    endWrite(&slot.sequence);
+}
+
+void FrameTimestampsRing::publishSignalTime(uint64_t frameNumber, SignalTime which,
+        nsecs_t signalTime) {
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    Slot& slot = mSlots[frameNumber % mCapacity];
+    if (slot.frameNumber.load(std::memory_order_relaxed) != frameNumber) {
+        return;
+    }
+
+    std::atomic<nsecs_t>* published = nullptr;
+    switch (which) {
+        case SignalTime::GPU_COMPOSITION_DONE:
+            published = &slot.gpuCompositionDoneTime;
+            break;
+        case SignalTime::DISPLAY_PRESENT:
+            published = &slot.displayPresentTime;
+            break;
+        case SignalTime::RELEASE:
+            published = &slot.releaseTime;
+            break;
+    }
+    beginWrite(&slot.sequence);
+    published->store(signalTime, std::memory_order_relaxed);
+    endWrite(&slot.sequence);
+}
+
+void FrameTimestampsRing::publishSignalTimeWhenSignaled(
+        const std::shared_ptr<FrameTimestampsRing>& ring, uint64_t frameNumber,
+        SignalTime which, const std::shared_ptr<FenceTime>& fence) {
+    if (!fence->isValid()) {
+        return;
+    }
+    const nsecs_t signalTime = fence->getCachedSignalTime();
+    if (signalTime != Fence::SIGNAL_TIME_PENDING) {
+        ring->publishSignalTime(frameNumber, which, signalTime);
+        return;
+    }
+    getSignalTimePublisher(which).queue(ring, frameNumber, which, fence);
+}
+
+bool FrameTimestampsRing::read(uint64_t frameNumber, Record* outRecord) const {
+    const Slot& slot = mSlots[frameNumber % mCapacity];
+    for (int attempt = 0; attempt < kMaxReadAttempts; attempt++) {
+        const uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            continue;
+        }
+
+        Record record;
+        record.frameNumber = slot.frameNumber.load(std::memory_order_relaxed);
+        const uint32_t flags = slot.flags.load(std::memory_order_relaxed);
+        record.addPostCompositeCalled = (flags & kPostCompositeCalledFlag) != 0;
+        record.addReleaseCalled = (flags & kReleaseCalledFlag) != 0;
+        record.latchTime = slot.latchTime.load(std::memory_order_relaxed);
+        record.firstRefreshStartTime = slot.firstRefreshStartTime.load(std::memory_order_relaxed);
+        record.lastRefreshStartTime = slot.lastRefreshStartTime.load(std::memory_order_relaxed);
+        record.dequeueReadyTime = slot.dequeueReadyTime.load(std::memory_order_relaxed);
+        record.gpuCompositionDoneTime = slot.gpuCompositionDoneTime.load(std::memory_order_relaxed);
+        record.displayPresentTime = slot.displayPresentTime.load(std::memory_order_relaxed);
+        record.releaseTime = slot.releaseTime.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+        if (record.frameNumber != frameNumber) {
+            return false;
+        }
+        *outRecord = record;
+        return true;
+    }
+    return false;
+}
+
+
 // ============================================================================
 // FrameEventHistory
 // ============================================================================
@@ -349,6 +677,60 @@ std::shared_ptr<FenceTime> ProducerFrameEventHistory::createFenceTime(
     return std::make_shared<FenceTime>(fence);
 }
 
+void ProducerFrameEventHistory::setTimestampsRing(
+        std::shared_ptr<const FrameTimestampsRing> ring) {
+    mTimestampsRing = std::move(ring);
+}
+
+static void applyPublishedSignalTime(std::shared_ptr<FenceTime>* dst,
+        nsecs_t signalTime) {
+    // Keep a fence from an earlier delta, which signals on its own.
+    if ((*dst)->isValid()) {
+        return;
+    }
+    *dst = (signalTime == Fence::SIGNAL_TIME_INVALID)
+            ? FenceTime::NO_FENCE
+            : std::make_shared<FenceTime>(signalTime);
+}
+
+bool ProducerFrameEventHistory::applyPublishedTimestamps(uint64_t frameNumber) {
+    if (mTimestampsRing == nullptr) {
+        return false;
+    }
+    FrameEvents* frame = getFrame(frameNumber);
+    if (frame == nullptr) {
+        return false;
+    }
+    FrameTimestampsRing::Record record;
+    if (!mTimestampsRing->read(frameNumber, &record)) {
+        return false;
+    }
+
+    frame->latchTime = record.latchTime;
+    frame->firstRefreshStartTime = record.firstRefreshStartTime;
+    frame->lastRefreshStartTime = record.lastRefreshStartTime;
+    frame->dequeueReadyTime = record.dequeueReadyTime;
+
+    // A pending fence can't be made from a signal time, so the frame is only
+    // marked composited or released once the consumer published the signal
+    // times of its fences. Until then they are reported pending.
+    if (record.addPostCompositeCalled &&
+            record.gpuCompositionDoneTime != Fence::SIGNAL_TIME_PENDING &&
+            record.displayPresentTime != Fence::SIGNAL_TIME_PENDING) {
+        frame->addPostCompositeCalled = true;
+        applyPublishedSignalTime(&frame->gpuCompositionDoneFence,
+                record.gpuCompositionDoneTime);
+        applyPublishedSignalTime(&frame->displayPresentFence,
+                record.displayPresentTime);
+    }
+    if (record.addReleaseCalled &&
+            record.releaseTime != Fence::SIGNAL_TIME_PENDING) {
+        frame->addReleaseCalled = true;
+        applyPublishedSignalTime(&frame->releaseFence, record.releaseTime);
+    }
+    return true;
+}
+
 
 // ============================================================================
 // ConsumerFrameEventHistory
@@ -388,6 +770,7 @@ void ConsumerFrameEventHistory::addQueue(const NewFrameEventsEntry& newEntry) {
     // they have the original one already, so there is no need to set the
     // acquire dirty bit.
     mFramesDirty[mQueueOffset].setDirty<FrameEvent::POSTED>();
+    publishFrame(mFrames[mQueueOffset]);
 
     mQueueOffset = (mQueueOffset + 1) % mFrames.size();
 }
@@ -401,6 +784,7 @@ void ConsumerFrameEventHistory::addLatch(
     }
     frame->latchTime = latchTime;
     mFramesDirty[mCompositionOffset].setDirty<FrameEvent::LATCH>();
+    publishFrame(*frame);
 }
 
 void ConsumerFrameEventHistory::addPreComposition(
@@ -417,6 +801,7 @@ void ConsumerFrameEventHistory::addPreComposition(
         frame->firstRefreshStartTime = refreshStartTime;
         mFramesDirty[mCompositionOffset].setDirty<FrameEvent::FIRST_REFRESH_START>();
     }
+    publishFrame(*frame);
 }
 
 void ConsumerFrameEventHistory::addPostComposition(uint64_t frameNumber,
@@ -440,6 +825,15 @@ void ConsumerFrameEventHistory::addPostComposition(uint64_t frameNumber,
             frame->displayPresentFence = displayPresent;
             mFramesDirty[mCompositionOffset].setDirty<FrameEvent::DISPLAY_PRESENT>();
         }
+        publishFrame(*frame);
+        if (mTimestampsRing != nullptr && frame->connectId == mCurrentConnectId) {
+            FrameTimestampsRing::publishSignalTimeWhenSignaled(mTimestampsRing,
+                    frameNumber, FrameTimestampsRing::SignalTime::GPU_COMPOSITION_DONE,
+                    frame->gpuCompositionDoneFence);
+            FrameTimestampsRing::publishSignalTimeWhenSignaled(mTimestampsRing,
+                    frameNumber, FrameTimestampsRing::SignalTime::DISPLAY_PRESENT,
+                    frame->displayPresentFence);
+        }
     }
 }
 
@@ -454,6 +848,38 @@ void ConsumerFrameEventHistory::addRelease(uint64_t frameNumber,
     frame->dequeueReadyTime = dequeueReadyTime;
     frame->releaseFence = std::move(release);
     mFramesDirty[mReleaseOffset].setDirty<FrameEvent::RELEASE>();
+    publishFrame(*frame);
+    if (mTimestampsRing != nullptr && frame->connectId == mCurrentConnectId) {
+        FrameTimestampsRing::publishSignalTimeWhenSignaled(mTimestampsRing,
+                frameNumber, FrameTimestampsRing::SignalTime::RELEASE,
+                frame->releaseFence);
+    }
+}
+
+void ConsumerFrameEventHistory::setTimestampsRing(
+        std::shared_ptr<FrameTimestampsRing> ring) {
+    mTimestampsRing = std::move(ring);
+}
+
+void ConsumerFrameEventHistory::publishFrame(const FrameEvents& frame) {
+    // Like deltas, only publish the frames of the current connection.
+    if (mTimestampsRing == nullptr || frame.connectId != mCurrentConnectId) {
+        return;
+    }
+    // Fences which haven't signaled yet are published by the signal time
+    // publishers, rather than polled here.
+    FrameTimestampsRing::Record record;
+    record.frameNumber = frame.frameNumber;
+    record.addPostCompositeCalled = frame.addPostCompositeCalled;
+    record.addReleaseCalled = frame.addReleaseCalled;
+    record.latchTime = frame.latchTime;
+    record.firstRefreshStartTime = frame.firstRefreshStartTime;
+    record.lastRefreshStartTime = frame.lastRefreshStartTime;
+    record.dequeueReadyTime = frame.dequeueReadyTime;
+    record.gpuCompositionDoneTime = frame.gpuCompositionDoneFence->getCachedSignalTime();
+    record.displayPresentTime = frame.displayPresentFence->getCachedSignalTime();
+    record.releaseTime = frame.releaseFence->getCachedSignalTime();
+    mTimestampsRing->publish(record);
 }
 
 void ConsumerFrameEventHistory::getFrameDelta(FrameEventHistoryDelta* delta,
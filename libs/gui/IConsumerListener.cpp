@@ -85,6 +85,11 @@ public:
                                   FrameEventHistoryDelta* /*outDelta*/) override {
         LOG_ALWAYS_FATAL("IConsumerListener::addAndGetFrameTimestamps cannot be proxied");
     }
+
+    status_t getFrameTimestampsRing(base::unique_fd* /*outRing*/) override {
+        // A consumer in another process doesn't share its frame events.
+        return INVALID_OPERATION;
+    }
 };
 
 // Out-of-line virtual method definitions to trigger vtable emission in this translation unit (see
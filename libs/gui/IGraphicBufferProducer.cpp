@@ -82,6 +82,7 @@ enum {
     CANCEL_BUFFERS,
     QUERY_MULTIPLE,
     GET_LAST_QUEUED_BUFFER2,
+    GET_FRAME_TIMESTAMPS_RING,
 };
 
 class BpGraphicBufferProducer : public BpInterface<IGraphicBufferProducer>
@@ -717,6 +718,26 @@ public:
         }
     }
 
+    virtual status_t getFrameTimestampsRing(base::unique_fd* outRing) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        status_t result = remote()->transact(GET_FRAME_TIMESTAMPS_RING, data, &reply);
+        if (result != NO_ERROR) {
+            ALOGE("IGBP::getFrameTimestampsRing failed to transact: %d", result);
+            return result;
+        }
+        status_t remoteError = NO_ERROR;
+        result = reply.readInt32(&remoteError);
+        if (result != NO_ERROR) {
+            ALOGE("IGBP::getFrameTimestampsRing failed to read status: %d", result);
+            return result;
+        }
+        if (remoteError != NO_ERROR) {
+            return remoteError;
+        }
+        return reply.readUniqueFileDescriptor(outRing);
+    }
+
     virtual status_t getUniqueId(uint64_t* outId) const {
         Parcel data, reply;
         data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
@@ -930,6 +951,10 @@ public:
         return mBase->getFrameTimestamps(outDelta);
     }
 
+    status_t getFrameTimestampsRing(base::unique_fd* outRing) override {
+        return mBase->getFrameTimestampsRing(outRing);
+    }
+
     status_t getUniqueId(uint64_t* outId) const override {
         return mBase->getUniqueId(outId);
     }
@@ -1469,6 +1494,21 @@ status_t BnGraphicBufferProducer::onTransact(
             }
             return NO_ERROR;
         }
+        case GET_FRAME_TIMESTAMPS_RING: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            base::unique_fd ring;
+            status_t result = getFrameTimestampsRing(&ring);
+            reply->writeInt32(result);
+            if (result != NO_ERROR) {
+                return NO_ERROR;
+            }
+            result = reply->writeUniqueFileDescriptor(ring);
+            if (result != NO_ERROR) {
+                ALOGE("BnGBP::GET_FRAME_TIMESTAMPS_RING failed to write ring: %d", result);
+                return result;
+            }
+            return NO_ERROR;
+        }
         case GET_UNIQUE_ID: {
             CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
             uint64_t outId = 0;
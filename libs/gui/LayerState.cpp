@@ -18,6 +18,8 @@
 
 #include <cinttypes>
 #include <cmath>
+#include <cstring>
+#include <type_traits>
 
 #include <android/native_window.h>
 #include <binder/Parcel.h>
@@ -74,87 +76,392 @@ layer_state_t::layer_state_t()
     hdrMetadata.validTypes = 0;
 }
 
+namespace {
+
+// The version of the layout of the block of plain fields, which changes whenever fields are added,
+// removed or reordered.
+constexpr uint32_t kPlainFieldsVersion = 1;
+
+// Counts the bytes taken by the plain fields written by writePlainFields.
+class PlainFieldsSizeCounter {
+public:
+    template <typename T>
+    void write(const T&) {
+        mSize += sizeof(T);
+    }
+    size_t size() const { return mSize; }
+
+private:
+    size_t mSize = 0;
+};
+
+// Writes the plain fields in place, into memory reserved in the parcel.
+class PlainFieldsWriter {
+public:
+    explicit PlainFieldsWriter(void* data) : mData(static_cast<uint8_t*>(data)) {}
+
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        memcpy(mData, &value, sizeof(T));
+        mData += sizeof(T);
+    }
+
+private:
+    uint8_t* mData;
+};
+
+// Reads the plain fields in place, from the memory of the parcel.
+class PlainFieldsReader {
+public:
+    PlainFieldsReader(const void* data, size_t size)
+          : mData(static_cast<const uint8_t*>(data)), mSize(size) {}
+
+    template <typename T>
+    status_t read(T* value) {
+        static_assert(std::is_trivially_copyable_v<T> && !std::is_same_v<T, bool>);
+        if (sizeof(T) > mSize - mOffset) {
+            return BAD_VALUE;
+        }
+        memcpy(value, mData + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return NO_ERROR;
+    }
+
+    status_t readBool(bool* value) {
+        uint8_t byte = 0;
+        SAFE_PARCEL(read, &byte);
+        *value = byte != 0;
+        return NO_ERROR;
+    }
+
+    status_t readRect(Rect* rect) {
+        SAFE_PARCEL(read, &rect->left);
+        SAFE_PARCEL(read, &rect->top);
+        SAFE_PARCEL(read, &rect->right);
+        SAFE_PARCEL(read, &rect->bottom);
+        return NO_ERROR;
+    }
+
+    size_t remaining() const { return mSize - mOffset; }
+
+private:
+    const uint8_t* mData;
+    const size_t mSize;
+    size_t mOffset = 0;
+};
+
+template <typename Writer>
+void writeRect(Writer& writer, const Rect& rect) {
+    writer.write(rect.left);
+    writer.write(rect.top);
+    writer.write(rect.right);
+    writer.write(rect.bottom);
+}
+
+// Writes the plain fields of the properties changed by the state, in the order of readPlainFields.
+template <typename Writer>
+void writePlainFields(Writer& writer, const layer_state_t& s) {
+    const uint64_t what = s.what;
+    writer.write(kPlainFieldsVersion);
+    if (what & layer_state_t::ePositionChanged) {
+        writer.write(s.x);
+        writer.write(s.y);
+    }
+    if (what & (layer_state_t::eLayerChanged | layer_state_t::eRelativeLayerChanged)) {
+        writer.write(s.z);
+    }
+    if (what & layer_state_t::eSizeChanged) {
+        writer.write(s.w);
+        writer.write(s.h);
+    }
+    if (what & layer_state_t::eLayerStackChanged) {
+        writer.write(s.layerStack.id);
+    }
+    if (what & layer_state_t::eAlphaChanged) {
+        writer.write(s.alpha);
+    }
+    if (what & layer_state_t::eFlagsChanged) {
+        writer.write(s.flags);
+        writer.write(s.mask);
+    }
+    if (what & layer_state_t::eMatrixChanged) {
+        writer.write(s.matrix.dsdx);
+        writer.write(s.matrix.dtdx);
+        writer.write(s.matrix.dtdy);
+        writer.write(s.matrix.dsdy);
+    }
+    if (what & layer_state_t::eCropChanged) {
+        writeRect(writer, s.crop);
+    }
+    if (what & (layer_state_t::eColorChanged | layer_state_t::eBackgroundColorChanged)) {
+        writer.write(static_cast<float>(s.color.r));
+        writer.write(static_cast<float>(s.color.g));
+        writer.write(static_cast<float>(s.color.b));
+    }
+    if (what & layer_state_t::eBackgroundColorChanged) {
+        writer.write(s.bgColorAlpha);
+        writer.write(static_cast<uint32_t>(s.bgColorDataspace));
+    }
+    if (what & layer_state_t::eTransformChanged) {
+        writer.write(s.transform);
+    }
+    if (what & layer_state_t::eTransformToDisplayInverseChanged) {
+        writer.write(static_cast<uint8_t>(s.transformToDisplayInverse));
+    }
+    if (what & layer_state_t::eDataspaceChanged) {
+        writer.write(static_cast<uint32_t>(s.dataspace));
+    }
+    if (what & layer_state_t::eApiChanged) {
+        writer.write(s.api);
+    }
+    if (what & layer_state_t::eColorTransformChanged) {
+        const float* colorTransform = s.colorTransform.asArray();
+        for (size_t i = 0; i < 16; i++) {
+            writer.write(colorTransform[i]);
+        }
+    }
+    if (what & layer_state_t::eCornerRadiusChanged) {
+        writer.write(s.cornerRadius);
+    }
+    if (what & layer_state_t::eBackgroundBlurRadiusChanged) {
+        writer.write(s.backgroundBlurRadius);
+    }
+    if (what & layer_state_t::eColorSpaceAgnosticChanged) {
+        writer.write(static_cast<uint8_t>(s.colorSpaceAgnostic));
+    }
+    if (what & layer_state_t::eShadowRadiusChanged) {
+        writer.write(s.shadowRadius);
+    }
+    if (what & layer_state_t::eFrameRateSelectionPriority) {
+        writer.write(s.frameRateSelectionPriority);
+    }
+    if (what & layer_state_t::eFrameRateChanged) {
+        writer.write(s.frameRate);
+        writer.write(s.frameRateCompatibility);
+        writer.write(s.changeFrameRateStrategy);
+    }
+    if (what & layer_state_t::eFixedTransformHintChanged) {
+        writer.write(static_cast<uint32_t>(s.fixedTransformHint));
+    }
+    if (what & layer_state_t::eAutoRefreshChanged) {
+        writer.write(static_cast<uint8_t>(s.autoRefresh));
+    }
+    if (what & layer_state_t::eDimmingEnabledChanged) {
+        writer.write(static_cast<uint8_t>(s.dimmingEnabled));
+    }
+    if (what & layer_state_t::eBlurRegionsChanged) {
+        writer.write(static_cast<uint32_t>(s.blurRegions.size()));
+        for (const BlurRegion& region : s.blurRegions) {
+            writer.write(region);
+        }
+    }
+    if (what & layer_state_t::eBufferCropChanged) {
+        writeRect(writer, s.bufferCrop);
+    }
+    if (what & layer_state_t::eDestinationFrameChanged) {
+        writeRect(writer, s.destinationFrame);
+    }
+    if (what & layer_state_t::eTrustedOverlayChanged) {
+        writer.write(static_cast<uint8_t>(s.isTrustedOverlay));
+    }
+    if (what & layer_state_t::eDropInputModeChanged) {
+        writer.write(static_cast<uint32_t>(s.dropInputMode));
+    }
+}
+
+status_t readPlainFields(PlainFieldsReader& reader, layer_state_t& s) {
+    const uint64_t what = s.what;
+    uint32_t version = 0;
+    SAFE_PARCEL(reader.read, &version);
+    if (version != kPlainFieldsVersion) {
+        ALOGE("Unexpected layer state version %" PRIu32 ", expected %" PRIu32, version,
+              kPlainFieldsVersion);
+        return BAD_VALUE;
+    }
+
+    uint32_t tmpUint32 = 0;
+    if (what & layer_state_t::ePositionChanged) {
+        SAFE_PARCEL(reader.read, &s.x);
+        SAFE_PARCEL(reader.read, &s.y);
+    }
+    if (what & (layer_state_t::eLayerChanged | layer_state_t::eRelativeLayerChanged)) {
+        SAFE_PARCEL(reader.read, &s.z);
+    }
+    if (what & layer_state_t::eSizeChanged) {
+        SAFE_PARCEL(reader.read, &s.w);
+        SAFE_PARCEL(reader.read, &s.h);
+    }
+    if (what & layer_state_t::eLayerStackChanged) {
+        SAFE_PARCEL(reader.read, &s.layerStack.id);
+    }
+    if (what & layer_state_t::eAlphaChanged) {
+        SAFE_PARCEL(reader.read, &s.alpha);
+    }
+    if (what & layer_state_t::eFlagsChanged) {
+        SAFE_PARCEL(reader.read, &s.flags);
+        SAFE_PARCEL(reader.read, &s.mask);
+    }
+    if (what & layer_state_t::eMatrixChanged) {
+        SAFE_PARCEL(reader.read, &s.matrix.dsdx);
+        SAFE_PARCEL(reader.read, &s.matrix.dtdx);
+        SAFE_PARCEL(reader.read, &s.matrix.dtdy);
+        SAFE_PARCEL(reader.read, &s.matrix.dsdy);
+    }
+    if (what & layer_state_t::eCropChanged) {
+        SAFE_PARCEL(reader.readRect, &s.crop);
+    }
+    if (what & (layer_state_t::eColorChanged | layer_state_t::eBackgroundColorChanged)) {
+        float tmpFloat = 0;
+        SAFE_PARCEL(reader.read, &tmpFloat);
+        s.color.r = tmpFloat;
+        SAFE_PARCEL(reader.read, &tmpFloat);
+        s.color.g = tmpFloat;
+        SAFE_PARCEL(reader.read, &tmpFloat);
+        s.color.b = tmpFloat;
+    }
+    if (what & layer_state_t::eBackgroundColorChanged) {
+        SAFE_PARCEL(reader.read, &s.bgColorAlpha);
+        SAFE_PARCEL(reader.read, &tmpUint32);
+        s.bgColorDataspace = static_cast<ui::Dataspace>(tmpUint32);
+    }
+    if (what & layer_state_t::eTransformChanged) {
+        SAFE_PARCEL(reader.read, &s.transform);
+    }
+    if (what & layer_state_t::eTransformToDisplayInverseChanged) {
+        SAFE_PARCEL(reader.readBool, &s.transformToDisplayInverse);
+    }
+    if (what & layer_state_t::eDataspaceChanged) {
+        SAFE_PARCEL(reader.read, &tmpUint32);
+        s.dataspace = static_cast<ui::Dataspace>(tmpUint32);
+    }
+    if (what & layer_state_t::eApiChanged) {
+        SAFE_PARCEL(reader.read, &s.api);
+    }
+    if (what & layer_state_t::eColorTransformChanged) {
+        float colorTransform[16];
+        for (float& value : colorTransform) {
+            SAFE_PARCEL(reader.read, &value);
+        }
+        s.colorTransform = mat4(colorTransform);
+    }
+    if (what & layer_state_t::eCornerRadiusChanged) {
+        SAFE_PARCEL(reader.read, &s.cornerRadius);
+    }
+    if (what & layer_state_t::eBackgroundBlurRadiusChanged) {
+        SAFE_PARCEL(reader.read, &s.backgroundBlurRadius);
+    }
+    if (what & layer_state_t::eColorSpaceAgnosticChanged) {
+        SAFE_PARCEL(reader.readBool, &s.colorSpaceAgnostic);
+    }
+    if (what & layer_state_t::eShadowRadiusChanged) {
+        SAFE_PARCEL(reader.read, &s.shadowRadius);
+    }
+    if (what & layer_state_t::eFrameRateSelectionPriority) {
+        SAFE_PARCEL(reader.read, &s.frameRateSelectionPriority);
+    }
+    if (what & layer_state_t::eFrameRateChanged) {
+        SAFE_PARCEL(reader.read, &s.frameRate);
+        SAFE_PARCEL(reader.read, &s.frameRateCompatibility);
+        SAFE_PARCEL(reader.read, &s.changeFrameRateStrategy);
+    }
+    if (what & layer_state_t::eFixedTransformHintChanged) {
+        SAFE_PARCEL(reader.read, &tmpUint32);
+        s.fixedTransformHint = static_cast<ui::Transform::RotationFlags>(tmpUint32);
+    }
+    if (what & layer_state_t::eAutoRefreshChanged) {
+        SAFE_PARCEL(reader.readBool, &s.autoRefresh);
+    }
+    if (what & layer_state_t::eDimmingEnabledChanged) {
+        SAFE_PARCEL(reader.readBool, &s.dimmingEnabled);
+    }
+    if (what & layer_state_t::eBlurRegionsChanged) {
+        uint32_t numRegions = 0;
+        SAFE_PARCEL(reader.read, &numRegions);
+        if (numRegions > reader.remaining() / sizeof(BlurRegion)) {
+            return BAD_VALUE;
+        }
+        s.blurRegions.resize(numRegions);
+        for (BlurRegion& region : s.blurRegions) {
+            SAFE_PARCEL(reader.read, &region);
+        }
+    }
+    if (what & layer_state_t::eBufferCropChanged) {
+        SAFE_PARCEL(reader.readRect, &s.bufferCrop);
+    }
+    if (what & layer_state_t::eDestinationFrameChanged) {
+        SAFE_PARCEL(reader.readRect, &s.destinationFrame);
+    }
+    if (what & layer_state_t::eTrustedOverlayChanged) {
+        SAFE_PARCEL(reader.readBool, &s.isTrustedOverlay);
+    }
+    if (what & layer_state_t::eDropInputModeChanged) {
+        SAFE_PARCEL(reader.read, &tmpUint32);
+        s.dropInputMode = static_cast<gui::DropInputMode>(tmpUint32);
+    }
+    return NO_ERROR;
+}
+
+} // namespace
+
 status_t layer_state_t::write(Parcel& output) const
 {
     SAFE_PARCEL(output.writeStrongBinder, surface);
     SAFE_PARCEL(output.writeInt32, layerId);
     SAFE_PARCEL(output.writeUint64, what);
-    SAFE_PARCEL(output.writeFloat, x);
-    SAFE_PARCEL(output.writeFloat, y);
-    SAFE_PARCEL(output.writeInt32, z);
-    SAFE_PARCEL(output.writeUint32, w);
-    SAFE_PARCEL(output.writeUint32, h);
-    SAFE_PARCEL(output.writeUint32, layerStack.id);
-    SAFE_PARCEL(output.writeFloat, alpha);
-    SAFE_PARCEL(output.writeUint32, flags);
-    SAFE_PARCEL(output.writeUint32, mask);
-    SAFE_PARCEL(matrix.write, output);
-    SAFE_PARCEL(output.write, crop);
-    SAFE_PARCEL(SurfaceControl::writeNullableToParcel, output, reparentSurfaceControl);
-    SAFE_PARCEL(SurfaceControl::writeNullableToParcel, output, relativeLayerSurfaceControl);
-    SAFE_PARCEL(SurfaceControl::writeNullableToParcel, output, parentSurfaceControlForChild);
-    SAFE_PARCEL(output.writeFloat, color.r);
-    SAFE_PARCEL(output.writeFloat, color.g);
-    SAFE_PARCEL(output.writeFloat, color.b);
-    SAFE_PARCEL(windowInfoHandle->writeToParcel, &output);
-    SAFE_PARCEL(output.write, transparentRegion);
-    SAFE_PARCEL(output.writeUint32, transform);
-    SAFE_PARCEL(output.writeBool, transformToDisplayInverse);
-
-    SAFE_PARCEL(output.writeUint32, static_cast<uint32_t>(dataspace));
-    SAFE_PARCEL(output.write, hdrMetadata);
-    SAFE_PARCEL(output.write, surfaceDamageRegion);
-    SAFE_PARCEL(output.writeInt32, api);
-
-    if (sidebandStream) {
-        SAFE_PARCEL(output.writeBool, true);
-        SAFE_PARCEL(output.writeNativeHandle, sidebandStream->handle());
-    } else {
-        SAFE_PARCEL(output.writeBool, false);
+
+    // The plain fields of the changed properties are packed into a single block.
+    PlainFieldsSizeCounter sizeCounter;
+    writePlainFields(sizeCounter, *this);
+    SAFE_PARCEL(output.writeUint32, static_cast<uint32_t>(sizeCounter.size()));
+    void* plainFields = output.writeInplace(sizeCounter.size());
+    if (plainFields == nullptr) {
+        return NO_MEMORY;
     }
+    PlainFieldsWriter plainFieldsWriter(plainFields);
+    writePlainFields(plainFieldsWriter, *this);
 
-    SAFE_PARCEL(output.write, colorTransform.asArray(), 16 * sizeof(float));
-    SAFE_PARCEL(output.writeFloat, cornerRadius);
-    SAFE_PARCEL(output.writeUint32, backgroundBlurRadius);
-    SAFE_PARCEL(output.writeParcelable, metadata);
-    SAFE_PARCEL(output.writeFloat, bgColorAlpha);
-    SAFE_PARCEL(output.writeUint32, static_cast<uint32_t>(bgColorDataspace));
-    SAFE_PARCEL(output.writeBool, colorSpaceAgnostic);
-    SAFE_PARCEL(output.writeVectorSize, listeners);
+    // The other fields of the changed properties follow.
+    if (what & eRelativeLayerChanged) {
+        SAFE_PARCEL(SurfaceControl::writeNullableToParcel, output, relativeLayerSurfaceControl);
+    }
+    if (what & eReparent) {
+        SAFE_PARCEL(SurfaceControl::writeNullableToParcel, output, parentSurfaceControlForChild);
+    }
+    if (what & eInputInfoChanged) {
+        SAFE_PARCEL(windowInfoHandle->writeToParcel, &output);
+    }
+    if (what & eTransparentRegionChanged) {
+        SAFE_PARCEL(output.write, transparentRegion);
+    }
+    if (what & eHdrMetadataChanged) {
+        SAFE_PARCEL(output.write, hdrMetadata);
+    }
+    if (what & eSurfaceDamageRegionChanged) {
+        SAFE_PARCEL(output.write, surfaceDamageRegion);
+    }
+    if (what & eSidebandStreamChanged) {
+        if (sidebandStream) {
+            SAFE_PARCEL(output.writeBool, true);
+            SAFE_PARCEL(output.writeNativeHandle, sidebandStream->handle());
+        } else {
+            SAFE_PARCEL(output.writeBool, false);
+        }
+    }
+    if (what & eMetadataChanged) {
+        SAFE_PARCEL(output.writeParcelable, metadata);
+    }
+    if (what & eStretchChanged) {
+        SAFE_PARCEL(output.write, stretchEffect);
+    }
 
+    // The listeners and the buffer are looked at by SurfaceFlinger whether or not the state
+    // changes them.
+    SAFE_PARCEL(output.writeVectorSize, listeners);
     for (auto listener : listeners) {
         SAFE_PARCEL(output.writeStrongBinder, listener.transactionCompletedListener);
         SAFE_PARCEL(output.writeParcelableVector, listener.callbackIds);
     }
-    SAFE_PARCEL(output.writeFloat, shadowRadius);
-    SAFE_PARCEL(output.writeInt32, frameRateSelectionPriority);
-    SAFE_PARCEL(output.writeFloat, frameRate);
-    SAFE_PARCEL(output.writeByte, frameRateCompatibility);
-    SAFE_PARCEL(output.writeByte, changeFrameRateStrategy);
-    SAFE_PARCEL(output.writeUint32, fixedTransformHint);
-    SAFE_PARCEL(output.writeBool, autoRefresh);
-    SAFE_PARCEL(output.writeBool, dimmingEnabled);
-
-    SAFE_PARCEL(output.writeUint32, blurRegions.size());
-    for (auto region : blurRegions) {
-        SAFE_PARCEL(output.writeUint32, region.blurRadius);
-        SAFE_PARCEL(output.writeFloat, region.cornerRadiusTL);
-        SAFE_PARCEL(output.writeFloat, region.cornerRadiusTR);
-        SAFE_PARCEL(output.writeFloat, region.cornerRadiusBL);
-        SAFE_PARCEL(output.writeFloat, region.cornerRadiusBR);
-        SAFE_PARCEL(output.writeFloat, region.alpha);
-        SAFE_PARCEL(output.writeInt32, region.left);
-        SAFE_PARCEL(output.writeInt32, region.top);
-        SAFE_PARCEL(output.writeInt32, region.right);
-        SAFE_PARCEL(output.writeInt32, region.bottom);
-    }
-
-    SAFE_PARCEL(output.write, stretchEffect);
-    SAFE_PARCEL(output.write, bufferCrop);
-    SAFE_PARCEL(output.write, destinationFrame);
-    SAFE_PARCEL(output.writeBool, isTrustedOverlay);
-
-    SAFE_PARCEL(output.writeUint32, static_cast<uint32_t>(dropInputMode));
 
     const bool hasBufferData = (bufferData != nullptr);
     SAFE_PARCEL(output.writeBool, hasBufferData);
@@ -169,61 +476,47 @@ status_t layer_state_t::read(const Parcel& input)
     SAFE_PARCEL(input.readNullableStrongBinder, &surface);
     SAFE_PARCEL(input.readInt32, &layerId);
     SAFE_PARCEL(input.readUint64, &what);
-    SAFE_PARCEL(input.readFloat, &x);
-    SAFE_PARCEL(input.readFloat, &y);
-    SAFE_PARCEL(input.readInt32, &z);
-    SAFE_PARCEL(input.readUint32, &w);
-    SAFE_PARCEL(input.readUint32, &h);
-    SAFE_PARCEL(input.readUint32, &layerStack.id);
-    SAFE_PARCEL(input.readFloat, &alpha);
-
-    SAFE_PARCEL(input.readUint32, &flags);
-
-    SAFE_PARCEL(input.readUint32, &mask);
-
-    SAFE_PARCEL(matrix.read, input);
-    SAFE_PARCEL(input.read, crop);
-    SAFE_PARCEL(SurfaceControl::readNullableFromParcel, input, &reparentSurfaceControl);
-
-    SAFE_PARCEL(SurfaceControl::readNullableFromParcel, input, &relativeLayerSurfaceControl);
-    SAFE_PARCEL(SurfaceControl::readNullableFromParcel, input, &parentSurfaceControlForChild);
 
-    float tmpFloat = 0;
-    SAFE_PARCEL(input.readFloat, &tmpFloat);
-    color.r = tmpFloat;
-    SAFE_PARCEL(input.readFloat, &tmpFloat);
-    color.g = tmpFloat;
-    SAFE_PARCEL(input.readFloat, &tmpFloat);
-    color.b = tmpFloat;
-    SAFE_PARCEL(windowInfoHandle->readFromParcel, &input);
-
-    SAFE_PARCEL(input.read, transparentRegion);
-    SAFE_PARCEL(input.readUint32, &transform);
-    SAFE_PARCEL(input.readBool, &transformToDisplayInverse);
-
-    uint32_t tmpUint32 = 0;
-    SAFE_PARCEL(input.readUint32, &tmpUint32);
-    dataspace = static_cast<ui::Dataspace>(tmpUint32);
-
-    SAFE_PARCEL(input.read, hdrMetadata);
-    SAFE_PARCEL(input.read, surfaceDamageRegion);
-    SAFE_PARCEL(input.readInt32, &api);
-
-    bool tmpBool = false;
-    SAFE_PARCEL(input.readBool, &tmpBool);
-    if (tmpBool) {
-        sidebandStream = NativeHandle::create(input.readNativeHandle(), true);
+    uint32_t plainFieldsSize = 0;
+    SAFE_PARCEL_READ_SIZE(input.readUint32, &plainFieldsSize, input.dataSize());
+    const void* plainFields = input.readInplace(plainFieldsSize);
+    if (plainFields == nullptr) {
+        return BAD_VALUE;
     }
+    PlainFieldsReader plainFieldsReader(plainFields, plainFieldsSize);
+    SAFE_PARCEL(readPlainFields, plainFieldsReader, *this);
 
-    SAFE_PARCEL(input.read, &colorTransform, 16 * sizeof(float));
-    SAFE_PARCEL(input.readFloat, &cornerRadius);
-    SAFE_PARCEL(input.readUint32, &backgroundBlurRadius);
-    SAFE_PARCEL(input.readParcelable, &metadata);
-
-    SAFE_PARCEL(input.readFloat, &bgColorAlpha);
-    SAFE_PARCEL(input.readUint32, &tmpUint32);
-    bgColorDataspace = static_cast<ui::Dataspace>(tmpUint32);
-    SAFE_PARCEL(input.readBool, &colorSpaceAgnostic);
+    if (what & eRelativeLayerChanged) {
+        SAFE_PARCEL(SurfaceControl::readNullableFromParcel, input, &relativeLayerSurfaceControl);
+    }
+    if (what & eReparent) {
+        SAFE_PARCEL(SurfaceControl::readNullableFromParcel, input, &parentSurfaceControlForChild);
+    }
+    if (what & eInputInfoChanged) {
+        SAFE_PARCEL(windowInfoHandle->readFromParcel, &input);
+    }
+    if (what & eTransparentRegionChanged) {
+        SAFE_PARCEL(input.read, transparentRegion);
+    }
+    if (what & eHdrMetadataChanged) {
+        SAFE_PARCEL(input.read, hdrMetadata);
+    }
+    if (what & eSurfaceDamageRegionChanged) {
+        SAFE_PARCEL(input.read, surfaceDamageRegion);
+    }
+    if (what & eSidebandStreamChanged) {
+        bool tmpBool = false;
+        SAFE_PARCEL(input.readBool, &tmpBool);
+        if (tmpBool) {
+            sidebandStream = NativeHandle::create(input.readNativeHandle(), true);
+        }
+    }
+    if (what & eMetadataChanged) {
+        SAFE_PARCEL(input.readParcelable, &metadata);
+    }
+    if (what & eStretchChanged) {
+        SAFE_PARCEL(input.read, stretchEffect);
+    }
 
     int32_t numListeners = 0;
     SAFE_PARCEL_READ_SIZE(input.readInt32, &numListeners, input.dataSize());
@@ -235,42 +528,6 @@ status_t layer_state_t::read(const Parcel& input)
         SAFE_PARCEL(input.readParcelableVector, &callbackIds);
         listeners.emplace_back(listener, callbackIds);
     }
-    SAFE_PARCEL(input.readFloat, &shadowRadius);
-    SAFE_PARCEL(input.readInt32, &frameRateSelectionPriority);
-    SAFE_PARCEL(input.readFloat, &frameRate);
-    SAFE_PARCEL(input.readByte, &frameRateCompatibility);
-    SAFE_PARCEL(input.readByte, &changeFrameRateStrategy);
-    SAFE_PARCEL(input.readUint32, &tmpUint32);
-    fixedTransformHint = static_cast<ui::Transform::RotationFlags>(tmpUint32);
-    SAFE_PARCEL(input.readBool, &autoRefresh);
-    SAFE_PARCEL(input.readBool, &dimmingEnabled);
-
-    uint32_t numRegions = 0;
-    SAFE_PARCEL(input.readUint32, &numRegions);
-    blurRegions.clear();
-    for (uint32_t i = 0; i < numRegions; i++) {
-        BlurRegion region;
-        SAFE_PARCEL(input.readUint32, &region.blurRadius);
-        SAFE_PARCEL(input.readFloat, &region.cornerRadiusTL);
-        SAFE_PARCEL(input.readFloat, &region.cornerRadiusTR);
-        SAFE_PARCEL(input.readFloat, &region.cornerRadiusBL);
-        SAFE_PARCEL(input.readFloat, &region.cornerRadiusBR);
-        SAFE_PARCEL(input.readFloat, &region.alpha);
-        SAFE_PARCEL(input.readInt32, &region.left);
-        SAFE_PARCEL(input.readInt32, &region.top);
-        SAFE_PARCEL(input.readInt32, &region.right);
-        SAFE_PARCEL(input.readInt32, &region.bottom);
-        blurRegions.push_back(region);
-    }
-
-    SAFE_PARCEL(input.read, stretchEffect);
-    SAFE_PARCEL(input.read, bufferCrop);
-    SAFE_PARCEL(input.read, destinationFrame);
-    SAFE_PARCEL(input.readBool, &isTrustedOverlay);
-
-    uint32_t mode;
-    SAFE_PARCEL(input.readUint32, &mode);
-    dropInputMode = static_cast<gui::DropInputMode>(mode);
 
     bool hasBufferData;
     SAFE_PARCEL(input.readBool, &hasBufferData);
@@ -837,6 +1094,11 @@ status_t BufferData::writeToParcel(Parcel* output) const {
     SAFE_PARCEL(output->writeBool, hasBarrier);
     SAFE_PARCEL(output->writeUint64, barrierFrameNumber);
 
+    SAFE_PARCEL(output->writeBool, occupancyDelta.has_value());
+    if (occupancyDelta) {
+        SAFE_PARCEL(output->writeParcelable, *occupancyDelta);
+    }
+
     return NO_ERROR;
 }
 
@@ -875,6 +1137,12 @@ status_t BufferData::readFromParcel(const Parcel* input) {
     SAFE_PARCEL(input->readBool, &hasBarrier);
     SAFE_PARCEL(input->readUint64, &barrierFrameNumber);
 
+    SAFE_PARCEL(input->readBool, &tmpBool);
+    if (tmpBool) {
+        occupancyDelta.emplace();
+        SAFE_PARCEL(input->readParcelable, &*occupancyDelta);
+    }
+
     return NO_ERROR;
 }
 
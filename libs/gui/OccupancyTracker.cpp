@@ -18,14 +18,151 @@
 #define LOG_TAG "OccupancyTracker"
 
 #include <gui/OccupancyTracker.h>
+#include <android-base/stringprintf.h>
 #include <binder/Parcel.h>
 #include <utils/String8.h>
 #include <utils/Trace.h>
 
 #include <inttypes.h>
 
+#include <algorithm>
+#include <mutex>
+
 namespace android {
 
+using base::StringAppendF;
+
+bool OccupancyHistogram::Snapshot::isEmpty() const {
+    return std::all_of(occupancyTimes.begin(), occupancyTimes.end(),
+                       [](nsecs_t time) { return time == 0; }) &&
+            std::all_of(latencyCounts.begin(), latencyCounts.end(),
+                        [](uint64_t count) { return count == 0; });
+}
+
+void OccupancyHistogram::Snapshot::dump(std::string& result, const std::string& prefix) const {
+    nsecs_t totalTime = 0;
+    for (nsecs_t time : occupancyTimes) {
+        totalTime += time;
+    }
+    StringAppendF(&result, "%soccupancy (%.3f s):", prefix.c_str(), totalTime / 1e9);
+    for (size_t i = 0; i < OCCUPANCY_BUCKET_COUNT; i++) {
+        const float percent = totalTime > 0 ? 100.0f * occupancyTimes[i] / totalTime : 0.0f;
+        StringAppendF(&result, " %zu%s=%.1f%%", i, i == OCCUPANCY_BUCKET_COUNT - 1 ? "+" : "",
+                      percent);
+    }
+
+    uint64_t frameCount = 0;
+    for (uint64_t count : latencyCounts) {
+        frameCount += count;
+    }
+    StringAppendF(&result, "\n%squeue-to-acquire (%" PRIu64 " frames):", prefix.c_str(),
+                  frameCount);
+    nsecs_t limit = FIRST_LATENCY_LIMIT;
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT - 1; i++, limit *= 2) {
+        StringAppendF(&result, " <%gms=%" PRIu64, limit / 1e6, latencyCounts[i]);
+    }
+    StringAppendF(&result, " >=%gms=%" PRIu64 "\n", limit / 2 / 1e6,
+                  latencyCounts[LATENCY_BUCKET_COUNT - 1]);
+}
+
+void OccupancyHistogram::recordOccupancy(size_t occupancy, nsecs_t duration) {
+    const size_t bucket = std::min(occupancy, OCCUPANCY_BUCKET_COUNT - 1);
+    mOccupancyTimes[bucket].fetch_add(duration, std::memory_order_relaxed);
+}
+
+void OccupancyHistogram::recordLatency(nsecs_t latency) {
+    size_t bucket = 0;
+    for (nsecs_t limit = FIRST_LATENCY_LIMIT;
+            latency >= limit && bucket < LATENCY_BUCKET_COUNT - 1; limit *= 2) {
+        ++bucket;
+    }
+    mLatencyCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+status_t OccupancyHistogram::Snapshot::writeToParcel(Parcel* parcel) const {
+    for (nsecs_t time : occupancyTimes) {
+        status_t result = parcel->writeInt64(time);
+        if (result != OK) {
+            return result;
+        }
+    }
+    for (uint64_t count : latencyCounts) {
+        status_t result = parcel->writeUint64(count);
+        if (result != OK) {
+            return result;
+        }
+    }
+    return OK;
+}
+
+status_t OccupancyHistogram::Snapshot::readFromParcel(const Parcel* parcel) {
+    for (nsecs_t& time : occupancyTimes) {
+        status_t result = parcel->readInt64(&time);
+        if (result != OK) {
+            return result;
+        }
+        if (time < 0) {
+            return BAD_VALUE;
+        }
+    }
+    for (uint64_t& count : latencyCounts) {
+        status_t result = parcel->readUint64(&count);
+        if (result != OK) {
+            return result;
+        }
+    }
+    return OK;
+}
+
+void OccupancyHistogram::add(const Snapshot& snapshot) {
+    for (size_t i = 0; i < OCCUPANCY_BUCKET_COUNT; i++) {
+        mOccupancyTimes[i].fetch_add(snapshot.occupancyTimes[i], std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        mLatencyCounts[i].fetch_add(snapshot.latencyCounts[i], std::memory_order_relaxed);
+    }
+}
+
+OccupancyHistogram::Snapshot OccupancyHistogram::getSnapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < OCCUPANCY_BUCKET_COUNT; i++) {
+        snapshot.occupancyTimes[i] = mOccupancyTimes[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        snapshot.latencyCounts[i] = mLatencyCounts[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+OccupancyHistogram& OccupancyHistogram::getProcessHistogram() {
+    static OccupancyHistogram histogram;
+    return histogram;
+}
+
+bool OccupancyHistogram::takeProcessHistogramDelta(nsecs_t now, Snapshot* delta) {
+    static std::mutex mutex;
+    static Snapshot taken;
+    static nsecs_t lastTakeTime = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (lastTakeTime != 0 && now - lastTakeTime < EXPORT_PERIOD) {
+        return false;
+    }
+    const Snapshot current = getProcessHistogram().getSnapshot();
+    for (size_t i = 0; i < OCCUPANCY_BUCKET_COUNT; i++) {
+        delta->occupancyTimes[i] = current.occupancyTimes[i] - taken.occupancyTimes[i];
+    }
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        delta->latencyCounts[i] = current.latencyCounts[i] - taken.latencyCounts[i];
+    }
+    if (delta->isEmpty()) {
+        return false;
+    }
+    taken = current;
+    lastTakeTime = now;
+    return true;
+}
+
 status_t OccupancyTracker::Segment::writeToParcel(Parcel* parcel) const {
     status_t result = parcel->writeInt64(totalTime);
     if (result != OK) {
@@ -67,6 +204,9 @@ void OccupancyTracker::registerOccupancyChange(size_t occupancy) {
     if (delta > NEW_SEGMENT_DELAY) {
         recordPendingSegment();
     } else {
+        // Like segments, the histograms skip the time the queue was idle.
+        mHistogram.recordOccupancy(mLastOccupancy, delta);
+        OccupancyHistogram::getProcessHistogram().recordOccupancy(mLastOccupancy, delta);
         mPendingSegment.totalTime += delta;
         if (mPendingSegment.mOccupancyTimes.count(mLastOccupancy)) {
             mPendingSegment.mOccupancyTimes[mLastOccupancy] += delta;
@@ -92,6 +232,11 @@ std::vector<OccupancyTracker::Segment> OccupancyTracker::getSegmentHistory(
     return segments;
 }
 
+void OccupancyTracker::registerQueueToAcquireLatency(nsecs_t latency) {
+    mHistogram.recordLatency(latency);
+    OccupancyHistogram::getProcessHistogram().recordLatency(latency);
+}
+
 void OccupancyTracker::recordPendingSegment() {
     // Only record longer segments to get a better measurement of actual double-
     // vs. triple-buffered time
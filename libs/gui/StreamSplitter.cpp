@@ -58,9 +58,22 @@ status_t StreamSplitter::createSplitter(
 
 StreamSplitter::StreamSplitter(const sp<IGraphicBufferConsumer>& inputQueue)
       : mIsAbandoned(false), mMutex(), mReleaseCondition(),
-        mOutstandingBuffers(0), mInput(inputQueue), mOutputs(), mBuffers() {}
+        mOutstandingBuffers(0), mInput(inputQueue), mOutputs(),
+        mParallelFanOut(false), mBuffers() {}
 
 StreamSplitter::~StreamSplitter() {
+    {
+        Mutex::Autolock lock(mMutex);
+        for (auto& worker : mWorkers) {
+            worker->mStopped = true;
+            worker->mCondition.signal();
+        }
+    }
+    for (auto& worker : mWorkers) {
+        worker->mThread.join();
+    }
+    mWorkers.clear();
+
     mInput->consumerDisconnect();
     Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
     for (; output != mOutputs.end(); ++output) {
@@ -93,6 +106,22 @@ status_t StreamSplitter::addOutput(
 
     mOutputs.push_back(outputQueue);
 
+    if (mParallelFanOut) {
+        mWorkers.push_back(std::make_unique<OutputWorker>(outputQueue));
+        OutputWorker* worker = mWorkers.back().get();
+        worker->mThread = std::thread(&StreamSplitter::runOutputWorker, this, worker);
+    }
+
+    return NO_ERROR;
+}
+
+status_t StreamSplitter::setParallelFanOut(bool enabled) {
+    Mutex::Autolock lock(mMutex);
+    if (!mOutputs.isEmpty()) {
+        ALOGE("setParallelFanOut: outputs were already added");
+        return INVALID_OPERATION;
+    }
+    mParallelFanOut = enabled;
     return NO_ERROR;
 }
 
@@ -111,8 +140,9 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
     // input queue, slowing down its producer.
 
     // If there are too many outstanding buffers, we block until a buffer is
-    // released back to the input in onBufferReleased
-    while (mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
+    // released back to the input in onBufferReleased. In parallel fan-out
+    // mode, late outputs are skipped instead (see fanOutLocked).
+    while (!mParallelFanOut && mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
         mReleaseCondition.wait(mMutex);
 
         // If the splitter is abandoned while we are waiting, the release
@@ -138,9 +168,8 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "detaching buffer from input failed (%d)", status);
 
-    // Initialize our reference count for this buffer
-    mBuffers.add(bufferItem.mGraphicBuffer->getId(),
-            new BufferTracker(bufferItem.mGraphicBuffer));
+    sp<BufferTracker> tracker = new BufferTracker(bufferItem.mGraphicBuffer);
+    mBuffers.add(bufferItem.mGraphicBuffer->getId(), tracker);
 
     IGraphicBufferProducer::QueueBufferInput queueInput(
             bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
@@ -148,6 +177,14 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
             static_cast<int32_t>(bufferItem.mScalingMode),
             bufferItem.mTransform, bufferItem.mFence);
 
+    if (mParallelFanOut) {
+        fanOutLocked(tracker, queueInput);
+        return;
+    }
+
+    // Initialize our reference count for this buffer
+    tracker->setPendingReleases(mOutputs.size());
+
     // Attach and queue the buffer to each of the outputs
     Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
     for (; output != mOutputs.end(); ++output) {
@@ -155,11 +192,12 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
         status = (*output)->attachBuffer(&slot, bufferItem.mGraphicBuffer);
         if (status == NO_INIT) {
             // If we just discovered that this output has been abandoned, note
-            // that, increment the release count so that we still release this
-            // buffer eventually, and move on to the next output
+            // that, release this buffer on its behalf so that we still
+            // release it eventually, and move on to the next output
             onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
+            if (tracker->release()) {
+                returnBufferLocked(tracker);
+            }
             continue;
         } else {
             LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
@@ -170,11 +208,12 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
         status = (*output)->queueBuffer(slot, queueInput, &queueOutput);
         if (status == NO_INIT) {
             // If we just discovered that this output has been abandoned, note
-            // that, increment the release count so that we still release this
-            // buffer eventually, and move on to the next output
+            // that, release this buffer on its behalf so that we still
+            // release it eventually, and move on to the next output
             onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
+            if (tracker->release()) {
+                returnBufferLocked(tracker);
+            }
             continue;
         } else {
             LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
@@ -186,14 +225,95 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
     }
 }
 
+void StreamSplitter::fanOutLocked(const sp<BufferTracker>& tracker,
+        const IGraphicBufferProducer::QueueBufferInput& queueInput) {
+    // Skip the outputs already holding as many buffers as they may, so that
+    // they don't stall the input and the other outputs.
+    size_t receivers = 0;
+    for (const auto& worker : mWorkers) {
+        if (worker->mOutstandingBuffers < MAX_OUTSTANDING_BUFFERS) {
+            ++receivers;
+        }
+    }
+    if (receivers == 0) {
+        ALOGV("dropping buffer %#" PRIx64 ", all outputs are late",
+                tracker->getBuffer()->getId());
+        returnBufferLocked(tracker);
+        return;
+    }
+
+    tracker->setPendingReleases(receivers);
+    for (const auto& worker : mWorkers) {
+        if (worker->mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
+            ALOGV("dropping buffer %#" PRIx64 " for late output %p",
+                    tracker->getBuffer()->getId(), worker->mOutput.get());
+            continue;
+        }
+        ++worker->mOutstandingBuffers;
+        worker->mPendingBuffers.emplace_back(tracker, queueInput);
+        worker->mCondition.signal();
+    }
+}
+
+void StreamSplitter::runOutputWorker(OutputWorker* worker) {
+    mMutex.lock();
+    while (true) {
+        while (worker->mPendingBuffers.empty() && !worker->mStopped) {
+            worker->mCondition.wait(mMutex);
+        }
+        if (worker->mStopped) {
+            break;
+        }
+        auto [tracker, queueInput] = std::move(worker->mPendingBuffers.front());
+        worker->mPendingBuffers.pop_front();
+
+        // Attach and queue the buffer without holding the lock, so that the
+        // other workers do the same for their outputs meanwhile
+        mMutex.unlock();
+        int slot;
+        status_t status = worker->mOutput->attachBuffer(&slot, tracker->getBuffer());
+        if (status == NO_ERROR) {
+            IGraphicBufferProducer::QueueBufferOutput queueOutput;
+            status = worker->mOutput->queueBuffer(slot, queueInput, &queueOutput);
+        }
+        mMutex.lock();
+
+        if (status == NO_INIT) {
+            // The output has been abandoned, so it won't release the buffer
+            onAbandonedLocked();
+            --worker->mOutstandingBuffers;
+            if (tracker->release()) {
+                returnBufferLocked(tracker);
+            }
+            continue;
+        }
+        LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+                "attaching and queueing buffer to output failed (%d)", status);
+        ALOGV("queued buffer %#" PRIx64 " to output %p",
+                tracker->getBuffer()->getId(), worker->mOutput.get());
+    }
+
+    // Buffers which never reached the output are released on its behalf
+    for (const auto& pending : worker->mPendingBuffers) {
+        if (pending.first->release()) {
+            returnBufferLocked(pending.first);
+        }
+    }
+    worker->mPendingBuffers.clear();
+    mMutex.unlock();
+}
+
 void StreamSplitter::onBufferReleasedByOutput(
         const sp<IGraphicBufferProducer>& from) {
     ATRACE_CALL();
-    Mutex::Autolock lock(mMutex);
 
+    // Detach without holding the lock, so that releases by an output don't
+    // wait on buffers being queued to the others
     sp<GraphicBuffer> buffer;
     sp<Fence> fence;
     status_t status = from->detachNextBuffer(&buffer, &fence);
+
+    Mutex::Autolock lock(mMutex);
     if (status == NO_INIT) {
         // If we just discovered that this output has been abandoned, note that,
         // but we can't do anything else, since buffer is invalid
@@ -207,30 +327,40 @@ void StreamSplitter::onBufferReleasedByOutput(
     ALOGV("detached buffer %#" PRIx64 " from output %p",
           buffer->getId(), from.get());
 
-    const sp<BufferTracker>& tracker = mBuffers.editValueFor(buffer->getId());
+    for (const auto& worker : mWorkers) {
+        if (worker->mOutput == from) {
+            --worker->mOutstandingBuffers;
+        }
+    }
+
+    sp<BufferTracker> tracker = mBuffers.editValueFor(buffer->getId());
 
     // Merge the release fence of the incoming buffer so that the fence we send
     // back to the input includes all of the outputs' fences
     tracker->mergeFence(fence);
 
     // Check to see if this is the last outstanding reference to this buffer
-    size_t releaseCount = tracker->incrementReleaseCountLocked();
-    ALOGV("buffer %#" PRIx64 " reference count %zu (of %zu)", buffer->getId(),
-            releaseCount, mOutputs.size());
-    if (releaseCount < mOutputs.size()) {
+    if (!tracker->release()) {
         return;
     }
+    ALOGV("buffer %#" PRIx64 " released by all outputs", buffer->getId());
+
+    returnBufferLocked(tracker);
+}
+
+void StreamSplitter::returnBufferLocked(const sp<BufferTracker>& tracker) {
+    const uint64_t bufferId = tracker->getBuffer()->getId();
 
     // If we've been abandoned, we can't return the buffer to the input, so just
     // stop tracking it and move on
     if (mIsAbandoned) {
-        mBuffers.removeItem(buffer->getId());
+        mBuffers.removeItem(bufferId);
         return;
     }
 
     // Attach and release the buffer back to the input
     int consumerSlot;
-    status = mInput->attachBuffer(&consumerSlot, tracker->getBuffer());
+    status_t status = mInput->attachBuffer(&consumerSlot, tracker->getBuffer());
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "attaching buffer to input failed (%d)", status);
 
@@ -239,11 +369,11 @@ void StreamSplitter::onBufferReleasedByOutput(
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "releasing buffer to input failed (%d)", status);
 
-    ALOGV("released buffer %#" PRIx64 " to input", buffer->getId());
+    ALOGV("released buffer %#" PRIx64 " to input", bufferId);
 
     // We no longer need to track the buffer once it has been returned to the
     // input
-    mBuffers.removeItem(buffer->getId());
+    mBuffers.removeItem(bufferId);
 
     // Notify any waiting onFrameAvailable calls
     --mOutstandingBuffers;
@@ -276,7 +406,7 @@ void StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who */) {
 }
 
 StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer)
-      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mReleaseCount(0) {}
+      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mPendingReleases(0) {}
 
 StreamSplitter::BufferTracker::~BufferTracker() {}
 
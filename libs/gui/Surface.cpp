@@ -198,6 +198,15 @@ void Surface::enableFrameTimestamps(bool enable) {
         FrameEventHistoryDelta delta;
         mGraphicBufferProducer->getFrameTimestamps(&delta);
         mFrameEventHistory->applyDelta(delta);
+
+        // Map the frame events the consumer publishes, if it does, to read
+        // them rather than ask for deltas.
+        base::unique_fd ring;
+        if (!mFrameEventHistory->hasTimestampsRing() &&
+                mGraphicBufferProducer->getFrameTimestampsRing(&ring) == NO_ERROR) {
+            mFrameEventHistory->setTimestampsRing(
+                    FrameTimestampsRing::map(std::move(ring)));
+        }
     }
     mEnableFrameTimestamps = enable;
 }
@@ -314,9 +323,13 @@ status_t Surface::getFrameTimestamps(uint64_t frameNumber,
             outLatchTime, outFirstRefreshStartTime, outLastRefreshStartTime,
             outGpuCompositionDoneTime, outDisplayPresentTime,
             outDequeueReadyTime, outReleaseTime)) {
-        FrameEventHistoryDelta delta;
-        mGraphicBufferProducer->getFrameTimestamps(&delta);
-        mFrameEventHistory->applyDelta(delta);
+        // Reading the frame events the consumer published is much cheaper
+        // than asking it for a delta through the producer.
+        if (!mFrameEventHistory->applyPublishedTimestamps(frameNumber)) {
+            FrameEventHistoryDelta delta;
+            mGraphicBufferProducer->getFrameTimestamps(&delta);
+            mFrameEventHistory->applyDelta(delta);
+        }
         events = mFrameEventHistory->getFrame(frameNumber);
     }
 
@@ -73,6 +73,15 @@ std::atomic<uint32_t> idCounter = 0;
 int64_t generateId() {
     return (((int64_t)getpid()) << 32) | ++idCounter;
 }
+
+// Adds a value to a vector used as a set. The last values added are the most likely to be added
+// again, so they are compared first.
+template <typename T>
+void addUnique(std::vector<T>& values, const T& value) {
+    if (std::find(values.rbegin(), values.rend(), value) == values.rend()) {
+        values.push_back(value);
+    }
+}
 } // namespace
 
 ComposerService::ComposerService()
@@ -236,9 +245,7 @@ void TransactionCompletedListener::startListeningLocked() {
 
 CallbackId TransactionCompletedListener::addCallbackFunction(
         const TransactionCompletedCallback& callbackFunction,
-        const std::unordered_set<sp<SurfaceControl>, SurfaceComposerClient::SCHash>&
-                surfaceControls,
-        CallbackId::Type callbackType) {
+        const std::vector<sp<SurfaceControl>>& surfaceControls, CallbackId::Type callbackType) {
     std::lock_guard<std::mutex> lock(mMutex);
     startListeningLocked();
 
@@ -296,8 +303,7 @@ void TransactionCompletedListener::removeSurfaceStatsListener(void* context, voi
 }
 
 void TransactionCompletedListener::addSurfaceControlToCallbacks(
-        const sp<SurfaceControl>& surfaceControl,
-        const std::unordered_set<CallbackId, CallbackIdHash>& callbackIds) {
+        const sp<SurfaceControl>& surfaceControl, const std::vector<CallbackId>& callbackIds) {
     std::lock_guard<std::mutex> lock(mMutex);
 
     for (auto callbackId : callbackIds) {
@@ -641,6 +647,33 @@ SurfaceComposerClient::Transaction::Transaction(const Transaction& other)
     mListenerCallbacks = other.mListenerCallbacks;
 }
 
+SurfaceComposerClient::Transaction::ComposerStates::iterator
+SurfaceComposerClient::Transaction::ComposerStates::find(const sp<IBinder>& handle) {
+    if (mStates.size() <= kIndexThreshold) {
+        return std::find_if(mStates.begin(), mStates.end(),
+                            [&handle](const Entry& entry) { return entry.first == handle; });
+    }
+    if (mIndices.size() != mStates.size()) {
+        mIndices.clear();
+        mIndices.reserve(mStates.size());
+        for (size_t i = 0; i < mStates.size(); i++) {
+            mIndices.emplace(mStates[i].first, i);
+        }
+    }
+    const auto it = mIndices.find(handle);
+    return it == mIndices.end() ? mStates.end() : mStates.begin() + it->second;
+}
+
+SurfaceComposerClient::Transaction::ComposerStates::iterator
+SurfaceComposerClient::Transaction::ComposerStates::add(const sp<IBinder>& handle,
+                                                        ComposerState&& state) {
+    mStates.emplace_back(handle, std::move(state));
+    if (!mIndices.empty()) {
+        mIndices.emplace(handle, mStates.size() - 1);
+    }
+    return std::prev(mStates.end());
+}
+
 void SurfaceComposerClient::Transaction::sanitize() {
     for (auto & [handle, composerState] : mComposerStates) {
         composerState.state.sanitize(0 /* permissionMask */);
@@ -702,7 +735,7 @@ status_t SurfaceComposerClient::Transaction::readFromParcel(const Parcel* parcel
         for (size_t j = 0; j < numCallbackIds; j++) {
             CallbackId id;
             parcel->readParcelable(&id);
-            listenerCallbacks[listener].callbackIds.insert(id);
+            addUnique(listenerCallbacks[listener].callbackIds, id);
         }
         size_t numSurfaces = parcel->readUint32();
         if (numSurfaces > parcel->dataSize()) {
@@ -711,7 +744,7 @@ status_t SurfaceComposerClient::Transaction::readFromParcel(const Parcel* parcel
         for (size_t j = 0; j < numSurfaces; j++) {
             sp<SurfaceControl> surface;
             SAFE_PARCEL(SurfaceControl::readFromParcel, *parcel, &surface);
-            listenerCallbacks[listener].surfaceControls.insert(surface);
+            addUnique(listenerCallbacks[listener].surfaceControls, surface);
         }
     }
 
@@ -719,7 +752,7 @@ status_t SurfaceComposerClient::Transaction::readFromParcel(const Parcel* parcel
     if (count > parcel->dataSize()) {
         return BAD_VALUE;
     }
-    std::unordered_map<sp<IBinder>, ComposerState, IBinderHash> composerStates;
+    ComposerStates composerStates;
     composerStates.reserve(count);
     for (size_t i = 0; i < count; i++) {
         sp<IBinder> surfaceControlHandle;
@@ -729,7 +762,11 @@ status_t SurfaceComposerClient::Transaction::readFromParcel(const Parcel* parcel
         if (composerState.read(*parcel) == BAD_VALUE) {
             return BAD_VALUE;
         }
-        composerStates[surfaceControlHandle] = composerState;
+        if (auto it = composerStates.find(surfaceControlHandle); it != composerStates.end()) {
+            it->second = std::move(composerState);
+        } else {
+            composerStates.add(surfaceControlHandle, std::move(composerState));
+        }
     }
 
     InputWindowCommands inputWindowCommands;
@@ -747,7 +784,7 @@ status_t SurfaceComposerClient::Transaction::readFromParcel(const Parcel* parcel
     mFrameTimelineInfo = frameTimelineInfo;
     mDisplayStates = displayStates;
     mListenerCallbacks = listenerCallbacks;
-    mComposerStates = composerStates;
+    mComposerStates = std::move(composerStates);
     mInputWindowCommands = inputWindowCommands;
     mApplyToken = applyToken;
     return NO_ERROR;
@@ -826,14 +863,19 @@ void SurfaceComposerClient::Transaction::releaseBufferIfOverwriting(const layer_
 }
 
 SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::merge(Transaction&& other) {
-    for (auto const& [handle, composerState] : other.mComposerStates) {
-        if (mComposerStates.count(handle) == 0) {
-            mComposerStates[handle] = composerState;
-        } else {
+    if (mComposerStates.empty()) {
+        mComposerStates = std::move(other.mComposerStates);
+    } else {
+        for (auto& [handle, composerState] : other.mComposerStates) {
+            auto it = mComposerStates.find(handle);
+            if (it == mComposerStates.end()) {
+                mComposerStates.add(handle, std::move(composerState));
+                continue;
+            }
             if (composerState.state.what & layer_state_t::eBufferChanged) {
-                releaseBufferIfOverwriting(mComposerStates[handle].state);
+                releaseBufferIfOverwriting(it->second.state);
             }
-            mComposerStates[handle].state.merge(composerState.state);
+            it->second.state.merge(composerState.state);
         }
     }
 
@@ -846,22 +888,26 @@ SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::merge(Tr
         }
     }
 
-    for (const auto& [listener, callbackInfo] : other.mListenerCallbacks) {
-        auto& [callbackIds, surfaceControls] = callbackInfo;
-        mListenerCallbacks[listener].callbackIds.insert(std::make_move_iterator(
-                                                                callbackIds.begin()),
-                                                        std::make_move_iterator(callbackIds.end()));
-
-        mListenerCallbacks[listener].surfaceControls.insert(surfaceControls.begin(),
-                                                            surfaceControls.end());
-
+    if (!other.mListenerCallbacks.empty()) {
+        // The map is node based, so the reference stays valid as listeners are added.
         auto& currentProcessCallbackInfo =
                 mListenerCallbacks[TransactionCompletedListener::getIInstance()];
-        currentProcessCallbackInfo.surfaceControls
-                .insert(std::make_move_iterator(surfaceControls.begin()),
-                        std::make_move_iterator(surfaceControls.end()));
+        for (auto& [listener, callbackInfo] : other.mListenerCallbacks) {
+            auto& [callbackIds, surfaceControls] = callbackInfo;
+            auto& listenerCallbackInfo = mListenerCallbacks[listener];
+            for (const CallbackId& callbackId : callbackIds) {
+                addUnique(listenerCallbackInfo.callbackIds, callbackId);
+            }
+            for (const sp<SurfaceControl>& surfaceControl : surfaceControls) {
+                if (&listenerCallbackInfo != &currentProcessCallbackInfo) {
+                    addUnique(listenerCallbackInfo.surfaceControls, surfaceControl);
+                }
+                addUnique(currentProcessCallbackInfo.surfaceControls, surfaceControl);
+            }
+        }
 
-        // register all surface controls for all callbackIds for this listener that is merging
+        // Register all surface controls for all callbackIds once every listener is merged,
+        // rather than again for each listener.
         for (const auto& surfaceControl : currentProcessCallbackInfo.surfaceControls) {
             TransactionCompletedListener::getInstance()
                     ->addSurfaceControlToCallbacks(surfaceControl,
@@ -885,7 +931,21 @@ SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::merge(Tr
 void SurfaceComposerClient::Transaction::clear() {
     mComposerStates.clear();
     mDisplayStates.clear();
-    mListenerCallbacks.clear();
+    // Keep the callbacks of this process, which most transactions have, emptied, so that a
+    // transaction reused for each frame doesn't allocate them again.
+    if (!mListenerCallbacks.empty()) {
+        const sp<ITransactionCompletedListener> currentProcessListener =
+                TransactionCompletedListener::getIInstance();
+        for (auto it = mListenerCallbacks.begin(); it != mListenerCallbacks.end();) {
+            if (it->first == currentProcessListener) {
+                it->second.callbackIds.clear();
+                it->second.surfaceControls.clear();
+                ++it;
+            } else {
+                it = mListenerCallbacks.erase(it);
+            }
+        }
+    }
     mInputWindowCommands.clear();
     mContainsBuffer = false;
     mForceSynchronous = 0;
@@ -922,7 +982,7 @@ void SurfaceComposerClient::Transaction::cacheBuffers() {
 
     size_t count = 0;
     for (auto& [handle, cs] : mComposerStates) {
-        layer_state_t* s = &(mComposerStates[handle].state);
+        layer_state_t* s = &cs.state;
         if (!(s->what & layer_state_t::eBufferChanged)) {
             continue;
         } else if (s->bufferData &&
@@ -968,7 +1028,14 @@ status_t SurfaceComposerClient::Transaction::apply(bool synchronous, bool oneWay
 
     sp<ISurfaceComposer> sf(ComposerService::getComposerService());
 
-    bool hasListenerCallbacks = !mListenerCallbacks.empty();
+    // The callbacks of this process are kept empty when the transaction is cleared.
+    bool hasListenerCallbacks =
+            std::any_of(mListenerCallbacks.begin(), mListenerCallbacks.end(),
+                        [](const auto& entry) {
+                            const CallbackInfo& callbackInfo = entry.second;
+                            return !callbackInfo.callbackIds.empty() ||
+                                    !callbackInfo.surfaceControls.empty();
+                        });
     std::vector<ListenerCallbacks> listenerCallbacks;
     // For every listener with registered callbacks
     for (const auto& [listener, callbackInfo] : mListenerCallbacks) {
@@ -1123,23 +1190,24 @@ void SurfaceComposerClient::Transaction::setEarlyWakeupEnd() {
 layer_state_t* SurfaceComposerClient::Transaction::getLayerState(const sp<SurfaceControl>& sc) {
     auto handle = sc->getLayerStateHandle();
 
-    if (mComposerStates.count(handle) == 0) {
+    auto it = mComposerStates.find(handle);
+    if (it == mComposerStates.end()) {
         // we don't have it, add an initialized layer_state to our list
         ComposerState s;
 
         s.state.surface = handle;
         s.state.layerId = sc->getLayerId();
 
-        mComposerStates[handle] = s;
+        it = mComposerStates.add(handle, std::move(s));
     }
 
-    return &(mComposerStates[handle].state);
+    return &it->second.state;
 }
 
 void SurfaceComposerClient::Transaction::registerSurfaceControlForCallback(
         const sp<SurfaceControl>& sc) {
     auto& callbackInfo = mListenerCallbacks[TransactionCompletedListener::getIInstance()];
-    callbackInfo.surfaceControls.insert(sc);
+    addUnique(callbackInfo.surfaceControls, sc);
 
     TransactionCompletedListener::getInstance()
             ->addSurfaceControlToCallbacks(sc, callbackInfo.callbackIds);
@@ -1494,6 +1562,17 @@ SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::setBuffe
     return *this;
 }
 
+SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::setBufferOccupancyDelta(
+        const sp<SurfaceControl>& sc, const OccupancyHistogram::Snapshot& delta) {
+    layer_state_t* s = getLayerState(sc);
+    if (!s) {
+        mStatus = BAD_INDEX;
+        return *this;
+    }
+    s->bufferData->occupancyDelta = delta;
+    return *this;
+}
+
 SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::setBuffer(
         const sp<SurfaceControl>& sc, const sp<GraphicBuffer>& buffer,
         const std::optional<sp<Fence>>& fence, const std::optional<uint64_t>& optFrameNumber,
@@ -1685,8 +1764,8 @@ SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::addTrans
     CallbackId callbackId =
             listener->addCallbackFunction(callbackWithContext, surfaceControls, callbackType);
 
-    mListenerCallbacks[TransactionCompletedListener::getIInstance()].callbackIds.emplace(
-            callbackId);
+    addUnique(mListenerCallbacks[TransactionCompletedListener::getIInstance()].callbackIds,
+              callbackId);
     return *this;
 }
 
@@ -29,6 +29,10 @@
 #include <system/window.h>
 #include <thread>
 #include <queue>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace android {
 
@@ -41,12 +45,16 @@ public:
                             int bufferCount, bool controlledByApp, wp<BLASTBufferQueue> bbq)
           : BufferItemConsumer(consumer, consumerUsage, bufferCount, controlledByApp),
             mBLASTBufferQueue(std::move(bbq)),
+            mTimestampsRing(FrameTimestampsRing::create(FrameEventHistory::MAX_FRAME_HISTORY)),
             mCurrentlyConnected(false),
-            mPreviouslyConnected(false) {}
+            mPreviouslyConnected(false) {
+        mFrameEventHistory.setTimestampsRing(mTimestampsRing);
+    }
 
     void onDisconnect() override;
     void addAndGetFrameTimestamps(const NewFrameEventsEntry* newTimestamps,
                                   FrameEventHistoryDelta* outDelta) override REQUIRES(mMutex);
+    status_t getFrameTimestampsRing(base::unique_fd* outRing) override;
     void updateFrameTimestamps(uint64_t frameNumber, nsecs_t refreshStartTime,
                                const sp<Fence>& gpuCompositionDoneFence,
                                const sp<Fence>& presentFence, const sp<Fence>& prevReleaseFence,
@@ -61,6 +69,9 @@ private:
     const wp<BLASTBufferQueue> mBLASTBufferQueue;
 
     uint64_t mCurrentFrameNumber = 0;
+    // Null if the shared memory couldn't be created, in which case the producer only gets frame
+    // events through deltas.
+    const std::shared_ptr<FrameTimestampsRing> mTimestampsRing;
 
     Mutex mMutex;
     ConsumerFrameEventHistory mFrameEventHistory GUARDED_BY(mMutex);
@@ -169,9 +180,12 @@ private:
     int32_t mNumAcquired GUARDED_BY(mMutex) = 0;
 
     // Keep a reference to the submitted buffers so we can release when surfaceflinger drops the
-    // buffer or the buffer has been presented and a new buffer is ready to be presented.
-    std::unordered_map<ReleaseCallbackId, BufferItem, ReleaseBufferCallbackIdHash> mSubmitted
-            GUARDED_BY(mMutex);
+    // buffer or the buffer has been presented and a new buffer is ready to be presented. A handful
+    // of buffers are in flight at once, so a flat table reserved up front is searched rather than
+    // a map allocating a node per frame.
+    using SubmittedBuffers = std::vector<std::pair<ReleaseCallbackId, BufferItem>>;
+    SubmittedBuffers mSubmitted GUARDED_BY(mMutex);
+    SubmittedBuffers::iterator findSubmittedLocked(const ReleaseCallbackId& id) REQUIRES(mMutex);
 
     // Keep a queue of the released buffers instead of immediately releasing
     // the buffers back to the buffer queue. This would be controlled by SF
@@ -231,13 +245,26 @@ private:
     sp<IGraphicBufferProducer> mProducer;
     sp<BLASTBufferItemConsumer> mBufferItemConsumer;
 
+    // Bytes of buffers the queue may allocate ahead while the app resizes its window, e.g. during
+    // a resize animation. Enough for a few full screen RGBA_8888 buffers on most devices.
+    static constexpr size_t kPreallocationBudget = 32 * 1024 * 1024;
+
     std::function<void(SurfaceComposerClient::Transaction*)> mTransactionReadyCallback
             GUARDED_BY(mMutex);
     SurfaceComposerClient::Transaction* mSyncTransaction GUARDED_BY(mMutex);
     std::vector<std::tuple<uint64_t /* framenumber */, SurfaceComposerClient::Transaction>>
             mPendingTransactions GUARDED_BY(mMutex);
 
-    std::queue<std::pair<uint64_t, FrameTimelineInfo>> mPendingFrameTimelines GUARDED_BY(mMutex);
+    // Frame timelines waiting for their frame, by increasing frame number. Reserved up front, as
+    // there is usually one per frame. Not a cap, the vector grows past it if frames fall behind.
+    static constexpr size_t kExpectedPendingFrameTimelines = 8;
+    std::vector<std::pair<uint64_t, FrameTimelineInfo>> mPendingFrameTimelines GUARDED_BY(mMutex);
+
+    // The transaction submitting each acquired buffer when no sync transaction is set. It is
+    // cleared when applied, and reused for the next buffer so that its tables aren't allocated
+    // again every frame.
+    std::optional<SurfaceComposerClient::Transaction> mBufferTransaction GUARDED_BY(mMutex){
+            std::in_place};
 
     // Tracks the last acquired frame number
     uint64_t mLastAcquiredFrameNumber GUARDED_BY(mMutex) = 0;
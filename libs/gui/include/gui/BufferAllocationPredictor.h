@@ -0,0 +1,79 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <ui/PixelFormat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+namespace android {
+
+// The attributes a buffer is allocated with.
+struct BufferAllocationConfig {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat format = PIXEL_FORMAT_NONE;
+    uint64_t usage = 0;
+
+    bool operator==(const BufferAllocationConfig& other) const {
+        return width == other.width && height == other.height && format == other.format &&
+                usage == other.usage;
+    }
+    bool operator!=(const BufferAllocationConfig& other) const { return !(*this == other); }
+};
+
+// Predicts the attributes of the next buffers a producer allocates from the ones it allocated
+// before, so that the buffers can be allocated before a dequeue needs them.
+//
+// Two patterns are recognized: the size changing by the same step at each allocation, as while a
+// window is resized, and an earlier configuration coming back, as while toggling between two sizes
+// or formats, in which case the configuration which followed it the last time is predicted.
+class BufferAllocationPredictor {
+public:
+    // The number of configurations remembered.
+    static constexpr size_t kHistorySize = 8;
+
+    struct Prediction {
+        BufferAllocationConfig config;
+        // The number of buffers expected to be allocated with the configuration, e.g. one per
+        // buffer of the swapchain.
+        size_t count;
+    };
+
+    // Records the configuration of an allocation.
+    void onAllocation(const BufferAllocationConfig& config);
+
+    // The configuration of the next allocations, or nullopt if no pattern is recognized.
+    std::optional<Prediction> predict() const;
+
+    void clear() { mHistory.clear(); }
+
+private:
+    struct Run {
+        BufferAllocationConfig config;
+        // The number of consecutive allocations with the configuration.
+        size_t count;
+    };
+
+    // The runs of allocations, oldest first.
+    std::deque<Run> mHistory;
+};
+
+} // namespace android
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <gui/BufferItem.h>
+#include <log/log.h>
+
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace android {
+
+// The FIFO of buffers queued to a BufferQueue.
+//
+// The items are held in a circular buffer, so acquiring the front item doesn't move the ones
+// queued after it. The buffer grows by doubling and never shrinks, so once a BufferQueue reached
+// its steady state depth, queueing and acquiring don't allocate.
+class BufferItemFifo {
+public:
+    template <typename Fifo, typename Item>
+    class Iterator {
+    public:
+        Iterator(Fifo* fifo, size_t index) : mFifo(fifo), mIndex(index) {}
+
+        Item& operator*() const { return (*mFifo)[mIndex]; }
+        Item* operator->() const { return &(*mFifo)[mIndex]; }
+        Iterator& operator++() {
+            mIndex++;
+            return *this;
+        }
+        bool operator==(const Iterator& other) const {
+            return mFifo == other.mFifo && mIndex == other.mIndex;
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        Fifo* mFifo;
+        size_t mIndex;
+    };
+
+    using iterator = Iterator<BufferItemFifo, BufferItem>;
+    using const_iterator = Iterator<const BufferItemFifo, const BufferItem>;
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    size_t capacity() const { return mItems.size(); }
+
+    // The item at the index, counting from the front.
+    BufferItem& operator[](size_t index) { return *mItems[physicalIndex(index)]; }
+    const BufferItem& operator[](size_t index) const { return *mItems[physicalIndex(index)]; }
+
+    BufferItem& front() { return (*this)[0]; }
+    const BufferItem& front() const { return (*this)[0]; }
+    BufferItem& back() { return (*this)[mSize - 1]; }
+    const BufferItem& back() const { return (*this)[mSize - 1]; }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, mSize); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, mSize); }
+
+    void push_back(const BufferItem& item) {
+        if (mSize == mItems.size()) {
+            grow();
+        }
+        mItems[physicalIndex(mSize)].emplace(item);
+        mSize++;
+    }
+
+    // Destroys the front item, releasing the buffer and fence it holds.
+    void pop_front() {
+        LOG_ALWAYS_FATAL_IF(mSize == 0, "pop_front: the FIFO is empty");
+        mItems[mHead].reset();
+        mHead = (mHead + 1) & (mItems.size() - 1);
+        mSize--;
+    }
+
+    void clear() {
+        while (!empty()) {
+            pop_front();
+        }
+        mHead = 0;
+    }
+
+private:
+    static constexpr size_t kInitialCapacity = 4;
+
+    // The capacity is a power of two, so that indices wrap with a mask.
+    size_t physicalIndex(size_t index) const { return (mHead + index) & (mItems.size() - 1); }
+
+    void grow() {
+        std::vector<std::optional<BufferItem>> items(
+                mItems.empty() ? kInitialCapacity : mItems.size() * 2);
+        for (size_t i = 0; i < mSize; i++) {
+            items[i] = std::move(mItems[physicalIndex(i)]);
+        }
+        mItems = std::move(items);
+        mHead = 0;
+    }
+
+    std::vector<std::optional<BufferItem>> mItems;
+    size_t mHead = 0;
+    size_t mSize = 0;
+};
+
+} // namespace android
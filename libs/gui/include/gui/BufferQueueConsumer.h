@@ -178,6 +178,13 @@ public:
     // will eventually be released or acquired by the consumer.
     void setAllowExtraAcquire(bool /* allow */);
 
+    // Sets the bytes of the buffers the BufferQueue allocates ahead of the
+    // dequeueBuffer calls predicted to need them, when the producer resizes
+    // its buffers in a recognizable pattern. 0, the default, disables the
+    // preallocation. A buffer allocated ahead which isn't dequeued within
+    // BufferQueueCore::PREALLOCATION_TIMEOUT is freed.
+    void setPreallocationBudget(size_t bytes);
+
 private:
     sp<BufferQueueCore> mCore;
 
@@ -17,7 +17,9 @@
 #ifndef ANDROID_GUI_BUFFERQUEUECORE_H
 #define ANDROID_GUI_BUFFERQUEUECORE_H
 
+#include <gui/BufferAllocationPredictor.h>
 #include <gui/BufferItem.h>
+#include <gui/BufferItemFifo.h>
 #include <gui/BufferQueueDefs.h>
 #include <gui/BufferSlot.h>
 #include <gui/OccupancyTracker.h>
@@ -26,13 +28,19 @@
 #include <utils/RefBase.h>
 #include <utils/String8.h>
 #include <utils/StrongPointer.h>
+#include <utils/Timers.h>
 #include <utils/Trace.h>
 #include <utils/Vector.h>
 
+#include <array>
+#include <atomic>
 #include <list>
 #include <set>
 #include <mutex>
 #include <condition_variable>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define ATRACE_BUFFER_INDEX(index)                                                         \
     do {                                                                                   \
@@ -70,7 +78,11 @@ public:
         NO_CONNECTED_API        = 0,
     };
 
-    typedef Vector<BufferItem> Fifo;
+    typedef BufferItemFifo Fifo;
+
+    // How long a buffer allocated ahead of dequeueBuffer is held for, at most,
+    // before it is freed unused.
+    static constexpr nsecs_t PREALLOCATION_TIMEOUT = ms2ns(500);
 
     // BufferQueueCore manages a pool of gralloc memory slots to be used by
     // producers and consumers.
@@ -114,6 +126,38 @@ private:
     // given slot.
     void clearBufferSlotLocked(int slot);
 
+    // setReleasableLocked lets the consumer release the buffer it just acquired
+    // in the given slot without mMutex held, see releaseBuffer. It isn't
+    // allowed in shared buffer mode or when the producer wants to be notified
+    // of releases, which both need mMutex.
+    void setReleasableLocked(int slot, uint64_t frameNumber);
+
+    // revokeReleasableLocked takes back what setReleasableLocked allowed for the
+    // given slot, dropping the release if it already happened without mMutex.
+    // revokeAllReleasableLocked does it for every slot, applying the releases
+    // which already happened first.
+    void revokeReleasableLocked(int slot);
+    void revokeAllReleasableLocked();
+
+    // takeReleaseStateLocked sets the release state of the given slot to
+    // RELEASE_NOT_ALLOWED and returns the previous one. A release which claimed
+    // the slot is only a few stores away from RELEASE_PENDING, so it waits.
+    uint64_t takeReleaseStateLocked(int slot);
+
+    // releaseWithoutLock releases the buffer acquired in the given slot if
+    // setReleasableLocked allowed it for that frame number. It returns false,
+    // doing nothing, if the caller has to release the buffer with mMutex held.
+    bool releaseWithoutLock(int slot, uint64_t frameNumber, const sp<Fence>& releaseFence);
+
+    // applyPendingReleasesLocked moves the slots releaseWithoutLock released
+    // from ACQUIRED to FREE. It must be called before counting acquired slots
+    // or looking for a free buffer.
+    void applyPendingReleasesLocked();
+
+    // releasePendingSlotLocked does what releaseBuffer does with mMutex held
+    // for a slot releaseWithoutLock released.
+    void releasePendingSlotLocked(int slot);
+
     // freeAllBuffersLocked frees the GraphicBuffer and sync resources for
     // all slots, even if they're currently dequeued, queued, or acquired.
     void freeAllBuffersLocked();
@@ -130,6 +174,32 @@ private:
     // waitWhileAllocatingLocked blocks until mIsAllocating is false.
     void waitWhileAllocatingLocked(std::unique_lock<std::mutex>& lock) const;
 
+    // onBufferAllocatedLocked records that dequeueBuffer allocated a buffer
+    // with the given attributes, and asks mPreallocationThread to allocate the
+    // buffers predicted to be needed next, if any and if the budget allows.
+    void onBufferAllocatedLocked(const BufferAllocationConfig& config);
+
+    // takePreallocatedBufferLocked returns a buffer allocated ahead with the
+    // given attributes, or NULL if there is none. If such a buffer is being or
+    // is about to be allocated, it waits for it rather than let the caller
+    // allocate another.
+    sp<GraphicBuffer> takePreallocatedBufferLocked(std::unique_lock<std::mutex>& lock,
+            const BufferAllocationConfig& config);
+
+    // discardPreallocatedBuffersLocked hands the buffers allocated ahead which
+    // weren't dequeued yet to mPreallocationThread to be freed, and cancels
+    // the pending preallocations.
+    void discardPreallocatedBuffersLocked();
+
+    // setPreallocationBudgetLocked sets mPreallocationBudget, discarding the
+    // buffers allocated ahead which no longer fit in it.
+    void setPreallocationBudgetLocked(size_t bytes);
+
+    // preallocationThreadMain is the loop of mPreallocationThread. It
+    // allocates the buffers requested by onBufferAllocatedLocked, frees the
+    // ones which expired or were discarded, all without mMutex held.
+    void preallocationThreadMain();
+
 #if DEBUG_ONLY_CODE
     // validateConsistencyLocked ensures that the free lists are in sync with
     // the information stored in mSlots
@@ -219,6 +289,24 @@ private:
     // synchronous mode.
     mutable std::condition_variable mDequeueCondition;
 
+    // mReleaseStates holds, for each slot, the frame number releaseWithoutLock
+    // may release, or one of the ReleaseState values. mReleaseFences holds the
+    // fence of a RELEASE_PENDING slot, and mPendingReleases a bit for each such
+    // slot. They are the only slot state changed without mMutex held.
+    enum ReleaseState : uint64_t {
+        RELEASE_NOT_ALLOWED = 0,
+        RELEASE_CLAIMED = UINT64_MAX - 1,
+        RELEASE_PENDING = UINT64_MAX,
+    };
+    std::array<std::atomic<uint64_t>, BufferQueueDefs::NUM_BUFFER_SLOTS> mReleaseStates{};
+    std::array<sp<Fence>, BufferQueueDefs::NUM_BUFFER_SLOTS> mReleaseFences;
+    std::atomic<uint64_t> mPendingReleases{0};
+
+    // mDequeueWaiters counts the threads which may wait on mDequeueCondition
+    // for a buffer to be released. releaseWithoutLock only takes mMutex to
+    // broadcast mDequeueCondition when it is not 0.
+    std::atomic<int> mDequeueWaiters{0};
+
     // mDequeueBufferCannotBlock indicates whether dequeueBuffer is allowed to
     // block. This flag is set during connect when both the producer and
     // consumer are controlled by the application.
@@ -357,6 +445,63 @@ private:
     // This allows the consumer to acquire an additional buffer if that buffer is not droppable and
     // will eventually be released or acquired by the consumer.
     bool mAllowExtraAcquire = false;
+
+    // mAllocationPredictor predicts the attributes of the next buffer the
+    // connected producer needs allocated, from the ones dequeueBuffer
+    // allocated. It is reset when a producer connects.
+    BufferAllocationPredictor mAllocationPredictor;
+
+    // A buffer allocated ahead of the dequeueBuffer predicted to need it, with
+    // the bytes it is accounted for in mPreallocationBudget and the time it
+    // was allocated at.
+    struct PreallocatedBuffer {
+        BufferAllocationConfig config;
+        sp<GraphicBuffer> buffer;
+        size_t bytes;
+        nsecs_t allocationTime;
+    };
+
+    // mPreallocatedBuffers holds the buffers allocated ahead which weren't
+    // dequeued yet, and mPreallocatedBytes the bytes they hold, which never
+    // exceed mPreallocationBudget. A budget of 0 disables preallocation.
+    std::vector<PreallocatedBuffer> mPreallocatedBuffers;
+    size_t mPreallocatedBytes = 0;
+    size_t mPreallocationBudget = 0;
+
+    // mLastAllocationConfig holds the attributes of the last buffer
+    // dequeueBuffer allocated, whose preallocated buffers are kept even when
+    // another size is predicted next.
+    BufferAllocationConfig mLastAllocationConfig;
+
+    // mPendingPreallocationCount is the number of buffers with the attributes
+    // mPendingPreallocationConfig mPreallocationThread still has to allocate.
+    size_t mPendingPreallocationCount = 0;
+    BufferAllocationConfig mPendingPreallocationConfig;
+
+    // mIsPreallocating indicates whether a buffer with the attributes
+    // mPreallocatingConfig is being allocated by mPreallocationThread. At most
+    // one buffer is. mPreallocationCondition is signaled when it is done.
+    bool mIsPreallocating = false;
+    BufferAllocationConfig mPreallocatingConfig;
+    mutable std::condition_variable mPreallocationCondition;
+
+    // mBuffersToFree holds the buffers allocated ahead which won't be used,
+    // for mPreallocationThread to drop without mMutex held.
+    std::vector<sp<GraphicBuffer>> mBuffersToFree;
+
+    // mPreallocationThread allocates and frees the buffers allocated ahead. It
+    // is started by the first prediction, so that queues whose producer never
+    // resizes don't pay for it, and stopped by the destructor.
+    // mPreallocationThreadCondition wakes it up when there is work to do.
+    std::thread mPreallocationThread;
+    bool mPreallocationThreadStopped = false;
+    std::condition_variable mPreallocationThreadCondition;
+
+    // Counts of the buffers allocated ahead, of the ones dequeueBuffer used,
+    // and of the ones freed unused because the prediction was wrong.
+    uint64_t mPreallocationCount = 0;
+    uint64_t mPreallocationHitCount = 0;
+    uint64_t mPreallocationMissCount = 0;
 }; // class BufferQueueCore
 
 } // namespace android
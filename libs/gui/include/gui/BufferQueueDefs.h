@@ -26,6 +26,9 @@ namespace android {
     namespace BufferQueueDefs {
         typedef BufferSlot SlotsType[NUM_BUFFER_SLOTS];
     } // namespace BufferQueueDefs
+
+    // The number of layers of the buffers a BufferQueue allocates.
+    static constexpr uint32_t BQ_LAYER_COUNT = 1;
 } // namespace android
 
 #endif
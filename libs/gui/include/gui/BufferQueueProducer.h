@@ -17,12 +17,16 @@
 #ifndef ANDROID_GUI_BUFFERQUEUEPRODUCER_H
 #define ANDROID_GUI_BUFFERQUEUEPRODUCER_H
 
+#include <gui/BufferItem.h>
 #include <gui/BufferQueueDefs.h>
 #include <gui/IGraphicBufferProducer.h>
 
+#include <memory>
+
 namespace android {
 
 class IBinder;
+class IConsumerListener;
 struct BufferSlot;
 
 #ifndef NO_BINDER
@@ -45,6 +49,11 @@ public:
     // flags indicating that previously-returned buffers are no longer valid.
     virtual status_t requestBuffer(int slot, sp<GraphicBuffer>* buf);
 
+    // See IGraphicBufferProducer::requestBuffers. The BufferQueue is locked
+    // once for the whole batch.
+    virtual status_t requestBuffers(const std::vector<int32_t>& slots,
+                                    std::vector<RequestBufferOutput>* outputs) override;
+
     // see IGraphicsBufferProducer::setMaxDequeuedBufferCount
     virtual status_t setMaxDequeuedBufferCount(int maxDequeuedBuffers);
 
@@ -91,6 +100,12 @@ public:
                                    uint64_t* outBufferAge,
                                    FrameEventHistoryDelta* outTimestamps) override;
 
+    // See IGraphicBufferProducer::dequeueBuffers. The BufferQueue is locked
+    // once to find the slots of the whole batch, and the buffers missing from
+    // these slots are then allocated in a single pass without the lock held.
+    virtual status_t dequeueBuffers(const std::vector<DequeueBufferInput>& inputs,
+                                    std::vector<DequeueBufferOutput>* outputs) override;
+
     // See IGraphicBufferProducer::detachBuffer
     virtual status_t detachBuffer(int slot);
 
@@ -119,6 +134,12 @@ public:
     virtual status_t queueBuffer(int slot,
             const QueueBufferInput& input, QueueBufferOutput* output);
 
+    // See IGraphicBufferProducer::queueBuffers. The BufferQueue is locked once
+    // for the whole batch, and the consumer is called back for the whole batch
+    // in a single pass, after which the producer throttles once.
+    virtual status_t queueBuffers(const std::vector<QueueBufferInput>& inputs,
+                                  std::vector<QueueBufferOutput>* outputs) override;
+
     // cancelBuffer returns a dequeued buffer to the BufferQueue, but doesn't
     // queue it for use by the consumer.
     //
@@ -193,6 +214,9 @@ public:
     // See IGraphicBufferProducer::getFrameTimestamps
     virtual void getFrameTimestamps(FrameEventHistoryDelta* outDelta) override;
 
+    // See IGraphicBufferProducer::getFrameTimestampsRing
+    virtual status_t getFrameTimestampsRing(base::unique_fd* outRing) override;
+
     // See IGraphicBufferProducer::getUniqueId
     virtual status_t getUniqueId(uint64_t* outId) const override;
 
@@ -229,6 +253,60 @@ private:
     status_t waitForFreeSlotThenRelock(FreeSlotCaller caller, std::unique_lock<std::mutex>& lock,
             int* found) const;
 
+    status_t requestBufferLocked(int slot, sp<GraphicBuffer>* buf);
+
+    // A buffer being dequeued by dequeueBuffer or dequeueBuffers. Dequeuing
+    // takes the following steps, so that dequeueBuffers can take each of them
+    // for the whole batch at once:
+    // 1. dequeueBufferLocked finds a slot, with mCore->mMutex held.
+    // 2. allocateDequeuedBuffer allocates the buffer of the slot if needed,
+    //    without the lock held.
+    // 3. attachDequeuedBufferLocked puts the allocated buffer in the slot, with
+    //    the lock held. Once all the buffers it allocated are attached, the
+    //    caller clears mCore->mIsAllocating.
+    // 4. finishDequeue waits for the EGL fence of the slot, without the lock
+    //    held.
+    struct DequeueOperation {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        PixelFormat format = 0;
+        uint64_t usage = 0;
+
+        int slot = BufferItem::INVALID_BUFFER_SLOT;
+        status_t returnFlags = NO_ERROR;
+        uint64_t bufferAge = 0;
+        EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+        EGLSyncKHR eglFence = EGL_NO_SYNC_KHR;
+        bool attachedByConsumer = false;
+        sp<GraphicBuffer> allocatedBuffer;
+    };
+    // Waits for an allocation in progress to finish if no buffer is free, so
+    // that dequeuing doesn't allocate in parallel.
+    void waitForAllocationBeforeDequeueLocked(std::unique_lock<std::mutex>& lock);
+    status_t dequeueBufferLocked(std::unique_lock<std::mutex>& lock, DequeueOperation* dequeue,
+                                 sp<Fence>* outFence);
+    void allocateDequeuedBuffer(DequeueOperation* dequeue) const;
+    status_t attachDequeuedBufferLocked(DequeueOperation* dequeue);
+    status_t finishDequeue(const DequeueOperation& dequeue, uint64_t* outBufferAge,
+                           FrameEventHistoryDelta* outTimestamps);
+
+    // A buffer being queued by queueBuffer or queueBuffers. queueBufferLocked
+    // queues the buffer with mCore->mMutex held, then onFramesQueued calls
+    // back the consumer without the lock held, for all the buffers queued
+    // with the same callback ticket.
+    struct QueueOperation {
+        BufferItem item;
+        sp<IConsumerListener> frameAvailableListener;
+        sp<IConsumerListener> frameReplacedListener;
+        int64_t requestedPresentTimestamp = 0;
+        std::shared_ptr<FenceTime> acquireFenceTime;
+        bool getFrameTimestamps = false;
+        QueueBufferOutput* output = nullptr;
+    };
+    status_t queueBufferLocked(int slot, const QueueBufferInput& input, QueueBufferOutput* output,
+                               QueueOperation* queue);
+    void onFramesQueued(QueueOperation* queues, size_t count, int callbackTicket);
+
     sp<BufferQueueCore> mCore;
 
     // This references mCore->mSlots. Lock mCore->mMutex while accessing.
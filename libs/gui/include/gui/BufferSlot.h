@@ -24,6 +24,7 @@
 #include <EGL/eglext.h>
 
 #include <utils/StrongPointer.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -182,7 +183,8 @@ struct BufferSlot {
       mEglFence(EGL_NO_SYNC_KHR),
       mFence(Fence::NO_FENCE),
       mAcquireCalled(false),
-      mNeedsReallocation(false) {
+      mNeedsReallocation(false),
+      mQueueTime(0) {
     }
 
     // mGraphicBuffer points to the buffer allocated for this slot or is NULL
@@ -230,6 +232,10 @@ struct BufferSlot {
     // producer. If so, it needs to set the BUFFER_NEEDS_REALLOCATION flag when
     // dequeued to prevent the producer from using a stale cached buffer.
     bool mNeedsReallocation;
+
+    // mQueueTime is the time the buffer of this slot was last queued, to
+    // measure how long it waits before being acquired.
+    nsecs_t mQueueTime;
 };
 
 } // namespace android
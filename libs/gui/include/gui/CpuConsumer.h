@@ -111,6 +111,19 @@ class CpuConsumer : public ConsumerBase
     // lockNextBuffer.
     status_t unlockBuffer(const LockedBuffer &nativeBuffer);
 
+    // Converts the pixels of a locked buffer to packed RGBA_8888, writing
+    // buffer.height rows of dstStride bytes to dst. The buffer may be of
+    // format RGBA_8888, RGBX_8888 or RGB_565, or be locked as flexible
+    // YCbCr_420_888, in which case its dataspace selects the BT.601 or BT.709
+    // coefficients and the range. BAD_VALUE is returned for other formats.
+    //
+    // The rows are split in up to threadCount bands, converted by the calling
+    // thread and by worker threads kept across calls, at most one less than
+    // the number of CPUs. Each band has at least 128K pixels, so small buffers
+    // are converted on the calling thread alone.
+    static status_t convertToRgba8888(const LockedBuffer& buffer, uint8_t* dst,
+            size_t dstStride, size_t threadCount = 1);
+
   private:
     // Maximum number of buffers that can be locked at a time
     const size_t mMaxLockedBuffers;
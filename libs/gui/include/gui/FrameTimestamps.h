@@ -17,6 +17,7 @@
 #ifndef ANDROID_GUI_FRAMETIMESTAMPS_H
 #define ANDROID_GUI_FRAMETIMESTAMPS_H
 
+#include <android-base/unique_fd.h>
 #include <ui/FenceTime.h>
 #include <utils/Flattenable.h>
 #include <utils/StrongPointer.h>
@@ -24,6 +25,8 @@
 
 #include <array>
 #include <bitset>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace android {
@@ -102,6 +105,89 @@ struct CompositorTiming {
     nsecs_t presentLatency{16666667};
 };
 
+// The timestamps of the most recent frames, published by the consumer in
+// shared memory for the producer to read without asking the consumer for a
+// delta through the IGraphicBufferProducer.
+//
+// Fences can't be shared this way, so each fence is published by its signal
+// time once it signals. Each slot is guarded by a sequence lock. Writers, all
+// in the consumer's process, serialize on a mutex, and readers retry reading a
+// slot that is being written, so the producer never waits on the consumer.
+class FrameTimestampsRing {
+public:
+    struct Record {
+        uint64_t frameNumber{0};
+        bool addPostCompositeCalled{false};
+        bool addReleaseCalled{false};
+        nsecs_t latchTime{FrameEvents::TIMESTAMP_PENDING};
+        nsecs_t firstRefreshStartTime{FrameEvents::TIMESTAMP_PENDING};
+        nsecs_t lastRefreshStartTime{FrameEvents::TIMESTAMP_PENDING};
+        nsecs_t dequeueReadyTime{FrameEvents::TIMESTAMP_PENDING};
+        nsecs_t gpuCompositionDoneTime{Fence::SIGNAL_TIME_INVALID};
+        nsecs_t displayPresentTime{Fence::SIGNAL_TIME_INVALID};
+        nsecs_t releaseTime{Fence::SIGNAL_TIME_INVALID};
+    };
+
+    // The fences of a frame the consumer publishes once they signal.
+    enum class SignalTime {
+        GPU_COMPOSITION_DONE,
+        DISPLAY_PRESENT,
+        RELEASE,
+    };
+
+    // Creates a ring holding the last |capacity| frames, which are expected
+    // to be numbered consecutively, in a new shared memory region. Returns
+    // nullptr if the region can't be created.
+    static std::shared_ptr<FrameTimestampsRing> create(size_t capacity);
+
+    // Maps the ring of the consumer read-only. Returns nullptr if |fd| isn't
+    // a ring.
+    static std::shared_ptr<const FrameTimestampsRing> map(base::unique_fd fd);
+
+    ~FrameTimestampsRing();
+
+    // Returns a new file descriptor of the shared memory region, to hand to
+    // the producer.
+    base::unique_fd dupFd() const;
+
+    // Overwrites the record of the frame |capacity| frames before. A signal
+    // time still pending in |record| doesn't overwrite one already published
+    // for the frame by publishSignalTime().
+    void publish(const Record& record);
+
+    // Publishes the signal time of a fence of the frame, unless the frame has
+    // been overwritten since.
+    void publishSignalTime(uint64_t frameNumber, SignalTime which,
+            nsecs_t signalTime);
+
+    // Publishes the signal time of |fence| once it signals, from another
+    // thread. Nothing is published if the ring is destroyed before then.
+    static void publishSignalTimeWhenSignaled(
+            const std::shared_ptr<FrameTimestampsRing>& ring,
+            uint64_t frameNumber, SignalTime which,
+            const std::shared_ptr<FenceTime>& fence);
+
+    // Returns false if the frame isn't in the ring, or kept being overwritten
+    // while reading it.
+    bool read(uint64_t frameNumber, Record* outRecord) const;
+
+private:
+    struct Header;
+    struct Slot;
+
+    FrameTimestampsRing(base::unique_fd fd, void* base, size_t size);
+
+    static size_t getRegionSize(size_t capacity);
+
+    const base::unique_fd mFd;
+    void* const mBase;
+    const size_t mSize;
+    const size_t mCapacity;
+    Slot* const mSlots;
+
+    std::mutex mWriteMutex;
+};
+
 // A short history of frames that are synchronized between the consumer and
 // producer via deltas.
 class FrameEventHistory {
@@ -144,6 +230,13 @@ public:
             uint64_t frameNumber, std::shared_ptr<FenceTime>&& acquire);
     void applyDelta(const FrameEventHistoryDelta& delta);
 
+    void setTimestampsRing(std::shared_ptr<const FrameTimestampsRing> ring);
+    bool hasTimestampsRing() const { return mTimestampsRing != nullptr; }
+    // Applies the timestamps the consumer published for the frame. Returns
+    // false if the frame isn't in the ring, in which case the consumer must
+    // be asked for a delta.
+    bool applyPublishedTimestamps(uint64_t frameNumber);
+
     void updateSignalTimes();
 
 protected:
@@ -164,6 +257,8 @@ protected:
     FenceTimeline mGpuCompositionDoneTimeline;
     FenceTimeline mPresentTimeline;
     FenceTimeline mReleaseTimeline;
+
+    std::shared_ptr<const FrameTimestampsRing> mTimestampsRing;
 };
 
 
@@ -225,9 +320,15 @@ public:
 
     void getAndResetDelta(FrameEventHistoryDelta* delta);
 
+    // Publishes the events of the frames of the current connection to the
+    // ring as they are added, and the signal times of their fences once they
+    // signal.
+    void setTimestampsRing(std::shared_ptr<FrameTimestampsRing> ring);
+
 private:
     void getFrameDelta(FrameEventHistoryDelta* delta,
                        const std::vector<FrameEvents>::iterator& frame);
+    void publishFrame(const FrameEvents& frame);
 
     std::vector<FrameEventDirtyFields> mFramesDirty;
 
@@ -237,6 +338,8 @@ private:
 
     int mCurrentConnectId{0};
     bool mProducerWantsEvents{false};
+
+    std::shared_ptr<FrameTimestampsRing> mTimestampsRing;
 };
 
 
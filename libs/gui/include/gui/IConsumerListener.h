@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <android-base/unique_fd.h>
 #include <binder/IInterface.h>
 #include <binder/SafeInterface.h>
 
@@ -90,6 +91,13 @@ public:
     // WARNING: This method can only be called when the BufferQueue is in the consumer's process.
     virtual void addAndGetFrameTimestamps(const NewFrameEventsEntry* /*newTimestamps*/,
                                           FrameEventHistoryDelta* /*outDelta*/) {}
+
+    // Returns the shared memory the consumer publishes frame events to, if it does. See
+    // IGraphicBufferProducer::getFrameTimestampsRing. Returns INVALID_OPERATION if the consumer is
+    // in another process than the BufferQueue.
+    virtual status_t getFrameTimestampsRing(base::unique_fd* /*outRing*/) {
+        return INVALID_OPERATION;
+    }
 };
 
 #ifndef NO_BINDER
@@ -659,6 +659,15 @@ public:
     // Gets the frame events that haven't already been retrieved.
     virtual void getFrameTimestamps(FrameEventHistoryDelta* /*outDelta*/) {}
 
+    // Gets the shared memory the consumer publishes the frame events to, to
+    // map with FrameTimestampsRing::map(). Reading it saves asking for a delta
+    // with getFrameTimestamps() while the events of a frame are pending.
+    //
+    // Returns INVALID_OPERATION if the consumer doesn't publish frame events.
+    virtual status_t getFrameTimestampsRing(base::unique_fd* /*outRing*/) {
+        return INVALID_OPERATION;
+    }
+
     // Returns a unique id for this BufferQueue
     virtual status_t getUniqueId(uint64_t* outId) const = 0;
 
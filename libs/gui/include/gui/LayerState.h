@@ -34,6 +34,7 @@
 #include <gui/ISurfaceComposer.h>
 #include <gui/LayerCaptureArgs.h>
 #include <gui/LayerMetadata.h>
+#include <gui/OccupancyTracker.h>
 #include <gui/SpHash.h>
 #include <gui/SurfaceControl.h>
 #include <gui/WindowInfo.h>
@@ -47,6 +48,7 @@
 #include <ui/StretchEffect.h>
 #include <ui/Transform.h>
 #include <utils/Errors.h>
+#include <optional>
 
 namespace android {
 
@@ -107,6 +109,10 @@ public:
 
     client_cache_t cachedBuffer;
 
+    // Set by BLASTBufferQueue to report the BufferQueue histograms of its process to
+    // SurfaceFlinger, see OccupancyHistogram::takeProcessHistogramDelta().
+    std::optional<OccupancyHistogram::Snapshot> occupancyDelta;
+
     // Generates the release callback id based on the buffer id and frame number.
     // This is used as an identifier when release callbacks are invoked.
     ReleaseCallbackId generateReleaseCallbackId() const;
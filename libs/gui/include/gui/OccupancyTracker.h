@@ -22,13 +22,81 @@
 
 #include <utils/Timers.h>
 
+#include <array>
+#include <atomic>
 #include <deque>
+#include <string>
 #include <unordered_map>
 
 namespace android {
 
 class String8;
 
+// Histograms of the number of buffers queued to BufferQueues over time, and of
+// the time buffers wait in the queue before being acquired.
+//
+// The counters are atomics, so that a histogram is read without the lock of the
+// BufferQueue recording into it, e.g. while dumping, and so that the histograms
+// of all the BufferQueues of a process are aggregated in a single one.
+class OccupancyHistogram
+{
+public:
+    // Occupancies of 0 to OCCUPANCY_BUCKET_COUNT - 1 buffers, the last bucket
+    // counting larger occupancies as well.
+    static constexpr size_t OCCUPANCY_BUCKET_COUNT = 5;
+
+    // Latencies below FIRST_LATENCY_LIMIT, then doubling, the last bucket
+    // counting latencies of 256 ms and more.
+    static constexpr size_t LATENCY_BUCKET_COUNT = 12;
+    static constexpr nsecs_t FIRST_LATENCY_LIMIT = us2ns(250);
+
+    // Histograms of at most one export per EXPORT_PERIOD are reported to
+    // another process, see takeProcessHistogramDelta().
+    static constexpr nsecs_t EXPORT_PERIOD = s2ns(1);
+
+    struct Snapshot : public Parcelable {
+        std::array<nsecs_t, OCCUPANCY_BUCKET_COUNT> occupancyTimes{};
+        std::array<uint64_t, LATENCY_BUCKET_COUNT> latencyCounts{};
+
+        bool isEmpty() const;
+
+        // Appends the histograms as two lines, each starting with prefix.
+        void dump(std::string& result, const std::string& prefix) const;
+
+        // Parcelable interface
+        virtual status_t writeToParcel(Parcel* parcel) const override;
+        virtual status_t readFromParcel(const Parcel* parcel) override;
+    };
+
+    // Records that a queue held occupancy buffers for duration.
+    void recordOccupancy(size_t occupancy, nsecs_t duration);
+
+    // Records that a buffer was acquired latency after being queued.
+    void recordLatency(nsecs_t latency);
+
+    // Adds the counters of snapshot, e.g. of a delta reported by another
+    // process.
+    void add(const Snapshot& snapshot);
+
+    Snapshot getSnapshot() const;
+
+    // The histogram aggregating those of all the BufferQueues of the process.
+    // Queues record into it from their consumer side, so it doesn't cover the
+    // queues of other processes, e.g. SurfaceFlinger's doesn't cover BLAST.
+    static OccupancyHistogram& getProcessHistogram();
+
+    // Sets delta to what the process histogram recorded since the last delta
+    // taken, so that it is reported to another process, e.g. by
+    // BLASTBufferQueue to SurfaceFlinger. Returns false and leaves the counts
+    // to a later call if nothing was recorded, or if the last delta was taken
+    // less than EXPORT_PERIOD before now.
+    static bool takeProcessHistogramDelta(nsecs_t now, Snapshot* delta);
+
+private:
+    std::array<std::atomic<nsecs_t>, OCCUPANCY_BUCKET_COUNT> mOccupancyTimes{};
+    std::array<std::atomic<uint64_t>, LATENCY_BUCKET_COUNT> mLatencyCounts{};
+};
+
 class OccupancyTracker
 {
 public:
@@ -72,6 +140,14 @@ public:
     void registerOccupancyChange(size_t occupancy);
     std::vector<Segment> getSegmentHistory(bool forceFlush);
 
+    // Records the time a buffer waited in the queue before being acquired.
+    void registerQueueToAcquireLatency(nsecs_t latency);
+
+    // The histograms of this queue. Unlike the segment history, they are never
+    // cleared, and are also aggregated in
+    // OccupancyHistogram::getProcessHistogram().
+    const OccupancyHistogram& getHistogram() const { return mHistogram; }
+
 private:
     static constexpr size_t MAX_HISTORY_SIZE = 10;
     static constexpr nsecs_t NEW_SEGMENT_DELAY = ms2ns(100);
@@ -97,6 +173,8 @@ private:
     size_t mLastOccupancy;
     nsecs_t mLastOccupancyChangeTime;
 
+    OccupancyHistogram mHistogram;
+
 }; // class OccupancyTracker
 
 } // namespace android
@@ -18,6 +18,7 @@
 #define ANDROID_GUI_STREAMSPLITTER_H
 
 #include <gui/IConsumerListener.h>
+#include <gui/IGraphicBufferProducer.h>
 #include <gui/IProducerListener.h>
 
 #include <utils/Condition.h>
@@ -25,11 +26,17 @@
 #include <utils/Mutex.h>
 #include <utils/StrongPointer.h>
 
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
 namespace android {
 
 class GraphicBuffer;
 class IGraphicBufferConsumer;
-class IGraphicBufferProducer;
 
 // StreamSplitter is an autonomous class that manages one input BufferQueue
 // and multiple output BufferQueues. By using the buffer attach and detach logic
@@ -63,6 +70,18 @@ public:
     // of other error codes.
     status_t addOutput(const sp<IGraphicBufferProducer>& outputQueue);
 
+    // setParallelFanOut enables feeding each output from its own thread, so
+    // that buffers are attached and queued to all of the outputs concurrently
+    // rather than one output after another. In this mode, an output which is
+    // late releasing its buffers doesn't hold back the input or the other
+    // outputs: buffers queued to the input while an output holds
+    // MAX_OUTSTANDING_BUFFERS buffers are not queued to that output, and are
+    // returned to the input as soon as the other outputs release them.
+    //
+    // This must be called before adding any output. INVALID_OPERATION is
+    // returned otherwise.
+    status_t setParallelFanOut(bool enabled);
+
     // setName sets the consumer name of the input queue
     void setName(const String8& name);
 
@@ -104,6 +123,36 @@ private:
     // acquire. This must be called with mMutex locked.
     void onAbandonedLocked();
 
+    class BufferTracker;
+
+    // Returns a buffer all of the outputs it was queued to have released to
+    // the input, and allows a blocked onFrameAvailable call to proceed. This
+    // must be called with mMutex locked.
+    void returnBufferLocked(const sp<BufferTracker>& tracker);
+
+    // Hands the buffer to the worker of each output that isn't late. This must
+    // be called with mMutex locked.
+    void fanOutLocked(const sp<BufferTracker>& tracker,
+            const IGraphicBufferProducer::QueueBufferInput& queueInput);
+
+    // Attaches and queues a buffer to an output in parallel fan-out mode.
+    struct OutputWorker {
+        explicit OutputWorker(const sp<IGraphicBufferProducer>& output)
+              : mOutput(output) {}
+
+        const sp<IGraphicBufferProducer> mOutput;
+        std::thread mThread;
+        // The following are guarded by the splitter's mMutex.
+        Condition mCondition;
+        std::deque<std::pair<sp<BufferTracker>,
+                IGraphicBufferProducer::QueueBufferInput>> mPendingBuffers;
+        // Buffers handed to the output and not released by it yet
+        int mOutstandingBuffers = 0;
+        bool mStopped = false;
+    };
+
+    void runOutputWorker(OutputWorker* worker);
+
     // This is a thin wrapper class that lets us determine which BufferQueue
     // the IProducerListener::onBufferReleased callback is associated with. We
     // create one of these per output BufferQueue, and then pass the producer
@@ -133,11 +182,19 @@ private:
         const sp<GraphicBuffer>& getBuffer() const { return mBuffer; }
         const sp<Fence>& getMergedFence() const { return mMergedFence; }
 
+        // Only called while mMutex is held
         void mergeFence(const sp<Fence>& with);
 
-        // Returns the new value
-        // Only called while mMutex is held
-        size_t incrementReleaseCountLocked() { return ++mReleaseCount; }
+        // Sets how many outputs must release the buffer before it can be
+        // returned to the input
+        void setPendingReleases(size_t count) {
+            mPendingReleases.store(count, std::memory_order_relaxed);
+        }
+
+        // Returns true if this was the last output holding the buffer
+        bool release() {
+            return mPendingReleases.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
 
     private:
         // Only destroy through LightRefBase
@@ -150,7 +207,7 @@ private:
 
         sp<GraphicBuffer> mBuffer; // One instance that holds this native handle
         sp<Fence> mMergedFence;
-        size_t mReleaseCount;
+        std::atomic<size_t> mPendingReleases;
     };
 
     // Only called from createSplitter
@@ -173,6 +230,10 @@ private:
     sp<IGraphicBufferConsumer> mInput;
     Vector<sp<IGraphicBufferProducer> > mOutputs;
 
+    bool mParallelFanOut;
+    // One per output in parallel fan-out mode
+    std::vector<std::unique_ptr<OutputWorker>> mWorkers;
+
     // Map of GraphicBuffer IDs (GraphicBuffer::getId()) to buffer tracking
     // objects (which are mostly for counting how many outputs have released the
     // buffer, but also contain merged release fences).
@@ -22,6 +22,8 @@
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <binder/IBinder.h>
 
@@ -387,13 +389,16 @@ public:
         }
     };
 
+    // The callbacks and SurfaceControls are kept in vectors without duplicates rather than in
+    // sets. A transaction usually has a few of each, and clearing a vector keeps its storage for
+    // the next use of the transaction.
     struct CallbackInfo {
         // All the callbacks that have been requested for a TransactionCompletedListener in the
         // Transaction
-        std::unordered_set<CallbackId, CallbackIdHash> callbackIds;
+        std::vector<CallbackId> callbackIds;
         // All the SurfaceControls that have been modified in this TransactionCompletedListener's
         // process that require a callback if there is one or more callbackIds set.
-        std::unordered_set<sp<SurfaceControl>, SCHash> surfaceControls;
+        std::vector<sp<SurfaceControl>> surfaceControls;
     };
 
     class Transaction : public Parcelable {
@@ -401,7 +406,42 @@ public:
         void releaseBufferIfOverwriting(const layer_state_t& state);
 
     protected:
-        std::unordered_map<sp<IBinder>, ComposerState, IBinderHash> mComposerStates;
+        // The states of the layers changed, by handle, in the order they were first changed. Most
+        // transactions change few layers, so their states are found by scanning, which is cheaper
+        // than hashing, and merging moves them without rehashing them. Past kIndexThreshold
+        // layers, the handles are indexed so that changing many layers isn't quadratic.
+        class ComposerStates {
+        public:
+            using Entry = std::pair<sp<IBinder>, ComposerState>;
+            using iterator = std::vector<Entry>::iterator;
+            using const_iterator = std::vector<Entry>::const_iterator;
+
+            iterator begin() { return mStates.begin(); }
+            iterator end() { return mStates.end(); }
+            const_iterator begin() const { return mStates.begin(); }
+            const_iterator end() const { return mStates.end(); }
+            size_t size() const { return mStates.size(); }
+            bool empty() const { return mStates.empty(); }
+            void reserve(size_t count) { mStates.reserve(count); }
+            void clear() {
+                mStates.clear();
+                mIndices.clear();
+            }
+
+            // Returns end() if the layer of the handle wasn't changed.
+            iterator find(const sp<IBinder>& handle);
+            // Adds the state of a layer which wasn't changed yet.
+            iterator add(const sp<IBinder>& handle, ComposerState&& state);
+
+        private:
+            static constexpr size_t kIndexThreshold = 16;
+
+            std::vector<Entry> mStates;
+            // The index in mStates of the state of each handle. Built by find() once there are
+            // more than kIndexThreshold states, and kept up to date by add() from then on.
+            std::unordered_map<sp<IBinder>, size_t, IBinderHash> mIndices;
+        };
+        ComposerStates mComposerStates;
         SortedVector<DisplayState> mDisplayStates;
         std::unordered_map<sp<ITransactionCompletedListener>, CallbackInfo, TCLHash>
                 mListenerCallbacks;
@@ -550,6 +590,11 @@ public:
          */
         Transaction& setBufferHasBarrier(const sp<SurfaceControl>& sc,
                                          uint64_t barrierFrameNumber);
+        // Reports to SurfaceFlinger, along with the buffer set for the given SurfaceControl, the
+        // BufferQueue histograms recorded in this process since the last report. They are lost
+        // if the buffer is replaced before the transaction is applied.
+        Transaction& setBufferOccupancyDelta(const sp<SurfaceControl>& sc,
+                                             const OccupancyHistogram::Snapshot& delta);
         Transaction& setDataspace(const sp<SurfaceControl>& sc, ui::Dataspace dataspace);
         Transaction& setHdrMetadata(const sp<SurfaceControl>& sc, const HdrMetadata& hdrMetadata);
         Transaction& setSurfaceDamageRegion(const sp<SurfaceControl>& sc,
@@ -787,15 +832,12 @@ public:
 
     void startListeningLocked() REQUIRES(mMutex);
 
-    CallbackId addCallbackFunction(
-            const TransactionCompletedCallback& callbackFunction,
-            const std::unordered_set<sp<SurfaceControl>, SurfaceComposerClient::SCHash>&
-                    surfaceControls,
-            CallbackId::Type callbackType);
+    CallbackId addCallbackFunction(const TransactionCompletedCallback& callbackFunction,
+                                   const std::vector<sp<SurfaceControl>>& surfaceControls,
+                                   CallbackId::Type callbackType);
 
-    void addSurfaceControlToCallbacks(
-            const sp<SurfaceControl>& surfaceControl,
-            const std::unordered_set<CallbackId, CallbackIdHash>& callbackIds);
+    void addSurfaceControlToCallbacks(const sp<SurfaceControl>& surfaceControl,
+                                      const std::vector<CallbackId>& callbackIds);
 
     void addQueueStallListener(std::function<void()> stallListener, void* id);
     void removeQueueStallListener(void *id);
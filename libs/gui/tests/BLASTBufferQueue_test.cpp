@@ -37,8 +37,28 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdlib>
+#include <new>
+
 using namespace std::chrono_literals;
 
+// Counts the allocations of each thread, see ReusedTransactionClearAndMergeDoNotAllocate. Binder
+// threads allocate at any time, so only the test's own thread is looked at.
+static thread_local size_t tAllocationCount = 0;
+
+void* operator new(size_t size) {
+    tAllocationCount++;
+    void* ptr = std::malloc(size);
+    if (ptr == nullptr) {
+        std::abort();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
 namespace android {
 
 using Transaction = SurfaceComposerClient::Transaction;
@@ -165,6 +185,25 @@ public:
         mBlastBufferQueueAdapter->mergeWithNextTransaction(merge, frameNumber);
     }
 
+    void setFrameTimelineInfo(uint64_t frameNumber, const FrameTimelineInfo& info) {
+        mBlastBufferQueueAdapter->setFrameTimelineInfo(frameNumber, info);
+    }
+
+    // The capacities of the tables tracking frames in flight, which grow if they allocate.
+    std::pair<size_t, size_t> getFrameTableCapacities() {
+        std::unique_lock lock{mBlastBufferQueueAdapter->mMutex};
+        return {mBlastBufferQueueAdapter->mSubmitted.capacity(),
+                mBlastBufferQueueAdapter->mPendingFrameTimelines.capacity()};
+    }
+
+    // The counters of the buffers allocated ahead of the frames predicted to need them.
+    std::string getPreallocationStats() {
+        String8 dump;
+        mBlastBufferQueueAdapter->mConsumer->dumpState(String8{}, &dump);
+        const ssize_t start = dump.find("preallocation:");
+        return start < 0 ? std::string{} : std::string(dump.string() + start);
+    }
+
 private:
     sp<TestBLASTBufferQueue> mBlastBufferQueueAdapter;
 };
@@ -501,6 +540,108 @@ TEST_F(BLASTBufferQueueTest, TripleBuffering) {
     adapter.waitForCallbacks();
 }
 
+TEST_F(BLASTBufferQueueTest, SteadyStateFramesDoNotGrowFrameTables) {
+    BLASTBufferQueueHelper adapter(mSurfaceControl, mDisplayWidth, mDisplayHeight);
+    sp<IGraphicBufferProducer> igbProducer;
+    setUpProducer(adapter, igbProducer);
+    const auto initialCapacities = adapter.getFrameTableCapacities();
+
+    uint64_t frameNumber = 1;
+    const auto queueFrames = [&](int count) {
+        for (int i = 0; i < count; i++) {
+            int slot;
+            sp<Fence> fence;
+            sp<GraphicBuffer> buf;
+            auto ret = igbProducer->dequeueBuffer(&slot, &fence, mDisplayWidth, mDisplayHeight,
+                                                  PIXEL_FORMAT_RGBA_8888,
+                                                  GRALLOC_USAGE_SW_WRITE_OFTEN, nullptr, nullptr);
+            if (ret & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+                ASSERT_EQ(OK, igbProducer->requestBuffer(slot, &buf));
+            }
+            FrameTimelineInfo info;
+            info.vsyncId = static_cast<int64_t>(frameNumber);
+            adapter.setFrameTimelineInfo(frameNumber++, info);
+            IGraphicBufferProducer::QueueBufferOutput qbOutput;
+            IGraphicBufferProducer::QueueBufferInput input(systemTime(), true /* autotimestamp */,
+                                                           HAL_DATASPACE_UNKNOWN,
+                                                           Rect(mDisplayWidth, mDisplayHeight),
+                                                           NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                           Fence::NO_FENCE);
+            igbProducer->queueBuffer(slot, input, &qbOutput);
+        }
+    };
+
+    // The buffers are allocated, and the tables reserved, by the first frames.
+    ASSERT_NO_FATAL_FAILURE(queueFrames(10));
+    adapter.waitForCallbacks();
+    const auto capacities = adapter.getFrameTableCapacities();
+    EXPECT_EQ(initialCapacities, capacities);
+
+    ASSERT_NO_FATAL_FAILURE(queueFrames(100));
+    adapter.waitForCallbacks();
+    EXPECT_EQ(capacities, adapter.getFrameTableCapacities());
+}
+
+TEST_F(BLASTBufferQueueTest, ReusedTransactionClearAndMergeDoNotAllocate) {
+    // BLASTBufferQueue reuses a transaction for every frame. It is cleared once applied, and the
+    // transactions pending for the frame are merged into it.
+    Transaction t;
+    Transaction pending;
+    const auto runFrame = [&](int frame) {
+        pending.setDataspace(mSurfaceControl, ui::Dataspace::V0_SRGB)
+                .setBufferCrop(mSurfaceControl, Rect(frame, frame, mDisplayWidth, mDisplayHeight));
+        const size_t allocationCount = tAllocationCount;
+        t.clear();
+        t.merge(std::move(pending));
+        return tAllocationCount - allocationCount;
+    };
+
+    runFrame(0);
+    for (int frame = 1; frame < 10; frame++) {
+        EXPECT_EQ(0u, runFrame(frame)) << "frame " << frame;
+    }
+}
+
+TEST_F(BLASTBufferQueueTest, ResizeUsesPreallocatedBuffers) {
+    BLASTBufferQueueHelper adapter(mSurfaceControl, mDisplayWidth / 2, mDisplayHeight / 2);
+    sp<IGraphicBufferProducer> igbProducer;
+    setUpProducer(adapter, igbProducer);
+
+    // Grow the window by the same step at each frame, as a resize animation does.
+    for (uint32_t i = 0; i < 10; i++) {
+        const uint32_t width = mDisplayWidth / 2 + 8 * i;
+        const uint32_t height = mDisplayHeight / 2 + 4 * i;
+        adapter.update(mSurfaceControl, width, height);
+
+        int slot;
+        sp<Fence> fence;
+        sp<GraphicBuffer> buf;
+        auto ret = igbProducer->dequeueBuffer(&slot, &fence, width, height,
+                                              PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_SW_WRITE_OFTEN,
+                                              nullptr, nullptr);
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+                  ret & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION);
+        ASSERT_EQ(OK, igbProducer->requestBuffer(slot, &buf));
+        ASSERT_EQ(width, buf->getWidth());
+        ASSERT_EQ(height, buf->getHeight());
+
+        IGraphicBufferProducer::QueueBufferOutput qbOutput;
+        IGraphicBufferProducer::QueueBufferInput input(systemTime(), true /* autotimestamp */,
+                                                       HAL_DATASPACE_UNKNOWN, Rect(width, height),
+                                                       NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                       Fence::NO_FENCE);
+        igbProducer->queueBuffer(slot, input, &qbOutput);
+    }
+    adapter.waitForCallbacks();
+
+    // The sizes after the first few are predicted, and their buffers allocated ahead of the
+    // dequeueBuffer calls which need them.
+    const std::string stats = adapter.getPreallocationStats();
+    const size_t hitsStart = stats.find("hits=");
+    ASSERT_NE(std::string::npos, hitsStart) << stats;
+    EXPECT_GT(std::stoull(stats.substr(hitsStart + strlen("hits="))), 0u) << stats;
+}
+
 TEST_F(BLASTBufferQueueTest, SetCrop_Item) {
     uint8_t r = 255;
     uint8_t g = 0;
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferAllocationPredictor_test"
+
+#include <gtest/gtest.h>
+#include <gui/BufferAllocationPredictor.h>
+
+#include <optional>
+
+namespace android {
+namespace {
+
+BufferAllocationConfig makeConfig(uint32_t width, uint32_t height,
+                                  PixelFormat format = PIXEL_FORMAT_RGBA_8888) {
+    return {width, height, format, 0};
+}
+
+std::optional<BufferAllocationConfig> predictConfig(const BufferAllocationPredictor& predictor) {
+    const auto prediction = predictor.predict();
+    if (!prediction) {
+        return std::nullopt;
+    }
+    return prediction->config;
+}
+
+TEST(BufferAllocationPredictorTest, predictsNothingWithoutPattern) {
+    BufferAllocationPredictor predictor;
+    EXPECT_FALSE(predictor.predict());
+
+    predictor.onAllocation(makeConfig(100, 100));
+    EXPECT_FALSE(predictor.predict());
+
+    predictor.onAllocation(makeConfig(200, 100));
+    predictor.onAllocation(makeConfig(250, 300));
+    EXPECT_FALSE(predictor.predict());
+}
+
+TEST(BufferAllocationPredictorTest, extrapolatesResize) {
+    BufferAllocationPredictor predictor;
+    predictor.onAllocation(makeConfig(100, 200));
+    predictor.onAllocation(makeConfig(110, 195));
+    // Each buffer of the swapchain is allocated in turn.
+    predictor.onAllocation(makeConfig(110, 195));
+    predictor.onAllocation(makeConfig(120, 190));
+    EXPECT_EQ(makeConfig(130, 185), predictConfig(predictor));
+
+    // The size doesn't go below 1.
+    predictor.clear();
+    predictor.onAllocation(makeConfig(30, 100));
+    predictor.onAllocation(makeConfig(20, 100));
+    predictor.onAllocation(makeConfig(10, 100));
+    EXPECT_FALSE(predictor.predict());
+
+    // Nor does a step across formats count.
+    predictor.clear();
+    predictor.onAllocation(makeConfig(100, 100));
+    predictor.onAllocation(makeConfig(110, 100, PIXEL_FORMAT_RGB_565));
+    predictor.onAllocation(makeConfig(120, 100, PIXEL_FORMAT_RGB_565));
+    EXPECT_FALSE(predictor.predict());
+}
+
+TEST(BufferAllocationPredictorTest, predictsRecurringConfig) {
+    // Rotating back and forth.
+    BufferAllocationPredictor predictor;
+    predictor.onAllocation(makeConfig(1080, 2400));
+    predictor.onAllocation(makeConfig(2400, 1080));
+    EXPECT_FALSE(predictor.predict());
+    predictor.onAllocation(makeConfig(1080, 2400));
+    EXPECT_EQ(makeConfig(2400, 1080), predictConfig(predictor));
+
+    // The most recent successor wins.
+    predictor.onAllocation(makeConfig(640, 480));
+    predictor.onAllocation(makeConfig(1080, 2400));
+    EXPECT_EQ(makeConfig(640, 480), predictConfig(predictor));
+
+    // Format changes recur as well.
+    predictor.clear();
+    predictor.onAllocation(makeConfig(640, 480));
+    predictor.onAllocation(makeConfig(640, 480, PIXEL_FORMAT_RGBA_FP16));
+    predictor.onAllocation(makeConfig(640, 480));
+    EXPECT_EQ(makeConfig(640, 480, PIXEL_FORMAT_RGBA_FP16), predictConfig(predictor));
+}
+
+TEST(BufferAllocationPredictorTest, predictsBufferCount) {
+    // A resize of a triple buffered window, then a double buffered one.
+    BufferAllocationPredictor predictor;
+    for (uint32_t width : {100, 110, 120}) {
+        for (int i = 0; i < 3; i++) {
+            predictor.onAllocation(makeConfig(width, 100));
+        }
+    }
+    predictor.onAllocation(makeConfig(130, 100));
+    auto prediction = predictor.predict();
+    ASSERT_TRUE(prediction);
+    EXPECT_EQ(makeConfig(140, 100), prediction->config);
+    EXPECT_EQ(3u, prediction->count);
+
+    // Back to a size seen before, the count of the size which followed it.
+    predictor.clear();
+    predictor.onAllocation(makeConfig(1080, 2400));
+    predictor.onAllocation(makeConfig(2400, 1080));
+    predictor.onAllocation(makeConfig(2400, 1080));
+    predictor.onAllocation(makeConfig(1080, 2400));
+    prediction = predictor.predict();
+    ASSERT_TRUE(prediction);
+    EXPECT_EQ(makeConfig(2400, 1080), prediction->config);
+    EXPECT_EQ(2u, prediction->count);
+}
+
+TEST(BufferAllocationPredictorTest, forgetsOldestConfigs) {
+    BufferAllocationPredictor predictor;
+    predictor.onAllocation(makeConfig(1, 1));
+    predictor.onAllocation(makeConfig(2, 7));
+    for (uint32_t i = 0; i < BufferAllocationPredictor::kHistorySize - 1; i++) {
+        predictor.onAllocation(makeConfig(10 + i * i, 10));
+    }
+    predictor.onAllocation(makeConfig(1, 1));
+    EXPECT_FALSE(predictor.predict());
+}
+
+} // namespace
+} // namespace android
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferItemFifo_test"
+
+#include <gtest/gtest.h>
+#include <gui/BufferItemFifo.h>
+#include <ui/GraphicBuffer.h>
+
+#include <vector>
+
+namespace android {
+namespace {
+
+BufferItem makeItem(int slot) {
+    BufferItem item;
+    item.mSlot = slot;
+    return item;
+}
+
+std::vector<int> getSlots(const BufferItemFifo& fifo) {
+    std::vector<int> slots;
+    for (const BufferItem& item : fifo) {
+        slots.push_back(item.mSlot);
+    }
+    return slots;
+}
+
+TEST(BufferItemFifoTest, isFirstInFirstOut) {
+    BufferItemFifo fifo;
+    EXPECT_TRUE(fifo.empty());
+
+    fifo.push_back(makeItem(1));
+    fifo.push_back(makeItem(2));
+    fifo.push_back(makeItem(3));
+    EXPECT_EQ(3u, fifo.size());
+    EXPECT_EQ(1, fifo.front().mSlot);
+    EXPECT_EQ(3, fifo.back().mSlot);
+    EXPECT_EQ(2, fifo[1].mSlot);
+
+    fifo.pop_front();
+    EXPECT_EQ((std::vector<int>{2, 3}), getSlots(fifo));
+}
+
+TEST(BufferItemFifoTest, wrapsAroundWithoutGrowing) {
+    BufferItemFifo fifo;
+    fifo.push_back(makeItem(0));
+    fifo.push_back(makeItem(1));
+    const size_t capacity = fifo.capacity();
+
+    // A queue two buffers deep, acquired as fast as it is queued.
+    for (int slot = 2; slot < 100; slot++) {
+        fifo.push_back(makeItem(slot));
+        fifo.pop_front();
+        EXPECT_EQ((std::vector<int>{slot - 1, slot}), getSlots(fifo));
+    }
+    EXPECT_EQ(capacity, fifo.capacity());
+}
+
+TEST(BufferItemFifoTest, growsKeepingOrder) {
+    BufferItemFifo fifo;
+    fifo.push_back(makeItem(0));
+    fifo.push_back(makeItem(1));
+    fifo.pop_front();
+
+    std::vector<int> expected{1};
+    for (int slot = 2; slot < 20; slot++) {
+        fifo.push_back(makeItem(slot));
+        expected.push_back(slot);
+    }
+    EXPECT_EQ(expected, getSlots(fifo));
+}
+
+TEST(BufferItemFifoTest, releasesPoppedBuffers) {
+    sp<GraphicBuffer> buffer = new GraphicBuffer();
+    BufferItemFifo fifo;
+    BufferItem item = makeItem(0);
+    item.mGraphicBuffer = buffer;
+    fifo.push_back(item);
+    fifo.push_back(item);
+    item.mGraphicBuffer = nullptr;
+    EXPECT_EQ(3, buffer->getStrongCount());
+
+    fifo.pop_front();
+    EXPECT_EQ(2, buffer->getStrongCount());
+    fifo.clear();
+    EXPECT_EQ(1, buffer->getStrongCount());
+    EXPECT_TRUE(fifo.empty());
+}
+
+} // namespace
+} // namespace android
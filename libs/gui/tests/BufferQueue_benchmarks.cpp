@@ -0,0 +1,265 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferQueue_benchmarks"
+
+#include <benchmark/benchmark.h>
+#include <gui/BufferItem.h>
+#include <gui/BufferQueue.h>
+#include <gui/IProducerListener.h>
+#include <log/log.h>
+#include <system/window.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MockConsumer.h"
+
+namespace android {
+namespace {
+
+using DequeueBufferInput = IGraphicBufferProducer::DequeueBufferInput;
+using DequeueBufferOutput = IGraphicBufferProducer::DequeueBufferOutput;
+using QueueBufferInput = IGraphicBufferProducer::QueueBufferInput;
+using QueueBufferOutput = IGraphicBufferProducer::QueueBufferOutput;
+
+constexpr int64_t kMaxBatchSize = 8;
+
+// A BufferQueue whose producer dequeues and queues batchSize buffers per
+// iteration, which the consumer then acquires and releases.
+class BatchedBufferQueue {
+public:
+    explicit BatchedBufferQueue(size_t batchSize) : mBatchSize(batchSize) {
+        BufferQueue::createBufferQueue(&mProducer, &mConsumer);
+        // Not controlled by the app, so that queued buffers aren't replaced.
+        LOG_ALWAYS_FATAL_IF(mConsumer->consumerConnect(new MockConsumer, false) != OK);
+        QueueBufferOutput output;
+        LOG_ALWAYS_FATAL_IF(mProducer->connect(new StubProducerListener, NATIVE_WINDOW_API_CPU,
+                                               false, &output) != OK);
+        LOG_ALWAYS_FATAL_IF(mProducer->setMaxDequeuedBufferCount(static_cast<int>(batchSize)) !=
+                            OK);
+
+        mDequeueInput.width = 64;
+        mDequeueInput.height = 64;
+        mDequeueInput.format = PIXEL_FORMAT_RGBA_8888;
+        mDequeueInput.usage = GRALLOC_USAGE_SW_READ_OFTEN;
+        mDequeueInput.getTimestamps = false;
+
+        // Allocate the buffers up front, so that iterations only reuse them.
+        std::vector<DequeueBufferOutput> outputs;
+        mProducer->dequeueBuffers(std::vector(mBatchSize, mDequeueInput), &outputs);
+        std::vector<int32_t> slots;
+        for (const DequeueBufferOutput& dequeueOutput : outputs) {
+            LOG_ALWAYS_FATAL_IF(dequeueOutput.result < 0);
+            slots.push_back(dequeueOutput.slot);
+        }
+        std::vector<IGraphicBufferProducer::RequestBufferOutput> requestOutputs;
+        mProducer->requestBuffers(slots, &requestOutputs);
+        queueBatched(slots);
+        consume();
+    }
+
+    void dequeueAndQueueBatched() {
+        std::vector<DequeueBufferOutput> outputs;
+        mProducer->dequeueBuffers(std::vector(mBatchSize, mDequeueInput), &outputs);
+        std::vector<int32_t> slots;
+        slots.reserve(outputs.size());
+        for (const DequeueBufferOutput& output : outputs) {
+            slots.push_back(output.slot);
+        }
+        queueBatched(slots);
+    }
+
+    void dequeueAndQueueSequential() {
+        for (size_t i = 0; i < mBatchSize; i++) {
+            int slot;
+            sp<Fence> fence;
+            mProducer->dequeueBuffer(&slot, &fence, mDequeueInput.width, mDequeueInput.height,
+                                     mDequeueInput.format, mDequeueInput.usage, nullptr, nullptr);
+            QueueBufferOutput output;
+            mProducer->queueBuffer(slot, makeQueueInput(slot), &output);
+        }
+    }
+
+    void consume() {
+        for (size_t i = 0; i < mBatchSize; i++) {
+            BufferItem item;
+            LOG_ALWAYS_FATAL_IF(mConsumer->acquireBuffer(&item, 0) != OK);
+            mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                     EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+        }
+    }
+
+private:
+    static QueueBufferInput makeQueueInput(int32_t slot) {
+        QueueBufferInput input(0, true, HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+                               NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+        input.slot = slot;
+        return input;
+    }
+
+    void queueBatched(const std::vector<int32_t>& slots) {
+        std::vector<QueueBufferInput> inputs;
+        inputs.reserve(slots.size());
+        for (int32_t slot : slots) {
+            inputs.push_back(makeQueueInput(slot));
+        }
+        std::vector<QueueBufferOutput> outputs;
+        mProducer->queueBuffers(inputs, &outputs);
+    }
+
+    const size_t mBatchSize;
+    sp<IGraphicBufferProducer> mProducer;
+    sp<IGraphicBufferConsumer> mConsumer;
+    DequeueBufferInput mDequeueInput;
+};
+
+void BM_DequeueQueueBatched(benchmark::State& state) {
+    BatchedBufferQueue queue(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        queue.dequeueAndQueueBatched();
+        state.PauseTiming();
+        queue.consume();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DequeueQueueBatched)->DenseRange(1, kMaxBatchSize);
+
+void BM_DequeueQueueSequential(benchmark::State& state) {
+    BatchedBufferQueue queue(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        queue.dequeueAndQueueSequential();
+        state.PauseTiming();
+        queue.consume();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DequeueQueueSequential)->DenseRange(1, kMaxBatchSize);
+
+// A consumer acquiring and releasing each frame on its own thread as soon as it is available,
+// like a buffer transport relaying frames to another process.
+class PingPongConsumer : public BnConsumerListener {
+public:
+    explicit PingPongConsumer(const sp<IGraphicBufferConsumer>& consumer)
+          : mConsumer(consumer), mThread(&PingPongConsumer::threadMain, this) {}
+
+    void onFrameAvailable(const BufferItem& /* item */) override {
+        std::lock_guard lock(mMutex);
+        mAvailableFrames++;
+        mCondition.notify_all();
+    }
+    void onBuffersReleased() override {}
+    void onSidebandStreamChanged() override {}
+
+    // Waits for the consumer to release the next frame.
+    void waitForRelease() {
+        std::unique_lock lock(mMutex);
+        mCondition.wait(lock, [this] { return mReleasedFrames > 0; });
+        mReleasedFrames--;
+    }
+
+    void stop() {
+        {
+            std::lock_guard lock(mMutex);
+            mStopped = true;
+            mCondition.notify_all();
+        }
+        mThread.join();
+    }
+
+private:
+    void threadMain() {
+        std::unique_lock lock(mMutex);
+        while (true) {
+            mCondition.wait(lock, [this] { return mAvailableFrames > 0 || mStopped; });
+            if (mStopped) {
+                return;
+            }
+            mAvailableFrames--;
+            lock.unlock();
+
+            BufferItem item;
+            LOG_ALWAYS_FATAL_IF(mConsumer->acquireBuffer(&item, 0) != OK);
+            mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                     EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+
+            lock.lock();
+            mReleasedFrames++;
+            mCondition.notify_all();
+        }
+    }
+
+    const sp<IGraphicBufferConsumer> mConsumer;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    size_t mAvailableFrames = 0;
+    size_t mReleasedFrames = 0;
+    bool mStopped = false;
+    std::thread mThread;
+};
+
+// Measures the round trip of a frame from the producer to a consumer on another thread and back.
+void BM_ProducerConsumerPingPong(benchmark::State& state) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    sp<PingPongConsumer> listener = new PingPongConsumer(consumer);
+    LOG_ALWAYS_FATAL_IF(consumer->consumerConnect(listener, false) != OK);
+    QueueBufferOutput output;
+    LOG_ALWAYS_FATAL_IF(
+            producer->connect(new StubProducerListener, NATIVE_WINDOW_API_CPU, false, &output) !=
+            OK);
+
+    const auto pingPong = [&] {
+        int slot;
+        sp<Fence> fence;
+        const status_t result = producer->dequeueBuffer(&slot, &fence, 64, 64,
+                                                        PIXEL_FORMAT_RGBA_8888,
+                                                        GRALLOC_USAGE_SW_READ_OFTEN, nullptr,
+                                                        nullptr);
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            producer->requestBuffer(slot, &buffer);
+        }
+        QueueBufferInput input(0, true, HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+                               NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+        producer->queueBuffer(slot, input, &output);
+        listener->waitForRelease();
+    };
+
+    // Allocate the buffers up front, so that iterations only reuse them.
+    for (int i = 0; i < BufferQueueDefs::NUM_BUFFER_SLOTS; i++) {
+        pingPong();
+    }
+    for (auto _ : state) {
+        pingPong();
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    listener->stop();
+    producer->disconnect(NATIVE_WINDOW_API_CPU);
+    consumer->consumerDisconnect();
+}
+BENCHMARK(BM_ProducerConsumerPingPong)->UseRealTime();
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
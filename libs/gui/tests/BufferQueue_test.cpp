@@ -21,9 +21,13 @@
 
 #include <gui/BufferItem.h>
 #include <gui/BufferQueue.h>
+#include <gui/BufferQueueConsumer.h>
+#include <gui/BufferQueueCore.h>
+#include <gui/BufferQueueProducer.h>
 #include <gui/IProducerListener.h>
 
 #include <ui/GraphicBuffer.h>
+#include <ui/Size.h>
 
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
@@ -36,7 +40,11 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <thread>
+#include <vector>
 
 using namespace std::chrono_literals;
 
@@ -1209,6 +1217,90 @@ TEST_F(BufferQueueTest, TestStaleBufferHandleSentAfterDisconnect) {
     ASSERT_NE(nullptr, item.mGraphicBuffer.get());
 }
 
+TEST_F(BufferQueueTest, TestBatchedDequeueRequestAndQueue) {
+    struct FrameCountingConsumer : public MockConsumer {
+        void onFrameAvailable(const BufferItem& /* item */) override { mFrameCount++; }
+        std::atomic<int> mFrameCount{0};
+    };
+
+    createBufferQueue();
+    sp<FrameCountingConsumer> mc(new FrameCountingConsumer);
+    // Not controlled by the app, so that queued buffers aren't replaced.
+    ASSERT_EQ(OK, mConsumer->consumerConnect(mc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK,
+              mProducer->connect(new StubProducerListener, NATIVE_WINDOW_API_CPU, true, &output));
+    constexpr size_t kBatchSize = 3;
+    ASSERT_EQ(OK, mProducer->setMaxDequeuedBufferCount(kBatchSize));
+
+    IGraphicBufferProducer::DequeueBufferInput dequeueInput{};
+    dequeueInput.width = 16;
+    dequeueInput.height = 16;
+    dequeueInput.format = PIXEL_FORMAT_RGBA_8888;
+    dequeueInput.usage = GRALLOC_USAGE_SW_READ_OFTEN;
+    std::vector<IGraphicBufferProducer::DequeueBufferOutput> dequeueOutputs;
+    ASSERT_EQ(OK,
+              mProducer->dequeueBuffers(std::vector(kBatchSize, dequeueInput), &dequeueOutputs));
+    ASSERT_EQ(kBatchSize, dequeueOutputs.size());
+
+    std::vector<int32_t> slots;
+    for (const auto& dequeueOutput : dequeueOutputs) {
+        // Each buffer of the batch is allocated.
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION, dequeueOutput.result);
+        ASSERT_EQ(slots.end(), std::find(slots.begin(), slots.end(), dequeueOutput.slot));
+        slots.push_back(dequeueOutput.slot);
+    }
+
+    std::vector<IGraphicBufferProducer::RequestBufferOutput> requestOutputs;
+    ASSERT_EQ(OK, mProducer->requestBuffers(slots, &requestOutputs));
+    ASSERT_EQ(kBatchSize, requestOutputs.size());
+    for (const auto& requestOutput : requestOutputs) {
+        ASSERT_EQ(OK, requestOutput.result);
+        ASSERT_NE(nullptr, requestOutput.buffer.get());
+        ASSERT_EQ(16u, requestOutput.buffer->getWidth());
+    }
+
+    // A buffer of the batch failing to queue doesn't fail the others.
+    std::vector<IGraphicBufferProducer::QueueBufferInput> queueInputs;
+    for (int32_t slot : {slots[0], -1, slots[1], slots[2]}) {
+        IGraphicBufferProducer::QueueBufferInput input(0ull, true, HAL_DATASPACE_UNKNOWN,
+                                                       Rect::INVALID_RECT,
+                                                       NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                       Fence::NO_FENCE);
+        input.slot = slot;
+        queueInputs.push_back(input);
+    }
+    std::vector<IGraphicBufferProducer::QueueBufferOutput> queueOutputs;
+    ASSERT_EQ(OK, mProducer->queueBuffers(queueInputs, &queueOutputs));
+    ASSERT_EQ(queueInputs.size(), queueOutputs.size());
+    EXPECT_EQ(OK, queueOutputs[0].result);
+    EXPECT_EQ(BAD_VALUE, queueOutputs[1].result);
+    EXPECT_EQ(OK, queueOutputs[2].result);
+    EXPECT_EQ(OK, queueOutputs[3].result);
+    EXPECT_EQ(kBatchSize, queueOutputs[3].numPendingBuffers);
+    EXPECT_EQ(static_cast<int>(kBatchSize), mc->mFrameCount.load());
+
+    // The buffers are acquired in the order they were queued.
+    for (int32_t slot : slots) {
+        BufferItem item;
+        ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        EXPECT_EQ(slot, item.mSlot);
+        ASSERT_EQ(OK,
+                  mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                           EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+
+    // The buffers are reused by the next batch, each with its own age.
+    ASSERT_EQ(OK,
+              mProducer->dequeueBuffers(std::vector(kBatchSize, dequeueInput), &dequeueOutputs));
+    for (const auto& dequeueOutput : dequeueOutputs) {
+        EXPECT_EQ(OK, dequeueOutput.result);
+        const auto it = std::find(slots.begin(), slots.end(), dequeueOutput.slot);
+        ASSERT_NE(slots.end(), it);
+        EXPECT_EQ(kBatchSize - static_cast<size_t>(it - slots.begin()), dequeueOutput.bufferAge);
+    }
+}
+
 TEST_F(BufferQueueTest, TestProducerConnectDisconnect) {
     createBufferQueue();
     sp<MockConsumer> mc(new MockConsumer);
@@ -1224,4 +1316,183 @@ TEST_F(BufferQueueTest, TestProducerConnectDisconnect) {
     ASSERT_EQ(NO_INIT, mProducer->disconnect(NATIVE_WINDOW_API_CPU));
 }
 
+TEST_F(BufferQueueTest, TestReleaseWithoutLockWakesUpBlockedDequeue) {
+    createBufferQueue();
+    sp<MockConsumer> mc(new MockConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(mc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK,
+              mProducer->connect(new StubProducerListener, NATIVE_WINDOW_API_CPU, false, &output));
+    ASSERT_EQ(OK, mProducer->setMaxDequeuedBufferCount(1));
+
+    IGraphicBufferProducer::QueueBufferInput input(0ull, true, HAL_DATASPACE_UNKNOWN,
+                                                   Rect::INVALID_RECT,
+                                                   NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                   Fence::NO_FENCE);
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buffer;
+    BufferItem item;
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+                  mProducer->dequeueBuffer(&slot, &fence, 1, 1, 0, GRALLOC_USAGE_SW_READ_OFTEN,
+                                           nullptr, nullptr));
+        ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+        if (i == 0) {
+            ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        }
+    }
+
+    // Both buffers are taken, so the dequeue blocks until the consumer
+    // releases the one it acquired.
+    std::thread releaseThread([&] {
+        std::this_thread::sleep_for(100ms);
+        EXPECT_EQ(OK,
+                  mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                           EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    });
+    ASSERT_EQ(OK,
+              mProducer->dequeueBuffer(&slot, &fence, 1, 1, 0, GRALLOC_USAGE_SW_READ_OFTEN,
+                                       nullptr, nullptr));
+    releaseThread.join();
+    EXPECT_EQ(item.mSlot, slot);
+}
+
+TEST_F(BufferQueueTest, TestReleaseWithoutLockKeepsSlotStateConsistent) {
+    createBufferQueue();
+    sp<MockConsumer> mc(new MockConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(mc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK,
+              mProducer->connect(new StubProducerListener, NATIVE_WINDOW_API_CPU, false, &output));
+    ASSERT_EQ(OK, mProducer->setMaxDequeuedBufferCount(2));
+
+    IGraphicBufferProducer::QueueBufferInput input(0ull, true, HAL_DATASPACE_UNKNOWN,
+                                                   Rect::INVALID_RECT,
+                                                   NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                   Fence::NO_FENCE);
+    for (int frame = 0; frame < 8; frame++) {
+        int slot;
+        sp<Fence> fence;
+        ASSERT_GE(mProducer->dequeueBuffer(&slot, &fence, 1, 1, 0, GRALLOC_USAGE_SW_READ_OFTEN,
+                                           nullptr, nullptr),
+                  OK);
+        sp<GraphicBuffer> buffer;
+        ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+
+        // The consumer can acquire as many buffers as before once the
+        // previous ones were released without the lock.
+        BufferItem item;
+        ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        EXPECT_EQ(STALE_BUFFER_SLOT,
+                  mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber + 1, EGL_NO_DISPLAY,
+                                           EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+        ASSERT_EQ(OK,
+                  mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                           EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+        EXPECT_EQ(BAD_VALUE,
+                  mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                           EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+
+    // Buffers released without the lock are discarded like any free one.
+    ASSERT_EQ(OK, mConsumer->discardFreeBuffers());
+    String8 dump;
+    ASSERT_EQ(OK, mConsumer->dumpState(String8{}, &dump));
+    EXPECT_EQ(-1, dump.find("ACQUIRED")) << dump;
+}
+
+// Renders a frame of each of the given sizes, each needing a buffer allocated.
+static void renderFramesOfSizes(const sp<IGraphicBufferProducer>& producer,
+        const sp<IGraphicBufferConsumer>& consumer, const std::vector<ui::Size>& sizes) {
+    ASSERT_EQ(OK, consumer->consumerConnect(new MockConsumer, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, producer->connect(new StubProducerListener, NATIVE_WINDOW_API_CPU, false,
+            &output));
+
+    for (const ui::Size& size : sizes) {
+        const uint32_t width = static_cast<uint32_t>(size.width);
+        const uint32_t height = static_cast<uint32_t>(size.height);
+        int slot;
+        sp<Fence> fence;
+        const status_t result = producer->dequeueBuffer(&slot, &fence, width, height,
+                PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_SW_READ_OFTEN, nullptr, nullptr);
+        ASSERT_GE(result, OK);
+        ASSERT_TRUE(result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION);
+        sp<GraphicBuffer> buffer;
+        ASSERT_EQ(OK, producer->requestBuffer(slot, &buffer));
+        ASSERT_EQ(width, buffer->getWidth());
+        ASSERT_EQ(height, buffer->getHeight());
+
+        IGraphicBufferProducer::QueueBufferInput input(0ull, true, HAL_DATASPACE_UNKNOWN,
+                Rect::INVALID_RECT, NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+        ASSERT_EQ(OK, producer->queueBuffer(slot, input, &output));
+        BufferItem item;
+        ASSERT_EQ(OK, consumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(OK, consumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+}
+
+static std::vector<ui::Size> getResizeStormSizes(int frameCount) {
+    std::vector<ui::Size> sizes;
+    for (int i = 0; i < frameCount; i++) {
+        sizes.emplace_back(100 + 8 * i, 200 + 4 * i);
+    }
+    return sizes;
+}
+
+TEST_F(BufferQueueTest, TestPreallocationDuringResizeStorm) {
+    sp<BufferQueueCore> core(new BufferQueueCore());
+    sp<BufferQueueConsumer> consumer(new BufferQueueConsumer(core));
+    sp<IGraphicBufferProducer> producer(new BufferQueueProducer(core));
+    consumer->setPreallocationBudget(32 * 1024 * 1024);
+    ASSERT_NO_FATAL_FAILURE(renderFramesOfSizes(producer, consumer, getResizeStormSizes(10)));
+
+    // The first 3 sizes are allocated by dequeueBuffer, from which the next
+    // ones are predicted and allocated ahead.
+    String8 dump;
+    ASSERT_EQ(OK, consumer->dumpState(String8{}, &dump));
+    EXPECT_NE(-1, dump.find("hits=7 ")) << dump;
+    ASSERT_EQ(OK, producer->disconnect(NATIVE_WINDOW_API_CPU));
+}
+
+TEST_F(BufferQueueTest, TestPreallocationDisabledByDefault) {
+    sp<BufferQueueCore> core(new BufferQueueCore());
+    sp<BufferQueueConsumer> consumer(new BufferQueueConsumer(core));
+    sp<IGraphicBufferProducer> producer(new BufferQueueProducer(core));
+    ASSERT_NO_FATAL_FAILURE(renderFramesOfSizes(producer, consumer, getResizeStormSizes(10)));
+
+    String8 dump;
+    ASSERT_EQ(OK, consumer->dumpState(String8{}, &dump));
+    EXPECT_NE(-1, dump.find("budget=0 ")) << dump;
+    EXPECT_NE(-1, dump.find("allocated=0 hits=0 ")) << dump;
+    ASSERT_EQ(OK, producer->disconnect(NATIVE_WINDOW_API_CPU));
+}
+
+TEST_F(BufferQueueTest, TestPreallocatedBuffersExpire) {
+    sp<BufferQueueCore> core(new BufferQueueCore());
+    sp<BufferQueueConsumer> consumer(new BufferQueueConsumer(core));
+    sp<IGraphicBufferProducer> producer(new BufferQueueProducer(core));
+    consumer->setPreallocationBudget(32 * 1024 * 1024);
+
+    // After a single rotation, the other orientation is predicted next, but
+    // the producer doesn't rotate back.
+    ASSERT_NO_FATAL_FAILURE(renderFramesOfSizes(producer, consumer,
+            {{100, 200}, {200, 100}, {100, 200}}));
+
+    String8 dump;
+    const nsecs_t deadline = systemTime() + 10 * BufferQueueCore::PREALLOCATION_TIMEOUT;
+    do {
+        std::this_thread::sleep_for(
+                std::chrono::nanoseconds(BufferQueueCore::PREALLOCATION_TIMEOUT));
+        dump.clear();
+        ASSERT_EQ(OK, consumer->dumpState(String8{}, &dump));
+    } while (dump.find("misses=1 ") == -1 && systemTime() < deadline);
+    EXPECT_NE(-1, dump.find("held=0 (0 buffers) allocated=1 hits=0 misses=1 ")) << dump;
+    ASSERT_EQ(OK, producer->disconnect(NATIVE_WINDOW_API_CPU));
+}
+
 } // namespace android
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CpuConsumer_benchmarks"
+
+#include <benchmark/benchmark.h>
+#include <gui/CpuConsumer.h>
+#include <log/log.h>
+#include <system/graphics.h>
+
+#include <vector>
+
+namespace android {
+namespace {
+
+// A frame as locked by CpuConsumer, backed by plain memory rather than a graphic buffer.
+class SyntheticFrame {
+public:
+    SyntheticFrame(uint32_t width, uint32_t height, int format) {
+        mBuffer.width = width;
+        mBuffer.height = height;
+        mBuffer.stride = width;
+        mBuffer.format = static_cast<PixelFormat>(format);
+        mBuffer.flexFormat = mBuffer.format;
+        mBuffer.dataSpace = HAL_DATASPACE_V0_BT709;
+
+        const size_t pixels = static_cast<size_t>(width) * height;
+        switch (format) {
+            case HAL_PIXEL_FORMAT_RGBA_8888:
+            case HAL_PIXEL_FORMAT_RGBX_8888:
+                mData.resize(pixels * 4);
+                break;
+            case HAL_PIXEL_FORMAT_RGB_565:
+                mData.resize(pixels * 2);
+                break;
+            case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+                // NV21, as most cameras produce: a Y plane, then interleaved Cr and Cb.
+                mData.resize(pixels * 3 / 2);
+                mBuffer.flexFormat = HAL_PIXEL_FORMAT_YCbCr_420_888;
+                mBuffer.dataCr = mData.data() + pixels;
+                mBuffer.dataCb = mBuffer.dataCr + 1;
+                mBuffer.chromaStride = width;
+                mBuffer.chromaStep = 2;
+                break;
+            default:
+                LOG_ALWAYS_FATAL("Unsupported format %#x", format);
+        }
+        for (size_t i = 0; i < mData.size(); i++) {
+            mData[i] = static_cast<uint8_t>(i * 31);
+        }
+        mBuffer.data = mData.data();
+    }
+
+    const CpuConsumer::LockedBuffer& buffer() const { return mBuffer; }
+
+private:
+    std::vector<uint8_t> mData;
+    CpuConsumer::LockedBuffer mBuffer;
+};
+
+void BM_ConvertToRgba8888(benchmark::State& state) {
+    const uint32_t width = static_cast<uint32_t>(state.range(0));
+    const uint32_t height = width * 9 / 16;
+    const SyntheticFrame frame(width, height, static_cast<int>(state.range(1)));
+    const size_t threadCount = static_cast<size_t>(state.range(2));
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+
+    for (auto _ : state) {
+        LOG_ALWAYS_FATAL_IF(CpuConsumer::convertToRgba8888(frame.buffer(), rgba.data(),
+                                                           width * 4, threadCount) != OK);
+        benchmark::DoNotOptimize(rgba.data());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(rgba.size()));
+}
+BENCHMARK(BM_ConvertToRgba8888)
+        ->ArgsProduct({{1920, 3840},
+                       {HAL_PIXEL_FORMAT_RGBA_8888, HAL_PIXEL_FORMAT_RGBX_8888,
+                        HAL_PIXEL_FORMAT_RGB_565, HAL_PIXEL_FORMAT_YCrCb_420_SP},
+                       {1, 4}})
+        ->UseRealTime();
+
+} // namespace
+} // namespace android
@@ -806,6 +806,190 @@ INSTANTIATE_TEST_CASE_P(Rgba8888Tests,
         ::testing::ValuesIn(rgba8888TestSets));
 #endif
 
+TEST(CpuConsumerConversionTest, ConvertsRgbFormats) {
+    // Two pixels per row, padded to a stride of 3 pixels.
+    uint8_t rgbx[24] = {0x11, 0x22, 0x33, 0x00, 0x44, 0x55, 0x66, 0x77, 0, 0, 0, 0,
+                        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0, 0, 0, 0};
+    CpuConsumer::LockedBuffer buffer;
+    buffer.data = rgbx;
+    buffer.width = 2;
+    buffer.height = 2;
+    buffer.stride = 3;
+    buffer.format = HAL_PIXEL_FORMAT_RGBX_8888;
+    buffer.flexFormat = buffer.format;
+
+    uint8_t rgba[16] = {};
+    ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, rgba, 8));
+    std::vector<uint8_t> expected = {0x11, 0x22, 0x33, 0xff, 0x44, 0x55, 0x66, 0xff,
+                                     0x88, 0x99, 0xaa, 0xff, 0xcc, 0xdd, 0xee, 0xff};
+    EXPECT_EQ(expected, std::vector<uint8_t>(rgba, rgba + 16));
+
+    buffer.format = HAL_PIXEL_FORMAT_RGBA_8888;
+    buffer.flexFormat = buffer.format;
+    ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, rgba, 8));
+    EXPECT_EQ(0x00, rgba[3]);
+    EXPECT_EQ(0xff, rgba[15]);
+
+    // Pure red, green and blue, then white.
+    uint16_t rgb565[4] = {0xf800, 0x07e0, 0x001f, 0xffff};
+    buffer.data = reinterpret_cast<uint8_t*>(rgb565);
+    buffer.stride = 2;
+    buffer.format = HAL_PIXEL_FORMAT_RGB_565;
+    buffer.flexFormat = buffer.format;
+    ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, rgba, 8));
+    expected = {255, 0, 0, 255, 0, 255, 0, 255, 0, 0, 255, 255, 255, 255, 255, 255};
+    EXPECT_EQ(expected, std::vector<uint8_t>(rgba, rgba + 16));
+}
+
+TEST(CpuConsumerConversionTest, ConvertsYuvWithDataspaceRange) {
+    // Black, white and mid gray in limited range, with neutral chroma.
+    uint8_t y[4] = {16, 235, 128, 128};
+    uint8_t cbcr[4] = {128, 128, 128, 128};
+    CpuConsumer::LockedBuffer buffer;
+    buffer.data = y;
+    buffer.width = 4;
+    buffer.height = 1;
+    buffer.stride = 4;
+    buffer.format = HAL_PIXEL_FORMAT_YCbCr_420_888;
+    buffer.flexFormat = buffer.format;
+    buffer.dataSpace = HAL_DATASPACE_V0_BT601_625;
+    buffer.dataCb = cbcr;
+    buffer.dataCr = cbcr + 1;
+    buffer.chromaStride = 4;
+    buffer.chromaStep = 2;
+
+    uint8_t rgba[16] = {};
+    ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, rgba, sizeof(rgba)));
+    EXPECT_EQ((std::vector<uint8_t>{0, 0, 0, 255, 255, 255, 255, 255, 130, 130, 130, 255, 130,
+                                    130, 130, 255}),
+              std::vector<uint8_t>(rgba, rgba + 16));
+
+    // In full range, Y is used as is.
+    buffer.dataSpace = HAL_DATASPACE_V0_JFIF;
+    ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, rgba, sizeof(rgba)));
+    EXPECT_EQ(16, rgba[0]);
+    EXPECT_EQ(235, rgba[4]);
+    EXPECT_EQ(128, rgba[8]);
+
+    // Cr adds red and takes green away, clamping to the byte range.
+    uint8_t white[4] = {255, 255, 255, 255};
+    buffer.data = white;
+    cbcr[1] = 255;
+    ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, rgba, sizeof(rgba)));
+    EXPECT_EQ(255, rgba[0]);
+    EXPECT_EQ(164, rgba[1]);
+    EXPECT_EQ(255, rgba[2]);
+}
+
+TEST(CpuConsumerConversionTest, VectorKernelsMatchScalarLoop) {
+    // Wide enough for the vector kernels, with pixels left for the scalar
+    // loop. Converting a buffer one pixel wide only uses the scalar loop.
+    constexpr uint32_t kWidth = 37;
+    std::vector<uint8_t> src(kWidth * 4);
+    std::vector<uint8_t> chroma(kWidth * 2);
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    for (size_t i = 0; i < chroma.size(); i++) {
+        chroma[i] = static_cast<uint8_t>(i * 101 + 7);
+    }
+
+    struct Format {
+        int32_t format;
+        uint32_t chromaStep;
+    };
+    for (const Format& format : {Format{HAL_PIXEL_FORMAT_RGBX_8888, 0},
+                                 Format{HAL_PIXEL_FORMAT_RGB_565, 0},
+                                 Format{HAL_PIXEL_FORMAT_YCbCr_420_888, 1},
+                                 Format{HAL_PIXEL_FORMAT_YCbCr_420_888, 2}}) {
+        const bool isYuv = format.chromaStep != 0;
+        const uint32_t bytesPerPixel = format.format == HAL_PIXEL_FORMAT_RGB_565 ? 2 : 4;
+        CpuConsumer::LockedBuffer buffer;
+        buffer.width = kWidth;
+        buffer.height = 1;
+        buffer.stride = kWidth;
+        buffer.format = format.format;
+        buffer.flexFormat = buffer.format;
+        buffer.dataSpace = HAL_DATASPACE_V0_BT709;
+        buffer.chromaStride = kWidth;
+        buffer.chromaStep = format.chromaStep;
+        const auto setPixels = [&](uint32_t x) {
+            buffer.data = src.data() + x * (isYuv ? 1 : bytesPerPixel);
+            if (isYuv) {
+                // Planar chroma is in two halves, semi-planar chroma interleaved.
+                const size_t offset = (x / 2) * format.chromaStep;
+                buffer.dataCb = chroma.data() + offset;
+                buffer.dataCr = chroma.data() + offset + (format.chromaStep == 1 ? kWidth : 1);
+            }
+        };
+
+        setPixels(0);
+        std::vector<uint8_t> rgba(kWidth * 4);
+        ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, rgba.data(), rgba.size()));
 
+        std::vector<uint8_t> expected(kWidth * 4);
+        buffer.width = 1;
+        for (uint32_t x = 0; x < kWidth; x++) {
+            setPixels(x);
+            ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, expected.data() + x * 4, 4));
+        }
+        EXPECT_EQ(expected, rgba) << "format " << format.format << ", chroma step "
+                                  << format.chromaStep;
+    }
+}
+
+TEST(CpuConsumerConversionTest, SplitsRowsBetweenThreads) {
+    // Large enough to be split in 4 bands, with an odd number of rows.
+    constexpr uint32_t kWidth = 1022;
+    constexpr uint32_t kHeight = 517;
+    std::vector<uint8_t> y(kWidth * kHeight);
+    std::vector<uint8_t> cb(kWidth / 2 * (kHeight + 1) / 2);
+    std::vector<uint8_t> cr(cb.size());
+    for (size_t i = 0; i < y.size(); i++) {
+        y[i] = static_cast<uint8_t>(i * 7);
+    }
+    for (size_t i = 0; i < cb.size(); i++) {
+        cb[i] = static_cast<uint8_t>(i * 13);
+        cr[i] = static_cast<uint8_t>(i * 29);
+    }
+    CpuConsumer::LockedBuffer buffer;
+    buffer.data = y.data();
+    buffer.width = kWidth;
+    buffer.height = kHeight;
+    buffer.stride = kWidth;
+    buffer.format = HAL_PIXEL_FORMAT_YCbCr_420_888;
+    buffer.flexFormat = buffer.format;
+    buffer.dataCb = cb.data();
+    buffer.dataCr = cr.data();
+    buffer.chromaStride = kWidth / 2;
+    buffer.chromaStep = 1;
+
+    std::vector<uint8_t> expected(kWidth * 4 * kHeight);
+    ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(buffer, expected.data(), kWidth * 4));
+    for (size_t threadCount : {2, 4, 64}) {
+        std::vector<uint8_t> rgba(expected.size());
+        ASSERT_EQ(OK,
+                  CpuConsumer::convertToRgba8888(buffer, rgba.data(), kWidth * 4, threadCount));
+        EXPECT_EQ(expected, rgba) << threadCount << " threads";
+    }
+}
+
+TEST(CpuConsumerConversionTest, RejectsUnsupportedFormats) {
+    uint16_t y16[4] = {};
+    uint8_t rgba[16] = {};
+    CpuConsumer::LockedBuffer buffer;
+    buffer.data = reinterpret_cast<uint8_t*>(y16);
+    buffer.width = 4;
+    buffer.height = 1;
+    buffer.stride = 4;
+    buffer.format = HAL_PIXEL_FORMAT_Y16;
+    buffer.flexFormat = buffer.format;
+    EXPECT_EQ(BAD_VALUE, CpuConsumer::convertToRgba8888(buffer, rgba, sizeof(rgba)));
+
+    // The destination rows must fit the buffer's.
+    buffer.format = HAL_PIXEL_FORMAT_RGBA_8888;
+    buffer.flexFormat = buffer.format;
+    EXPECT_EQ(BAD_VALUE, CpuConsumer::convertToRgba8888(buffer, rgba, 8));
+}
 
 } // namespace android
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerState_benchmarks"
+
+#include <benchmark/benchmark.h>
+#include <binder/Parcel.h>
+#include <gui/LayerState.h>
+#include <system/window.h>
+
+namespace android {
+namespace {
+
+enum class Scenario {
+    // A buffer submitted by BLASTBufferQueue.
+    BufferUpdate,
+    // A window moved and faded by an animation.
+    Animation,
+    // Every property changed at once.
+    AllProperties,
+};
+
+layer_state_t makeState(Scenario scenario) {
+    layer_state_t state;
+    state.layerId = 1;
+    switch (scenario) {
+        case Scenario::BufferUpdate:
+            state.what = layer_state_t::eBufferChanged | layer_state_t::eDataspaceChanged |
+                    layer_state_t::eHdrMetadataChanged |
+                    layer_state_t::eSurfaceDamageRegionChanged |
+                    layer_state_t::eDestinationFrameChanged | layer_state_t::eBufferCropChanged |
+                    layer_state_t::eTransformChanged |
+                    layer_state_t::eTransformToDisplayInverseChanged |
+                    layer_state_t::eAutoRefreshChanged;
+            state.surfaceDamageRegion = Region(Rect(100, 100));
+            state.destinationFrame = Rect(1080, 2400);
+            state.bufferCrop = Rect(1080, 2400);
+            break;
+        case Scenario::Animation:
+            state.what = layer_state_t::ePositionChanged | layer_state_t::eMatrixChanged |
+                    layer_state_t::eAlphaChanged | layer_state_t::eCropChanged |
+                    layer_state_t::eCornerRadiusChanged;
+            state.crop = Rect(1080, 2400);
+            break;
+        case Scenario::AllProperties:
+            state.what = ~(layer_state_t::eInputInfoChanged | layer_state_t::eReparent |
+                           layer_state_t::eRelativeLayerChanged | layer_state_t::eLayerChanged |
+                           layer_state_t::eSidebandStreamChanged);
+            state.transparentRegion = Region(Rect(100, 100));
+            state.surfaceDamageRegion = Region(Rect(100, 100));
+            state.blurRegions.resize(2);
+            break;
+    }
+    return state;
+}
+
+void BM_WriteLayerState(benchmark::State& benchmarkState) {
+    const layer_state_t state = makeState(static_cast<Scenario>(benchmarkState.range(0)));
+    Parcel parcel;
+    for (auto _ : benchmarkState) {
+        parcel.setDataSize(0);
+        state.write(parcel);
+    }
+    benchmarkState.counters["parcelBytes"] = static_cast<double>(parcel.dataSize());
+}
+BENCHMARK(BM_WriteLayerState)->DenseRange(0, static_cast<int>(Scenario::AllProperties));
+
+void BM_ReadLayerState(benchmark::State& benchmarkState) {
+    const layer_state_t state = makeState(static_cast<Scenario>(benchmarkState.range(0)));
+    Parcel parcel;
+    state.write(parcel);
+    for (auto _ : benchmarkState) {
+        parcel.setDataPosition(0);
+        layer_state_t result;
+        benchmark::DoNotOptimize(result.read(parcel));
+    }
+    benchmarkState.counters["parcelBytes"] = static_cast<double>(parcel.dataSize());
+}
+BENCHMARK(BM_ReadLayerState)->DenseRange(0, static_cast<int>(Scenario::AllProperties));
+
+} // namespace
+} // namespace android
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerState_test"
+
+#include <binder/Parcel.h>
+#include <gtest/gtest.h>
+#include <gui/LayerState.h>
+
+namespace android {
+namespace {
+
+layer_state_t roundTrip(const layer_state_t& state, size_t* outSize = nullptr) {
+    Parcel parcel;
+    EXPECT_EQ(NO_ERROR, state.write(parcel));
+    if (outSize) {
+        *outSize = parcel.dataSize();
+    }
+    parcel.setDataPosition(0);
+    layer_state_t result;
+    EXPECT_EQ(NO_ERROR, result.read(parcel));
+    EXPECT_EQ(parcel.dataSize(), parcel.dataPosition());
+    return result;
+}
+
+TEST(LayerStateTest, roundTripsChangedProperties) {
+    layer_state_t state;
+    state.layerId = 42;
+    state.what = layer_state_t::ePositionChanged | layer_state_t::eAlphaChanged |
+            layer_state_t::eCropChanged | layer_state_t::eBackgroundColorChanged |
+            layer_state_t::eBlurRegionsChanged | layer_state_t::eTransparentRegionChanged |
+            layer_state_t::eAutoRefreshChanged | layer_state_t::eFrameRateChanged;
+    state.x = 10.f;
+    state.y = 20.f;
+    state.alpha = 0.5f;
+    state.crop = Rect(1, 2, 3, 4);
+    state.color = half3(0.25f, 0.5f, 0.75f);
+    state.bgColorAlpha = 0.1f;
+    state.bgColorDataspace = ui::Dataspace::DISPLAY_P3;
+    BlurRegion blurRegion{};
+    blurRegion.blurRadius = 5;
+    blurRegion.right = 100;
+    state.blurRegions = {blurRegion, blurRegion};
+    state.transparentRegion = Region(Rect(5, 5));
+    state.autoRefresh = true;
+    state.frameRate = 60.f;
+    state.frameRateCompatibility = ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE;
+    state.changeFrameRateStrategy = ANATIVEWINDOW_CHANGE_FRAME_RATE_ALWAYS;
+
+    const layer_state_t result = roundTrip(state);
+    EXPECT_EQ(42, result.layerId);
+    EXPECT_EQ(state.what, result.what);
+    EXPECT_EQ(10.f, result.x);
+    EXPECT_EQ(20.f, result.y);
+    EXPECT_EQ(0.5f, result.alpha);
+    EXPECT_EQ(Rect(1, 2, 3, 4), result.crop);
+    EXPECT_EQ(0.25f, static_cast<float>(result.color.r));
+    EXPECT_EQ(0.75f, static_cast<float>(result.color.b));
+    EXPECT_EQ(0.1f, result.bgColorAlpha);
+    EXPECT_EQ(ui::Dataspace::DISPLAY_P3, result.bgColorDataspace);
+    EXPECT_EQ(state.blurRegions, result.blurRegions);
+    EXPECT_TRUE(result.transparentRegion.hasSameRects(state.transparentRegion));
+    EXPECT_TRUE(result.autoRefresh);
+    EXPECT_EQ(60.f, result.frameRate);
+    EXPECT_EQ(ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE, result.frameRateCompatibility);
+    EXPECT_EQ(ANATIVEWINDOW_CHANGE_FRAME_RATE_ALWAYS, result.changeFrameRateStrategy);
+}
+
+TEST(LayerStateTest, writesOnlyChangedProperties) {
+    layer_state_t state;
+    state.what = layer_state_t::eAlphaChanged;
+    state.alpha = 0.5f;
+    size_t alphaSize = 0;
+    roundTrip(state, &alphaSize);
+
+    // Values of unchanged properties aren't written, and keep their defaults.
+    state.x = 10.f;
+    state.crop = Rect(1, 2, 3, 4);
+    state.transparentRegion = Region(Rect(5, 5));
+    size_t size = 0;
+    const layer_state_t result = roundTrip(state, &size);
+    EXPECT_EQ(alphaSize, size);
+    EXPECT_EQ(0.5f, result.alpha);
+    EXPECT_EQ(0.f, result.x);
+    EXPECT_EQ(Rect::INVALID_RECT, result.crop);
+    EXPECT_TRUE(result.transparentRegion.isEmpty());
+
+    state.what |= layer_state_t::ePositionChanged;
+    roundTrip(state, &size);
+    EXPECT_EQ(alphaSize + 2 * sizeof(float), size);
+}
+
+TEST(LayerStateTest, rejectsMissingFields) {
+    layer_state_t state;
+    state.what = layer_state_t::ePositionChanged | layer_state_t::eMatrixChanged;
+    Parcel parcel;
+    ASSERT_EQ(NO_ERROR, state.write(parcel));
+
+    // Claim a change whose fields weren't written.
+    parcel.setDataPosition(0);
+    layer_state_t result;
+    ASSERT_EQ(NO_ERROR, parcel.readNullableStrongBinder(&result.surface));
+    parcel.setDataPosition(parcel.dataPosition() + sizeof(int32_t));
+    parcel.writeUint64(state.what | layer_state_t::eColorTransformChanged);
+    parcel.setDataPosition(0);
+    EXPECT_NE(NO_ERROR, result.read(parcel));
+}
+
+} // namespace
+} // namespace android
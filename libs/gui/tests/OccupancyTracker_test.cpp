@@ -0,0 +1,130 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OccupancyTracker_test"
+
+#include <binder/Parcel.h>
+#include <gtest/gtest.h>
+#include <gui/OccupancyTracker.h>
+
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace android {
+namespace {
+
+TEST(OccupancyHistogramTest, bucketsOccupancyAndLatency) {
+    OccupancyHistogram histogram;
+    histogram.recordOccupancy(1, ms2ns(10));
+    histogram.recordOccupancy(1, ms2ns(5));
+    histogram.recordOccupancy(2, ms2ns(1));
+    // Larger occupancies share the last bucket.
+    histogram.recordOccupancy(7, ms2ns(2));
+
+    histogram.recordLatency(us2ns(100));
+    histogram.recordLatency(us2ns(250));
+    histogram.recordLatency(ms2ns(3));
+    histogram.recordLatency(ms2ns(255));
+    histogram.recordLatency(s2ns(2));
+
+    const OccupancyHistogram::Snapshot snapshot = histogram.getSnapshot();
+    EXPECT_EQ((std::array<nsecs_t, OccupancyHistogram::OCCUPANCY_BUCKET_COUNT>{
+                      0, ms2ns(15), ms2ns(1), 0, ms2ns(2)}),
+              snapshot.occupancyTimes);
+    EXPECT_EQ((std::array<uint64_t, OccupancyHistogram::LATENCY_BUCKET_COUNT>{1, 1, 0, 0, 1, 0, 0,
+                                                                              0, 0, 0, 1, 1}),
+              snapshot.latencyCounts);
+}
+
+TEST(OccupancyHistogramTest, dumpsPercentagesAndCounts) {
+    OccupancyHistogram::Snapshot snapshot;
+    snapshot.occupancyTimes[1] = s2ns(3);
+    snapshot.occupancyTimes[2] = s2ns(1);
+    snapshot.latencyCounts[0] = 1;
+    snapshot.latencyCounts[4] = 2;
+
+    std::string dump;
+    snapshot.dump(dump, "  ");
+    EXPECT_EQ("  occupancy (4.000 s): 0=0.0% 1=75.0% 2=25.0% 3=0.0% 4+=0.0%\n"
+              "  queue-to-acquire (3 frames): <0.25ms=1 <0.5ms=0 <1ms=0 <2ms=0 <4ms=2 <8ms=0 "
+              "<16ms=0 <32ms=0 <64ms=0 <128ms=0 <256ms=0 >=256ms=0\n",
+              dump);
+}
+
+TEST(OccupancyTrackerTest, aggregatesHistogramsOfProcess) {
+    const OccupancyHistogram::Snapshot before =
+            OccupancyHistogram::getProcessHistogram().getSnapshot();
+
+    OccupancyTracker tracker;
+    tracker.registerOccupancyChange(1);
+    std::this_thread::sleep_for(2ms);
+    tracker.registerOccupancyChange(0);
+    tracker.registerQueueToAcquireLatency(ms2ns(3));
+
+    const OccupancyHistogram::Snapshot snapshot = tracker.getHistogram().getSnapshot();
+    EXPECT_EQ(0, snapshot.occupancyTimes[0]);
+    EXPECT_GE(snapshot.occupancyTimes[1], ms2ns(2));
+    EXPECT_EQ(1u, snapshot.latencyCounts[4]);
+
+    const OccupancyHistogram::Snapshot after =
+            OccupancyHistogram::getProcessHistogram().getSnapshot();
+    EXPECT_GE(after.occupancyTimes[1] - before.occupancyTimes[1], snapshot.occupancyTimes[1]);
+    EXPECT_GE(after.latencyCounts[4] - before.latencyCounts[4], 1u);
+}
+
+TEST(OccupancyHistogramTest, addsSnapshotsReadFromParcel) {
+    OccupancyHistogram::Snapshot snapshot;
+    snapshot.occupancyTimes[1] = ms2ns(30);
+    snapshot.latencyCounts[5] = 2;
+
+    Parcel parcel;
+    ASSERT_EQ(OK, snapshot.writeToParcel(&parcel));
+    parcel.setDataPosition(0);
+    OccupancyHistogram::Snapshot readSnapshot;
+    ASSERT_EQ(OK, readSnapshot.readFromParcel(&parcel));
+
+    OccupancyHistogram histogram;
+    histogram.add(readSnapshot);
+    histogram.add(readSnapshot);
+    const OccupancyHistogram::Snapshot sum = histogram.getSnapshot();
+    EXPECT_EQ(ms2ns(60), sum.occupancyTimes[1]);
+    EXPECT_EQ(4u, sum.latencyCounts[5]);
+    EXPECT_EQ(0u, sum.latencyCounts[4]);
+}
+
+TEST(OccupancyHistogramTest, takesProcessHistogramDeltaOncePerPeriod) {
+    // Takes what other tests recorded, so that the next delta is taken a period later.
+    const nsecs_t start = systemTime() + OccupancyHistogram::EXPORT_PERIOD;
+    OccupancyHistogram::getProcessHistogram().recordLatency(0);
+    OccupancyHistogram::Snapshot delta;
+    ASSERT_TRUE(OccupancyHistogram::takeProcessHistogramDelta(start, &delta));
+
+    OccupancyHistogram::getProcessHistogram().recordLatency(ms2ns(3));
+    EXPECT_FALSE(OccupancyHistogram::takeProcessHistogramDelta(
+            start + OccupancyHistogram::EXPORT_PERIOD - 1, &delta));
+    ASSERT_TRUE(OccupancyHistogram::takeProcessHistogramDelta(
+            start + OccupancyHistogram::EXPORT_PERIOD, &delta));
+    EXPECT_EQ(1u, delta.latencyCounts[4]);
+    EXPECT_EQ(0, delta.occupancyTimes[0]);
+
+    EXPECT_FALSE(OccupancyHistogram::takeProcessHistogramDelta(
+            start + 2 * OccupancyHistogram::EXPORT_PERIOD, &delta));
+}
+
+} // namespace
+} // namespace android
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StreamSplitter_benchmarks"
+
+#include <benchmark/benchmark.h>
+#include <gui/BufferItem.h>
+#include <gui/BufferQueue.h>
+#include <gui/IProducerListener.h>
+#include <gui/StreamSplitter.h>
+#include <log/log.h>
+#include <system/window.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace {
+
+// An output consumer acquiring and releasing each frame on its own thread as soon as it is
+// available, like a consumer in another process would.
+class ReleasingConsumer : public BnConsumerListener {
+public:
+    explicit ReleasingConsumer(const sp<IGraphicBufferConsumer>& consumer)
+          : mConsumer(consumer), mThread(&ReleasingConsumer::threadMain, this) {}
+
+    void onFrameAvailable(const BufferItem& /* item */) override {
+        std::lock_guard lock(mMutex);
+        mAvailableFrames++;
+        mCondition.notify_all();
+    }
+    void onBuffersReleased() override {}
+    void onSidebandStreamChanged() override {}
+
+    void stop() {
+        {
+            std::lock_guard lock(mMutex);
+            mStopped = true;
+            mCondition.notify_all();
+        }
+        mThread.join();
+    }
+
+private:
+    void threadMain() {
+        std::unique_lock lock(mMutex);
+        while (true) {
+            mCondition.wait(lock, [this] { return mAvailableFrames > 0 || mStopped; });
+            if (mStopped) {
+                return;
+            }
+            mAvailableFrames--;
+            lock.unlock();
+
+            BufferItem item;
+            if (mConsumer->acquireBuffer(&item, 0) == OK) {
+                mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                         EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+            }
+
+            lock.lock();
+        }
+    }
+
+    const sp<IGraphicBufferConsumer> mConsumer;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    size_t mAvailableFrames = 0;
+    bool mStopped = false;
+    std::thread mThread;
+};
+
+// Measures queueing frames to a splitter feeding range(0) outputs, one after another or, if
+// range(1) is 1, in parallel.
+void BM_SplitFrames(benchmark::State& state) {
+    const int64_t outputCount = state.range(0);
+    const bool parallel = state.range(1) != 0;
+
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+    sp<StreamSplitter> splitter;
+    LOG_ALWAYS_FATAL_IF(StreamSplitter::createSplitter(inputConsumer, &splitter) != OK);
+    LOG_ALWAYS_FATAL_IF(splitter->setParallelFanOut(parallel) != OK);
+
+    std::vector<sp<IGraphicBufferConsumer>> outputConsumers;
+    std::vector<sp<ReleasingConsumer>> listeners;
+    for (int64_t i = 0; i < outputCount; i++) {
+        sp<IGraphicBufferProducer> outputProducer;
+        sp<IGraphicBufferConsumer> outputConsumer;
+        BufferQueue::createBufferQueue(&outputProducer, &outputConsumer);
+        sp<ReleasingConsumer> listener = new ReleasingConsumer(outputConsumer);
+        LOG_ALWAYS_FATAL_IF(outputConsumer->consumerConnect(listener, false) != OK);
+        LOG_ALWAYS_FATAL_IF(splitter->addOutput(outputProducer) != OK);
+        outputConsumers.push_back(outputConsumer);
+        listeners.push_back(listener);
+    }
+
+    IGraphicBufferProducer::QueueBufferOutput output;
+    LOG_ALWAYS_FATAL_IF(inputProducer->connect(new StubProducerListener, NATIVE_WINDOW_API_CPU,
+                                               false, &output) != OK);
+    const IGraphicBufferProducer::QueueBufferInput input(0, true, HAL_DATASPACE_UNKNOWN,
+                                                         Rect::INVALID_RECT,
+                                                         NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                         Fence::NO_FENCE);
+    const auto queueFrame = [&] {
+        int slot;
+        sp<Fence> fence;
+        const status_t result =
+                inputProducer->dequeueBuffer(&slot, &fence, 64, 64, PIXEL_FORMAT_RGBA_8888,
+                                             GRALLOC_USAGE_SW_READ_OFTEN, nullptr, nullptr);
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            inputProducer->requestBuffer(slot, &buffer);
+        }
+        inputProducer->queueBuffer(slot, input, &output);
+    };
+
+    // Allocate the buffers up front, so that iterations mostly reuse them.
+    for (int i = 0; i < BufferQueueDefs::NUM_BUFFER_SLOTS; i++) {
+        queueFrame();
+    }
+    for (auto _ : state) {
+        queueFrame();
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    inputProducer->disconnect(NATIVE_WINDOW_API_CPU);
+    for (const sp<ReleasingConsumer>& listener : listeners) {
+        listener->stop();
+    }
+    for (const sp<IGraphicBufferConsumer>& outputConsumer : outputConsumers) {
+        outputConsumer->consumerDisconnect();
+    }
+}
+BENCHMARK(BM_SplitFrames)->ArgsProduct({{1, 2, 3, 4}, {0, 1}})->UseRealTime();
+
+} // namespace
+} // namespace android
@@ -54,6 +54,28 @@ struct FakeListener : public BnConsumerListener {
     virtual void onSidebandStreamChanged() {}
 };
 
+// Lets a test wait for frames queued to an output from another thread
+struct WaitingListener : public BnConsumerListener {
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        Mutex::Autolock lock(mMutex);
+        ++mFrames;
+        mCondition.signal();
+    }
+    virtual void onBuffersReleased() {}
+    virtual void onSidebandStreamChanged() {}
+
+    void waitForFrames(int count) {
+        Mutex::Autolock lock(mMutex);
+        while (mFrames < count) {
+            mCondition.wait(mMutex);
+        }
+    }
+
+    Mutex mMutex;
+    Condition mCondition;
+    int mFrames = 0;
+};
+
 static const uint32_t TEST_DATA = 0x12345678u;
 
 TEST_F(StreamSplitterTest, OneInputOneOutput) {
@@ -238,4 +260,69 @@ TEST_F(StreamSplitterTest, OutputAbandonment) {
                                            nullptr, nullptr));
 }
 
+TEST_F(StreamSplitterTest, ParallelFanOutSkipsLateOutput) {
+    const int NUM_FRAMES = 5;
+
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+
+    sp<IGraphicBufferProducer> outputProducers[2] = {};
+    sp<IGraphicBufferConsumer> outputConsumers[2] = {};
+    sp<WaitingListener> listeners[2] = {};
+    for (int output = 0; output < 2; ++output) {
+        BufferQueue::createBufferQueue(&outputProducers[output],
+                &outputConsumers[output]);
+        listeners[output] = new WaitingListener;
+        ASSERT_EQ(OK, outputConsumers[output]->consumerConnect(listeners[output], false));
+    }
+
+    sp<StreamSplitter> splitter;
+    ASSERT_EQ(OK, StreamSplitter::createSplitter(inputConsumer, &splitter));
+    ASSERT_EQ(OK, splitter->setParallelFanOut(true));
+    for (int output = 0; output < 2; ++output) {
+        ASSERT_EQ(OK, splitter->addOutput(outputProducers[output]));
+    }
+    ASSERT_EQ(INVALID_OPERATION, splitter->setParallelFanOut(false));
+
+    IGraphicBufferProducer::QueueBufferOutput qbOutput;
+    ASSERT_EQ(OK,
+              inputProducer->connect(new StubProducerListener, NATIVE_WINDOW_API_CPU, false,
+                                     &qbOutput));
+
+    IGraphicBufferProducer::QueueBufferInput qbInput(0, false,
+            HAL_DATASPACE_UNKNOWN, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+
+    // The first output releases every frame, while the second one never does
+    for (int frame = 0; frame < NUM_FRAMES; ++frame) {
+        int slot;
+        sp<Fence> fence;
+        status_t result = inputProducer->dequeueBuffer(&slot, &fence, 0, 0, 0,
+                GRALLOC_USAGE_SW_WRITE_OFTEN, nullptr, nullptr);
+        ASSERT_GE(result, 0);
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            ASSERT_EQ(OK, inputProducer->requestBuffer(slot, &buffer));
+        }
+        ASSERT_EQ(OK, inputProducer->queueBuffer(slot, qbInput, &qbOutput));
+
+        listeners[0]->waitForFrames(frame + 1);
+        BufferItem item;
+        ASSERT_EQ(OK, outputConsumers[0]->acquireBuffer(&item, 0));
+        ASSERT_EQ(OK, outputConsumers[0]->releaseBuffer(item.mSlot,
+                    item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                    Fence::NO_FENCE));
+    }
+
+    // The late output only received the frames queued before it held as many
+    // buffers as it may
+    listeners[1]->waitForFrames(2);
+    BufferItem item;
+    ASSERT_EQ(OK, outputConsumers[1]->acquireBuffer(&item, 0));
+    ASSERT_EQ(OK, outputConsumers[1]->acquireBuffer(&item, 0));
+    ASSERT_EQ(IGraphicBufferConsumer::NO_BUFFER_AVAILABLE,
+              outputConsumers[1]->acquireBuffer(&item, 0));
+}
+
 } // namespace android
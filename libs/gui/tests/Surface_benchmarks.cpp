@@ -0,0 +1,118 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Surface_benchmarks"
+
+#include <benchmark/benchmark.h>
+#include <gui/BufferQueue.h>
+#include <gui/FrameTimestamps.h>
+#include <gui/IConsumerListener.h>
+#include <gui/Surface.h>
+#include <log/log.h>
+#include <system/window.h>
+#include <utils/Timers.h>
+
+#include <memory>
+#include <mutex>
+
+namespace android {
+namespace {
+
+// A consumer keeping the frame events of its producer, like BLASTBufferQueue does, and publishing
+// them to shared memory if it has a ring.
+class FrameEventsConsumer : public BnConsumerListener {
+public:
+    explicit FrameEventsConsumer(std::shared_ptr<FrameTimestampsRing> timestampsRing)
+          : mTimestampsRing(std::move(timestampsRing)) {
+        mFrameEventHistory.setTimestampsRing(mTimestampsRing);
+    }
+
+    void onFrameAvailable(const BufferItem& /* item */) override {}
+    void onBuffersReleased() override {}
+    void onSidebandStreamChanged() override {}
+
+    void addAndGetFrameTimestamps(const NewFrameEventsEntry* newTimestamps,
+                                  FrameEventHistoryDelta* outDelta) override {
+        std::lock_guard lock(mMutex);
+        if (newTimestamps) {
+            mFrameEventHistory.addQueue(*newTimestamps);
+        }
+        if (outDelta) {
+            mFrameEventHistory.getAndResetDelta(outDelta);
+        }
+    }
+
+    status_t getFrameTimestampsRing(base::unique_fd* outRing) override {
+        if (mTimestampsRing == nullptr) {
+            return INVALID_OPERATION;
+        }
+        *outRing = mTimestampsRing->dupFd();
+        return NO_ERROR;
+    }
+
+    void latch(uint64_t frameNumber, nsecs_t latchTime) {
+        std::lock_guard lock(mMutex);
+        mFrameEventHistory.addLatch(frameNumber, latchTime);
+        mFrameEventHistory.addPreComposition(frameNumber, latchTime);
+    }
+
+private:
+    const std::shared_ptr<FrameTimestampsRing> mTimestampsRing;
+    std::mutex mMutex;
+    ConsumerFrameEventHistory mFrameEventHistory;
+};
+
+// Measures polling the composition time of a frame which is latched but not composited yet, the
+// way apps pacing their frames do. The consumer is asked for a delta each time, unless range(0) is
+// 1 and the events it publishes to shared memory are read instead. The present time isn't polled,
+// since its support depends on the display.
+void BM_PollPendingFrameTimestamps(benchmark::State& state) {
+    const bool readPublished = state.range(0) != 0;
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    sp<FrameEventsConsumer> listener = new FrameEventsConsumer(
+            readPublished ? FrameTimestampsRing::create(FrameEventHistory::MAX_FRAME_HISTORY)
+                          : nullptr);
+    LOG_ALWAYS_FATAL_IF(consumer->consumerConnect(listener, false) != OK);
+    sp<Surface> surface = new Surface(producer);
+    ANativeWindow* window = surface.get();
+    LOG_ALWAYS_FATAL_IF(native_window_api_connect(window, NATIVE_WINDOW_API_CPU) != OK);
+    LOG_ALWAYS_FATAL_IF(native_window_enable_frame_timestamps(window, true) != OK);
+
+    uint64_t frameId;
+    LOG_ALWAYS_FATAL_IF(native_window_get_next_frame_id(window, &frameId) != OK);
+    ANativeWindowBuffer* buffer;
+    int fence;
+    LOG_ALWAYS_FATAL_IF(window->dequeueBuffer(window, &buffer, &fence) != OK);
+    LOG_ALWAYS_FATAL_IF(window->queueBuffer(window, buffer, fence) != OK);
+    listener->latch(frameId, systemTime());
+
+    for (auto _ : state) {
+        int64_t gpuCompositionDoneTime;
+        native_window_get_frame_timestamps(window, frameId, nullptr, nullptr, nullptr, nullptr,
+                                           nullptr, &gpuCompositionDoneTime, nullptr, nullptr,
+                                           nullptr);
+        benchmark::DoNotOptimize(gpuCompositionDoneTime);
+    }
+
+    native_window_api_disconnect(window, NATIVE_WINDOW_API_CPU);
+    consumer->consumerDisconnect();
+}
+BENCHMARK(BM_PollPendingFrameTimestamps)->Arg(0)->Arg(1);
+
+} // namespace
+} // namespace android
@@ -671,6 +671,19 @@ public:
         mAddAndGetFrameTimestampsCallCount++;
     }
 
+    status_t getFrameTimestampsRing(base::unique_fd* outRing) override {
+        if (mTimestampsRing == nullptr) {
+            return INVALID_OPERATION;
+        }
+        *outRing = mTimestampsRing->dupFd();
+        return NO_ERROR;
+    }
+
+    void setTimestampsRing(std::shared_ptr<FrameTimestampsRing> ring) {
+        mTimestampsRing = ring;
+        mFrameEventHistory.setTimestampsRing(std::move(ring));
+    }
+
     bool mGetFrameTimestampsEnabled = false;
 
     ConsumerFrameEventHistory mFrameEventHistory;
@@ -678,6 +691,7 @@ public:
     int mAddFrameTimestampsCount = 0;
     int mGetFrameTimestampsCount = 0;
     uint64_t mLastAddedFrameNumber = NO_FRAME_INDEX;
+    std::shared_ptr<FrameTimestampsRing> mTimestampsRing;
 
     NewFrameEventsEntry mNewFrameEntryOverride = { 0, 0, 0, nullptr };
 };
@@ -2029,6 +2043,81 @@ TEST_F(GetFrameTimestampsTest, PresentUnsupportedNoSync) {
     EXPECT_EQ(-1, outDisplayPresentTime);
 }
 
+// This test verifies that the frame events a consumer publishes to shared
+// memory are read without a sync call, including fences which are still
+// pending, and that signal times are read once published.
+TEST_F(GetFrameTimestampsTest, PublishedTimestampsNoSync) {
+    auto ring = FrameTimestampsRing::create(FrameEventHistory::MAX_FRAME_HISTORY);
+    ASSERT_NE(nullptr, ring);
+    mFakeConsumer->setTimestampsRing(ring);
+    enableFrameTimestamps();
+
+    // Dequeue and queue frame 1.
+    const uint64_t fId1 = getNextFrameId();
+    dequeueAndQueue(0);
+    mFrames[0].signalQueueFences();
+
+    // Dequeue and queue frame 2.
+    const uint64_t fId2 = getNextFrameId();
+    dequeueAndQueue(1);
+    mFrames[1].signalQueueFences();
+
+    // Only the fences of frame 2 have signaled when the consumer adds them.
+    mFrames[1].signalRefreshFences();
+    addFrameEvents(true, NO_FRAME_INDEX, 0);
+    addFrameEvents(true, 0, 1);
+
+    // Verify the timestamps of frame 2 are read without a sync call.
+    resetTimestamps();
+    int oldCount = mFakeConsumer->mGetFrameTimestampsCount;
+    int result = getAllFrameTimestamps(fId2);
+    EXPECT_EQ(oldCount, mFakeConsumer->mGetFrameTimestampsCount);
+    EXPECT_EQ(NO_ERROR, result);
+    EXPECT_EQ(mFrames[1].kRequestedPresentTime, outRequestedPresentTime);
+    EXPECT_EQ(mFrames[1].kProducerAcquireTime, outAcquireTime);
+    EXPECT_EQ(mFrames[1].kLatchTime, outLatchTime);
+    EXPECT_EQ(mFrames[1].mRefreshes[0].kStartTime, outFirstRefreshStartTime);
+    EXPECT_EQ(mFrames[1].mRefreshes[1].kStartTime, outLastRefreshStartTime);
+    EXPECT_EQ(mFrames[1].mRefreshes[0].kGpuCompositionDoneTime,
+            outGpuCompositionDoneTime);
+    EXPECT_EQ(mFrames[1].mRefreshes[0].kPresentTime, outDisplayPresentTime);
+    EXPECT_EQ(NATIVE_WINDOW_TIMESTAMP_PENDING, outDequeueReadyTime);
+    EXPECT_EQ(NATIVE_WINDOW_TIMESTAMP_PENDING, outReleaseTime);
+
+    // Verify the pending fences of frame 1 are reported pending without a
+    // sync call.
+    resetTimestamps();
+    oldCount = mFakeConsumer->mGetFrameTimestampsCount;
+    result = getAllFrameTimestamps(fId1);
+    EXPECT_EQ(oldCount, mFakeConsumer->mGetFrameTimestampsCount);
+    EXPECT_EQ(NO_ERROR, result);
+    EXPECT_EQ(mFrames[0].kLatchTime, outLatchTime);
+    EXPECT_EQ(mFrames[0].mRefreshes[0].kStartTime, outFirstRefreshStartTime);
+    EXPECT_EQ(NATIVE_WINDOW_TIMESTAMP_PENDING, outGpuCompositionDoneTime);
+    EXPECT_EQ(NATIVE_WINDOW_TIMESTAMP_PENDING, outDisplayPresentTime);
+    EXPECT_EQ(mFrames[0].kDequeueReadyTime, outDequeueReadyTime);
+    EXPECT_EQ(NATIVE_WINDOW_TIMESTAMP_PENDING, outReleaseTime);
+
+    // Publish the signal times of frame 1 like the consumer does once its
+    // fences signal, and verify they are read without a sync call.
+    ring->publishSignalTime(fId1, FrameTimestampsRing::SignalTime::GPU_COMPOSITION_DONE,
+            mFrames[0].mRefreshes[0].kGpuCompositionDoneTime);
+    ring->publishSignalTime(fId1, FrameTimestampsRing::SignalTime::DISPLAY_PRESENT,
+            mFrames[0].mRefreshes[0].kPresentTime);
+    ring->publishSignalTime(fId1, FrameTimestampsRing::SignalTime::RELEASE,
+            mFrames[0].kReleaseTime);
+    resetTimestamps();
+    oldCount = mFakeConsumer->mGetFrameTimestampsCount;
+    result = getAllFrameTimestamps(fId1);
+    EXPECT_EQ(oldCount, mFakeConsumer->mGetFrameTimestampsCount);
+    EXPECT_EQ(NO_ERROR, result);
+    EXPECT_EQ(mFrames[0].mRefreshes[2].kStartTime, outLastRefreshStartTime);
+    EXPECT_EQ(mFrames[0].mRefreshes[0].kGpuCompositionDoneTime,
+            outGpuCompositionDoneTime);
+    EXPECT_EQ(mFrames[0].mRefreshes[0].kPresentTime, outDisplayPresentTime);
+    EXPECT_EQ(mFrames[0].kReleaseTime, outReleaseTime);
+}
+
 TEST_F(SurfaceTest, DequeueWithConsumerDrivenSize) {
     sp<IGraphicBufferProducer> producer;
     sp<IGraphicBufferConsumer> consumer;
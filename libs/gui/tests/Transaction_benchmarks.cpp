@@ -0,0 +1,95 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Transaction_benchmarks"
+
+#include <benchmark/benchmark.h>
+#include <binder/Binder.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+
+#include <vector>
+
+namespace android {
+namespace {
+
+using Transaction = SurfaceComposerClient::Transaction;
+
+std::vector<sp<SurfaceControl>> makeSurfaceControls(size_t count) {
+    std::vector<sp<SurfaceControl>> surfaceControls;
+    for (size_t i = 0; i < count; i++) {
+        surfaceControls.push_back(new SurfaceControl(nullptr /* client */, new BBinder(),
+                                                     nullptr /* gbp */,
+                                                     static_cast<int32_t>(i)));
+    }
+    return surfaceControls;
+}
+
+// Merges transactions which each move and fade the same layers, as an animation composed of
+// several transactions does.
+void BM_MergeTransactions(benchmark::State& state) {
+    const auto transactionCount = static_cast<size_t>(state.range(0));
+    const std::vector<sp<SurfaceControl>> surfaceControls =
+            makeSurfaceControls(static_cast<size_t>(state.range(1)));
+
+    std::vector<Transaction> transactions(transactionCount);
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (size_t i = 0; i < transactionCount; i++) {
+            for (const sp<SurfaceControl>& surfaceControl : surfaceControls) {
+                transactions[i].setPosition(surfaceControl, static_cast<float>(i), 0.f);
+                transactions[i].setAlpha(surfaceControl, 1.f);
+            }
+        }
+        state.ResumeTiming();
+
+        Transaction merged;
+        for (Transaction& transaction : transactions) {
+            merged.merge(std::move(transaction));
+        }
+        benchmark::DoNotOptimize(merged);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MergeTransactions)->ArgsProduct({{2, 4, 8, 16, 32, 64}, {1, 10, 50}});
+
+// Merges transactions which each change their own layer, as when the changes of many surfaces are
+// batched into one transaction, so that the merged transaction grows to N distinct layers.
+void BM_MergeTransactionsOfDistinctLayers(benchmark::State& state) {
+    const auto layerCount = static_cast<size_t>(state.range(0));
+    const std::vector<sp<SurfaceControl>> surfaceControls = makeSurfaceControls(layerCount);
+
+    std::vector<Transaction> transactions(layerCount);
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (size_t i = 0; i < layerCount; i++) {
+            transactions[i].setPosition(surfaceControls[i], static_cast<float>(i), 0.f);
+            transactions[i].setAlpha(surfaceControls[i], 1.f);
+        }
+        state.ResumeTiming();
+
+        Transaction merged;
+        for (Transaction& transaction : transactions) {
+            merged.merge(std::move(transaction));
+        }
+        benchmark::DoNotOptimize(merged);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MergeTransactionsOfDistinctLayers)->RangeMultiplier(4)->Range(4, 1024);
+
+} // namespace
+} // namespace android
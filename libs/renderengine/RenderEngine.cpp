@@ -22,6 +22,7 @@
 #include "threaded/RenderEngineThreaded.h"
 
 #include "skia/SkiaGLRenderEngine.h"
+#include "skia/SkiaRasterRenderEngine.h"
 
 namespace android {
 namespace renderengine {
@@ -44,6 +45,17 @@ std::unique_ptr<RenderEngine> RenderEngine::create(const RenderEngineCreationArg
                     },
                     args.renderEngineType);
         }
+        case RenderEngineType::SKIA_RASTER:
+            ALOGD("RenderEngine with SkiaRaster Backend");
+            return renderengine::skia::SkiaRasterRenderEngine::create(args);
+        case RenderEngineType::SKIA_RASTER_THREADED: {
+            ALOGD("Threaded RenderEngine with SkiaRaster Backend");
+            return renderengine::threaded::RenderEngineThreaded::create(
+                    [args]() {
+                        return android::renderengine::skia::SkiaRasterRenderEngine::create(args);
+                    },
+                    args.renderEngineType);
+        }
         case RenderEngineType::GLES:
         default:
             ALOGD("RenderEngine with GLES Backend");
@@ -39,6 +39,10 @@ std::string RenderEngineTypeName(RenderEngine::RenderEngineType type) {
             return "skiaglthreaded";
         case RenderEngine::RenderEngineType::SKIA_GL:
             return "skiagl";
+        case RenderEngine::RenderEngineType::SKIA_RASTER_THREADED:
+            return "skiarasterthreaded";
+        case RenderEngine::RenderEngineType::SKIA_RASTER:
+            return "skiaraster";
         case RenderEngine::RenderEngineType::GLES:
         case RenderEngine::RenderEngineType::THREADED:
             LOG_ALWAYS_FATAL("GLESRenderEngine is deprecated - why time it?");
@@ -69,6 +73,13 @@ static void RunSkiaGLThreaded(benchmark::internal::Benchmark* b) {
     AddRenderEngineType(b, RenderEngine::RenderEngineType::SKIA_GL_THREADED);
 }
 
+/**
+ * Run a benchmark once using SKIA_RASTER_THREADED, which composes on the CPU.
+ */
+static void RunSkiaRasterThreaded(benchmark::internal::Benchmark* b) {
+    AddRenderEngineType(b, RenderEngine::RenderEngineType::SKIA_RASTER_THREADED);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //  Helpers for calling drawLayers
 ///////////////////////////////////////////////////////////////////////////////
@@ -116,6 +127,11 @@ static std::shared_ptr<ExternalTexture> allocateBuffer(RenderEngine& re, uint32_
                                                        uint32_t height,
                                                        uint64_t extraUsageFlags = 0,
                                                        std::string name = "output") {
+    // The raster backend locks buffers for CPU access.
+    if (re.getRenderEngineType() == RenderEngine::RenderEngineType::SKIA_RASTER ||
+        re.getRenderEngineType() == RenderEngine::RenderEngineType::SKIA_RASTER_THREADED) {
+        extraUsageFlags |= GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+    }
     return std::make_shared<
             impl::ExternalTexture>(new GraphicBuffer(width, height, HAL_PIXEL_FORMAT_RGBA_8888, 1,
                                                      GRALLOC_USAGE_HW_RENDER |
@@ -212,21 +228,23 @@ static void benchDrawLayers(RenderEngine& re, const std::vector<LayerSettings>&
 //  Benchmarks
 ///////////////////////////////////////////////////////////////////////////////
 
-void BM_blur(benchmark::State& benchState) {
-    auto re = createRenderEngine(static_cast<RenderEngine::RenderEngineType>(benchState.range()));
-
+static std::shared_ptr<ExternalTexture> decodeHomescreen(RenderEngine& re) {
     // Initially use cpu access so we can decode into it with AImageDecoder.
     auto [width, height] = getDisplaySize();
     auto srcBuffer =
-            allocateBuffer(*re, width, height, GRALLOC_USAGE_SW_WRITE_OFTEN, "decoded_source");
-    {
-        std::string srcImage = base::GetExecutableDirectory();
-        srcImage.append("/resources/homescreen.png");
-        renderenginebench::decode(srcImage.c_str(), srcBuffer->getBuffer());
-
-        // Now copy into GPU-only buffer for more realistic timing.
-        srcBuffer = copyBuffer(*re, srcBuffer, 0, "source");
-    }
+            allocateBuffer(re, width, height, GRALLOC_USAGE_SW_WRITE_OFTEN, "decoded_source");
+    std::string srcImage = base::GetExecutableDirectory();
+    srcImage.append("/resources/homescreen.png");
+    renderenginebench::decode(srcImage.c_str(), srcBuffer->getBuffer());
+
+    // Now copy into GPU-only buffer for more realistic timing.
+    return copyBuffer(re, srcBuffer, 0, "source");
+}
+
+void BM_blur(benchmark::State& benchState) {
+    auto re = createRenderEngine(static_cast<RenderEngine::RenderEngineType>(benchState.range()));
+    auto [width, height] = getDisplaySize();
+    auto srcBuffer = decodeHomescreen(*re);
 
     const FloatRect layerRect(0, 0, width, height);
     LayerSettings layer{
@@ -257,4 +275,59 @@ void BM_blur(benchmark::State& benchState) {
     benchDrawLayers(*re, layers, benchState, "blurred");
 }
 
-BENCHMARK(BM_blur)->Apply(RunSkiaGLThreaded);
+BENCHMARK(BM_blur)->Apply(RunSkiaGLThreaded)->Apply(RunSkiaRasterThreaded);
+
+/**
+ * Composes a window with rounded corners and a shadow over the homescreen. Unlike BM_blur, the
+ * frame doesn't read back what was drawn, so the raster backend draws it in parallel tiles.
+ */
+void BM_window(benchmark::State& benchState) {
+    auto re = createRenderEngine(static_cast<RenderEngine::RenderEngineType>(benchState.range()));
+    auto [width, height] = getDisplaySize();
+    auto srcBuffer = decodeHomescreen(*re);
+
+    const FloatRect layerRect(0, 0, width, height);
+    LayerSettings layer{
+            .geometry =
+                    Geometry{
+                            .boundaries = layerRect,
+                    },
+            .source =
+                    PixelSource{
+                            .buffer =
+                                    Buffer{
+                                            .buffer = srcBuffer,
+                                    },
+                    },
+            .alpha = half(1.0f),
+    };
+    const FloatRect windowRect(width / 8.f, height / 8.f, width * 7.f / 8.f, height * 7.f / 8.f);
+    LayerSettings windowLayer{
+            .geometry =
+                    Geometry{
+                            .boundaries = windowRect,
+                            .roundedCornersRadius = {40.f, 40.f},
+                            .roundedCornersCrop = windowRect,
+                    },
+            .source =
+                    PixelSource{
+                            .solidColor = half3(0.9f, 0.9f, 0.95f),
+                    },
+            .alpha = half(0.9f),
+            .shadow =
+                    ShadowSettings{
+                            .boundaries = windowRect,
+                            .ambientColor = vec4(0.f, 0.f, 0.f, 0.04f),
+                            .spotColor = vec4(0.f, 0.f, 0.f, 0.2f),
+                            .lightPos = vec3(width / 2.f, 0.f, 1000.f),
+                            .lightRadius = 800.f,
+                            .length = 40.f,
+                            .casterIsTranslucent = true,
+                    },
+    };
+
+    auto layers = std::vector<LayerSettings>{layer, windowLayer};
+    benchDrawLayers(*re, layers, benchState, "window");
+}
+
+BENCHMARK(BM_window)->Apply(RunSkiaGLThreaded)->Apply(RunSkiaRasterThreaded);
@@ -79,6 +79,15 @@ struct DisplaySettings {
     // Configures the rendering intent of the output display. This is used for tonemapping.
     aidl::android::hardware::graphics::composer3::RenderIntent renderIntent =
             aidl::android::hardware::graphics::composer3::RenderIntent::TONE_MAP_COLORIMETRIC;
+
+    // True if the layers are drawn for a screenshot rather than for a display. Screenshots may be
+    // drawn after display composition queued later.
+    bool isScreenshot = false;
+
+    // If not empty, only this region of the buffer, in buffer pixels, is drawn, and the rest of the
+    // buffer is left as is. Used when the buffer already holds the same layers but for the ones
+    // within the region. Ignored unless RenderEngine::supportsPartialRedraw().
+    Region damage;
 };
 
 static inline bool operator==(const DisplaySettings& lhs, const DisplaySettings& rhs) {
@@ -90,7 +99,8 @@ static inline bool operator==(const DisplaySettings& lhs, const DisplaySettings&
             lhs.deviceHandlesColorTransform == rhs.deviceHandlesColorTransform &&
             lhs.orientation == rhs.orientation &&
             lhs.targetLuminanceNits == rhs.targetLuminanceNits &&
-            lhs.dimmingStage == rhs.dimmingStage && lhs.renderIntent == rhs.renderIntent;
+            lhs.dimmingStage == rhs.dimmingStage && lhs.renderIntent == rhs.renderIntent &&
+            lhs.isScreenshot == rhs.isScreenshot && lhs.damage.hasSameRects(rhs.damage);
 }
 
 static const char* orientation_to_string(uint32_t orientation) {
@@ -134,6 +144,9 @@ static inline void PrintTo(const DisplaySettings& settings, ::std::ostream* os)
         << aidl::android::hardware::graphics::composer3::toString(settings.dimmingStage).c_str();
     *os << "\n    .renderIntent = "
         << aidl::android::hardware::graphics::composer3::toString(settings.renderIntent).c_str();
+    *os << "\n    .isScreenshot = " << settings.isScreenshot;
+    *os << "\n    .damage = ";
+    PrintTo(settings.damage, os);
     *os << "\n}";
 }
 
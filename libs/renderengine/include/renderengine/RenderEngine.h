@@ -54,6 +54,12 @@
  */
 #define PROPERTY_SKIA_ATRACE_ENABLED "debug.renderengine.skia_atrace_enabled"
 
+/**
+ * Path of the file in which the settings of the layers drawn by SkiaGL are saved, so that their
+ * shaders are compiled in the background after the first frame of the next boot. Disabled if unset.
+ */
+#define PROPERTY_DEBUG_RENDERENGINE_SHADER_MANIFEST "debug.renderengine.shader_manifest"
+
 struct ANativeWindowBuffer;
 
 namespace android {
@@ -98,6 +104,8 @@ public:
         THREADED = 2,
         SKIA_GL = 3,
         SKIA_GL_THREADED = 4,
+        SKIA_RASTER = 5,
+        SKIA_RASTER_THREADED = 6,
     };
 
     static std::unique_ptr<RenderEngine> create(const RenderEngineCreationArgs& args);
@@ -182,6 +190,11 @@ public:
     // query is required to be thread safe.
     virtual bool supportsBackgroundBlur() = 0;
 
+    // Returns true if drawLayers() leaves the buffer untouched outside of DisplaySettings::damage,
+    // but for the frames which read back what was drawn so far. If false, the whole buffer is
+    // always redrawn. This query is required to be thread safe.
+    virtual bool supportsPartialRedraw() = 0;
+
     // Returns the current type of RenderEngine instance that was created.
     // TODO(b/180767535): This is only implemented to allow for backend-specific behavior, which
     // we should not allow in general, so remove this.
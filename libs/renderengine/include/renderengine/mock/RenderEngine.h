@@ -59,6 +59,7 @@ public:
     MOCK_METHOD0(cleanFramebufferCache, void());
     MOCK_METHOD0(getContextPriority, int());
     MOCK_METHOD0(supportsBackgroundBlur, bool());
+    MOCK_METHOD0(supportsPartialRedraw, bool());
     MOCK_METHOD1(onActiveDisplaySizeChanged, void(ui::Size));
 
 protected:
@@ -23,6 +23,7 @@
 #include <sys/types.h>
 #include <ui/GraphicTypes.h>
 
+#include "BackendBuffer.h"
 #include "android-base/macros.h"
 
 #include <mutex>
@@ -78,7 +79,7 @@ public:
     // Local reference that supports RAII-style management of an AutoBackendTexture
     // AutoBackendTexture by itself can't be managed in a similar fashion because
     // of shared ownership with Skia objects, so we wrap it here instead.
-    class LocalRef {
+    class LocalRef : public BackendBuffer {
     public:
         LocalRef(GrDirectContext* context, AHardwareBuffer* buffer, bool isOutputBuffer,
                  CleanupManager& cleanupMgr) {
@@ -86,7 +87,7 @@ public:
             mTexture->ref();
         }
 
-        ~LocalRef() {
+        ~LocalRef() override {
             if (mTexture != nullptr) {
                 mTexture->unref(true);
             }
@@ -96,16 +97,17 @@ public:
         // As SkImages are immutable but buffer content is not, we create
         // a new SkImage every time.
         sk_sp<SkImage> makeImage(ui::Dataspace dataspace, SkAlphaType alphaType,
-                                 GrDirectContext* context) {
+                                 GrDirectContext* context) override {
             return mTexture->makeImage(dataspace, alphaType, context);
         }
 
         // Makes a new SkSurface from the texture content, if needed.
-        sk_sp<SkSurface> getOrCreateSurface(ui::Dataspace dataspace, GrDirectContext* context) {
+        sk_sp<SkSurface> getOrCreateSurface(ui::Dataspace dataspace,
+                                            GrDirectContext* context) override {
             return mTexture->getOrCreateSurface(dataspace, context);
         }
 
-        SkColorType colorType() const { return mTexture->mColorType; }
+        SkColorType colorType() const override { return mTexture->mColorType; }
 
         DISALLOW_COPY_AND_ASSIGN(LocalRef);
 
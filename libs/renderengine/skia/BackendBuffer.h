@@ -0,0 +1,49 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <GrDirectContext.h>
+#include <SkImage.h>
+#include <SkSurface.h>
+#include <ui/GraphicTypes.h>
+
+namespace android {
+namespace renderengine {
+namespace skia {
+
+// Skia's view of a GraphicBuffer, as provided by a SkiaRenderEngine backend for drawing one frame.
+class BackendBuffer {
+public:
+    virtual ~BackendBuffer() = default;
+
+    virtual SkColorType colorType() const = 0;
+
+    // Makes a new SkImage from the buffer content.
+    // As SkImages are immutable but buffer content is not, a new SkImage is made every time.
+    // Returns nullptr if the buffer can't be sampled by the backend.
+    virtual sk_sp<SkImage> makeImage(ui::Dataspace dataspace, SkAlphaType alphaType,
+                                     GrDirectContext* context) = 0;
+
+    // Makes a new SkSurface drawing into the buffer, if needed.
+    // Returns nullptr if the backend can't draw into the buffer.
+    virtual sk_sp<SkSurface> getOrCreateSurface(ui::Dataspace dataspace,
+                                                GrDirectContext* context) = 0;
+};
+
+} // namespace skia
+} // namespace renderengine
+} // namespace android
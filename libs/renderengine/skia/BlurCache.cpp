@@ -0,0 +1,194 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "RenderEngine"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "BlurCache.h"
+
+#include <android-base/stringprintf.h>
+#include <math/HashCombine.h>
+#include <renderengine/ExternalTexture.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+
+namespace android::renderengine::skia {
+
+using base::StringAppendF;
+
+namespace {
+
+template <typename Vector>
+void hashCombineVector(size_t& hash, const Vector& vector) {
+    for (size_t i = 0; i < vector.size(); i++) {
+        hashCombineSingle(hash, static_cast<float>(vector[i]));
+    }
+}
+
+void hashCombineMatrix(size_t& hash, const mat4& matrix) {
+    for (size_t i = 0; i < 16; i++) {
+        hashCombineSingle(hash, matrix.asArray()[i]);
+    }
+}
+
+void hashCombineRect(size_t& hash, const FloatRect& rect) {
+    hashCombineSingle(hash, hashCombine(rect.left, rect.top, rect.right, rect.bottom));
+}
+
+} // namespace
+
+size_t BlurCache::hash(const LayerSettings& layer) {
+    const Buffer& buffer = layer.source.buffer;
+    if (buffer.buffer && buffer.frameNumber == 0) {
+        return 0;
+    }
+
+    size_t hash = hashCombine(buffer.buffer ? buffer.buffer->getId() : 0, buffer.frameNumber,
+                              buffer.useTextureFiltering, buffer.usePremultipliedAlpha,
+                              buffer.isOpaque, buffer.isY410BT2020, buffer.maxLuminanceNits);
+    hashCombineMatrix(hash, buffer.textureTransform);
+
+    hashCombineVector(hash, layer.source.solidColor);
+
+    hashCombineRect(hash, layer.geometry.boundaries);
+    hashCombineMatrix(hash, layer.geometry.positionTransform);
+    hashCombineVector(hash, layer.geometry.roundedCornersRadius);
+    hashCombineRect(hash, layer.geometry.roundedCornersCrop);
+
+    hashCombineSingle(hash,
+                      hashCombine(static_cast<float>(layer.alpha), layer.sourceDataspace,
+                                  layer.disableBlending, layer.skipContentDraw,
+                                  layer.backgroundBlurRadius, layer.whitePointNits));
+    hashCombineMatrix(hash, layer.colorTransform);
+
+    const ShadowSettings& shadow = layer.shadow;
+    hashCombineRect(hash, shadow.boundaries);
+    hashCombineVector(hash, shadow.ambientColor);
+    hashCombineVector(hash, shadow.spotColor);
+    hashCombineVector(hash, shadow.lightPos);
+    hashCombineSingle(hash,
+                      hashCombine(shadow.lightRadius, shadow.length, shadow.casterIsTranslucent));
+
+    for (const BlurRegion& region : layer.blurRegions) {
+        hashCombineSingle(hash,
+                          hashCombine(region.blurRadius, region.cornerRadiusTL,
+                                      region.cornerRadiusTR, region.cornerRadiusBL,
+                                      region.cornerRadiusBR, region.alpha, region.left, region.top,
+                                      region.right, region.bottom));
+    }
+    hashCombineMatrix(hash, layer.blurRegionTransform);
+
+    const StretchEffect& stretch = layer.stretchEffect;
+    hashCombineSingle(hash,
+                      hashCombine(stretch.width, stretch.height, stretch.vectorX, stretch.vectorY,
+                                  stretch.maxAmountX, stretch.maxAmountY));
+    hashCombineRect(hash, stretch.mappedChildBounds);
+
+    // 0 is reserved for layers which can't be identified.
+    return hash != 0 ? hash : 1;
+}
+
+BlurCache::Match BlurCache::match(const Entry& entry, GrRecordingContext* context,
+                                  const DisplaySettings& display, const std::vector<Layer>& layers,
+                                  uint32_t radius, const SkImageInfo& inputInfo,
+                                  const SkRect& blurRect) {
+    if (entry.context != context || entry.radius != radius || entry.blurRect != blurRect ||
+        entry.inputInfo != inputInfo || entry.layers.size() != layers.size() ||
+        !(entry.display == display)) {
+        return Match::NONE;
+    }
+
+    // Accumulate what changed in the input, from the bottom up, as layers sampling what is below
+    // them change wherever they draw if anything below them changed.
+    SkRect damage = SkRect::MakeEmpty();
+    for (size_t i = 0; i < layers.size(); i++) {
+        const Layer& oldLayer = entry.layers[i];
+        const Layer& newLayer = layers[i];
+        if (newLayer.hash == 0) {
+            return Match::STALE;
+        }
+        if (oldLayer.hash != newLayer.hash) {
+            damage.join(oldLayer.bounds);
+            damage.join(newLayer.bounds);
+        } else if (newLayer.samplesBelow && !damage.isEmpty()) {
+            damage.join(newLayer.bounds);
+        }
+    }
+    if (damage.isEmpty()) {
+        return Match::FULL;
+    }
+
+    // The blur samples up to its radius away from the rectangle.
+    const SkRect sampledRect = blurRect.makeOutset(radius, radius);
+    return damage.intersects(sampledRect) ? Match::STALE : Match::PARTIAL;
+}
+
+sk_sp<SkImage> BlurCache::getOrGenerate(const BlurFilter& filter, GrRecordingContext* context,
+                                        const DisplaySettings& display,
+                                        const std::vector<Layer>& layers, uint32_t radius,
+                                        const sk_sp<SkImage>& blurInput, const SkRect& blurRect) {
+    // The damage doesn't change what the blur samples, as frames with blurs are drawn whole.
+    DisplaySettings inputDisplay = display;
+    inputDisplay.damage.clear();
+    const SkImageInfo& inputInfo = blurInput->imageInfo();
+
+    for (auto it = mEntries.begin(); it != mEntries.end(); it++) {
+        const Match result = match(*it, context, inputDisplay, layers, radius, inputInfo, blurRect);
+        if (result == Match::NONE) {
+            continue;
+        }
+        if (result == Match::STALE) {
+            mEntries.erase(it);
+            break;
+        }
+
+        ATRACE_NAME("BlurCacheHit");
+        if (result == Match::PARTIAL) {
+            // Later frames are compared to this one.
+            it->layers = layers;
+            mStats.partialHits++;
+        }
+        mStats.hits++;
+        mStats.passesSaved += filter.getPassCount(radius);
+        mEntries.splice(mEntries.begin(), mEntries, it);
+        return mEntries.front().blur;
+    }
+
+    mStats.misses++;
+    sk_sp<SkImage> blur = filter.generate(context, radius, blurInput, blurRect);
+    const bool identified = std::all_of(layers.begin(), layers.end(),
+                                        [](const Layer& layer) { return layer.hash != 0; });
+    if (blur && identified) {
+        mEntries.push_front({context, std::move(inputDisplay), inputInfo, radius, blurRect, layers,
+                             blur});
+        if (mEntries.size() > kMaxEntries) {
+            mEntries.pop_back();
+        }
+    }
+    return blur;
+}
+
+void BlurCache::dump(std::string& result) const {
+    StringAppendF(&result,
+                  "Blur cache: %zu of %zu blurs, hits: %zu (%zu partial), misses: %zu, "
+                  "passes saved: %zu\n",
+                  mEntries.size(), kMaxEntries, mStats.hits, mStats.partialHits, mStats.misses,
+                  mStats.passesSaved);
+}
+
+} // namespace android::renderengine::skia
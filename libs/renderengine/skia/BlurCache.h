@@ -0,0 +1,108 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <SkImage.h>
+#include <SkImageInfo.h>
+#include <SkRect.h>
+#include <renderengine/DisplaySettings.h>
+#include <renderengine/LayerSettings.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "filters/BlurFilter.h"
+
+class GrRecordingContext;
+
+namespace android::renderengine::skia {
+
+// Keeps the images generated by a BlurFilter across frames, so that a blur is only generated
+// again once what it samples changed.
+//
+// The image a blur samples is identified by the display settings and by the layers drawn into it
+// so far. Layers are compared by hash, and a layer which changed since the blur was generated only
+// invalidates it if it may draw within the area the blur samples.
+//
+// This class isn't thread-safe.
+class BlurCache {
+public:
+    // How many blurs are kept, least recently used first out.
+    static constexpr size_t kMaxEntries = 8;
+
+    // A layer drawn into the image a blur samples.
+    struct Layer {
+        // Hash of the settings of the layer, see hash(). 0 if the content of the layer can't be
+        // identified, in which case the blurs sampling it aren't cached.
+        size_t hash = 0;
+        // Bounds of what the layer draws, in the coordinates of the image.
+        SkRect bounds = SkRect::MakeEmpty();
+        // Whether what the layer draws depends on what was drawn below it.
+        bool samplesBelow = false;
+    };
+
+    struct Stats {
+        // Blurs reused although layers they sample changed, outside of the area they sample.
+        size_t partialHits = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+        // Render passes of the blur filter skipped by the hits.
+        size_t passesSaved = 0;
+    };
+
+    // Returns the hash of what the layer draws, or 0 if its buffer doesn't identify its content.
+    static size_t hash(const LayerSettings& layer);
+
+    // Returns the blur of the rectangle of blurInput, whose content is described by the display
+    // and the layers drawn into it, generating it with the filter if it isn't cached.
+    sk_sp<SkImage> getOrGenerate(const BlurFilter& filter, GrRecordingContext* context,
+                                 const DisplaySettings& display, const std::vector<Layer>& layers,
+                                 uint32_t radius, const sk_sp<SkImage>& blurInput,
+                                 const SkRect& blurRect);
+
+    // Drops all blurs, which must be done before the context they were generated with is gone.
+    void clear() { mEntries.clear(); }
+
+    size_t size() const { return mEntries.size(); }
+    const Stats& stats() const { return mStats; }
+    void dump(std::string& result) const;
+
+private:
+    struct Entry {
+        GrRecordingContext* context;
+        DisplaySettings display;
+        SkImageInfo inputInfo;
+        uint32_t radius;
+        SkRect blurRect;
+        std::vector<Layer> layers;
+        sk_sp<SkImage> blur;
+    };
+
+    enum class Match { NONE, STALE, PARTIAL, FULL };
+    static Match match(const Entry& entry, GrRecordingContext* context,
+                       const DisplaySettings& display, const std::vector<Layer>& layers,
+                       uint32_t radius, const SkImageInfo& inputInfo, const SkRect& blurRect);
+
+    // Most recently used first.
+    std::list<Entry> mEntries;
+    Stats mStats;
+};
+
+} // namespace android::renderengine::skia
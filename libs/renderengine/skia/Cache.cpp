@@ -26,6 +26,9 @@
 #include "ui/Rect.h"
 #include "utils/Timers.h"
 
+#include <map>
+#include <utility>
+
 namespace android::renderengine::skia {
 
 namespace {
@@ -445,4 +448,226 @@ void Cache::primeShaderCache(SkiaRenderEngine* renderengine) {
     }
 }
 
+static PixelFormat toPixelFormat(ShaderKey::Format format) {
+    switch (format) {
+        case ShaderKey::Format::RGBA_FP16:
+            return PIXEL_FORMAT_RGBA_FP16;
+        case ShaderKey::Format::RGBA_1010102:
+            return PIXEL_FORMAT_RGBA_1010102;
+        default:
+            return PIXEL_FORMAT_RGBA_8888;
+    }
+}
+
+static ui::Dataspace toSourceDataspace(ShaderKey::Dataspace dataspace, ui::Dataspace output) {
+    switch (dataspace) {
+        case ShaderKey::Dataspace::OTHER_SDR:
+            return output == kDestDataSpace ? kOtherDataSpace : kDestDataSpace;
+        case ShaderKey::Dataspace::PQ:
+            return ui::Dataspace::BT2020_PQ;
+        case ShaderKey::Dataspace::HLG:
+            return ui::Dataspace::BT2020_HLG;
+        default:
+            return output;
+    }
+}
+
+// Rebuilds settings with the given key, reusing the values of the fixed list above where possible.
+static std::pair<DisplaySettings, LayerSettings> makeSettings(
+        const ShaderKey& key, const Rect& displayRect,
+        const std::shared_ptr<ExternalTexture>& srcTexture) {
+    // Any color matrix which isn't the identity will do.
+    const auto kColorTransform = mat4::scale(vec4(0.9f, 0.8f, 0.7f, 1.f));
+
+    DisplaySettings display{
+            .physicalDisplay = displayRect,
+            .clip = displayRect,
+            .maxLuminance = 500,
+            .outputDataspace = key.wideGamutOutput ? kOtherDataSpace : kDestDataSpace,
+    };
+    if (key.displayColorTransform) {
+        display.colorTransform = kColorTransform;
+    }
+
+    const FloatRect rect(0, 0, displayRect.width(), displayRect.height());
+    LayerSettings layer{
+            .geometry =
+                    Geometry{
+                            .boundaries = rect,
+                            .roundedCornersCrop = rect,
+                    },
+            .alpha = key.translucent ? 0.5f : 1.f,
+            .disableBlending = key.disableBlending,
+    };
+    layer.sourceDataspace = toSourceDataspace(key.dataspace, display.outputDataspace);
+
+    switch (key.source) {
+        case ShaderKey::Source::NONE:
+            // setting this is mandatory for shadows and blurs
+            layer.skipContentDraw = true;
+            break;
+        case ShaderKey::Source::SOLID_COLOR:
+            layer.source.solidColor = half3(0.1f, 0.2f, 0.3f);
+            break;
+        default:
+            layer.source.buffer = Buffer{
+                    .buffer = srcTexture,
+                    .usePremultipliedAlpha = key.premultiplied,
+                    .isOpaque = key.opaque,
+                    .maxLuminanceNits = 1000.f,
+            };
+            break;
+    }
+
+    switch (key.corners) {
+        case ShaderKey::Corners::CIRCULAR:
+            layer.geometry.roundedCornersRadius = {50.f, 50.f};
+            break;
+        case ShaderKey::Corners::ELLIPTICAL:
+            layer.geometry.roundedCornersRadius = {50.f, 30.f};
+            break;
+        default:
+            break;
+    }
+    if (key.clipped) {
+        // As in drawClippedLayers, the boundary is smaller than the rounded corners crop.
+        layer.geometry.boundaries = FloatRect(0, 0, displayRect.width(), displayRect.height() - 20);
+    }
+
+    switch (key.transform) {
+        case ShaderKey::Transform::SCALE_TRANSLATE:
+            layer.geometry.positionTransform = kScaleAndTranslate;
+            break;
+        case ShaderKey::Transform::OTHER:
+            layer.geometry.positionTransform = kFlip;
+            break;
+        default:
+            break;
+    }
+
+    if (key.shadow) {
+        layer.shadow = ShadowSettings{
+                .boundaries = rect,
+                .ambientColor = vec4(0, 0, 0, 0.00935997f),
+                .spotColor = vec4(0, 0, 0, 0.0455841f),
+                .lightPos = vec3(500.f, -1500.f, 1500.f),
+                .lightRadius = 2500.0f,
+                .length = 15.f,
+        };
+    }
+
+    // Different blur code is invoked for radii less and greater than 30 pixels, see drawBlurLayers.
+    switch (key.blur) {
+        case ShaderKey::Blur::SMALL:
+            layer.backgroundBlurRadius = 9;
+            break;
+        case ShaderKey::Blur::LARGE:
+            layer.backgroundBlurRadius = 60;
+            break;
+        default:
+            break;
+    }
+
+    if (key.stretch) {
+        layer.stretchEffect = StretchEffect{
+                .width = rect.getWidth(),
+                .height = rect.getHeight(),
+                .vectorX = 0.5f,
+                .vectorY = 0.5f,
+                .maxAmountX = 0.2f,
+                .maxAmountY = 0.2f,
+                .mappedChildBounds = rect,
+        };
+    }
+    if (key.layerColorTransform) {
+        layer.colorTransform = kColorTransform;
+    }
+    if (key.dimmed) {
+        // A layer whose white point is below the target luminance of the display is dimmed.
+        display.targetLuminanceNits = 500.f;
+        layer.whitePointNits = 250.f;
+    }
+    return {display, layer};
+}
+
+size_t Cache::primeShaderCache(SkiaRenderEngine* renderengine, const std::vector<ShaderKey>& keys,
+                               const std::function<bool()>& shouldContinue) {
+    const int previousCount = renderengine->reportShadersCompiled();
+    const nsecs_t timeBefore = systemTime();
+    const Rect displayRect(0, 0, 128, 128);
+    const int64_t usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE;
+
+    sp<GraphicBuffer> dstBuffer =
+            new GraphicBuffer(displayRect.width(), displayRect.height(), PIXEL_FORMAT_RGBA_8888, 1,
+                              usage, "primeShaderCache_dst");
+    const auto dstTexture =
+            std::make_shared<impl::ExternalTexture>(dstBuffer, *renderengine,
+                                                    impl::ExternalTexture::Usage::WRITEABLE);
+
+    // Source textures are created as keys need them, as most manifests only use a few formats.
+    // A null texture is cached for the formats the device can't allocate.
+    std::map<std::pair<ShaderKey::Format, bool>, std::shared_ptr<ExternalTexture>> srcTextures;
+    const auto getSrcTexture = [&](const ShaderKey& key) {
+        const auto [it, inserted] =
+                srcTextures.try_emplace(std::make_pair(key.format, key.externalTexture));
+        if (inserted) {
+            // GRALLOC_USAGE_HW_TEXTURE should be the same as
+            // AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE.
+            sp<GraphicBuffer> srcBuffer =
+                    new GraphicBuffer(displayRect.width(), displayRect.height(),
+                                      toPixelFormat(key.format), 1,
+                                      key.externalTexture ? GRALLOC_USAGE_HW_TEXTURE : usage,
+                                      "primeShaderCache_manifest_src");
+            if (srcBuffer->initCheck() == NO_ERROR) {
+                it->second = std::make_shared<
+                        impl::ExternalTexture>(srcBuffer, *renderengine,
+                                               impl::ExternalTexture::Usage::READABLE);
+            }
+        }
+        return it->second;
+    };
+
+    size_t keysDrawn = 0;
+    for (const ShaderKey& key : keys) {
+        if (!shouldContinue()) {
+            break;
+        }
+        std::shared_ptr<ExternalTexture> srcTexture;
+        if (key.source == ShaderKey::Source::BUFFER) {
+            srcTexture = getSrcTexture(key);
+            if (!srcTexture) {
+                continue;
+            }
+        }
+        if (key.blur != ShaderKey::Blur::NONE && !renderengine->supportsBackgroundBlur()) {
+            continue;
+        }
+
+        auto [display, layer] = makeSettings(key, displayRect, srcTexture);
+        auto layers = std::vector<LayerSettings>{layer};
+        renderengine->drawLayers(display, layers, dstTexture, kUseFrameBufferCache,
+                                 base::unique_fd());
+        keysDrawn++;
+    }
+
+    // draw one final layer synchronously to force GL submit
+    const DisplaySettings display{
+            .physicalDisplay = displayRect,
+            .clip = displayRect,
+            .outputDataspace = kDestDataSpace,
+    };
+    LayerSettings layer{
+            .source = PixelSource{.solidColor = half3(0.f, 0.f, 0.f)},
+    };
+    auto layers = std::vector<LayerSettings>{layer};
+    // call get() to make it synchronous
+    renderengine->drawLayers(display, layers, dstTexture, kUseFrameBufferCache, base::unique_fd())
+            .get();
+
+    const float compileTimeMs = static_cast<float>(systemTime() - timeBefore) / 1.0E6;
+    ALOGD("Shader manifest replayed %zu of %zu keys, generating %d shaders in %f ms\n", keysDrawn,
+          keys.size(), renderengine->reportShadersCompiled() - previousCount, compileTimeMs);
+    return keysDrawn;
+}
+
 } // namespace android::renderengine::skia
@@ -16,6 +16,11 @@
 
 #pragma once
 
+#include <functional>
+#include <vector>
+
+#include "ShaderManifest.h"
+
 namespace android::renderengine::skia {
 
 class SkiaRenderEngine;
@@ -24,6 +29,12 @@ class Cache {
 public:
     static void primeShaderCache(SkiaRenderEngine*);
 
+    // Draws a layer for each key, so that the shaders recorded in a ShaderManifest are compiled.
+    // Stops early if shouldContinue returns false, which is checked before each key. Returns the
+    // number of keys drawn.
+    static size_t primeShaderCache(SkiaRenderEngine*, const std::vector<ShaderKey>& keys,
+                                   const std::function<bool()>& shouldContinue);
+
 private:
     Cache() = default;
 };
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "RenderEngine"
+
+#include "ShaderManifest.h"
+
+#include <android-base/file.h>
+#include <log/log.h>
+#include <renderengine/ExternalTexture.h>
+#include <system/graphics-base-v1.0.h>
+#include <ui/GraphicBuffer.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+namespace android::renderengine::skia {
+
+namespace {
+
+// The file is the magic and version, followed by the number of keys and the packed keys, all
+// native endian 32 bit values.
+constexpr uint32_t kMagic = 0x4d534552; // "RESM"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 3 * sizeof(uint32_t);
+
+// Calls visit(field, bits) for each field of the key, in the order they are packed.
+template <typename Key, typename Visitor>
+void visitFields(Key& key, Visitor&& visit) {
+    visit(key.source, 2);
+    visit(key.format, 2);
+    visit(key.externalTexture, 1);
+    visit(key.opaque, 1);
+    visit(key.premultiplied, 1);
+    visit(key.dataspace, 2);
+    visit(key.wideGamutOutput, 1);
+    visit(key.translucent, 1);
+    visit(key.corners, 2);
+    visit(key.clipped, 1);
+    visit(key.transform, 2);
+    visit(key.disableBlending, 1);
+    visit(key.shadow, 1);
+    visit(key.blur, 2);
+    visit(key.stretch, 1);
+    visit(key.layerColorTransform, 1);
+    visit(key.displayColorTransform, 1);
+    visit(key.dimmed, 1);
+}
+
+ShaderKey::Format toKeyFormat(PixelFormat format) {
+    switch (format) {
+        case PIXEL_FORMAT_RGBA_FP16:
+            return ShaderKey::Format::RGBA_FP16;
+        case PIXEL_FORMAT_RGBA_1010102:
+            return ShaderKey::Format::RGBA_1010102;
+        default:
+            // Other formats are sampled like RGBA_8888.
+            return ShaderKey::Format::RGBA_8888;
+    }
+}
+
+ShaderKey::Dataspace toKeyDataspace(ui::Dataspace source, ui::Dataspace output) {
+    switch (source & HAL_DATASPACE_TRANSFER_MASK) {
+        case HAL_DATASPACE_TRANSFER_ST2084:
+            return ShaderKey::Dataspace::PQ;
+        case HAL_DATASPACE_TRANSFER_HLG:
+            return ShaderKey::Dataspace::HLG;
+        default:
+            return source == output || source == ui::Dataspace::UNKNOWN
+                    ? ShaderKey::Dataspace::OUTPUT
+                    : ShaderKey::Dataspace::OTHER_SDR;
+    }
+}
+
+ShaderKey::Transform toKeyTransform(const mat4& transform) {
+    if (transform == mat4()) {
+        return ShaderKey::Transform::IDENTITY;
+    }
+    return transform[0][1] == 0.f && transform[1][0] == 0.f
+            ? ShaderKey::Transform::SCALE_TRANSLATE
+            : ShaderKey::Transform::OTHER;
+}
+
+} // namespace
+
+ShaderKey ShaderKey::make(const DisplaySettings& display, const LayerSettings& layer,
+                          bool isDimmed) {
+    ShaderKey key;
+    if (layer.skipContentDraw) {
+        key.source = Source::NONE;
+    } else if (const auto& buffer = layer.source.buffer; buffer.buffer) {
+        key.source = Source::BUFFER;
+        key.format = toKeyFormat(buffer.buffer->getPixelFormat());
+        key.externalTexture = (buffer.buffer->getUsage() & GRALLOC_USAGE_HW_RENDER) == 0;
+        key.opaque = buffer.isOpaque;
+        key.premultiplied = buffer.usePremultipliedAlpha;
+    } else {
+        key.source = Source::SOLID_COLOR;
+    }
+
+    key.dataspace = toKeyDataspace(layer.sourceDataspace, display.outputDataspace);
+    key.wideGamutOutput = (display.outputDataspace & HAL_DATASPACE_STANDARD_MASK) !=
+            HAL_DATASPACE_STANDARD_BT709;
+    key.translucent = layer.alpha < 1.f;
+
+    const vec2& radius = layer.geometry.roundedCornersRadius;
+    if (radius.x > 0.f || radius.y > 0.f) {
+        key.corners = radius.x == radius.y ? Corners::CIRCULAR : Corners::ELLIPTICAL;
+        key.clipped = !(layer.geometry.boundaries == layer.geometry.roundedCornersCrop);
+    }
+    key.transform = toKeyTransform(layer.geometry.positionTransform);
+    key.disableBlending = layer.disableBlending;
+    key.shadow = layer.shadow.length > 0;
+
+    int blurRadius = layer.backgroundBlurRadius;
+    for (const auto& region : layer.blurRegions) {
+        blurRadius = std::max(blurRadius, static_cast<int>(region.blurRadius));
+    }
+    key.blur = blurRadius <= 0           ? Blur::NONE
+            : blurRadius < kLargeBlurRadius ? Blur::SMALL
+                                            : Blur::LARGE;
+
+    key.stretch = layer.stretchEffect.hasEffect();
+    key.layerColorTransform = layer.colorTransform != mat4();
+    key.displayColorTransform =
+            display.colorTransform != mat4() && !display.deviceHandlesColorTransform;
+    key.dimmed = isDimmed;
+    return key;
+}
+
+uint32_t ShaderKey::pack() const {
+    uint32_t value = 0;
+    uint32_t shift = 0;
+    visitFields(*this, [&](const auto& field, uint32_t bits) {
+        value |= static_cast<uint32_t>(field) << shift;
+        shift += bits;
+    });
+    return value;
+}
+
+std::optional<ShaderKey> ShaderKey::unpack(uint32_t value) {
+    ShaderKey key;
+    bool valid = true;
+    visitFields(key, [&](auto& field, uint32_t bits) {
+        using Field = std::decay_t<decltype(field)>;
+        const uint32_t fieldValue = value & ((1u << bits) - 1);
+        value >>= bits;
+        if constexpr (std::is_enum_v<Field>) {
+            valid = valid && fieldValue < static_cast<uint32_t>(Field::COUNT);
+        }
+        field = static_cast<Field>(fieldValue);
+    });
+    if (!valid || value != 0) {
+        return std::nullopt;
+    }
+    return key;
+}
+
+void ShaderManifest::record(const ShaderKey& key) {
+    std::lock_guard lock(mMutex);
+    if (mKeys.size() < kMaxKeys && mKeys.insert(key.pack()).second) {
+        mDirty = true;
+    }
+}
+
+std::vector<ShaderKey> ShaderManifest::keys() const {
+    std::vector<uint32_t> packedKeys;
+    {
+        std::lock_guard lock(mMutex);
+        packedKeys.assign(mKeys.begin(), mKeys.end());
+    }
+    std::sort(packedKeys.begin(), packedKeys.end());
+
+    std::vector<ShaderKey> keys;
+    keys.reserve(packedKeys.size());
+    for (const uint32_t packedKey : packedKeys) {
+        keys.push_back(*ShaderKey::unpack(packedKey));
+    }
+    return keys;
+}
+
+size_t ShaderManifest::size() const {
+    std::lock_guard lock(mMutex);
+    return mKeys.size();
+}
+
+bool ShaderManifest::isDirty() const {
+    std::lock_guard lock(mMutex);
+    return mDirty;
+}
+
+bool ShaderManifest::load(const std::string& path) {
+    std::string content;
+    if (!base::ReadFileToString(path, &content)) {
+        return false;
+    }
+
+    uint32_t header[3];
+    if (content.size() < kHeaderSize) {
+        ALOGW("Shader manifest %s is truncated", path.c_str());
+        return false;
+    }
+    memcpy(header, content.data(), kHeaderSize);
+    const auto [magic, version, count] = header;
+    if (magic != kMagic || version != kVersion || count > kMaxKeys ||
+        content.size() != kHeaderSize + count * sizeof(uint32_t)) {
+        ALOGW("Ignoring shader manifest %s: not a version %u manifest", path.c_str(), kVersion);
+        return false;
+    }
+
+    std::vector<uint32_t> packedKeys(count);
+    memcpy(packedKeys.data(), content.data() + kHeaderSize, count * sizeof(uint32_t));
+    for (const uint32_t packedKey : packedKeys) {
+        if (!ShaderKey::unpack(packedKey)) {
+            ALOGW("Ignoring shader manifest %s: invalid key 0x%x", path.c_str(), packedKey);
+            return false;
+        }
+    }
+
+    std::lock_guard lock(mMutex);
+    for (const uint32_t packedKey : packedKeys) {
+        if (mKeys.size() == kMaxKeys) {
+            break;
+        }
+        mKeys.insert(packedKey);
+    }
+    return true;
+}
+
+bool ShaderManifest::save(const std::string& path) {
+    std::string content;
+    {
+        std::lock_guard lock(mMutex);
+        const uint32_t header[] = {kMagic, kVersion, static_cast<uint32_t>(mKeys.size())};
+        content.append(reinterpret_cast<const char*>(header), sizeof(header));
+        for (const uint32_t packedKey : mKeys) {
+            content.append(reinterpret_cast<const char*>(&packedKey), sizeof(packedKey));
+        }
+        mDirty = false;
+    }
+
+    // Write a temporary file first, so that a crash doesn't leave a truncated manifest behind.
+    const std::string tmpPath = path + ".tmp";
+    if (!base::WriteStringToFile(content, tmpPath) || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ALOGW("Failed to save shader manifest %s: %s", path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        std::lock_guard lock(mMutex);
+        mDirty = true;
+        return false;
+    }
+    return true;
+}
+
+} // namespace android::renderengine::skia
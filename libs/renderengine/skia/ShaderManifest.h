@@ -0,0 +1,109 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/thread_annotations.h>
+#include <renderengine/DisplaySettings.h>
+#include <renderengine/LayerSettings.h>
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace android::renderengine::skia {
+
+// The settings of a layer which determine the shaders Skia needs to draw it, as opposed to e.g.
+// its size or color. Layers with the same key are drawn with the same shaders, give or take what
+// is decided in device space.
+struct ShaderKey {
+    enum class Source : uint8_t { NONE, SOLID_COLOR, BUFFER, COUNT };
+    enum class Format : uint8_t { RGBA_8888, RGBA_FP16, RGBA_1010102, COUNT };
+    // Source dataspace, relative to the output dataspace.
+    enum class Dataspace : uint8_t { OUTPUT, OTHER_SDR, PQ, HLG, COUNT };
+    enum class Corners : uint8_t { NONE, CIRCULAR, ELLIPTICAL, COUNT };
+    enum class Transform : uint8_t { IDENTITY, SCALE_TRANSLATE, OTHER, COUNT };
+    // Blurs below kLargeBlurRadius are drawn differently.
+    enum class Blur : uint8_t { NONE, SMALL, LARGE, COUNT };
+    static constexpr int kLargeBlurRadius = 30;
+
+    Source source = Source::NONE;
+    // Buffer sources only.
+    Format format = Format::RGBA_8888;
+    bool externalTexture = false;
+    bool opaque = false;
+    bool premultiplied = false;
+
+    Dataspace dataspace = Dataspace::OUTPUT;
+    bool wideGamutOutput = false;
+    bool translucent = false;
+    Corners corners = Corners::NONE;
+    // Whether the rounded corners crop intersects the layer bounds.
+    bool clipped = false;
+    Transform transform = Transform::IDENTITY;
+    bool disableBlending = false;
+    bool shadow = false;
+    Blur blur = Blur::NONE;
+    bool stretch = false;
+    bool layerColorTransform = false;
+    bool displayColorTransform = false;
+    bool dimmed = false;
+
+    // isDimmed is whether the layer is dimmed relative to the other layers of the display.
+    static ShaderKey make(const DisplaySettings& display, const LayerSettings& layer,
+                          bool isDimmed);
+
+    uint32_t pack() const;
+    // Returns nullopt if the value wasn't returned by pack().
+    static std::optional<ShaderKey> unpack(uint32_t value);
+
+    bool operator==(const ShaderKey& other) const { return pack() == other.pack(); }
+};
+
+// Set of the ShaderKeys drawn by a RenderEngine, which can be saved to disk so that the shaders
+// are compiled ahead of time on the next boot.
+//
+// This class is thread-safe.
+class ShaderManifest {
+public:
+    // Bounds the size of the file, and the time spent compiling shaders from it.
+    static constexpr size_t kMaxKeys = 1024;
+
+    void record(const ShaderKey& key);
+
+    // Ordered by packed value, so that the order doesn't change from one boot to the next.
+    std::vector<ShaderKey> keys() const;
+    size_t size() const;
+
+    // Whether keys were recorded since the manifest was last loaded or saved.
+    bool isDirty() const;
+
+    // Adds the keys of the file to the manifest. Returns false if the file can't be read or is not
+    // a valid manifest, in which case the manifest is unchanged.
+    bool load(const std::string& path);
+    // Replaces the file with the keys of the manifest. Returns false on failure.
+    bool save(const std::string& path);
+
+private:
+    mutable std::mutex mMutex;
+    std::unordered_set<uint32_t> mKeys GUARDED_BY(mMutex);
+    bool mDirty GUARDED_BY(mMutex) = false;
+};
+
+} // namespace android::renderengine::skia
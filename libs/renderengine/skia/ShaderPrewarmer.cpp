@@ -0,0 +1,169 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "RenderEngine"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "ShaderPrewarmer.h"
+
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <system/thread_defs.h>
+#include <utils/Trace.h>
+
+#include "Cache.h"
+#include "SkiaRenderEngine.h"
+
+namespace android::renderengine::skia {
+
+using base::StringAppendF;
+using namespace std::chrono_literals;
+
+// How often the keys recorded since the last save are saved. The manifest is saved on shutdown
+// too, but SurfaceFlinger is seldom shut down cleanly.
+static constexpr auto kSaveInterval = 5min;
+
+ShaderPrewarmer::ShaderPrewarmer(std::unique_ptr<SkiaRenderEngine> engine,
+                                 std::function<bool()> makeCurrent, ShaderManifest& manifest,
+                                 std::string manifestPath)
+      : mEngine(std::move(engine)),
+        mMakeCurrent(std::move(makeCurrent)),
+        mManifest(manifest),
+        mManifestPath(std::move(manifestPath)) {
+    mThread = std::thread(&ShaderPrewarmer::threadMain, this);
+}
+
+ShaderPrewarmer::~ShaderPrewarmer() {
+    {
+        std::lock_guard lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_one();
+    mThread.join();
+}
+
+void ShaderPrewarmer::onFrameDrawn() {
+    if (!mFrameDrawn.exchange(true)) {
+        // Lock so that the notification isn't lost if the thread is about to wait.
+        std::lock_guard lock(mMutex);
+        mCondition.notify_one();
+    }
+}
+
+const char* ShaderPrewarmer::toString(State state) {
+    switch (state) {
+        case State::LOADING:
+            return "loading";
+        case State::WAITING_FOR_FIRST_FRAME:
+            return "waiting for the first frame";
+        case State::REPLAYING:
+            return "replaying";
+        case State::DONE:
+            return "done";
+        case State::NO_CONTEXT:
+            return "failed to make the context current";
+    }
+    return "unknown";
+}
+
+void ShaderPrewarmer::threadMain() {
+    pthread_setname_np(pthread_self(), "reShaderPrewarm");
+    // The thread inherits the scheduling policy of RenderEngine, but must not compete with it.
+    struct sched_param param = {0};
+    sched_setscheduler(0, SCHED_OTHER, &param);
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND);
+
+    // A missing manifest is expected on the first boot.
+    if (mManifest.load(mManifestPath)) {
+        ALOGD("Loaded %zu keys from shader manifest %s", mManifest.size(), mManifestPath.c_str());
+    }
+
+    const bool isCurrent = mMakeCurrent();
+    ALOGE_IF(!isCurrent, "Can't make the shader prewarming context current");
+
+    std::unique_lock lock(mMutex);
+    if (isCurrent) {
+        mState = State::WAITING_FOR_FIRST_FRAME;
+        mCondition.wait(lock, [this]() REQUIRES(mMutex) { return mStopping || mFrameDrawn; });
+
+        if (!mStopping) {
+            const std::vector<ShaderKey> keys = mManifest.keys();
+            mState = State::REPLAYING;
+            mKeysTotal = keys.size();
+            lock.unlock();
+
+            ATRACE_NAME("ShaderPrewarmer::replay");
+            const auto start = std::chrono::steady_clock::now();
+            const size_t keysDrawn = Cache::primeShaderCache(mEngine.get(), keys,
+                                                             [this] { return onReplayingKey(); });
+
+            lock.lock();
+            mKeysDrawn = keysDrawn;
+            mReplayTime = std::chrono::steady_clock::now() - start;
+            mState = State::DONE;
+        }
+    } else {
+        mState = State::NO_CONTEXT;
+    }
+
+    while (!mCondition.wait_for(lock, kSaveInterval,
+                                [this]() REQUIRES(mMutex) { return mStopping; })) {
+        lock.unlock();
+        saveManifest();
+        lock.lock();
+    }
+    lock.unlock();
+    saveManifest();
+
+    // Destroy the engine while its context is current.
+    mEngine.reset();
+}
+
+bool ShaderPrewarmer::onReplayingKey() {
+    std::lock_guard lock(mMutex);
+    if (mStopping) {
+        return false;
+    }
+    mKeysReplayed++;
+    return true;
+}
+
+void ShaderPrewarmer::saveManifest() {
+    if (!mManifest.isDirty() || !mManifest.save(mManifestPath)) {
+        return;
+    }
+    std::lock_guard lock(mMutex);
+    mSaves++;
+}
+
+void ShaderPrewarmer::dump(std::string& result) const {
+    std::lock_guard lock(mMutex);
+    StringAppendF(&result, "Shader prewarming: %s, replayed %zu of %zu keys", toString(mState),
+                  mKeysReplayed, mKeysTotal);
+    if (mState == State::DONE) {
+        StringAppendF(&result, " (%zu drawn) in %.3f ms", mKeysDrawn,
+                      std::chrono::duration<double, std::milli>(mReplayTime).count());
+    }
+    StringAppendF(&result, "\n");
+    StringAppendF(&result, "Shader manifest %s: %zu keys, saved %zu times\n", mManifestPath.c_str(),
+                  mManifest.size(), mSaves);
+}
+
+} // namespace android::renderengine::skia
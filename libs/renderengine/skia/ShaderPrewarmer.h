@@ -0,0 +1,87 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/thread_annotations.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "ShaderManifest.h"
+
+namespace android::renderengine::skia {
+
+class SkiaRenderEngine;
+
+// Compiles the shaders of a ShaderManifest on a background thread, by drawing the keys of the
+// manifest with a secondary engine once the first frame is drawn. The secondary engine shares its
+// compiled programs with the primary one, see SkiaGLRenderEngine::SkSLCacheMonitor.
+//
+// The manifest is loaded from and periodically saved to manifestPath, so that the layers drawn by
+// the primary engine are prewarmed on the next boot.
+class ShaderPrewarmer {
+public:
+    // makeCurrent() is called on the prewarming thread to make the context of the engine current.
+    // The engine is destroyed on that thread too.
+    ShaderPrewarmer(std::unique_ptr<SkiaRenderEngine> engine, std::function<bool()> makeCurrent,
+                    ShaderManifest& manifest, std::string manifestPath);
+    // Stops prewarming and saves the manifest.
+    ~ShaderPrewarmer();
+
+    // Called by the primary engine after drawing each frame.
+    void onFrameDrawn();
+
+    void dump(std::string& result) const;
+
+private:
+    enum class State { LOADING, WAITING_FOR_FIRST_FRAME, REPLAYING, DONE, NO_CONTEXT };
+    static const char* toString(State state);
+
+    void threadMain();
+    // Called before drawing each key, returns false once stopping.
+    bool onReplayingKey();
+    void saveManifest();
+
+    // Only used by the prewarming thread.
+    std::unique_ptr<SkiaRenderEngine> mEngine;
+    const std::function<bool()> mMakeCurrent;
+    ShaderManifest& mManifest;
+    const std::string mManifestPath;
+
+    std::atomic<bool> mFrameDrawn = false;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping GUARDED_BY(mMutex) = false;
+    State mState GUARDED_BY(mMutex) = State::LOADING;
+    size_t mKeysTotal GUARDED_BY(mMutex) = 0;
+    size_t mKeysReplayed GUARDED_BY(mMutex) = 0;
+    size_t mKeysDrawn GUARDED_BY(mMutex) = 0;
+    std::chrono::steady_clock::duration mReplayTime GUARDED_BY(mMutex) =
+            std::chrono::steady_clock::duration::zero();
+    size_t mSaves GUARDED_BY(mMutex) = 0;
+
+    std::thread mThread;
+};
+
+} // namespace android::renderengine::skia
@@ -33,8 +33,10 @@
 #include "AutoBackendTexture.h"
 #include "EGL/egl.h"
 #include "GrContextOptions.h"
+#include "ShaderPrewarmer.h"
 #include "SkImageInfo.h"
 #include "SkiaRenderEngine.h"
+#include "TextureCache.h"
 #include "android-base/macros.h"
 #include "debug/SkiaCapture.h"
 #include "filters/BlurFilter.h"
@@ -46,11 +48,15 @@ namespace renderengine {
 namespace skia {
 
 class SkiaGLRenderEngine : public skia::SkiaRenderEngine {
+    class SkSLCacheMonitor;
+
 public:
     static std::unique_ptr<SkiaGLRenderEngine> create(const RenderEngineCreationArgs& args);
+    // skslCacheMonitor is shared with another engine, or nullptr for the engine to have its own.
     SkiaGLRenderEngine(const RenderEngineCreationArgs& args, EGLDisplay display, EGLContext ctxt,
                        EGLSurface placeholder, EGLContext protectedContext,
-                       EGLSurface protectedPlaceholder);
+                       EGLSurface protectedPlaceholder,
+                       std::shared_ptr<SkSLCacheMonitor> skslCacheMonitor = nullptr);
     ~SkiaGLRenderEngine() override EXCLUDES(mRenderingMutex);
 
     std::future<void> primeCache() override;
@@ -60,7 +66,6 @@ public:
     bool isProtected() const override { return mInProtectedContext; }
     bool supportsProtectedContent() const override;
     void useProtectedContext(bool useProtectedContext) override;
-    bool supportsBackgroundBlur() override { return mBlurFilter != nullptr; }
     void onActiveDisplaySizeChanged(ui::Size size) override;
     int reportShadersCompiled() override;
 
@@ -77,7 +82,18 @@ protected:
                             const std::shared_ptr<ExternalTexture>& buffer,
                             const bool useFramebufferCache, base::unique_fd&& bufferFence) override;
 
+    GrDirectContext* getActiveGrContext() const override;
+    std::shared_ptr<BackendBuffer> getOrCreateBackendBuffer(const sp<GraphicBuffer>& buffer,
+                                                            bool isOutputBuffer) override
+            REQUIRES(mRenderingMutex);
+    // waitFence attempts to wait in the GPU, and if unable to waits on the CPU instead.
+    void waitFence(base::borrowed_fd fenceFd) override;
+    RenderEngineResult flushAndSubmit(SkSurface* dstSurface) override REQUIRES(mRenderingMutex);
+
 private:
+    static std::unique_ptr<SkiaGLRenderEngine> create(
+            const RenderEngineCreationArgs& args,
+            std::shared_ptr<SkSLCacheMonitor> skslCacheMonitor);
     static EGLConfig chooseEglConfig(EGLDisplay display, int format, bool logConfig);
     static EGLContext createEglContext(EGLDisplay display, EGLConfig config,
                                        EGLContext shareContext,
@@ -87,47 +103,21 @@ private:
             const RenderEngineCreationArgs& args);
     static EGLSurface createPlaceholderEglPbufferSurface(EGLDisplay display, EGLConfig config,
                                                          int hwcFormat, Protection protection);
-    inline SkRect getSkRect(const FloatRect& layer);
-    inline SkRect getSkRect(const Rect& layer);
-    inline std::pair<SkRRect, SkRRect> getBoundsAndClip(const FloatRect& bounds,
-                                                        const FloatRect& crop,
-                                                        const vec2& cornerRadius);
-    inline bool layerHasBlur(const LayerSettings& layer, bool colorTransformModifiesAlpha);
-    inline SkColor getSkColor(const vec4& color);
-    inline SkM44 getSkM44(const mat4& matrix);
-    inline SkPoint3 getSkPoint3(const vec3& vector);
-    inline GrDirectContext* getActiveGrContext() const;
 
     base::unique_fd flush();
-    // waitFence attempts to wait in the GPU, and if unable to waits on the CPU instead.
-    void waitFence(base::borrowed_fd fenceFd);
     bool waitGpuFence(base::borrowed_fd fenceFd);
-
-    void initCanvas(SkCanvas* canvas, const DisplaySettings& display);
-    void drawShadow(SkCanvas* canvas, const SkRRect& casterRRect,
-                    const ShadowSettings& shadowSettings);
-
-    // If requiresLinearEffect is true or the layer has a stretchEffect a new shader is returned.
-    // Otherwise it returns the input shader.
-    struct RuntimeEffectShaderParameters {
-        sk_sp<SkShader> shader;
-        const LayerSettings& layer;
-        const DisplaySettings& display;
-        bool undoPremultipliedAlpha;
-        bool requiresLinearEffect;
-        float layerDimmingRatio;
-    };
-    sk_sp<SkShader> createRuntimeEffectShader(const RuntimeEffectShaderParameters&);
+    // Makes the context of the engine current on the calling thread.
+    bool makeCurrent();
+    // Starts compiling the shaders of the layers drawn on the previous boot, see ShaderPrewarmer.
+    void startShaderPrewarmer();
 
     EGLDisplay mEGLDisplay;
     EGLContext mEGLContext;
     EGLSurface mPlaceholderSurface;
     EGLContext mProtectedEGLContext;
     EGLSurface mProtectedPlaceholderSurface;
-    BlurFilter* mBlurFilter = nullptr;
 
     const PixelFormat mDefaultPixelFormat;
-    const bool mUseColorManagement;
 
     // Identifier used or various mappings of layers to various
     // textures or shaders
@@ -137,19 +127,10 @@ private:
     std::unordered_map<GraphicBufferId, int32_t> mGraphicBufferExternalRefs
             GUARDED_BY(mRenderingMutex);
     // Cache of GL textures that we'll store per GraphicBuffer ID, shared between GPU contexts.
-    std::unordered_map<GraphicBufferId, std::shared_ptr<AutoBackendTexture::LocalRef>> mTextureCache
-            GUARDED_BY(mRenderingMutex);
-    std::unordered_map<shaders::LinearEffect, sk_sp<SkRuntimeEffect>, shaders::LinearEffectHasher>
-            mRuntimeEffects;
+    // Textures of the last drawn frame are pinned until the next frame is drawn.
+    TextureCache<AutoBackendTexture::LocalRef> mTextureCache GUARDED_BY(mRenderingMutex);
     AutoBackendTexture::CleanupManager mTextureCleanupMgr GUARDED_BY(mRenderingMutex);
 
-    StretchShaderFactory mStretchShaderFactory;
-    // Mutex guarding rendering operations, so that:
-    // 1. GL operations aren't interleaved, and
-    // 2. Internal state related to rendering that is potentially modified by
-    // multiple threads is guaranteed thread-safe.
-    mutable std::mutex mRenderingMutex;
-
     sp<Fence> mLastDrawFence;
 
     // Graphics context used for creating surfaces and submitting commands
@@ -158,13 +139,16 @@ private:
     sk_sp<GrDirectContext> mProtectedGrContext;
 
     bool mInProtectedContext = false;
-    // Object to capture commands send to Skia.
-    std::unique_ptr<SkiaCapture> mCapture;
 
     // Implements PersistentCache as a way to monitor what SkSL shaders Skia has
-    // cached.
+    // cached. Once keepPrograms() is called, the compiled programs are kept in memory, so that the
+    // programs compiled by the context of one engine are loaded by the other engines sharing the
+    // monitor rather than compiled again. This class is thread-safe.
     class SkSLCacheMonitor : public GrContextOptions::PersistentCache {
     public:
+        // Programs compiled once the monitor holds that many bytes are not kept.
+        static constexpr size_t kMaxBytes = 8 * 1024 * 1024;
+
         SkSLCacheMonitor() = default;
         ~SkSLCacheMonitor() override = default;
 
@@ -172,20 +156,30 @@ private:
 
         void store(const SkData& key, const SkData& data, const SkString& description) override;
 
-        int shadersCachedSinceLastCall() {
-            const int shadersCachedSinceLastCall = mShadersCachedSinceLastCall;
-            mShadersCachedSinceLastCall = 0;
-            return shadersCachedSinceLastCall;
-        }
+        // Only needed while another engine compiles shaders for this one, see ShaderPrewarmer.
+        void keepPrograms();
 
-        int totalShadersCompiled() const { return mTotalShadersCompiled; }
+        int shadersCachedSinceLastCall();
+        int totalShadersCompiled() const;
+
+        void dump(std::string& result) const;
 
     private:
-        int mShadersCachedSinceLastCall = 0;
-        int mTotalShadersCompiled = 0;
+        mutable std::mutex mMutex;
+        int mShadersCachedSinceLastCall GUARDED_BY(mMutex) = 0;
+        int mTotalShadersCompiled GUARDED_BY(mMutex) = 0;
+        bool mKeepPrograms GUARDED_BY(mMutex) = false;
+        std::unordered_map<std::string, sk_sp<SkData>> mPrograms GUARDED_BY(mMutex);
+        size_t mProgramBytes GUARDED_BY(mMutex) = 0;
+        size_t mLoadHits GUARDED_BY(mMutex) = 0;
+        size_t mLoadMisses GUARDED_BY(mMutex) = 0;
     };
 
-    SkSLCacheMonitor mSkSLCacheMonitor;
+    const std::shared_ptr<SkSLCacheMonitor> mSkSLCacheMonitor;
+
+    // Only set on the primary engine, once primeCache() is called. Stopped before the engine is
+    // destroyed.
+    std::unique_ptr<ShaderPrewarmer> mShaderPrewarmer;
 };
 
 } // namespace skia
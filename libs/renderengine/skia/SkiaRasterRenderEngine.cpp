@@ -0,0 +1,393 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#undef LOG_TAG
+#define LOG_TAG "RenderEngine"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "SkiaRasterRenderEngine.h"
+
+#include <SkBBHFactory.h>
+#include <SkCanvas.h>
+#include <SkGraphics.h>
+#include <SkImage.h>
+#include <SkPicture.h>
+#include <SkPixmap.h>
+#include <android-base/stringprintf.h>
+#include <sync/sync.h>
+#include <sys/resource.h>
+#include <system/thread_defs.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+
+#include "ColorSpaces.h"
+#include "filters/GaussianBlurFilter.h"
+#include "log/log_main.h"
+#include "skia/debug/SkiaMemoryReporter.h"
+
+namespace android {
+namespace renderengine {
+namespace skia {
+
+using base::StringAppendF;
+
+namespace {
+
+// Skia's raster backend is only limited by memory, this matches what GPUs commonly support.
+constexpr size_t kMaxDimension = 16384;
+
+// Tiles start on multiples of the dither matrix size, so that dithering is seamless across tiles.
+constexpr int kTileAlignment = 8;
+// Below this height, playing the frame back costs more than what an extra thread gains.
+constexpr int kMinTileHeight = 64;
+// Splitting the frame into more tiles than threads lets threads which finish early take over
+// tiles that are more expensive to draw.
+constexpr int kTilesPerThread = 4;
+
+int getTileHeight(int height, size_t threadCount) {
+    const int tileCount = static_cast<int>(threadCount) * kTilesPerThread;
+    const int tileHeight = (height + tileCount - 1) / tileCount;
+    return std::max((tileHeight + kTileAlignment - 1) / kTileAlignment * kTileAlignment,
+                    kMinTileHeight);
+}
+
+SkColorType toSkColorType(PixelFormat format) {
+    switch (format) {
+        case PIXEL_FORMAT_RGBA_8888:
+            return kRGBA_8888_SkColorType;
+        case PIXEL_FORMAT_RGBX_8888:
+            return kRGB_888x_SkColorType;
+        case PIXEL_FORMAT_BGRA_8888:
+            return kBGRA_8888_SkColorType;
+        case PIXEL_FORMAT_RGBA_FP16:
+            return kRGBA_F16_SkColorType;
+        case PIXEL_FORMAT_RGBA_1010102:
+            return kRGBA_1010102_SkColorType;
+        case PIXEL_FORMAT_RGB_565:
+            return kRGB_565_SkColorType;
+        case PIXEL_FORMAT_R_8:
+            // Matches the GPU backend, which samples R8 buffers as alpha.
+            return kAlpha_8_SkColorType;
+        default:
+            return kUnknown_SkColorType;
+    }
+}
+
+// Pixels of a GraphicBuffer, locked for CPU access until the last SkImage or SkSurface using them
+// is destroyed.
+class RasterBuffer : public BackendBuffer, public std::enable_shared_from_this<RasterBuffer> {
+public:
+    RasterBuffer(const sp<GraphicBuffer>& buffer, bool isOutputBuffer)
+          : mBuffer(buffer),
+            mIsOutputBuffer(isOutputBuffer),
+            mColorType(toSkColorType(buffer->getPixelFormat())) {}
+
+    ~RasterBuffer() override {
+        if (mPixels != nullptr) {
+            mBuffer->unlock();
+        }
+    }
+
+    SkColorType colorType() const override { return mColorType; }
+
+    sk_sp<SkImage> makeImage(ui::Dataspace dataspace, SkAlphaType alphaType,
+                             GrDirectContext* /*context*/) override {
+        ATRACE_CALL();
+        auto colorType = mColorType;
+        if (alphaType == kOpaque_SkAlphaType && colorType == kRGBA_8888_SkColorType) {
+            colorType = kRGB_888x_SkColorType;
+        }
+
+        SkPixmap pixmap;
+        if (!lockPixels(dataspace, colorType, alphaType, &pixmap)) {
+            return nullptr;
+        }
+        return SkImage::MakeFromRaster(pixmap, releaseImageProc,
+                                       new std::shared_ptr<RasterBuffer>(shared_from_this()));
+    }
+
+    sk_sp<SkSurface> getOrCreateSurface(ui::Dataspace dataspace,
+                                        GrDirectContext* /*context*/) override {
+        ATRACE_CALL();
+        LOG_ALWAYS_FATAL_IF(!mIsOutputBuffer,
+                            "You can't generate a SkSurface for a read-only buffer");
+        // The surface isn't kept around, as it holds a reference on this buffer.
+        SkPixmap pixmap;
+        if (!lockPixels(dataspace, mColorType, kPremul_SkAlphaType, &pixmap)) {
+            return nullptr;
+        }
+        return SkSurface::MakeRasterDirectReleaseProc(pixmap.info(), pixmap.writable_addr(),
+                                                      pixmap.rowBytes(), releaseSurfaceProc,
+                                                      new std::shared_ptr<RasterBuffer>(
+                                                              shared_from_this()));
+    }
+
+private:
+    bool lockPixels(ui::Dataspace dataspace, SkColorType colorType, SkAlphaType alphaType,
+                    SkPixmap* pixmap) {
+        if (mColorType == kUnknown_SkColorType) {
+            ALOGE("Buffer 0x%" PRIx64 " has format %d, which can't be drawn on the CPU",
+                  mBuffer->getId(), mBuffer->getPixelFormat());
+            return false;
+        }
+
+        if (mPixels == nullptr) {
+            const uint32_t usage = mIsOutputBuffer
+                    ? GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN
+                    : GRALLOC_USAGE_SW_READ_OFTEN;
+            if (const status_t status = mBuffer->lock(usage, &mPixels); status != NO_ERROR) {
+                ALOGE("Failed to lock buffer 0x%" PRIx64 " for CPU access: %d", mBuffer->getId(),
+                      status);
+                mPixels = nullptr;
+                return false;
+            }
+        }
+
+        const SkImageInfo info = SkImageInfo::Make(mBuffer->getWidth(), mBuffer->getHeight(),
+                                                   colorType, alphaType,
+                                                   toSkColorSpace(dataspace));
+        pixmap->reset(info, mPixels, mBuffer->getStride() * SkColorTypeBytesPerPixel(mColorType));
+        return true;
+    }
+
+    // "context" contains a "std::shared_ptr<RasterBuffer>*" keeping the pixels locked.
+    static void releaseImageProc(const void* /*pixels*/, SkImage::ReleaseContext context) {
+        delete static_cast<std::shared_ptr<RasterBuffer>*>(context);
+    }
+
+    static void releaseSurfaceProc(void* /*pixels*/, void* context) {
+        delete static_cast<std::shared_ptr<RasterBuffer>*>(context);
+    }
+
+    const sp<GraphicBuffer> mBuffer;
+    const bool mIsOutputBuffer;
+    const SkColorType mColorType;
+    void* mPixels = nullptr;
+};
+
+} // namespace
+
+std::unique_ptr<SkiaRasterRenderEngine> SkiaRasterRenderEngine::create(
+        const RenderEngineCreationArgs& args) {
+    return std::make_unique<SkiaRasterRenderEngine>(args);
+}
+
+SkiaRasterRenderEngine::SkiaRasterRenderEngine(const RenderEngineCreationArgs& args)
+      : SkiaRenderEngine(args.renderEngineType, args.useColorManagement),
+        mTilePool(std::max(std::thread::hardware_concurrency(), 1u) - 1) {
+    if (args.supportsBackgroundBlur) {
+        ALOGD("Background Blurs Enabled");
+        // Kawase blurs run as runtime effects, which are much slower than Skia's own blur on the
+        // CPU.
+        mBlurFilter = std::make_unique<GaussianBlurFilter>();
+    }
+}
+
+void SkiaRasterRenderEngine::drawLayersInternal(
+        const std::shared_ptr<std::promise<RenderEngineResult>>&& resultPromise,
+        const DisplaySettings& display, const std::vector<LayerSettings>& layers,
+        const std::shared_ptr<ExternalTexture>& buffer, const bool /*useFramebufferCache*/,
+        base::unique_fd&& bufferFence) {
+    ATRACE_NAME("SkiaRaster::drawLayers");
+
+    std::lock_guard<std::mutex> lock(mRenderingMutex);
+    drawLayersLocked(resultPromise, display, layers, buffer, std::move(bufferFence));
+    mLockedBuffers.clear();
+}
+
+std::shared_ptr<BackendBuffer> SkiaRasterRenderEngine::getOrCreateBackendBuffer(
+        const sp<GraphicBuffer>& buffer, bool isOutputBuffer) {
+    if (isOutputBuffer) {
+        return std::make_shared<RasterBuffer>(buffer, true);
+    }
+
+    auto& lockedBuffer = mLockedBuffers[buffer->getId()];
+    std::shared_ptr<BackendBuffer> rasterBuffer = lockedBuffer.lock();
+    if (rasterBuffer == nullptr) {
+        rasterBuffer = std::make_shared<RasterBuffer>(buffer, false);
+        lockedBuffer = rasterBuffer;
+    }
+    return rasterBuffer;
+}
+
+void SkiaRasterRenderEngine::waitFence(base::borrowed_fd fenceFd) {
+    if (fenceFd.get() >= 0) {
+        ATRACE_NAME("SkiaRasterRenderEngine::waitFence");
+        sync_wait(fenceFd.get(), -1);
+    }
+}
+
+SkCanvas* SkiaRasterRenderEngine::beginRecording(SkSurface* dstSurface) {
+    // Without other threads to play the frame back on, recording only adds overhead.
+    if (mTilePool.threadCount() == 1) {
+        return nullptr;
+    }
+
+    mRecording = true;
+    // The R-tree lets each tile skip the drawing commands that don't intersect it.
+    SkRTreeFactory tileIndexFactory;
+    return mRecorder.beginRecording(SkRect::MakeIWH(dstSurface->width(), dstSurface->height()),
+                                    &tileIndexFactory);
+}
+
+RenderEngineResult SkiaRasterRenderEngine::flushAndSubmit(SkSurface* dstSurface) {
+    // Frames that weren't recorded are already drawn.
+    if (!mRecording) {
+        return {NO_ERROR, base::unique_fd()};
+    }
+    mRecording = false;
+    const sk_sp<SkPicture> picture = mRecorder.finishRecordingAsPicture();
+
+    SkPixmap dst;
+    if (!dstSurface->peekPixels(&dst)) {
+        ALOGE("Cannot access the pixels of the output buffer.");
+        return {INVALID_OPERATION, base::unique_fd()};
+    }
+
+    ATRACE_NAME("DrawTiles");
+    const int tileHeight = getTileHeight(dst.height(), mTilePool.threadCount());
+    const size_t tileCount = (dst.height() + tileHeight - 1) / tileHeight;
+    const SkSurfaceProps& props = dstSurface->props();
+    mTilePool.run(tileCount, [&](size_t tile) {
+        const int top = static_cast<int>(tile) * tileHeight;
+        SkPixmap band;
+        dst.extractSubset(&band,
+                          SkIRect::MakeLTRB(0, top, dst.width(),
+                                            std::min(top + tileHeight, dst.height())));
+        std::unique_ptr<SkCanvas> canvas =
+                SkCanvas::MakeRasterDirect(band.info(), band.writable_addr(), band.rowBytes(),
+                                           &props);
+        canvas->translate(0, -top);
+        canvas->drawPicture(picture);
+    });
+    return {NO_ERROR, base::unique_fd()};
+}
+
+size_t SkiaRasterRenderEngine::getMaxTextureSize() const {
+    return kMaxDimension;
+}
+
+size_t SkiaRasterRenderEngine::getMaxViewportDims() const {
+    return kMaxDimension;
+}
+
+void SkiaRasterRenderEngine::dump(std::string& result) {
+    StringAppendF(&result, "\n ------------RE-----------------\n");
+    StringAppendF(&result, "Skia raster backend drawing on %zu threads\n",
+                  mTilePool.threadCount());
+
+    std::vector<ResourcePair> cpuResourceMap = {
+            {"skia/sk_resource_cache/bitmap_", "Bitmaps"},
+            {"skia/sk_resource_cache/rrect-blur_", "Masks"},
+            {"skia/sk_resource_cache/rects-blur_", "Masks"},
+            {"skia/sk_resource_cache/tessellated", "Shadows"},
+            {"skia", "Other"},
+    };
+    SkiaMemoryReporter cpuReporter(cpuResourceMap, false);
+    SkGraphics::DumpMemoryStatistics(&cpuReporter);
+    StringAppendF(&result, "Skia CPU Caches: ");
+    cpuReporter.logTotals(result);
+    cpuReporter.logOutput(result);
+
+    {
+        std::lock_guard<std::mutex> lock(mRenderingMutex);
+        mBlurCache.dump(result);
+        StringAppendF(&result, "\n");
+        dumpRuntimeEffects(result);
+    }
+    StringAppendF(&result, "\n");
+}
+
+SkiaRasterRenderEngine::TilePool::TilePool(size_t workerCount) {
+    for (size_t i = 0; i < workerCount; i++) {
+        mWorkers.emplace_back([this, i] {
+            std::array<char, 16> name{"reRaster"};
+            snprintf(name.data(), name.size(), "reRaster%zu", i);
+            pthread_setname_np(pthread_self(), name.data());
+            setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_DISPLAY);
+            workerLoop();
+        });
+    }
+}
+
+SkiaRasterRenderEngine::TilePool::~TilePool() {
+    {
+        std::lock_guard lock(mLock);
+        mStopping = true;
+    }
+    mWorkCondition.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void SkiaRasterRenderEngine::TilePool::run(size_t tileCount,
+                                           const std::function<void(size_t)>& drawTile) {
+    {
+        std::lock_guard lock(mLock);
+        mDrawTile = &drawTile;
+        mTileCount = tileCount;
+        mNextTile = 0;
+        mBusyWorkers = mWorkers.size();
+        mGeneration++;
+    }
+    mWorkCondition.notify_all();
+    drawTiles(drawTile, tileCount);
+
+    std::unique_lock lock(mLock);
+    mDoneCondition.wait(lock, [this]() REQUIRES(mLock) { return mBusyWorkers == 0; });
+    mDrawTile = nullptr;
+}
+
+void SkiaRasterRenderEngine::TilePool::workerLoop() {
+    uint64_t generation = 0;
+    std::unique_lock lock(mLock);
+    while (true) {
+        mWorkCondition.wait(lock, [this, &generation]() REQUIRES(mLock) {
+            return mStopping || mGeneration != generation;
+        });
+        if (mStopping) {
+            return;
+        }
+        generation = mGeneration;
+        const auto* drawTile = mDrawTile;
+        const size_t tileCount = mTileCount;
+
+        lock.unlock();
+        drawTiles(*drawTile, tileCount);
+        lock.lock();
+
+        if (--mBusyWorkers == 0) {
+            mDoneCondition.notify_one();
+        }
+    }
+}
+
+void SkiaRasterRenderEngine::TilePool::drawTiles(const std::function<void(size_t)>& drawTile,
+                                                 size_t tileCount) {
+    for (size_t tile = mNextTile++; tile < tileCount; tile = mNextTile++) {
+        drawTile(tile);
+    }
+}
+
+} // namespace skia
+} // namespace renderengine
+} // namespace android
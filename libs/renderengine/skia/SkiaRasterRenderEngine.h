@@ -0,0 +1,123 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <SkPictureRecorder.h>
+#include <SkSurface.h>
+#include <android-base/thread_annotations.h>
+#include <renderengine/RenderEngine.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "SkiaRenderEngine.h"
+
+namespace android {
+namespace renderengine {
+namespace skia {
+
+/**
+ * SkiaRenderEngine drawing with Skia's CPU raster backend, for composition on machines without a
+ * GPU. Buffers are locked for CPU access while a frame is drawn, so they need to be allocated with
+ * the software read (input) and read/write (output) usages.
+ *
+ * Frames are recorded and then played back in horizontal bands on a pool of worker threads. Frames
+ * with blur read back what was drawn below the blurred layer, so they are drawn on the calling
+ * thread instead.
+ */
+class SkiaRasterRenderEngine : public skia::SkiaRenderEngine {
+public:
+    static std::unique_ptr<SkiaRasterRenderEngine> create(const RenderEngineCreationArgs& args);
+    explicit SkiaRasterRenderEngine(const RenderEngineCreationArgs& args);
+    ~SkiaRasterRenderEngine() override = default;
+
+    void cleanupPostRender() override {}
+    void cleanFramebufferCache() override {}
+    // Protected content can't be read by the CPU.
+    void useProtectedContext(bool /*useProtectedContext*/) override {}
+    void onActiveDisplaySizeChanged(ui::Size /*size*/) override {}
+
+protected:
+    void dump(std::string& result) override;
+    size_t getMaxTextureSize() const override;
+    size_t getMaxViewportDims() const override;
+    // Buffers are locked for each frame instead.
+    void mapExternalTextureBuffer(const sp<GraphicBuffer>& /*buffer*/,
+                                  bool /*isRenderable*/) override {}
+    void unmapExternalTextureBuffer(const sp<GraphicBuffer>& /*buffer*/) override {}
+    bool canSkipPostRenderCleanup() const override { return true; }
+    void drawLayersInternal(const std::shared_ptr<std::promise<RenderEngineResult>>&& resultPromise,
+                            const DisplaySettings& display,
+                            const std::vector<LayerSettings>& layers,
+                            const std::shared_ptr<ExternalTexture>& buffer,
+                            const bool useFramebufferCache, base::unique_fd&& bufferFence) override;
+
+    GrDirectContext* getActiveGrContext() const override { return nullptr; }
+    std::shared_ptr<BackendBuffer> getOrCreateBackendBuffer(const sp<GraphicBuffer>& buffer,
+                                                            bool isOutputBuffer) override
+            REQUIRES(mRenderingMutex);
+    // The CPU waits for the fence, as there is nothing else to queue the drawing on.
+    void waitFence(base::borrowed_fd fenceFd) override;
+    SkCanvas* beginRecording(SkSurface* dstSurface) override REQUIRES(mRenderingMutex);
+    RenderEngineResult flushAndSubmit(SkSurface* dstSurface) override REQUIRES(mRenderingMutex);
+
+private:
+    // Runs the tiles of a frame on a fixed set of threads, the calling thread included.
+    class TilePool {
+    public:
+        explicit TilePool(size_t workerCount);
+        ~TilePool();
+
+        size_t threadCount() const { return mWorkers.size() + 1; }
+
+        // Calls drawTile for each tile in [0, tileCount), and returns once all tiles are drawn.
+        void run(size_t tileCount, const std::function<void(size_t)>& drawTile);
+
+    private:
+        void workerLoop();
+        void drawTiles(const std::function<void(size_t)>& drawTile, size_t tileCount);
+
+        std::mutex mLock;
+        std::condition_variable mWorkCondition;
+        std::condition_variable mDoneCondition;
+        const std::function<void(size_t)>* mDrawTile GUARDED_BY(mLock) = nullptr;
+        size_t mTileCount GUARDED_BY(mLock) = 0;
+        // Incremented for every run, so that workers take part in each run exactly once.
+        uint64_t mGeneration GUARDED_BY(mLock) = 0;
+        size_t mBusyWorkers GUARDED_BY(mLock) = 0;
+        bool mStopping GUARDED_BY(mLock) = false;
+        std::atomic<size_t> mNextTile = 0;
+        std::vector<std::thread> mWorkers;
+    };
+
+    // Input buffers locked for the current frame, so that a buffer used by several layers is only
+    // locked once.
+    std::unordered_map<uint64_t, std::weak_ptr<BackendBuffer>> mLockedBuffers
+            GUARDED_BY(mRenderingMutex);
+    SkPictureRecorder mRecorder GUARDED_BY(mRenderingMutex);
+    bool mRecording GUARDED_BY(mRenderingMutex) = false;
+    TilePool mTilePool;
+};
+
+} // namespace skia
+} // namespace renderengine
+} // namespace android
@@ -17,9 +17,25 @@
 #ifndef SF_SKIARENDERENGINE_H_
 #define SF_SKIARENDERENGINE_H_
 
+#include <GrDirectContext.h>
+#include <SkCanvas.h>
+#include <SkSurface.h>
+#include <android-base/thread_annotations.h>
 #include <renderengine/RenderEngine.h>
 #include <sys/types.h>
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "BackendBuffer.h"
+#include "BlurCache.h"
+#include "ShaderManifest.h"
+#include "debug/SkiaCapture.h"
+#include "filters/BlurFilter.h"
+#include "filters/LinearEffect.h"
+#include "filters/StretchShaderFactory.h"
+
 namespace android {
 
 namespace renderengine {
@@ -29,14 +45,12 @@ class Texture;
 
 namespace skia {
 
-class BlurFilter;
-
-// TODO: Put common skia stuff here that can be shared between the GL & Vulkan backends
-// Currently mostly just handles all the no-op / missing APIs
+// Drawing code shared between the Skia backends. Backends provide Skia access to the buffers,
+// synchronization with fences and submission of the drawing commands.
 class SkiaRenderEngine : public RenderEngine {
 public:
     static std::unique_ptr<SkiaRenderEngine> create(const RenderEngineCreationArgs& args);
-    SkiaRenderEngine(RenderEngineType type);
+    SkiaRenderEngine(RenderEngineType type, bool useColorManagement);
     ~SkiaRenderEngine() override {}
 
     virtual std::future<void> primeCache() override { return {}; };
@@ -47,19 +61,95 @@ public:
     virtual int getContextPriority() override { return 0; }
     virtual int reportShadersCompiled() { return 0; }
     virtual void setEnableTracing(bool tracingEnabled) override;
+    bool supportsBackgroundBlur() override { return mBlurFilter != nullptr; }
+    bool supportsPartialRedraw() override { return true; }
 
 protected:
     virtual void mapExternalTextureBuffer(const sp<GraphicBuffer>& /*buffer*/,
                                           bool /*isRenderable*/) override = 0;
     virtual void unmapExternalTextureBuffer(const sp<GraphicBuffer>& /*buffer*/) override = 0;
 
-    virtual void drawLayersInternal(
-            const std::shared_ptr<std::promise<RenderEngineResult>>&& resultPromise,
-            const DisplaySettings& display, const std::vector<LayerSettings>& layers,
-            const std::shared_ptr<ExternalTexture>& buffer, const bool useFramebufferCache,
-            base::unique_fd&& bufferFence) override {
-        resultPromise->set_value({NO_ERROR, base::unique_fd()});
+    // Returns the context used for drawing, or nullptr if the backend draws on the CPU.
+    virtual GrDirectContext* getActiveGrContext() const = 0;
+
+    // Returns the buffer as seen by Skia. isOutputBuffer is true for the buffer being drawn into.
+    virtual std::shared_ptr<BackendBuffer> getOrCreateBackendBuffer(const sp<GraphicBuffer>& buffer,
+                                                                    bool isOutputBuffer)
+            REQUIRES(mRenderingMutex) = 0;
+
+    // Makes the subsequent drawing commands wait until the fence fires.
+    virtual void waitFence(base::borrowed_fd fenceFd) = 0;
+
+    // Returns a canvas recording the frame instead of drawing it into dstSurface right away, or
+    // nullptr to draw directly. Only frames which never read back dstSurface are recorded.
+    virtual SkCanvas* beginRecording(SkSurface* /*dstSurface*/) REQUIRES(mRenderingMutex) {
+        return nullptr;
+    }
+
+    // Submits the frame drawn into dstSurface. The returned fence fires once the frame is drawn.
+    virtual RenderEngineResult flushAndSubmit(SkSurface* dstSurface) REQUIRES(mRenderingMutex) = 0;
+
+    // Draws the layers into the buffer, see drawLayersInternal().
+    void drawLayersLocked(const std::shared_ptr<std::promise<RenderEngineResult>>& resultPromise,
+                          const DisplaySettings& display, const std::vector<LayerSettings>& layers,
+                          const std::shared_ptr<ExternalTexture>& buffer,
+                          base::unique_fd&& bufferFence) REQUIRES(mRenderingMutex);
+
+    void dumpRuntimeEffects(std::string& result) REQUIRES(mRenderingMutex);
+
+    std::unique_ptr<BlurFilter> mBlurFilter;
+    const bool mUseColorManagement;
+
+    // Blurs generated by mBlurFilter, reused while the layers they sample don't change.
+    BlurCache mBlurCache GUARDED_BY(mRenderingMutex);
+
+    // Mutex guarding rendering operations, so that:
+    // 1. Backend operations aren't interleaved, and
+    // 2. Internal state related to rendering that is potentially modified by
+    // multiple threads is guaranteed thread-safe.
+    mutable std::mutex mRenderingMutex;
+
+    // Object to capture commands send to Skia.
+    std::unique_ptr<SkiaCapture> mCapture;
+
+    // Settings of the layers drawn so far, so that their shaders can be compiled ahead of time on
+    // the next boot. Only recorded while a shader prewarmer runs, as told by mRecordShaderKeys,
+    // which is only accessed on the thread drawing.
+    bool mRecordShaderKeys = false;
+    ShaderManifest mShaderManifest;
+
+private:
+    inline SkRect getSkRect(const FloatRect& layer);
+    inline SkRect getSkRect(const Rect& layer);
+    inline std::pair<SkRRect, SkRRect> getBoundsAndClip(const FloatRect& bounds,
+                                                        const FloatRect& crop,
+                                                        const vec2& cornerRadius);
+    inline bool layerHasBlur(const LayerSettings& layer, bool colorTransformModifiesAlpha);
+    inline SkColor getSkColor(const vec4& color);
+    inline SkM44 getSkM44(const mat4& matrix);
+    inline SkPoint3 getSkPoint3(const vec3& vector);
+
+    void initCanvas(SkCanvas* canvas, const DisplaySettings& display);
+    void drawShadow(SkCanvas* canvas, const SkRRect& casterRRect,
+                    const ShadowSettings& shadowSettings);
+
+    // If requiresLinearEffect is true or the layer has a stretchEffect a new shader is returned.
+    // Otherwise it returns the input shader.
+    struct RuntimeEffectShaderParameters {
+        sk_sp<SkShader> shader;
+        const LayerSettings& layer;
+        const DisplaySettings& display;
+        bool undoPremultipliedAlpha;
+        bool requiresLinearEffect;
+        float layerDimmingRatio;
     };
+    sk_sp<SkShader> createRuntimeEffectShader(const RuntimeEffectShaderParameters&);
+
+    std::unordered_map<shaders::LinearEffect, sk_sp<SkRuntimeEffect>, shaders::LinearEffectHasher>
+            mRuntimeEffects;
+    shaders::LinearEffectUniformWriter mLinearEffectUniformWriter;
+
+    StretchShaderFactory mStretchShaderFactory;
 };
 
 } // namespace skia
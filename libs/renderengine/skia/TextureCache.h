@@ -0,0 +1,175 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace renderengine {
+namespace skia {
+
+/**
+ * Cache of textures per GraphicBuffer ID, bounded by a memory budget. Once the textures take more
+ * than the budget, the least recently used ones are evicted. Textures drawn by the frame in flight
+ * can be pinned so that they are never evicted, in which case the cache may temporarily exceed its
+ * budget. So may the most recently used texture on its own.
+ *
+ * This class is not thread-safe.
+ */
+template <typename Texture>
+class TextureCache {
+public:
+    using BufferId = uint64_t;
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t evictedBytes = 0;
+        // Number of times the cache couldn't get back under budget because of pinned textures.
+        size_t overBudget = 0;
+    };
+
+    explicit TextureCache(size_t budgetBytes = std::numeric_limits<size_t>::max())
+          : mBudgetBytes(budgetBytes) {}
+
+    // Returns the texture of the buffer, or nullptr if it isn't cached. A cached texture becomes
+    // the most recently used one.
+    std::shared_ptr<Texture> get(BufferId id) {
+        const auto it = mEntries.find(id);
+        if (it == mEntries.end()) {
+            mStats.misses++;
+            return nullptr;
+        }
+        mStats.hits++;
+        mLru.splice(mLru.end(), mLru, it->second.lruPosition);
+        return it->second.texture;
+    }
+
+    bool contains(BufferId id) const { return mEntries.count(id) > 0; }
+
+    // Caches the texture of the buffer as the most recently used one, replacing any texture already
+    // cached for it, then evicts textures until the cache is back under budget.
+    void insert(BufferId id, std::shared_ptr<Texture> texture, size_t sizeBytes) {
+        erase(id);
+        mLru.push_back(id);
+        mEntries.emplace(id,
+                         Entry{.texture = std::move(texture),
+                               .sizeBytes = sizeBytes,
+                               .lruPosition = std::prev(mLru.end())});
+        mSizeBytes += sizeBytes;
+        trim();
+    }
+
+    // Removes the texture of the buffer, even if it is pinned. Returns false if it wasn't cached.
+    bool erase(BufferId id) {
+        const auto it = mEntries.find(id);
+        if (it == mEntries.end()) {
+            return false;
+        }
+        mSizeBytes -= it->second.sizeBytes;
+        mLru.erase(it->second.lruPosition);
+        mEntries.erase(it);
+        return true;
+    }
+
+    // Prevents the texture of the buffer from being evicted until unpinAll() is called.
+    void pin(BufferId id) {
+        const auto it = mEntries.find(id);
+        if (it != mEntries.end() && !it->second.pinned) {
+            it->second.pinned = true;
+            mPinned.push_back(id);
+        }
+    }
+
+    void unpinAll() {
+        for (const BufferId id : mPinned) {
+            if (const auto it = mEntries.find(id); it != mEntries.end()) {
+                it->second.pinned = false;
+            }
+        }
+        mPinned.clear();
+        trim();
+    }
+
+    void setBudget(size_t budgetBytes) {
+        mBudgetBytes = budgetBytes;
+        trim();
+    }
+
+    size_t size() const { return mEntries.size(); }
+    size_t sizeBytes() const { return mSizeBytes; }
+    size_t budgetBytes() const { return mBudgetBytes; }
+    const Stats& stats() const { return mStats; }
+
+    // Calls f(id, texture) for each cached texture, from the least to the most recently used.
+    template <typename F>
+    void forEach(F f) const {
+        for (const BufferId id : mLru) {
+            f(id, *mEntries.at(id).texture);
+        }
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<Texture> texture;
+        size_t sizeBytes;
+        typename std::list<BufferId>::iterator lruPosition;
+        bool pinned = false;
+    };
+
+    // The most recently used texture is never evicted, as it is about to be drawn.
+    void trim() {
+        if (mLru.empty()) {
+            return;
+        }
+        const auto mostRecentlyUsed = std::prev(mLru.end());
+        for (auto it = mLru.begin(); mSizeBytes > mBudgetBytes && it != mostRecentlyUsed;) {
+            const auto entry = mEntries.find(*it);
+            if (entry->second.pinned) {
+                ++it;
+                continue;
+            }
+            mSizeBytes -= entry->second.sizeBytes;
+            mStats.evictions++;
+            mStats.evictedBytes += entry->second.sizeBytes;
+            mEntries.erase(entry);
+            it = mLru.erase(it);
+        }
+        if (mSizeBytes > mBudgetBytes) {
+            mStats.overBudget++;
+        }
+    }
+
+    size_t mBudgetBytes;
+    size_t mSizeBytes = 0;
+    // Least recently used first.
+    std::list<BufferId> mLru;
+    std::unordered_map<BufferId, Entry> mEntries;
+    std::vector<BufferId> mPinned;
+    Stats mStats;
+};
+
+} // namespace skia
+} // namespace renderengine
+} // namespace android
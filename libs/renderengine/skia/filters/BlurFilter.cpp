@@ -67,6 +67,13 @@ float BlurFilter::getMaxCrossFadeRadius() const {
     return mMaxCrossFadeRadius;
 }
 
+sk_sp<SkSurface> BlurFilter::makeSurface(GrRecordingContext* context, const SkImageInfo& info) {
+    if (context == nullptr) {
+        return SkSurface::MakeRaster(info);
+    }
+    return SkSurface::MakeRenderTarget(context, SkBudgeted::kNo, info);
+}
+
 void BlurFilter::drawBlurRegion(SkCanvas* canvas, const SkRRect& effectRegion,
                                 const uint32_t blurRadius, const float blurAlpha,
                                 const SkRect& blurRect, sk_sp<SkImage> blurredImage,
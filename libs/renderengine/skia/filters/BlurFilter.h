@@ -41,6 +41,9 @@ public:
     virtual sk_sp<SkImage> generate(GrRecordingContext* context, const uint32_t radius,
                             const sk_sp<SkImage> blurInput, const SkRect& blurRect) const = 0;
 
+    // Returns how many render passes generate() takes for the radius.
+    virtual uint32_t getPassCount(const uint32_t radius) const = 0;
+
     /**
      * Draw the blurred content (from the generate method) into the canvas.
      * @param canvas is the destination/output for the blur
@@ -58,6 +61,11 @@ public:
 
     float getMaxCrossFadeRadius() const;
 
+protected:
+    // Makes the surface the blurred image is drawn into. Backends drawing on the CPU have no
+    // context, in which case the surface is allocated in memory.
+    static sk_sp<SkSurface> makeSurface(GrRecordingContext* context, const SkImageInfo& info);
+
 private:
     // To avoid downscaling artifacts, we interpolate the blurred fbo with the full composited
     // image, up to this radius.
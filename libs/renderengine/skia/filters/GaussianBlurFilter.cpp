@@ -40,6 +40,10 @@ static const float GLASS_BLUR_SCALE = 2.0f;
 
 GaussianBlurFilter::GaussianBlurFilter() : BlurFilter(/* maxCrossFadeRadius= */ 0.0f) {}
 
+uint32_t GaussianBlurFilter::getPassCount(const uint32_t /*blurRadius*/) const {
+    return 1;
+}
+
 sk_sp<SkImage> GaussianBlurFilter::generate(GrRecordingContext* context, const uint32_t blurRadius,
                                             const sk_sp<SkImage> input, const SkRect& blurRect)
     const {
@@ -49,7 +53,7 @@ sk_sp<SkImage> GaussianBlurFilter::generate(GrRecordingContext* context, const u
 
     // Create a surface with the scaled dimensions
     SkImageInfo scaledInfo = input->imageInfo().makeWH(scaledWidth, scaledHeight);
-    sk_sp<SkSurface> surface = SkSurface::MakeRenderTarget(context, SkBudgeted::kNo, scaledInfo);
+    sk_sp<SkSurface> surface = makeSurface(context, scaledInfo);
 
     // Prepare the blur filter parameters
     const float sigmaScale = blurRadius * kInputScale * BLUR_SIGMA_SCALE;
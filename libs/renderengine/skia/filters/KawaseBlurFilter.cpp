@@ -55,6 +55,11 @@ KawaseBlurFilter::KawaseBlurFilter() : BlurFilter() {
     mBlurEffect = std::move(blurEffect);
 }
 
+uint32_t KawaseBlurFilter::getPassCount(const uint32_t blurRadius) const {
+    // The Kawase passes, followed by the final Gaussian blur.
+    return std::min(kMaxPasses, (uint32_t)ceil((float)blurRadius / 6.0f)) + 1;
+}
+
 sk_sp<SkImage> KawaseBlurFilter::generate(GrRecordingContext* context, const uint32_t blurRadius,
                                           const sk_sp<SkImage> input, const SkRect& blurRect)
     const {
@@ -100,7 +105,7 @@ sk_sp<SkImage> KawaseBlurFilter::generate(GrRecordingContext* context, const uin
 
     paint.setImageFilter(finalFilter);
 
-    sk_sp<SkSurface> surface = SkSurface::MakeRenderTarget(context, SkBudgeted::kNo, scaledInfo);
+    sk_sp<SkSurface> surface = makeSurface(context, scaledInfo);
 
     surface->getCanvas()->drawImage(tmpBlur.get(), 0, 0);
 
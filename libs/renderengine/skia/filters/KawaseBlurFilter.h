@@ -45,6 +45,8 @@ public:
     sk_sp<SkImage> generate(GrRecordingContext* context, const uint32_t radius,
                             const sk_sp<SkImage> blurInput, const SkRect& blurRect) const override;
 
+    uint32_t getPassCount(const uint32_t radius) const override;
+
 private:
     sk_sp<SkRuntimeEffect> mBlurEffect;
 };
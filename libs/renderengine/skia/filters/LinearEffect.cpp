@@ -44,19 +44,20 @@ sk_sp<SkShader> createLinearEffectShader(
         sk_sp<SkShader> shader, const shaders::LinearEffect& linearEffect,
         sk_sp<SkRuntimeEffect> runtimeEffect, const mat4& colorTransform, float maxDisplayLuminance,
         float currentDisplayLuminanceNits, float maxLuminance, AHardwareBuffer* buffer,
-        aidl::android::hardware::graphics::composer3::RenderIntent renderIntent) {
+        aidl::android::hardware::graphics::composer3::RenderIntent renderIntent,
+        shaders::LinearEffectUniformWriter& uniformWriter) {
     ATRACE_CALL();
     SkRuntimeShaderBuilder effectBuilder(runtimeEffect);
 
     effectBuilder.child("child") = shader;
 
-    const auto uniforms =
-            shaders::buildLinearEffectUniforms(linearEffect, colorTransform, maxDisplayLuminance,
-                                               currentDisplayLuminanceNits, maxLuminance, buffer,
-                                               renderIntent);
+    const auto& uniforms =
+            uniformWriter.write(linearEffect, colorTransform, maxDisplayLuminance,
+                                currentDisplayLuminanceNits, maxLuminance, buffer, renderIntent);
 
     for (const auto& uniform : uniforms) {
-        effectBuilder.uniform(uniform.name.c_str()).set(uniform.value.data(), uniform.value.size());
+        effectBuilder.uniform(uniform.name.c_str())
+                .set(uniformWriter.data() + uniform.offset, uniform.size);
     }
 
     return effectBuilder.makeShader();
@@ -44,11 +44,13 @@ sk_sp<SkRuntimeEffect> buildRuntimeEffect(const shaders::LinearEffect& linearEff
 // communicating any HDR metadata.
 // * A RenderIntent that communicates the downstream renderintent for a physical display, for image
 // quality compensation.
+// Uniforms are packed by uniformWriter, which is reused across shaders to avoid allocations.
 sk_sp<SkShader> createLinearEffectShader(
         sk_sp<SkShader> inputShader, const shaders::LinearEffect& linearEffect,
         sk_sp<SkRuntimeEffect> runtimeEffect, const mat4& colorTransform, float maxDisplayLuminance,
         float currentDisplayLuminanceNits, float maxLuminance, AHardwareBuffer* buffer,
-        aidl::android::hardware::graphics::composer3::RenderIntent renderIntent);
+        aidl::android::hardware::graphics::composer3::RenderIntent renderIntent,
+        shaders::LinearEffectUniformWriter& uniformWriter);
 } // namespace skia
 } // namespace renderengine
 } // namespace android
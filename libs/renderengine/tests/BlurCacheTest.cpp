@@ -0,0 +1,164 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "BlurCacheTest"
+
+#include <SkSurface.h>
+#include <gtest/gtest.h>
+#include <renderengine/mock/FakeExternalTexture.h>
+
+#include <memory>
+#include <vector>
+
+#include "../skia/BlurCache.h"
+
+namespace android::renderengine::skia {
+namespace {
+
+class FakeBlurFilter : public BlurFilter {
+public:
+    sk_sp<SkImage> generate(GrRecordingContext*, const uint32_t, const sk_sp<SkImage>,
+                            const SkRect& blurRect) const override {
+        mGenerated++;
+        return SkSurface::MakeRasterN32Premul(static_cast<int>(blurRect.width()),
+                                              static_cast<int>(blurRect.height()))
+                ->makeImageSnapshot();
+    }
+
+    uint32_t getPassCount(const uint32_t) const override { return 3; }
+
+    mutable size_t mGenerated = 0;
+};
+
+class BlurCacheTest : public testing::Test {
+protected:
+    static constexpr uint32_t kRadius = 10;
+
+    sk_sp<SkImage> getOrGenerate(const std::vector<BlurCache::Layer>& layers) {
+        return mCache.getOrGenerate(mFilter, nullptr, mDisplay, layers, kRadius, mInput,
+                                    mBlurRect);
+    }
+
+    FakeBlurFilter mFilter;
+    BlurCache mCache;
+    DisplaySettings mDisplay{.clip = Rect(100, 100)};
+    const sk_sp<SkImage> mInput = SkSurface::MakeRasterN32Premul(100, 100)->makeImageSnapshot();
+    const SkRect mBlurRect = SkRect::MakeLTRB(40, 40, 60, 60);
+    std::vector<BlurCache::Layer> mLayers = {
+            {.hash = 1, .bounds = SkRect::MakeWH(100, 100)},
+            {.hash = 2, .bounds = SkRect::MakeLTRB(0, 0, 10, 10)},
+    };
+};
+
+TEST_F(BlurCacheTest, reusesBlurOfSameInput) {
+    const sk_sp<SkImage> blur = getOrGenerate(mLayers);
+    ASSERT_NE(nullptr, blur);
+
+    EXPECT_EQ(blur, getOrGenerate(mLayers));
+    EXPECT_EQ(1u, mFilter.mGenerated);
+    EXPECT_EQ(1u, mCache.stats().hits);
+    EXPECT_EQ(1u, mCache.stats().misses);
+    EXPECT_EQ(3u, mCache.stats().passesSaved);
+}
+
+TEST_F(BlurCacheTest, reusesBlurIfChangesAreNotSampled) {
+    const sk_sp<SkImage> blur = getOrGenerate(mLayers);
+
+    mLayers[1].hash = 3;
+    EXPECT_EQ(blur, getOrGenerate(mLayers));
+    EXPECT_EQ(1u, mCache.stats().partialHits);
+
+    // The blur samples up to its radius away.
+    mLayers[1].hash = 4;
+    mLayers[1].bounds = SkRect::MakeLTRB(0, 0, 35, 35);
+    EXPECT_NE(blur, getOrGenerate(mLayers));
+    EXPECT_EQ(2u, mFilter.mGenerated);
+}
+
+TEST_F(BlurCacheTest, layerSamplingChangesInvalidatesBlur) {
+    mLayers.push_back(
+            {.hash = 5, .bounds = SkRect::MakeLTRB(30, 30, 70, 70), .samplesBelow = true});
+    getOrGenerate(mLayers);
+
+    mLayers[1].hash = 3;
+    getOrGenerate(mLayers);
+
+    EXPECT_EQ(2u, mFilter.mGenerated);
+    EXPECT_EQ(0u, mCache.stats().hits);
+}
+
+TEST_F(BlurCacheTest, generatesBlurOfOtherInput) {
+    getOrGenerate(mLayers);
+
+    mDisplay.outputDataspace = ui::Dataspace::DISPLAY_P3;
+    getOrGenerate(mLayers);
+    mLayers.pop_back();
+    getOrGenerate(mLayers);
+
+    EXPECT_EQ(3u, mFilter.mGenerated);
+    EXPECT_EQ(3u, mCache.size());
+
+    // The damage is ignored.
+    mDisplay.damage = Region(Rect(10, 10));
+    getOrGenerate(mLayers);
+    EXPECT_EQ(3u, mFilter.mGenerated);
+}
+
+TEST_F(BlurCacheTest, doesNotCacheUnidentifiedLayers) {
+    mLayers[0].hash = 0;
+    getOrGenerate(mLayers);
+    getOrGenerate(mLayers);
+
+    EXPECT_EQ(2u, mFilter.mGenerated);
+    EXPECT_EQ(0u, mCache.size());
+}
+
+TEST_F(BlurCacheTest, isBounded) {
+    for (uint32_t i = 0; i <= BlurCache::kMaxEntries; i++) {
+        mLayers[1].bounds = SkRect::MakeLTRB(0, 0, 10, 10 + i);
+        mLayers[1].hash = i + 10;
+        mDisplay.maxLuminance = i;
+        getOrGenerate(mLayers);
+    }
+
+    EXPECT_EQ(BlurCache::kMaxEntries, mCache.size());
+}
+
+TEST(BlurCacheHashTest, identifiesBufferContent) {
+    LayerSettings layer;
+    layer.source.solidColor = half3(1.f, 0.f, 0.f);
+    const size_t solidColorHash = BlurCache::hash(layer);
+    EXPECT_NE(0u, solidColorHash);
+
+    layer.alpha = 0.5f;
+    EXPECT_NE(solidColorHash, BlurCache::hash(layer));
+
+    layer.source.buffer.buffer =
+            std::make_shared<mock::FakeExternalTexture>(1, 1, 42, PIXEL_FORMAT_RGBA_8888,
+                                                        GRALLOC_USAGE_HW_TEXTURE);
+    // Without a frame number, the content of the buffer is unknown.
+    EXPECT_EQ(0u, BlurCache::hash(layer));
+
+    layer.source.buffer.frameNumber = 1;
+    const size_t bufferHash = BlurCache::hash(layer);
+    EXPECT_NE(0u, bufferHash);
+    layer.source.buffer.frameNumber = 2;
+    EXPECT_NE(bufferHash, BlurCache::hash(layer));
+}
+
+} // namespace
+} // namespace android::renderengine::skia
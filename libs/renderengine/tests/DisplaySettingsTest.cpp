@@ -66,4 +66,22 @@ TEST(DisplaySettingsTest, renderIntent) {
 
     ASSERT_FALSE(a == b);
 }
+
+TEST(DisplaySettingsTest, isScreenshot) {
+    DisplaySettings a, b;
+    ASSERT_EQ(a, b);
+
+    a.isScreenshot = true;
+
+    ASSERT_FALSE(a == b);
+}
+
+TEST(DisplaySettingsTest, damage) {
+    DisplaySettings a, b;
+    ASSERT_EQ(a, b);
+
+    a.damage = Region(Rect(10, 20, 30, 40));
+
+    ASSERT_FALSE(a == b);
+}
 } // namespace android::renderengine
@@ -25,9 +25,18 @@ namespace android {
 
 using testing::_;
 using testing::Eq;
+using testing::HasSubstr;
+using testing::InSequence;
 using testing::Mock;
 using testing::Return;
 
+// Also mocks buffer mapping, which callers of mock::RenderEngine never need.
+class MockRenderEngine : public renderengine::mock::RenderEngine {
+public:
+    MOCK_METHOD(void, mapExternalTextureBuffer, (const sp<GraphicBuffer>&, bool), (override));
+    MOCK_METHOD(void, unmapExternalTextureBuffer, (const sp<GraphicBuffer>&), (override));
+};
+
 struct RenderEngineThreadedTest : public ::testing::Test {
     ~RenderEngineThreadedTest() {}
 
@@ -37,16 +46,58 @@ struct RenderEngineThreadedTest : public ::testing::Test {
                 renderengine::RenderEngine::RenderEngineType::THREADED);
     }
 
+    // Blocks the RenderEngine thread until the returned promise is set, so that the work queued in
+    // the meantime is then run by priority.
+    std::shared_ptr<std::promise<void>> blockRenderEngineThread() {
+        const auto blocked = std::make_shared<std::promise<void>>();
+        const auto unblock = std::make_shared<std::promise<void>>();
+        std::future<void> blockedFuture = blocked->get_future();
+        std::shared_future<void> unblockFuture = unblock->get_future().share();
+        EXPECT_CALL(*mRenderEngine, primeCache()).WillOnce([blocked, unblockFuture]() {
+            blocked->set_value();
+            unblockFuture.wait();
+            return std::future<void>();
+        });
+        mThreadedRE->primeCache();
+        blockedFuture.wait();
+        return unblock;
+    }
+
+    std::shared_ptr<renderengine::ExternalTexture> makeTexture(renderengine::RenderEngine& re) {
+        return std::make_shared<
+                renderengine::impl::ExternalTexture>(new GraphicBuffer(), re,
+                                                     renderengine::impl::ExternalTexture::Usage::
+                                                             READABLE);
+    }
+
     std::unique_ptr<renderengine::threaded::RenderEngineThreaded> mThreadedRE;
-    renderengine::mock::RenderEngine* mRenderEngine = new renderengine::mock::RenderEngine();
+    MockRenderEngine* mRenderEngine = new MockRenderEngine();
 };
 
+using ResultPromise = std::shared_ptr<std::promise<renderengine::RenderEngineResult>>;
+
+static void setDrawLayersResult(const ResultPromise&& resultPromise,
+                                const renderengine::DisplaySettings&,
+                                const std::vector<renderengine::LayerSettings>&,
+                                const std::shared_ptr<renderengine::ExternalTexture>&, const bool,
+                                base::unique_fd&&) {
+    resultPromise->set_value({NO_ERROR, base::unique_fd()});
+}
+
 TEST_F(RenderEngineThreadedTest, dump) {
     std::string testString = "XYZ";
     EXPECT_CALL(*mRenderEngine, dump(_));
     mThreadedRE->dump(testString);
 }
 
+TEST_F(RenderEngineThreadedTest, dump_reportsQueueingLatency) {
+    std::string result;
+    EXPECT_CALL(*mRenderEngine, dump(_));
+    mThreadedRE->dump(result);
+    EXPECT_THAT(result, HasSubstr("RenderEngineThreaded queueing latency"));
+    EXPECT_THAT(result, HasSubstr("composition"));
+}
+
 TEST_F(RenderEngineThreadedTest, primeCache) {
     EXPECT_CALL(*mRenderEngine, primeCache());
     mThreadedRE->primeCache();
@@ -171,6 +222,16 @@ TEST_F(RenderEngineThreadedTest, supportsBackgroundBlur_returnsTrue) {
     ASSERT_EQ(true, result);
 }
 
+TEST_F(RenderEngineThreadedTest, supportsPartialRedraw_returnsFalse) {
+    EXPECT_CALL(*mRenderEngine, supportsPartialRedraw()).WillOnce(Return(false));
+    ASSERT_FALSE(mThreadedRE->supportsPartialRedraw());
+}
+
+TEST_F(RenderEngineThreadedTest, supportsPartialRedraw_returnsTrue) {
+    EXPECT_CALL(*mRenderEngine, supportsPartialRedraw()).WillOnce(Return(true));
+    ASSERT_TRUE(mThreadedRE->supportsPartialRedraw());
+}
+
 TEST_F(RenderEngineThreadedTest, drawLayers) {
     renderengine::DisplaySettings settings;
     std::vector<renderengine::LayerSettings> layers;
@@ -199,4 +260,130 @@ TEST_F(RenderEngineThreadedTest, drawLayers) {
     ASSERT_EQ(NO_ERROR, status);
 }
 
+TEST_F(RenderEngineThreadedTest, drawLayers_runsBeforeQueuedCleanup) {
+    auto texture = makeTexture(*mThreadedRE);
+    const sp<GraphicBuffer> buffer = texture->getBuffer();
+    // mapping a buffer is queued with display composition, so it is run by now.
+    EXPECT_CALL(*mRenderEngine, mapExternalTextureBuffer(buffer, false));
+    mThreadedRE->getContextPriority();
+
+    const auto unblock = blockRenderEngineThread();
+    EXPECT_CALL(*mRenderEngine, canSkipPostRenderCleanup()).WillOnce(Return(false));
+    {
+        InSequence seq;
+        EXPECT_CALL(*mRenderEngine, drawLayersInternal).WillOnce(setDrawLayersResult);
+        EXPECT_CALL(*mRenderEngine, unmapExternalTextureBuffer(buffer));
+        EXPECT_CALL(*mRenderEngine, cleanupPostRender());
+    }
+    texture.reset();
+    mThreadedRE->cleanupPostRender();
+    auto result = mThreadedRE->drawLayers(renderengine::DisplaySettings(), {}, nullptr, false,
+                                          base::unique_fd());
+    unblock->set_value();
+    ASSERT_EQ(NO_ERROR, result.get().status);
+}
+
+TEST_F(RenderEngineThreadedTest, drawLayers_screenshotRunsAfterComposition) {
+    const auto unblock = blockRenderEngineThread();
+    EXPECT_CALL(*mRenderEngine, isProtected()).WillRepeatedly(Return(false));
+    std::vector<bool> drawnScreenshots;
+    EXPECT_CALL(*mRenderEngine, drawLayersInternal)
+            .Times(2)
+            .WillRepeatedly([&](const ResultPromise&& resultPromise,
+                                const renderengine::DisplaySettings& display,
+                                const std::vector<renderengine::LayerSettings>&,
+                                const std::shared_ptr<renderengine::ExternalTexture>&, const bool,
+                                base::unique_fd&&) {
+                drawnScreenshots.push_back(display.isScreenshot);
+                resultPromise->set_value({NO_ERROR, base::unique_fd()});
+            });
+
+    renderengine::DisplaySettings screenshot;
+    screenshot.isScreenshot = true;
+    auto screenshotResult =
+            mThreadedRE->drawLayers(screenshot, {}, nullptr, false, base::unique_fd());
+    auto compositionResult = mThreadedRE->drawLayers(renderengine::DisplaySettings(), {}, nullptr,
+                                                     false, base::unique_fd());
+    unblock->set_value();
+    screenshotResult.wait();
+    compositionResult.wait();
+
+    EXPECT_EQ((std::vector<bool>{false, true}), drawnScreenshots);
+}
+
+TEST_F(RenderEngineThreadedTest, drawLayers_screenshotKeepsProtectedContext) {
+    bool protectedContext = false;
+    EXPECT_CALL(*mRenderEngine, isProtected()).WillRepeatedly([&]() { return protectedContext; });
+    EXPECT_CALL(*mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(true));
+    const auto unblock = blockRenderEngineThread();
+
+    EXPECT_CALL(*mRenderEngine, useProtectedContext(_)).WillRepeatedly([&](bool useProtected) {
+        protectedContext = useProtected;
+    });
+    std::vector<bool> drawnProtected;
+    EXPECT_CALL(*mRenderEngine, drawLayersInternal)
+            .Times(2)
+            .WillRepeatedly([&](const ResultPromise&& resultPromise,
+                                const renderengine::DisplaySettings&,
+                                const std::vector<renderengine::LayerSettings>&,
+                                const std::shared_ptr<renderengine::ExternalTexture>&, const bool,
+                                base::unique_fd&&) {
+                drawnProtected.push_back(protectedContext);
+                resultPromise->set_value({NO_ERROR, base::unique_fd()});
+            });
+
+    renderengine::DisplaySettings screenshot;
+    screenshot.isScreenshot = true;
+    mThreadedRE->useProtectedContext(true);
+    auto screenshotResult =
+            mThreadedRE->drawLayers(screenshot, {}, nullptr, false, base::unique_fd());
+    mThreadedRE->useProtectedContext(false);
+    auto compositionResult = mThreadedRE->drawLayers(renderengine::DisplaySettings(), {}, nullptr,
+                                                     false, base::unique_fd());
+    unblock->set_value();
+    screenshotResult.wait();
+    compositionResult.wait();
+    // call ANY synchronous function to ensure that the screenshot switched the context back.
+    mThreadedRE->getContextPriority();
+
+    EXPECT_EQ((std::vector<bool>{false, true}), drawnProtected);
+    EXPECT_FALSE(protectedContext);
+}
+
+TEST_F(RenderEngineThreadedTest, mapThenUnmap_cancelOut) {
+    const auto unblock = blockRenderEngineThread();
+    EXPECT_CALL(*mRenderEngine, mapExternalTextureBuffer(_, _)).Times(0);
+    EXPECT_CALL(*mRenderEngine, unmapExternalTextureBuffer(_)).Times(0);
+    for (int i = 0; i < 100; i++) {
+        // ExternalTexture maps the buffer when created and unmaps it when destroyed.
+        makeTexture(*mThreadedRE);
+    }
+    unblock->set_value();
+    mThreadedRE->getContextPriority();
+
+    std::string result;
+    EXPECT_CALL(*mRenderEngine, dump(_));
+    mThreadedRE->dump(result);
+    EXPECT_THAT(result, HasSubstr("Buffer mappings cancelled by unmapping: 100"));
+}
+
+TEST_F(RenderEngineThreadedTest, mapExternalTextureBuffer_batchesInOrder) {
+    const auto unblock = blockRenderEngineThread();
+    std::vector<std::shared_ptr<renderengine::ExternalTexture>> textures;
+    {
+        InSequence seq;
+        for (int i = 0; i < 10; i++) {
+            textures.push_back(makeTexture(*mThreadedRE));
+            EXPECT_CALL(*mRenderEngine,
+                        mapExternalTextureBuffer(textures.back()->getBuffer(), false));
+        }
+    }
+    unblock->set_value();
+    mThreadedRE->getContextPriority();
+    Mock::VerifyAndClearExpectations(mRenderEngine);
+
+    EXPECT_CALL(*mRenderEngine, unmapExternalTextureBuffer(_)).Times(10);
+    textures.clear();
+}
+
 } // namespace android
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "ShaderManifestTest"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <renderengine/mock/FakeExternalTexture.h>
+
+#include <memory>
+#include <string>
+
+#include "../skia/ShaderManifest.h"
+
+namespace android::renderengine::skia {
+namespace {
+
+ShaderKey makeBufferKey() {
+    ShaderKey key;
+    key.source = ShaderKey::Source::BUFFER;
+    key.format = ShaderKey::Format::RGBA_1010102;
+    key.externalTexture = true;
+    key.premultiplied = true;
+    key.dataspace = ShaderKey::Dataspace::HLG;
+    key.corners = ShaderKey::Corners::ELLIPTICAL;
+    key.clipped = true;
+    key.transform = ShaderKey::Transform::OTHER;
+    key.blur = ShaderKey::Blur::LARGE;
+    key.dimmed = true;
+    return key;
+}
+
+TEST(ShaderKeyTest, packRoundTrips) {
+    const ShaderKey key = makeBufferKey();
+
+    const auto unpacked = ShaderKey::unpack(key.pack());
+    ASSERT_TRUE(unpacked);
+    EXPECT_EQ(key, *unpacked);
+    EXPECT_EQ(ShaderKey::Format::RGBA_1010102, unpacked->format);
+    EXPECT_EQ(ShaderKey::Blur::LARGE, unpacked->blur);
+    EXPECT_TRUE(unpacked->dimmed);
+    EXPECT_FALSE(unpacked->opaque);
+}
+
+TEST(ShaderKeyTest, unpackRejectsInvalidValues) {
+    // The source only has three values.
+    EXPECT_FALSE(ShaderKey::unpack(3));
+    // Bits past the last field.
+    EXPECT_FALSE(ShaderKey::unpack(ShaderKey().pack() | 0x80000000));
+}
+
+TEST(ShaderKeyTest, makeBufferLayer) {
+    const DisplaySettings display{.outputDataspace = ui::Dataspace::SRGB};
+    LayerSettings layer;
+    layer.source.buffer.buffer =
+            std::make_shared<mock::FakeExternalTexture>(1, 1, 1, PIXEL_FORMAT_RGBA_FP16,
+                                                        GRALLOC_USAGE_HW_TEXTURE);
+    layer.source.buffer.isOpaque = true;
+    layer.sourceDataspace = ui::Dataspace::BT2020_PQ;
+    layer.alpha = 0.5f;
+    layer.geometry.roundedCornersRadius = {20.f, 20.f};
+    layer.geometry.boundaries = FloatRect(0, 0, 100, 100);
+    layer.geometry.roundedCornersCrop = FloatRect(0, 0, 100, 100);
+    layer.geometry.positionTransform = mat4::translate(vec4(10.f, 20.f, 0.f, 1.f));
+    layer.backgroundBlurRadius = 9;
+
+    const ShaderKey key = ShaderKey::make(display, layer, false);
+
+    EXPECT_EQ(ShaderKey::Source::BUFFER, key.source);
+    EXPECT_EQ(ShaderKey::Format::RGBA_FP16, key.format);
+    EXPECT_TRUE(key.externalTexture);
+    EXPECT_TRUE(key.opaque);
+    EXPECT_EQ(ShaderKey::Dataspace::PQ, key.dataspace);
+    EXPECT_FALSE(key.wideGamutOutput);
+    EXPECT_TRUE(key.translucent);
+    EXPECT_EQ(ShaderKey::Corners::CIRCULAR, key.corners);
+    EXPECT_FALSE(key.clipped);
+    EXPECT_EQ(ShaderKey::Transform::SCALE_TRANSLATE, key.transform);
+    EXPECT_EQ(ShaderKey::Blur::SMALL, key.blur);
+    EXPECT_FALSE(key.dimmed);
+}
+
+TEST(ShaderKeyTest, makeSolidColorLayer) {
+    DisplaySettings display{.outputDataspace = ui::Dataspace::DISPLAY_P3};
+    display.colorTransform = mat4::scale(vec4(0.5f, 0.5f, 0.5f, 1.f));
+    LayerSettings layer;
+    layer.sourceDataspace = ui::Dataspace::SRGB;
+    layer.alpha = 1.f;
+
+    ShaderKey key = ShaderKey::make(display, layer, true);
+
+    EXPECT_EQ(ShaderKey::Source::SOLID_COLOR, key.source);
+    EXPECT_EQ(ShaderKey::Dataspace::OTHER_SDR, key.dataspace);
+    EXPECT_TRUE(key.wideGamutOutput);
+    EXPECT_FALSE(key.translucent);
+    EXPECT_TRUE(key.displayColorTransform);
+    EXPECT_TRUE(key.dimmed);
+
+    display.deviceHandlesColorTransform = true;
+    key = ShaderKey::make(display, layer, true);
+    EXPECT_FALSE(key.displayColorTransform);
+}
+
+class ShaderManifestTest : public testing::Test {
+protected:
+    std::string path() const { return std::string(mDir.path) + "/manifest"; }
+
+    TemporaryDir mDir;
+    ShaderManifest mManifest;
+};
+
+TEST_F(ShaderManifestTest, recordDeduplicates) {
+    mManifest.record(makeBufferKey());
+    mManifest.record(ShaderKey());
+    mManifest.record(makeBufferKey());
+
+    EXPECT_EQ(2u, mManifest.size());
+    EXPECT_TRUE(mManifest.isDirty());
+}
+
+TEST_F(ShaderManifestTest, saveThenLoad) {
+    mManifest.record(makeBufferKey());
+    mManifest.record(ShaderKey());
+    ASSERT_TRUE(mManifest.save(path()));
+    EXPECT_FALSE(mManifest.isDirty());
+
+    ShaderManifest loaded;
+    ASSERT_TRUE(loaded.load(path()));
+
+    EXPECT_EQ(mManifest.keys(), loaded.keys());
+    EXPECT_FALSE(loaded.isDirty());
+}
+
+TEST_F(ShaderManifestTest, loadRejectsCorruptFile) {
+    mManifest.record(makeBufferKey());
+    ASSERT_TRUE(mManifest.save(path()));
+    std::string content;
+    ASSERT_TRUE(base::ReadFileToString(path(), &content));
+
+    // Truncated.
+    ASSERT_TRUE(base::WriteStringToFile(content.substr(0, content.size() - 1), path()));
+    ShaderManifest loaded;
+    EXPECT_FALSE(loaded.load(path()));
+
+    // Invalid key.
+    std::fill(content.end() - sizeof(uint32_t), content.end(), '\xff');
+    ASSERT_TRUE(base::WriteStringToFile(content, path()));
+    EXPECT_FALSE(loaded.load(path()));
+
+    EXPECT_EQ(0u, loaded.size());
+    EXPECT_FALSE(loaded.load(path() + ".missing"));
+}
+
+TEST_F(ShaderManifestTest, recordIsBounded) {
+    ShaderKey key;
+    // Varying the flags is enough to reach the bound.
+    for (uint32_t value = 0; mManifest.size() < ShaderManifest::kMaxKeys; value++) {
+        key.disableBlending = value & 1;
+        key.shadow = value & 2;
+        key.stretch = value & 4;
+        key.layerColorTransform = value & 8;
+        key.displayColorTransform = value & 16;
+        key.dimmed = value & 32;
+        key.translucent = value & 64;
+        key.clipped = value & 128;
+        key.opaque = value & 256;
+        key.premultiplied = value & 512;
+        key.externalTexture = value & 1024;
+        mManifest.record(key);
+    }
+    key = makeBufferKey();
+    mManifest.record(key);
+
+    EXPECT_EQ(ShaderManifest::kMaxKeys, mManifest.size());
+}
+
+} // namespace
+} // namespace android::renderengine::skia
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "TextureCacheTest"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "../skia/TextureCache.h"
+
+namespace android::renderengine::skia {
+namespace {
+
+struct FakeTexture {
+    explicit FakeTexture(uint64_t id) : id(id) {}
+    const uint64_t id;
+};
+
+constexpr size_t kTextureBytes = 1920 * 1080 * 4;
+
+class TextureCacheTest : public testing::Test {
+protected:
+    void insert(uint64_t id, size_t bytes = kTextureBytes) {
+        mCache.insert(id, std::make_shared<FakeTexture>(id), bytes);
+    }
+
+    std::vector<uint64_t> ids() const {
+        std::vector<uint64_t> result;
+        mCache.forEach([&](uint64_t id, const FakeTexture&) { result.push_back(id); });
+        return result;
+    }
+
+    TextureCache<FakeTexture> mCache{4 * kTextureBytes};
+};
+
+TEST_F(TextureCacheTest, getReturnsInsertedTexture) {
+    insert(1);
+
+    const auto texture = mCache.get(1);
+    ASSERT_NE(nullptr, texture);
+    EXPECT_EQ(1u, texture->id);
+    EXPECT_EQ(nullptr, mCache.get(2));
+    EXPECT_EQ(1u, mCache.stats().hits);
+    EXPECT_EQ(1u, mCache.stats().misses);
+}
+
+TEST_F(TextureCacheTest, insertReplacesTexture) {
+    insert(1);
+    insert(1, kTextureBytes / 2);
+
+    EXPECT_EQ(1u, mCache.size());
+    EXPECT_EQ(kTextureBytes / 2, mCache.sizeBytes());
+}
+
+TEST_F(TextureCacheTest, eraseReleasesBytes) {
+    insert(1);
+    insert(2);
+
+    EXPECT_TRUE(mCache.erase(1));
+    EXPECT_FALSE(mCache.erase(1));
+    EXPECT_EQ(std::vector<uint64_t>{2}, ids());
+    EXPECT_EQ(kTextureBytes, mCache.sizeBytes());
+    EXPECT_EQ(0u, mCache.stats().evictions);
+}
+
+TEST_F(TextureCacheTest, evictsLeastRecentlyUsed) {
+    for (uint64_t id = 1; id <= 4; id++) {
+        insert(id);
+    }
+    mCache.get(1);
+    insert(5);
+
+    EXPECT_EQ((std::vector<uint64_t>{3, 4, 1, 5}), ids());
+    EXPECT_EQ(1u, mCache.stats().evictions);
+    EXPECT_EQ(kTextureBytes, mCache.stats().evictedBytes);
+}
+
+TEST_F(TextureCacheTest, pinnedTexturesAreNotEvicted) {
+    for (uint64_t id = 1; id <= 4; id++) {
+        insert(id);
+        mCache.pin(id);
+    }
+    insert(5);
+
+    EXPECT_EQ((std::vector<uint64_t>{1, 2, 3, 4, 5}), ids());
+    EXPECT_EQ(5 * kTextureBytes, mCache.sizeBytes());
+    EXPECT_EQ(1u, mCache.stats().overBudget);
+
+    mCache.unpinAll();
+
+    EXPECT_EQ((std::vector<uint64_t>{2, 3, 4, 5}), ids());
+    EXPECT_EQ(4 * kTextureBytes, mCache.sizeBytes());
+}
+
+TEST_F(TextureCacheTest, erasePinnedTexture) {
+    insert(1);
+    mCache.pin(1);
+
+    EXPECT_TRUE(mCache.erase(1));
+    insert(1);
+    mCache.unpinAll();
+    insert(2, 4 * kTextureBytes);
+
+    EXPECT_EQ(std::vector<uint64_t>{2}, ids());
+}
+
+TEST_F(TextureCacheTest, setBudgetTrims) {
+    for (uint64_t id = 1; id <= 4; id++) {
+        insert(id);
+    }
+    mCache.setBudget(2 * kTextureBytes);
+
+    EXPECT_EQ((std::vector<uint64_t>{3, 4}), ids());
+    EXPECT_EQ(2 * kTextureBytes, mCache.budgetBytes());
+}
+
+// Drives thousands of distinct buffers through the cache, the way SurfaceFlinger does when apps
+// keep reallocating their buffers, while a few long lived buffers are drawn every frame.
+TEST_F(TextureCacheTest, staysWithinBudgetWithManyBuffers) {
+    constexpr uint64_t kLongLivedBuffers = 2;
+    constexpr uint64_t kFrames = 5000;
+    for (uint64_t id = 1; id <= kLongLivedBuffers; id++) {
+        insert(id);
+    }
+
+    for (uint64_t frame = 0; frame < kFrames; frame++) {
+        mCache.unpinAll();
+        const uint64_t id = kLongLivedBuffers + 1 + frame;
+        insert(id);
+        for (const uint64_t drawn : {uint64_t{1}, uint64_t{2}, id}) {
+            ASSERT_NE(nullptr, mCache.get(drawn));
+            mCache.pin(drawn);
+        }
+        ASSERT_LE(mCache.sizeBytes(), mCache.budgetBytes());
+    }
+
+    EXPECT_EQ(4u, mCache.size());
+    EXPECT_NE(nullptr, mCache.get(1));
+    EXPECT_NE(nullptr, mCache.get(2));
+    EXPECT_EQ(kFrames - 2, mCache.stats().evictions);
+    EXPECT_EQ((kFrames - 2) * kTextureBytes, mCache.stats().evictedBytes);
+    EXPECT_EQ(0u, mCache.stats().misses);
+    EXPECT_EQ(0u, mCache.stats().overBudget);
+}
+
+} // namespace
+} // namespace android::renderengine::skia
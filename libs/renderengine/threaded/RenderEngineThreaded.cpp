@@ -19,6 +19,7 @@
 #include "RenderEngineThreaded.h"
 
 #include <sched.h>
+#include <algorithm>
 #include <chrono>
 #include <future>
 
@@ -30,6 +31,7 @@
 #include "gl/GLESRenderEngine.h"
 
 using namespace std::chrono_literals;
+using android::base::StringAppendF;
 
 namespace android {
 namespace renderengine {
@@ -57,6 +59,22 @@ RenderEngineThreaded::~RenderEngineThreaded() {
     }
 }
 
+const char* RenderEngineThreaded::toString(Priority priority) {
+    switch (priority) {
+        case Priority::COMPOSITION:
+            return "composition";
+        case Priority::SCREENSHOT:
+            return "screenshot";
+        case Priority::PRIME_CACHE:
+            return "primeCache";
+        case Priority::CLEANUP:
+            return "cleanup";
+        case Priority::COUNT:
+            break;
+    }
+    return "unknown";
+}
+
 status_t RenderEngineThreaded::setSchedFifo(bool enabled) {
     static constexpr int kFifoPriority = 2;
     static constexpr int kOtherPriority = 0;
@@ -100,17 +118,12 @@ void RenderEngineThreaded::threadMain(CreateInstanceFactory factory) NO_THREAD_S
     }
     mInitializedCondition.notify_all();
 
-    while (mRunning) {
-        const auto getNextTask = [this]() -> std::optional<Work> {
-            std::scoped_lock lock(mThreadMutex);
-            if (!mFunctionCalls.empty()) {
-                Work task = mFunctionCalls.front();
-                mFunctionCalls.pop();
-                return std::make_optional<Work>(task);
-            }
-            return std::nullopt;
-        };
+    const auto getNextTask = [this]() -> std::optional<Work> {
+        std::scoped_lock lock(mThreadMutex);
+        return mFunctionCalls.pop();
+    };
 
+    while (mRunning) {
         const auto task = getNextTask();
 
         if (task) {
@@ -123,6 +136,12 @@ void RenderEngineThreaded::threadMain(CreateInstanceFactory factory) NO_THREAD_S
         });
     }
 
+    // Lower priority work may still be queued behind the last synchronous call, so run it before
+    // the RenderEngine is released.
+    while (const auto task = getNextTask()) {
+        (*task)(*mRenderEngine);
+    }
+
     // we must release the RenderEngine on the thread that created it
     mRenderEngine.reset();
 }
@@ -140,7 +159,8 @@ std::future<void> RenderEngineThreaded::primeCache() {
     // for the futures.
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([resultPromise](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::PRIME_CACHE, [resultPromise](renderengine::RenderEngine&
+                                                                           instance) {
             ATRACE_NAME("REThreaded::primeCache");
             if (setSchedFifo(false) != NO_ERROR) {
                 ALOGW("Couldn't set SCHED_OTHER for primeCache");
@@ -164,7 +184,8 @@ void RenderEngineThreaded::dump(std::string& result) {
     std::future<std::string> resultFuture = resultPromise.get_future();
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([&resultPromise, &result](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::COMPOSITION, [&resultPromise,
+                                                    &result](renderengine::RenderEngine& instance) {
             ATRACE_NAME("REThreaded::dump");
             std::string localResult = result;
             instance.dump(localResult);
@@ -174,6 +195,19 @@ void RenderEngineThreaded::dump(std::string& result) {
     mCondition.notify_one();
     // Note: This is an rvalue.
     result.assign(resultFuture.get());
+
+    std::lock_guard lock(mThreadMutex);
+    StringAppendF(&result, "RenderEngineThreaded queueing latency:\n");
+    for (size_t i = 0; i < static_cast<size_t>(Priority::COUNT); i++) {
+        const auto priority = static_cast<Priority>(i);
+        const auto& stats = mFunctionCalls.latencyStats(priority);
+        const auto average = stats.count > 0 ? stats.total / stats.count : 0ns;
+        StringAppendF(&result, "  %-12s %8zu calls, avg %.3f ms, max %.3f ms\n",
+                      toString(priority), stats.count,
+                      std::chrono::duration<double, std::milli>(average).count(),
+                      std::chrono::duration<double, std::milli>(stats.max).count());
+    }
+    StringAppendF(&result, "  Buffer mappings cancelled by unmapping: %zu\n", mCancelledMappings);
 }
 
 void RenderEngineThreaded::genTextures(size_t count, uint32_t* names) {
@@ -186,7 +220,8 @@ void RenderEngineThreaded::genTextures(size_t count, uint32_t* names) {
     std::future<void> resultFuture = resultPromise.get_future();
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([&resultPromise, count, names](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::COMPOSITION, [&resultPromise, count,
+                                                    names](renderengine::RenderEngine& instance) {
             ATRACE_NAME("REThreaded::genTextures");
             instance.genTextures(count, names);
             resultPromise.set_value();
@@ -206,7 +241,8 @@ void RenderEngineThreaded::deleteTextures(size_t count, uint32_t const* names) {
     std::future<void> resultFuture = resultPromise.get_future();
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([&resultPromise, count, &names](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::COMPOSITION, [&resultPromise, count,
+                                                    &names](renderengine::RenderEngine& instance) {
             ATRACE_NAME("REThreaded::deleteTextures");
             instance.deleteTextures(count, names);
             resultPromise.set_value();
@@ -223,9 +259,14 @@ void RenderEngineThreaded::mapExternalTextureBuffer(const sp<GraphicBuffer>& buf
     // for the futures.
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([=](renderengine::RenderEngine& instance) {
-            ATRACE_NAME("REThreaded::mapExternalTextureBuffer");
-            instance.mapExternalTextureBuffer(buffer, isRenderable);
+        mPendingMaps.push_back({buffer, isRenderable});
+        if (mMapWorkQueued) {
+            return;
+        }
+        // Mapping is queued with display composition, which is likely to draw the buffer soon.
+        mMapWorkQueued = true;
+        mFunctionCalls.push(Priority::COMPOSITION, [this](renderengine::RenderEngine& instance) {
+            mapPendingBuffers(instance);
         });
     }
     mCondition.notify_one();
@@ -237,14 +278,59 @@ void RenderEngineThreaded::unmapExternalTextureBuffer(const sp<GraphicBuffer>& b
     // for the futures.
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([=](renderengine::RenderEngine& instance) {
-            ATRACE_NAME("REThreaded::unmapExternalTextureBuffer");
-            instance.unmapExternalTextureBuffer(buffer);
+        // As RenderEngine counts the mappings of each buffer, unmapping a buffer cancels out one
+        // of its pending mappings.
+        const auto pendingMap =
+                std::find_if(mPendingMaps.rbegin(), mPendingMaps.rend(),
+                             [&](const BufferMapping& mapping) {
+                                 return mapping.buffer->getId() == buffer->getId();
+                             });
+        if (pendingMap != mPendingMaps.rend()) {
+            mPendingMaps.erase(std::next(pendingMap).base());
+            mCancelledMappings++;
+            return;
+        }
+
+        // Unmapping is queued with cleanup. Pending mappings are always run before, which is fine
+        // as mapping a buffer which is already mapped only increments its count.
+        mPendingUnmaps.push_back(buffer);
+        if (mUnmapWorkQueued) {
+            return;
+        }
+        mUnmapWorkQueued = true;
+        mFunctionCalls.push(Priority::CLEANUP, [this](renderengine::RenderEngine& instance) {
+            unmapPendingBuffers(instance);
         });
     }
     mCondition.notify_one();
 }
 
+void RenderEngineThreaded::mapPendingBuffers(renderengine::RenderEngine& instance) {
+    ATRACE_NAME("REThreaded::mapExternalTextureBuffer");
+    {
+        std::lock_guard lock(mThreadMutex);
+        std::swap(mMapsInFlight, mPendingMaps);
+        mMapWorkQueued = false;
+    }
+    for (const auto& [buffer, isRenderable] : mMapsInFlight) {
+        instance.mapExternalTextureBuffer(buffer, isRenderable);
+    }
+    mMapsInFlight.clear();
+}
+
+void RenderEngineThreaded::unmapPendingBuffers(renderengine::RenderEngine& instance) {
+    ATRACE_NAME("REThreaded::unmapExternalTextureBuffer");
+    {
+        std::lock_guard lock(mThreadMutex);
+        std::swap(mUnmapsInFlight, mPendingUnmaps);
+        mUnmapWorkQueued = false;
+    }
+    for (const auto& buffer : mUnmapsInFlight) {
+        instance.unmapExternalTextureBuffer(buffer);
+    }
+    mUnmapsInFlight.clear();
+}
+
 size_t RenderEngineThreaded::getMaxTextureSize() const {
     waitUntilInitialized();
     return mRenderEngine->getMaxTextureSize();
@@ -274,7 +360,8 @@ void RenderEngineThreaded::useProtectedContext(bool useProtectedContext) {
 
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([useProtectedContext, this](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::COMPOSITION, [useProtectedContext,
+                                                    this](renderengine::RenderEngine& instance) {
             ATRACE_NAME("REThreaded::useProtectedContext");
             instance.useProtectedContext(useProtectedContext);
             if (instance.isProtected() != useProtectedContext) {
@@ -299,7 +386,7 @@ void RenderEngineThreaded::cleanupPostRender() {
     // for the futures.
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([=](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::CLEANUP, [=](renderengine::RenderEngine& instance) {
             ATRACE_NAME("REThreaded::cleanupPostRender");
             instance.cleanupPostRender();
         });
@@ -326,29 +413,72 @@ std::future<RenderEngineResult> RenderEngineThreaded::drawLayers(
         const std::shared_ptr<ExternalTexture>& buffer, const bool useFramebufferCache,
         base::unique_fd&& bufferFence) {
     ATRACE_CALL();
-    const auto resultPromise = std::make_shared<std::promise<RenderEngineResult>>();
-    std::future<RenderEngineResult> resultFuture = resultPromise->get_future();
-    int fd = bufferFence.release();
+    std::unique_ptr<DrawLayersArgs> args;
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([resultPromise, display, layers, buffer, useFramebufferCache,
-                             fd](renderengine::RenderEngine& instance) {
-            ATRACE_NAME("REThreaded::drawLayers");
-            instance.drawLayersInternal(std::move(resultPromise), display, layers, buffer,
-                                        useFramebufferCache, base::unique_fd(fd));
-        });
+        if (!mFreeDrawLayersArgs.empty()) {
+            args = std::move(mFreeDrawLayersArgs.back());
+            mFreeDrawLayersArgs.pop_back();
+        }
+    }
+    if (!args) {
+        args = std::make_unique<DrawLayersArgs>();
+    }
+    args->resultPromise = std::make_shared<std::promise<RenderEngineResult>>();
+    std::future<RenderEngineResult> resultFuture = args->resultPromise->get_future();
+    args->display = display;
+    args->layers.assign(layers.begin(), layers.end());
+    args->buffer = buffer;
+    args->useFramebufferCache = useFramebufferCache;
+    args->bufferFence = std::move(bufferFence);
+    const Priority priority = display.isScreenshot ? Priority::SCREENSHOT : Priority::COMPOSITION;
+    {
+        std::lock_guard lock(mThreadMutex);
+        args->isProtected = mIsProtected;
+        // The work owns the arguments until it is run, see runDrawLayers.
+        mFunctionCalls.push(priority,
+                            [this, args = args.release()](renderengine::RenderEngine& instance) {
+                                runDrawLayers(instance, *args);
+                            });
     }
     mCondition.notify_one();
     return resultFuture;
 }
 
+void RenderEngineThreaded::runDrawLayers(renderengine::RenderEngine& instance,
+                                         DrawLayersArgs& args) {
+    ATRACE_NAME("REThreaded::drawLayers");
+    // Display composition queued after a screenshot may have switched the protected context
+    // since, so switch back to the context the screenshot was queued with.
+    const bool switchContext =
+            args.display.isScreenshot && instance.isProtected() != args.isProtected;
+    if (switchContext) {
+        instance.useProtectedContext(args.isProtected);
+    }
+    instance.drawLayersInternal(std::move(args.resultPromise), args.display, args.layers,
+                                args.buffer, args.useFramebufferCache,
+                                std::move(args.bufferFence));
+    if (switchContext) {
+        instance.useProtectedContext(!args.isProtected);
+    }
+
+    // Release the buffers now rather than when the arguments are reused. Clearing the layers
+    // keeps the capacity of the vector.
+    args.resultPromise = nullptr;
+    args.layers.clear();
+    args.buffer = nullptr;
+    args.bufferFence.reset();
+    std::lock_guard lock(mThreadMutex);
+    mFreeDrawLayersArgs.emplace_back(&args);
+}
+
 void RenderEngineThreaded::cleanFramebufferCache() {
     ATRACE_CALL();
     // This function is designed so it can run asynchronously, so we do not need to wait
     // for the futures.
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::CLEANUP, [](renderengine::RenderEngine& instance) {
             ATRACE_NAME("REThreaded::cleanFramebufferCache");
             instance.cleanFramebufferCache();
         });
@@ -361,7 +491,8 @@ int RenderEngineThreaded::getContextPriority() {
     std::future<int> resultFuture = resultPromise.get_future();
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([&resultPromise](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::COMPOSITION, [&resultPromise](renderengine::RenderEngine&
+                                                                            instance) {
             ATRACE_NAME("REThreaded::getContextPriority");
             int priority = instance.getContextPriority();
             resultPromise.set_value(priority);
@@ -376,12 +507,17 @@ bool RenderEngineThreaded::supportsBackgroundBlur() {
     return mRenderEngine->supportsBackgroundBlur();
 }
 
+bool RenderEngineThreaded::supportsPartialRedraw() {
+    waitUntilInitialized();
+    return mRenderEngine->supportsPartialRedraw();
+}
+
 void RenderEngineThreaded::onActiveDisplaySizeChanged(ui::Size size) {
     // This function is designed so it can run asynchronously, so we do not need to wait
     // for the futures.
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([size](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::COMPOSITION, [size](renderengine::RenderEngine& instance) {
             ATRACE_NAME("REThreaded::onActiveDisplaySizeChanged");
             instance.onActiveDisplaySizeChanged(size);
         });
@@ -394,7 +530,8 @@ std::optional<pid_t> RenderEngineThreaded::getRenderEngineTid() const {
     std::future<pid_t> tidFuture = tidPromise.get_future();
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([&tidPromise](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::COMPOSITION, [&tidPromise](renderengine::RenderEngine&
+                                                                         instance) {
             tidPromise.set_value(gettid());
         });
     }
@@ -408,7 +545,8 @@ void RenderEngineThreaded::setEnableTracing(bool tracingEnabled) {
     // for the futures.
     {
         std::lock_guard lock(mThreadMutex);
-        mFunctionCalls.push([tracingEnabled](renderengine::RenderEngine& instance) {
+        mFunctionCalls.push(Priority::COMPOSITION, [tracingEnabled](renderengine::RenderEngine&
+                                                                            instance) {
             ATRACE_NAME("REThreaded::setEnableTracing");
             instance.setEnableTracing(tracingEnabled);
         });
@@ -19,9 +19,10 @@
 #include <android-base/thread_annotations.h>
 #include <condition_variable>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <vector>
 
+#include "WorkQueue.h"
 #include "renderengine/RenderEngine.h"
 
 namespace android {
@@ -33,7 +34,8 @@ using CreateInstanceFactory = std::function<std::unique_ptr<renderengine::Render
 /**
  * This class extends a basic RenderEngine class. It contains a thread. Each time a function of
  * this class is called, we create a lambda function that is put on a queue. The main thread then
- * executes the functions in order.
+ * executes the functions by priority, so that display composition isn't delayed by screenshots,
+ * cache priming or cleanup, and in order for a given priority.
  */
 class RenderEngineThreaded : public RenderEngine {
 public:
@@ -65,6 +67,7 @@ public:
     void cleanFramebufferCache() override;
     int getContextPriority() override;
     bool supportsBackgroundBlur() override;
+    bool supportsPartialRedraw() override;
     void onActiveDisplaySizeChanged(ui::Size size) override;
     std::optional<pid_t> getRenderEngineTid() const override;
     void setEnableTracing(bool tracingEnabled) override;
@@ -80,9 +83,41 @@ protected:
                             const bool useFramebufferCache, base::unique_fd&& bufferFence) override;
 
 private:
+    enum class Priority : size_t {
+        // Display composition, and any call the caller waits for.
+        COMPOSITION,
+        SCREENSHOT,
+        PRIME_CACHE,
+        CLEANUP,
+        COUNT,
+    };
+
+    struct BufferMapping {
+        sp<GraphicBuffer> buffer;
+        bool isRenderable;
+    };
+
     void threadMain(CreateInstanceFactory factory);
     void waitUntilInitialized() const;
     static status_t setSchedFifo(bool enabled);
+    static const char* toString(Priority priority);
+
+    // Map and unmap the buffers queued since the last call, on the RenderEngine thread.
+    void mapPendingBuffers(renderengine::RenderEngine& instance);
+    void unmapPendingBuffers(renderengine::RenderEngine& instance);
+
+    // The arguments of a drawLayers call, until it is run on the RenderEngine thread.
+    struct DrawLayersArgs {
+        std::shared_ptr<std::promise<RenderEngineResult>> resultPromise;
+        DisplaySettings display;
+        std::vector<LayerSettings> layers;
+        std::shared_ptr<ExternalTexture> buffer;
+        bool useFramebufferCache = false;
+        base::unique_fd bufferFence;
+        // Whether the protected context was in use when the call was queued.
+        bool isProtected = false;
+    };
+    void runDrawLayers(renderengine::RenderEngine& instance, DrawLayersArgs& args);
 
     /* ------------------------------------------------------------------------
      * Threading
@@ -94,9 +129,26 @@ private:
     std::atomic<bool> mRunning = true;
 
     using Work = std::function<void(renderengine::RenderEngine&)>;
-    mutable std::queue<Work> mFunctionCalls GUARDED_BY(mThreadMutex);
+    mutable WorkQueue<Work, Priority> mFunctionCalls GUARDED_BY(mThreadMutex);
     mutable std::condition_variable mCondition;
 
+    // Buffers are mapped and unmapped in batches, so that a burst of calls is queued as a single
+    // work item. Mapping a buffer and unmapping it before the mapping is run cancel out.
+    std::vector<BufferMapping> mPendingMaps GUARDED_BY(mThreadMutex);
+    std::vector<sp<GraphicBuffer>> mPendingUnmaps GUARDED_BY(mThreadMutex);
+    // The DrawLayersArgs of the calls already run, for the next calls to reuse. Frames are queued
+    // without allocating, as the layers are copied into a vector which already has the capacity
+    // for them, and the queued work only captures a pointer, which std::function stores inline.
+    std::vector<std::unique_ptr<DrawLayersArgs>> mFreeDrawLayersArgs GUARDED_BY(mThreadMutex);
+
+    bool mMapWorkQueued GUARDED_BY(mThreadMutex) = false;
+    bool mUnmapWorkQueued GUARDED_BY(mThreadMutex) = false;
+    size_t mCancelledMappings GUARDED_BY(mThreadMutex) = 0;
+    // Batches being run, only accessed on the RenderEngine thread. They are swapped with the
+    // pending batches so that the vectors keep their capacity.
+    std::vector<BufferMapping> mMapsInFlight;
+    std::vector<sp<GraphicBuffer>> mUnmapsInFlight;
+
     // Used to allow select thread safe methods to be accessed without requiring the
     // method to be invoked on the RenderEngine thread
     bool mIsInitialized = false;
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace renderengine {
+namespace threaded {
+
+/**
+ * Queue of work by priority. Work is popped from the highest priority, which is the lowest value of
+ * Priority, and in the order it was pushed for a given priority. Priority must be an enum whose
+ * values start at 0 and end with COUNT.
+ *
+ * Each priority is a ring buffer which only grows, so that the queue doesn't allocate once it holds
+ * as much work as it ever did.
+ *
+ * This class is not thread-safe.
+ */
+template <typename Work, typename Priority>
+class WorkQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Time spent in the queue by the work popped so far.
+    struct LatencyStats {
+        size_t count = 0;
+        Clock::duration total = Clock::duration::zero();
+        Clock::duration max = Clock::duration::zero();
+    };
+
+    explicit WorkQueue(size_t initialCapacity = 16) {
+        for (auto& ring : mRings) {
+            ring.slots.resize(initialCapacity);
+        }
+    }
+
+    void push(Priority priority, Work work, Clock::time_point now = Clock::now()) {
+        Ring& ring = mRings[static_cast<size_t>(priority)];
+        if (ring.size == ring.slots.size()) {
+            grow(ring);
+        }
+        Entry& entry = ring.slots[(ring.head + ring.size) % ring.slots.size()];
+        entry.work = std::move(work);
+        entry.queueTime = now;
+        ring.size++;
+    }
+
+    std::optional<Work> pop(Clock::time_point now = Clock::now()) {
+        for (size_t priority = 0; priority < kPriorityCount; priority++) {
+            Ring& ring = mRings[priority];
+            if (ring.size == 0) {
+                continue;
+            }
+            Entry& entry = ring.slots[ring.head];
+            std::optional<Work> work = std::move(entry.work);
+            // Release what the work captured as soon as it is run, rather than when the slot is
+            // reused.
+            entry.work = Work();
+            ring.head = (ring.head + 1) % ring.slots.size();
+            ring.size--;
+
+            LatencyStats& stats = mLatencyStats[priority];
+            const Clock::duration latency = now - entry.queueTime;
+            stats.count++;
+            stats.total += latency;
+            stats.max = std::max(stats.max, latency);
+            return work;
+        }
+        return std::nullopt;
+    }
+
+    bool empty() const {
+        for (const Ring& ring : mRings) {
+            if (ring.size > 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const LatencyStats& latencyStats(Priority priority) const {
+        return mLatencyStats[static_cast<size_t>(priority)];
+    }
+
+private:
+    static constexpr size_t kPriorityCount = static_cast<size_t>(Priority::COUNT);
+
+    struct Entry {
+        Work work;
+        Clock::time_point queueTime;
+    };
+
+    struct Ring {
+        std::vector<Entry> slots;
+        size_t head = 0;
+        size_t size = 0;
+    };
+
+    static void grow(Ring& ring) {
+        std::vector<Entry> slots(std::max<size_t>(ring.slots.size() * 2, 1));
+        for (size_t i = 0; i < ring.size; i++) {
+            slots[i] = std::move(ring.slots[(ring.head + i) % ring.slots.size()]);
+        }
+        ring.slots = std::move(slots);
+        ring.head = 0;
+    }
+
+    std::array<Ring, kPriorityCount> mRings;
+    std::array<LatencyStats, kPriorityCount> mLatencyStats;
+};
+
+} // namespace threaded
+} // namespace renderengine
+} // namespace android
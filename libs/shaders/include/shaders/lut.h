@@ -0,0 +1,161 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+#include <shaders/shaders.h>
+#include <tonemap/tonemap.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace android::shaders {
+
+// Display and content parameters of a LinearEffect, see buildLinearEffectUniforms().
+struct LinearEffectParams {
+    mat4 colorTransform;
+    float maxDisplayLuminance = 0.f;
+    float currentDisplayLuminanceNits = 0.f;
+    float maxLuminance = 0.f;
+    aidl::android::hardware::graphics::composer3::RenderIntent renderIntent =
+            aidl::android::hardware::graphics::composer3::RenderIntent::TONE_MAP_COLORIMETRIC;
+};
+
+static inline bool operator==(const LinearEffectParams& lhs, const LinearEffectParams& rhs) {
+    return lhs.colorTransform == rhs.colorTransform &&
+            lhs.maxDisplayLuminance == rhs.maxDisplayLuminance &&
+            lhs.currentDisplayLuminanceNits == rhs.currentDisplayLuminanceNits &&
+            lhs.maxLuminance == rhs.maxLuminance && lhs.renderIntent == rhs.renderIntent;
+}
+
+/**
+ * CPU implementation of the shader built by buildLinearEffectSkSL() with the uniforms built by
+ * buildLinearEffectUniforms(). Colors are unpremultiplied, in [0, 1] and encoded with the transfer
+ * function of the input dataspace. Results are encoded with the transfer function of the output
+ * dataspace.
+ */
+class LinearEffectEvaluator {
+public:
+    LinearEffectEvaluator(const LinearEffect& linearEffect, const LinearEffectParams& params);
+
+    // Applies the effect to count colors, in place.
+    void apply(vec3* colors, size_t count) const;
+
+    // Same as apply(), but results are not clamped to [0, 1]. Values out of range are encoded by
+    // mirroring the transfer function around 0, so clamping them afterwards yields the results of
+    // apply(). This keeps the gamut clip out of anything interpolated between results.
+    void applyUnclamped(vec3* colors, size_t count) const;
+
+    // Whether each output channel only depends on the same input channel, which is the case when
+    // the effect neither tone maps nor mixes channels.
+    bool isSeparable() const { return mSeparable; }
+
+private:
+    using TransferFunction = float (*)(float);
+
+    template <bool kClamp>
+    void applyImpl(vec3* colors, size_t count) const;
+
+    TransferFunction mEOTF;
+    TransferFunction mOETF;
+    mat4 mRgbToXyz;
+    mat4 mXyzToRgb;
+    // Maps relative light to nits before tone mapping, and nits back to relative light after.
+    float mLuminanceScale;
+    float mLuminanceNormalization;
+    std::unique_ptr<tonemap::ToneMapCurve> mToneMapCurve;
+    bool mSeparable;
+};
+
+/**
+ * Lookup table sampled from a LinearEffect, as a cheaper alternative to evaluating the transfer
+ * functions and tone mapping curve for every pixel on the CPU. RenderEngine does not use it, it
+ * evaluates the effect analytically in its shaders.
+ *
+ * Only colors within [0, 1] are supported, extended range content must use the analytic path.
+ */
+struct LinearEffectLut {
+    enum class Type {
+        // One entry per input level. Channel c of an entry holds the output of channel c for that
+        // input level. Used for separable effects.
+        Separable,
+        // size^3 entries sampled on a regular grid of input colors, interpolated trilinearly.
+        Volume,
+    };
+
+    static constexpr uint32_t kSeparableSize = 1024;
+    static constexpr uint32_t kDefaultVolumeSize = 33;
+
+    Type type;
+    uint32_t size;
+
+    // Output colors, alpha is always 1. Entries are laid out as a 2D image: size x 1 entries for
+    // Separable, and size * size x size entries for Volume, where red varies along x within a
+    // slice, green along y, and slices of increasing blue are placed side by side.
+    // Entries are not clamped, see LinearEffectEvaluator::applyUnclamped(). Results are clamped
+    // after interpolation.
+    std::vector<vec4> entries;
+
+    vec3 apply(vec3 color) const;
+    void apply(vec3* colors, size_t count) const;
+};
+
+// Samples linearEffect into a lookup table. Separable effects get a Separable table, other
+// effects get a Volume table with volumeSize entries on each side.
+std::shared_ptr<const LinearEffectLut> buildLinearEffectLut(
+        const LinearEffect& linearEffect, const LinearEffectParams& params,
+        uint32_t volumeSize = LinearEffectLut::kDefaultVolumeSize);
+
+// Caches the lookup table of each LinearEffect. The table of an effect is rebuilt when it is
+// requested with different params. At most maxEntries tables are kept, the least recently used
+// one is dropped to make room for a new one.
+class LinearEffectLutCache {
+public:
+    static constexpr size_t kDefaultMaxEntries = 8;
+
+    explicit LinearEffectLutCache(size_t maxEntries = kDefaultMaxEntries)
+          : mMaxEntries(maxEntries) {}
+
+    std::shared_ptr<const LinearEffectLut> get(const LinearEffect& linearEffect,
+                                               const LinearEffectParams& params);
+    void clear();
+
+    size_t size() const;
+
+private:
+    struct Entry {
+        LinearEffect linearEffect;
+        LinearEffectParams params;
+        std::shared_ptr<const LinearEffectLut> lut;
+    };
+    using EntryList = std::list<Entry>;
+
+    const size_t mMaxEntries;
+
+    mutable std::mutex mMutex;
+    // Most recently used first.
+    EntryList mEntries;
+    std::unordered_map<LinearEffect, EntryList::iterator, LinearEffectHasher> mEntryIndex;
+};
+
+} // namespace android::shaders
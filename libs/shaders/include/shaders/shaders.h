@@ -20,6 +20,9 @@
 #include <tonemap/tonemap.h>
 #include <ui/GraphicTypes.h>
 #include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace android::shaders {
 
@@ -103,4 +106,37 @@ std::vector<tonemap::ShaderUniform> buildLinearEffectUniforms(
         aidl::android::hardware::graphics::composer3::RenderIntent renderIntent =
                 aidl::android::hardware::graphics::composer3::RenderIntent::TONE_MAP_COLORIMETRIC);
 
+// Writes the uniforms of buildLinearEffectUniforms() into a single block of memory which is reused
+// from one call to the next, instead of allocating a vector for every uniform. A writer is not
+// thread-safe, each thread setting uniforms should own one.
+class LinearEffectUniformWriter : private tonemap::ShaderUniformSink {
+public:
+    struct Uniform {
+        std::string name;
+        // Location of the value within data().
+        size_t offset;
+        size_t size;
+    };
+
+    // Returns the uniforms to set on the shader returned by buildLinearEffectSkSL(). Both the
+    // returned list and data() are only valid until the next call.
+    const std::vector<Uniform>& write(
+            const LinearEffect& linearEffect, const mat4& colorTransform,
+            float maxDisplayLuminance, float currentDisplayLuminanceNits, float maxLuminance,
+            AHardwareBuffer* buffer = nullptr,
+            aidl::android::hardware::graphics::composer3::RenderIntent renderIntent =
+                    aidl::android::hardware::graphics::composer3::RenderIntent::
+                            TONE_MAP_COLORIMETRIC);
+
+    const uint8_t* data() const { return mData.data(); }
+
+private:
+    void setUniform(std::string_view name, const void* value, size_t size) override;
+
+    std::vector<Uniform> mUniforms;
+    size_t mUniformCount = 0;
+    std::vector<uint8_t> mData;
+    size_t mDataSize = 0;
+};
+
 } // namespace android::shaders
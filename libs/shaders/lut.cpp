@@ -0,0 +1,434 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <shaders/lut.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <system/graphics-base-v1.0.h>
+
+#include "shaders_internal.h"
+
+namespace android::shaders {
+
+namespace {
+
+aidl::android::hardware::graphics::common::Dataspace toAidlDataspace(ui::Dataspace dataspace) {
+    return static_cast<aidl::android::hardware::graphics::common::Dataspace>(dataspace);
+}
+
+// The transfer functions below must match the ones generated by buildLinearEffectSkSL().
+
+float EOTF_ST2084(float channel) {
+    constexpr float m1 = (2610.f / 4096.f) / 4.f;
+    constexpr float m2 = (2523.f / 4096.f) * 128.f;
+    constexpr float c1 = (3424.f / 4096.f);
+    constexpr float c2 = (2413.f / 4096.f) * 32.f;
+    constexpr float c3 = (2392.f / 4096.f) * 32.f;
+
+    float tmp = std::pow(std::clamp(channel, 0.f, 1.f), 1.f / m2);
+    tmp = std::max(tmp - c1, 0.f) / (c2 - c3 * tmp);
+    return std::pow(tmp, 1.f / m1);
+}
+
+float EOTF_HLG(float channel) {
+    constexpr float a = 0.17883277f;
+    constexpr float b = 0.28466892f;
+    constexpr float c = 0.55991073f;
+    return channel <= 0.5f ? channel * channel / 3.f : (std::exp((channel - c) / a) + b) / 12.f;
+}
+
+float EOTF_SMPTE_170M(float channel) {
+    const float srgb = std::abs(channel);
+    return std::copysign(srgb <= 0.08125f ? srgb / 4.5f
+                                          : std::pow((srgb + 0.099f) / 1.099f, 1.f / 0.45f),
+                         channel);
+}
+
+template <int kGammaTimesTen>
+float EOTF_Gamma(float channel) {
+    return std::copysign(std::pow(std::abs(channel), kGammaTimesTen / 10.f), channel);
+}
+
+float EOTF_sRGB(float channel) {
+    const float srgb = std::abs(channel);
+    return std::copysign(srgb <= 0.04045f ? srgb / 12.92f
+                                          : std::pow((srgb + 0.055f) / 1.055f, 2.4f),
+                         channel);
+}
+
+float OETF_ST2084(float channel) {
+    constexpr float m1 = (2610.f / 4096.f) / 4.f;
+    constexpr float m2 = (2523.f / 4096.f) * 128.f;
+    constexpr float c1 = (3424.f / 4096.f);
+    constexpr float c2 = (2413.f / 4096.f) * 32.f;
+    constexpr float c3 = (2392.f / 4096.f) * 32.f;
+
+    float tmp = std::pow(channel, m1);
+    tmp = (c1 + c2 * tmp) / (1.f + c3 * tmp);
+    return std::pow(tmp, m2);
+}
+
+float OETF_HLG(float channel) {
+    constexpr float a = 0.17883277f;
+    constexpr float b = 0.28466892f;
+    constexpr float c = 0.55991073f;
+    return channel <= 1.f / 12.f ? std::sqrt(3.f * channel)
+                                 : a * std::log(12.f * channel - b) + c;
+}
+
+float OETF_SMPTE_170M(float channel) {
+    const float linear = std::abs(channel);
+    return std::copysign(linear <= 0.018f ? linear * 4.5f
+                                          : (std::pow(linear, 0.45f) * 1.099f) - 0.099f,
+                         channel);
+}
+
+template <int kGammaTimesTen>
+float OETF_Gamma(float channel) {
+    return std::copysign(std::pow(std::abs(channel), 10.f / kGammaTimesTen), channel);
+}
+
+float OETF_sRGB(float channel) {
+    const float linear = std::abs(channel);
+    return std::copysign(linear <= 0.0031308f
+                                 ? linear * 12.92f
+                                 : (std::pow(linear, 1.f / 2.4f) * 1.055f) - 0.055f,
+                         channel);
+}
+
+float identity(float channel) {
+    return channel;
+}
+
+using TransferFunction = float (*)(float);
+
+TransferFunction getEOTF(ui::Dataspace dataspace) {
+    switch (dataspace & HAL_DATASPACE_TRANSFER_MASK) {
+        case HAL_DATASPACE_TRANSFER_ST2084:
+            return EOTF_ST2084;
+        case HAL_DATASPACE_TRANSFER_HLG:
+            return EOTF_HLG;
+        case HAL_DATASPACE_TRANSFER_LINEAR:
+            return identity;
+        case HAL_DATASPACE_TRANSFER_SMPTE_170M:
+            return EOTF_SMPTE_170M;
+        case HAL_DATASPACE_TRANSFER_GAMMA2_2:
+            return EOTF_Gamma<22>;
+        case HAL_DATASPACE_TRANSFER_GAMMA2_6:
+            return EOTF_Gamma<26>;
+        case HAL_DATASPACE_TRANSFER_GAMMA2_8:
+            return EOTF_Gamma<28>;
+        case HAL_DATASPACE_TRANSFER_SRGB:
+        default:
+            return EOTF_sRGB;
+    }
+}
+
+TransferFunction getOETF(ui::Dataspace dataspace) {
+    switch (dataspace & HAL_DATASPACE_TRANSFER_MASK) {
+        case HAL_DATASPACE_TRANSFER_ST2084:
+            return OETF_ST2084;
+        case HAL_DATASPACE_TRANSFER_HLG:
+            return OETF_HLG;
+        case HAL_DATASPACE_TRANSFER_LINEAR:
+            return identity;
+        case HAL_DATASPACE_TRANSFER_SMPTE_170M:
+            return OETF_SMPTE_170M;
+        case HAL_DATASPACE_TRANSFER_GAMMA2_2:
+            return OETF_Gamma<22>;
+        case HAL_DATASPACE_TRANSFER_GAMMA2_6:
+            return OETF_Gamma<26>;
+        case HAL_DATASPACE_TRANSFER_GAMMA2_8:
+            return OETF_Gamma<28>;
+        case HAL_DATASPACE_TRANSFER_SRGB:
+        default:
+            return OETF_sRGB;
+    }
+}
+
+bool isHdr(ui::Dataspace dataspace) {
+    const int32_t transfer = dataspace & HAL_DATASPACE_TRANSFER_MASK;
+    return transfer == HAL_DATASPACE_TRANSFER_ST2084 || transfer == HAL_DATASPACE_TRANSFER_HLG;
+}
+
+float findUniform(const std::vector<tonemap::ShaderUniform>& uniforms, const char* name) {
+    float value = 0.f;
+    const auto it = std::find_if(uniforms.begin(), uniforms.end(),
+                                 [&](const auto& uniform) { return uniform.name == name; });
+    if (it != uniforms.end() && it->value.size() == sizeof(value)) {
+        std::memcpy(&value, it->value.data(), sizeof(value));
+    }
+    return value;
+}
+
+// Matches ScaleLuminance() in the shader.
+float getLuminanceScale(ui::Dataspace inputDataspace, ui::Dataspace outputDataspace,
+                        const std::vector<tonemap::ShaderUniform>& tonemapUniforms) {
+    switch (inputDataspace & HAL_DATASPACE_TRANSFER_MASK) {
+        case HAL_DATASPACE_TRANSFER_ST2084:
+            return 10000.f;
+        case HAL_DATASPACE_TRANSFER_HLG:
+            return 1000.f;
+        default:
+            return isHdr(outputDataspace)
+                    ? findUniform(tonemapUniforms, "in_libtonemap_inputMaxLuminance")
+                    : findUniform(tonemapUniforms, "in_libtonemap_displayMaxLuminance");
+    }
+}
+
+// Matches NormalizeLuminance() in the shader.
+float getLuminanceNormalization(ui::Dataspace outputDataspace,
+                                const std::vector<tonemap::ShaderUniform>& tonemapUniforms) {
+    switch (outputDataspace & HAL_DATASPACE_TRANSFER_MASK) {
+        case HAL_DATASPACE_TRANSFER_ST2084:
+            return 10000.f;
+        case HAL_DATASPACE_TRANSFER_HLG:
+            return 1000.f;
+        default:
+            return findUniform(tonemapUniforms, "in_libtonemap_displayMaxLuminance");
+    }
+}
+
+bool isDiagonal(const mat4& matrix) {
+    constexpr float kEpsilon = 1e-6f;
+    for (size_t column = 0; column < 3; column++) {
+        for (size_t row = 0; row < 3; row++) {
+            if (row != column && std::abs(matrix[column][row]) > kEpsilon) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Both tone mappers compute the gain from a single luminance, so probing gray levels over the
+// whole HDR range is enough to tell whether the curve is the identity.
+bool isIdentity(const tonemap::ToneMapCurve& curve) {
+    constexpr int kNumProbes = 113;
+    tonemap::Color colors[kNumProbes];
+    for (int i = 0; i < kNumProbes; i++) {
+        const float nits = std::exp2(-14.f + static_cast<float>(i) / 4.f);
+        colors[i] = {.linearRGB = vec3(nits), .xyz = vec3(nits)};
+    }
+    float gains[kNumProbes];
+    curve.lookupTonemapGain(colors, kNumProbes, gains);
+    return std::all_of(std::begin(gains), std::end(gains),
+                       [](float gain) { return std::abs(gain - 1.f) < 1e-6f; });
+}
+
+float clampToUnit(float value) {
+    // Also maps NaNs to 0.
+    return value > 0.f ? (value < 1.f ? value : 1.f) : 0.f;
+}
+
+} // namespace
+
+LinearEffectEvaluator::LinearEffectEvaluator(const LinearEffect& linearEffect,
+                                             const LinearEffectParams& params)
+      : mEOTF(getEOTF(getEotfDataspace(linearEffect))),
+        mOETF(getOETF(linearEffect.outputDataspace)) {
+    buildXyzTransforms(linearEffect, params.colorTransform, mRgbToXyz, mXyzToRgb);
+
+    const tonemap::Metadata metadata =
+            buildTonemapMetadata(params.maxDisplayLuminance, params.currentDisplayLuminanceNits,
+                                 params.maxLuminance, nullptr, params.renderIntent);
+    tonemap::ToneMapper* toneMapper = tonemap::getToneMapper();
+    const auto tonemapUniforms = toneMapper->generateShaderSkSLUniforms(metadata);
+    mLuminanceScale = getLuminanceScale(linearEffect.inputDataspace,
+                                        linearEffect.outputDataspace, tonemapUniforms);
+    mLuminanceNormalization =
+            getLuminanceNormalization(linearEffect.outputDataspace, tonemapUniforms);
+    mToneMapCurve = toneMapper->createToneMapCurve(toAidlDataspace(linearEffect.inputDataspace),
+                                                   toAidlDataspace(linearEffect.outputDataspace),
+                                                   metadata, tonemap::ToneMapCurve::Mode::Exact);
+
+    mSeparable = mLuminanceScale == mLuminanceNormalization && isDiagonal(mXyzToRgb * mRgbToXyz) &&
+            isIdentity(*mToneMapCurve);
+}
+
+template <bool kClamp>
+void LinearEffectEvaluator::applyImpl(vec3* colors, size_t count) const {
+    // Colors are tone mapped in chunks, to batch the gain computation.
+    constexpr size_t kChunkSize = 256;
+    tonemap::Color scaledColors[kChunkSize];
+    float gains[kChunkSize];
+
+    for (size_t start = 0; start < count; start += kChunkSize) {
+        vec3* chunk = colors + start;
+        const size_t chunkSize = std::min(kChunkSize, count - start);
+
+        for (size_t i = 0; i < chunkSize; i++) {
+            const vec3 linearRGB(mEOTF(chunk[i].r), mEOTF(chunk[i].g), mEOTF(chunk[i].b));
+            const vec3 xyz = (mRgbToXyz * vec4(linearRGB, 1.f)).xyz;
+            scaledColors[i] = {.linearRGB = linearRGB * mLuminanceScale,
+                               .xyz = xyz * mLuminanceScale};
+        }
+
+        mToneMapCurve->lookupTonemapGain(scaledColors, chunkSize, gains);
+
+        for (size_t i = 0; i < chunkSize; i++) {
+            const vec3 xyz = scaledColors[i].xyz * (gains[i] / mLuminanceNormalization);
+            const vec3 rgb = (mXyzToRgb * vec4(xyz, 1.f)).xyz;
+            if constexpr (kClamp) {
+                chunk[i] = vec3(mOETF(clampToUnit(rgb.r)), mOETF(clampToUnit(rgb.g)),
+                                mOETF(clampToUnit(rgb.b)));
+            } else {
+                chunk[i] = vec3(std::copysign(mOETF(std::abs(rgb.r)), rgb.r),
+                                std::copysign(mOETF(std::abs(rgb.g)), rgb.g),
+                                std::copysign(mOETF(std::abs(rgb.b)), rgb.b));
+            }
+        }
+    }
+}
+
+void LinearEffectEvaluator::apply(vec3* colors, size_t count) const {
+    applyImpl<true>(colors, count);
+}
+
+void LinearEffectEvaluator::applyUnclamped(vec3* colors, size_t count) const {
+    applyImpl<false>(colors, count);
+}
+
+vec3 LinearEffectLut::apply(vec3 color) const {
+    const float maxIndex = static_cast<float>(size - 1);
+    const vec3 position(clampToUnit(color.r) * maxIndex, clampToUnit(color.g) * maxIndex,
+                        clampToUnit(color.b) * maxIndex);
+
+    if (type == Type::Separable) {
+        vec3 result;
+        for (size_t channel = 0; channel < 3; channel++) {
+            const auto index = std::min(static_cast<uint32_t>(position[channel]), size - 2);
+            const float fraction = position[channel] - static_cast<float>(index);
+            const float lower = entries[index][channel];
+            const float upper = entries[index + 1][channel];
+            result[channel] = clampToUnit(lower + (upper - lower) * fraction);
+        }
+        return result;
+    }
+
+    const auto r = std::min(static_cast<uint32_t>(position.r), size - 2);
+    const auto g = std::min(static_cast<uint32_t>(position.g), size - 2);
+    const auto b = std::min(static_cast<uint32_t>(position.b), size - 2);
+    const vec3 fraction =
+            position - vec3(static_cast<float>(r), static_cast<float>(g), static_cast<float>(b));
+
+    // Same layout as the texture: red along x, green along y, blue slices side by side.
+    const size_t rowStride = size * size;
+    const size_t sliceStride = size;
+    const vec4* base = entries.data() + g * rowStride + b * sliceStride + r;
+    auto lerp = [](const vec4& a, const vec4& b, float t) { return a + (b - a) * t; };
+    auto sampleSlice = [&](const vec4* slice) {
+        return lerp(lerp(slice[0], slice[1], fraction.r),
+                    lerp(slice[rowStride], slice[rowStride + 1], fraction.r), fraction.g);
+    };
+    const vec3 result = lerp(sampleSlice(base), sampleSlice(base + sliceStride), fraction.b).rgb;
+    return vec3(clampToUnit(result.r), clampToUnit(result.g), clampToUnit(result.b));
+}
+
+void LinearEffectLut::apply(vec3* colors, size_t count) const {
+    for (size_t i = 0; i < count; i++) {
+        colors[i] = apply(colors[i]);
+    }
+}
+
+std::shared_ptr<const LinearEffectLut> buildLinearEffectLut(const LinearEffect& linearEffect,
+                                                            const LinearEffectParams& params,
+                                                            uint32_t volumeSize) {
+    const LinearEffectEvaluator evaluator(linearEffect, params);
+    auto lut = std::make_shared<LinearEffectLut>();
+
+    std::vector<vec3> colors;
+    if (evaluator.isSeparable()) {
+        lut->type = LinearEffectLut::Type::Separable;
+        lut->size = LinearEffectLut::kSeparableSize;
+        colors.reserve(lut->size);
+        for (uint32_t level = 0; level < lut->size; level++) {
+            colors.push_back(vec3(static_cast<float>(level) / static_cast<float>(lut->size - 1)));
+        }
+    } else {
+        lut->type = LinearEffectLut::Type::Volume;
+        lut->size = std::max(volumeSize, 2u);
+        const float maxIndex = static_cast<float>(lut->size - 1);
+        colors.reserve(lut->size * lut->size * lut->size);
+        // Texture order, see LinearEffectLut::entries.
+        for (uint32_t g = 0; g < lut->size; g++) {
+            for (uint32_t b = 0; b < lut->size; b++) {
+                for (uint32_t r = 0; r < lut->size; r++) {
+                    colors.push_back(vec3(static_cast<float>(r), static_cast<float>(g),
+                                          static_cast<float>(b)) /
+                                     maxIndex);
+                }
+            }
+        }
+    }
+
+    evaluator.applyUnclamped(colors.data(), colors.size());
+    lut->entries.reserve(colors.size());
+    for (const vec3& color : colors) {
+        lut->entries.push_back(vec4(color, 1.f));
+    }
+    return lut;
+}
+
+std::shared_ptr<const LinearEffectLut> LinearEffectLutCache::get(
+        const LinearEffect& linearEffect, const LinearEffectParams& params) {
+    {
+        std::lock_guard lock(mMutex);
+        const auto it = mEntryIndex.find(linearEffect);
+        if (it != mEntryIndex.end() && it->second->params == params) {
+            mEntries.splice(mEntries.begin(), mEntries, it->second);
+            return it->second->lut;
+        }
+    }
+
+    // Sampling the effect takes a while, don't hold the lock meanwhile.
+    auto lut = buildLinearEffectLut(linearEffect, params);
+
+    std::lock_guard lock(mMutex);
+    const auto it = mEntryIndex.find(linearEffect);
+    if (it != mEntryIndex.end()) {
+        it->second->params = params;
+        it->second->lut = lut;
+        mEntries.splice(mEntries.begin(), mEntries, it->second);
+        return lut;
+    }
+
+    if (mEntries.size() >= mMaxEntries && !mEntries.empty()) {
+        mEntryIndex.erase(mEntries.back().linearEffect);
+        mEntries.pop_back();
+    }
+    if (mMaxEntries > 0) {
+        mEntries.push_front(Entry{linearEffect, params, lut});
+        mEntryIndex.emplace(linearEffect, mEntries.begin());
+    }
+    return lut;
+}
+
+void LinearEffectLutCache::clear() {
+    std::lock_guard lock(mMutex);
+    mEntryIndex.clear();
+    mEntries.clear();
+}
+
+size_t LinearEffectLutCache::size() const {
+    std::lock_guard lock(mMutex);
+    return mEntries.size();
+}
+
+} // namespace android::shaders
@@ -19,12 +19,15 @@
 #include <tonemap/tonemap.h>
 
 #include <cmath>
+#include <cstring>
 #include <optional>
 
 #include <math/mat4.h>
 #include <system/graphics-base-v1.0.h>
 #include <ui/ColorSpace.h>
 
+#include "shaders_internal.h"
+
 namespace android::shaders {
 
 namespace {
@@ -450,12 +453,47 @@ std::vector<uint8_t> buildUniformValue(T value) {
 
 } // namespace
 
+ui::Dataspace getEotfDataspace(const LinearEffect& linearEffect) {
+    return linearEffect.fakeInputDataspace == ui::Dataspace::UNKNOWN
+            ? linearEffect.inputDataspace
+            : linearEffect.fakeInputDataspace;
+}
+
+void buildXyzTransforms(const LinearEffect& linearEffect, const mat4& colorTransform,
+                        mat4& outRgbToXyz, mat4& outXyzToRgb) {
+    const ui::Dataspace inputDataspace = getEotfDataspace(linearEffect);
+    if (inputDataspace == linearEffect.outputDataspace) {
+        outRgbToXyz = mat4();
+        outXyzToRgb = colorTransform;
+    } else {
+        ColorSpace inputColorSpace = toColorSpace(inputDataspace);
+        ColorSpace outputColorSpace = toColorSpace(linearEffect.outputDataspace);
+        outRgbToXyz = mat4(inputColorSpace.getRGBtoXYZ());
+        outXyzToRgb = colorTransform * mat4(outputColorSpace.getXYZtoRGB());
+    }
+}
+
+tonemap::Metadata buildTonemapMetadata(
+        float maxDisplayLuminance, float currentDisplayLuminanceNits, float maxLuminance,
+        AHardwareBuffer* buffer,
+        aidl::android::hardware::graphics::composer3::RenderIntent renderIntent) {
+    return tonemap::Metadata{.displayMaxLuminance = maxDisplayLuminance,
+                             // If the input luminance is unknown, use display luminance (aka,
+                             // no-op any luminance changes)
+                             // This will be the case for eg screenshots in addition to
+                             // uncalibrated displays
+                             .contentMaxLuminance =
+                                     maxLuminance > 0 ? maxLuminance : maxDisplayLuminance,
+                             .currentDisplayLuminance = currentDisplayLuminanceNits > 0
+                                     ? currentDisplayLuminanceNits
+                                     : maxDisplayLuminance,
+                             .buffer = buffer,
+                             .renderIntent = renderIntent};
+}
+
 std::string buildLinearEffectSkSL(const LinearEffect& linearEffect) {
     std::string shaderString;
-    generateEOTF(linearEffect.fakeInputDataspace == ui::Dataspace::UNKNOWN
-                         ? linearEffect.inputDataspace
-                         : linearEffect.fakeInputDataspace,
-                 shaderString);
+    generateEOTF(getEotfDataspace(linearEffect), shaderString);
     generateXYZTransforms(shaderString);
     generateOOTF(linearEffect.inputDataspace, linearEffect.outputDataspace, shaderString);
     generateOETF(linearEffect.outputDataspace, shaderString);
@@ -470,36 +508,15 @@ std::vector<tonemap::ShaderUniform> buildLinearEffectUniforms(
         aidl::android::hardware::graphics::composer3::RenderIntent renderIntent) {
     std::vector<tonemap::ShaderUniform> uniforms;
 
-    const ui::Dataspace inputDataspace = linearEffect.fakeInputDataspace == ui::Dataspace::UNKNOWN
-            ? linearEffect.inputDataspace
-            : linearEffect.fakeInputDataspace;
-
-    if (inputDataspace == linearEffect.outputDataspace) {
-        uniforms.push_back({.name = "in_rgbToXyz", .value = buildUniformValue<mat4>(mat4())});
-        uniforms.push_back(
-                {.name = "in_xyzToRgb", .value = buildUniformValue<mat4>(colorTransform)});
-    } else {
-        ColorSpace inputColorSpace = toColorSpace(inputDataspace);
-        ColorSpace outputColorSpace = toColorSpace(linearEffect.outputDataspace);
-        uniforms.push_back({.name = "in_rgbToXyz",
-                            .value = buildUniformValue<mat4>(mat4(inputColorSpace.getRGBtoXYZ()))});
-        uniforms.push_back({.name = "in_xyzToRgb",
-                            .value = buildUniformValue<mat4>(
-                                    colorTransform * mat4(outputColorSpace.getXYZtoRGB()))});
-    }
+    mat4 rgbToXyz;
+    mat4 xyzToRgb;
+    buildXyzTransforms(linearEffect, colorTransform, rgbToXyz, xyzToRgb);
+    uniforms.push_back({.name = "in_rgbToXyz", .value = buildUniformValue<mat4>(rgbToXyz)});
+    uniforms.push_back({.name = "in_xyzToRgb", .value = buildUniformValue<mat4>(xyzToRgb)});
 
-    tonemap::Metadata metadata{.displayMaxLuminance = maxDisplayLuminance,
-                               // If the input luminance is unknown, use display luminance (aka,
-                               // no-op any luminance changes)
-                               // This will be the case for eg screenshots in addition to
-                               // uncalibrated displays
-                               .contentMaxLuminance =
-                                       maxLuminance > 0 ? maxLuminance : maxDisplayLuminance,
-                               .currentDisplayLuminance = currentDisplayLuminanceNits > 0
-                                       ? currentDisplayLuminanceNits
-                                       : maxDisplayLuminance,
-                               .buffer = buffer,
-                               .renderIntent = renderIntent};
+    const tonemap::Metadata metadata =
+            buildTonemapMetadata(maxDisplayLuminance, currentDisplayLuminanceNits, maxLuminance,
+                                 buffer, renderIntent);
 
     for (const auto uniform : tonemap::getToneMapper()->generateShaderSkSLUniforms(metadata)) {
         uniforms.push_back(uniform);
@@ -508,4 +525,46 @@ std::vector<tonemap::ShaderUniform> buildLinearEffectUniforms(
     return uniforms;
 }
 
+const std::vector<LinearEffectUniformWriter::Uniform>& LinearEffectUniformWriter::write(
+        const LinearEffect& linearEffect, const mat4& colorTransform, float maxDisplayLuminance,
+        float currentDisplayLuminanceNits, float maxLuminance, AHardwareBuffer* buffer,
+        aidl::android::hardware::graphics::composer3::RenderIntent renderIntent) {
+    mUniformCount = 0;
+    mDataSize = 0;
+
+    mat4 rgbToXyz;
+    mat4 xyzToRgb;
+    buildXyzTransforms(linearEffect, colorTransform, rgbToXyz, xyzToRgb);
+    setUniform("in_rgbToXyz", &rgbToXyz, sizeof(rgbToXyz));
+    setUniform("in_xyzToRgb", &xyzToRgb, sizeof(xyzToRgb));
+
+    const tonemap::Metadata metadata =
+            buildTonemapMetadata(maxDisplayLuminance, currentDisplayLuminanceNits, maxLuminance,
+                                 buffer, renderIntent);
+    tonemap::getToneMapper()->writeShaderSkSLUniforms(metadata, *this);
+
+    // The set of uniforms only depends on the tone mapper, so this is a no-op after the first
+    // call and entries keep their names.
+    mUniforms.resize(mUniformCount);
+    return mUniforms;
+}
+
+void LinearEffectUniformWriter::setUniform(std::string_view name, const void* value, size_t size) {
+    if (mUniformCount == mUniforms.size()) {
+        mUniforms.emplace_back();
+    }
+    Uniform& uniform = mUniforms[mUniformCount++];
+    if (uniform.name != name) {
+        uniform.name.assign(name);
+    }
+    uniform.offset = mDataSize;
+    uniform.size = size;
+
+    mDataSize += size;
+    if (mData.size() < mDataSize) {
+        mData.resize(mDataSize);
+    }
+    std::memcpy(mData.data() + uniform.offset, value, size);
+}
+
 } // namespace android::shaders
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <shaders/shaders.h>
+
+// Helpers shared by the SkSL and the CPU implementations of a LinearEffect.
+namespace android::shaders {
+
+// Dataspace whose EOTF linearizes the input colors, see LinearEffect::fakeInputDataspace.
+ui::Dataspace getEotfDataspace(const LinearEffect& linearEffect);
+
+// Matrices bound to in_rgbToXyz and in_xyzToRgb.
+void buildXyzTransforms(const LinearEffect& linearEffect, const mat4& colorTransform,
+                        mat4& outRgbToXyz, mat4& outXyzToRgb);
+
+// Metadata handed to the ToneMapper for the given display and content luminances.
+tonemap::Metadata buildTonemapMetadata(
+        float maxDisplayLuminance, float currentDisplayLuminanceNits, float maxLuminance,
+        AHardwareBuffer* buffer,
+        aidl::android::hardware::graphics::composer3::RenderIntent renderIntent);
+
+} // namespace android::shaders
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <shaders/lut.h>
+
+#include <random>
+#include <vector>
+
+namespace android {
+namespace {
+
+using shaders::LinearEffect;
+using shaders::LinearEffectParams;
+
+constexpr size_t kNumColors = 1 << 14;
+
+const LinearEffect kEffect = {.inputDataspace = ui::Dataspace::BT2020_ITU_PQ,
+                              .outputDataspace = ui::Dataspace::DISPLAY_P3};
+
+const LinearEffectParams kParams = {.maxDisplayLuminance = 1000.f,
+                                    .currentDisplayLuminanceNits = 500.f,
+                                    .maxLuminance = 4000.f};
+
+std::vector<vec3> generateColors() {
+    std::mt19937 rng(kNumColors);
+    std::uniform_real_distribution<float> channel(0.f, 1.f);
+    std::vector<vec3> colors(kNumColors);
+    for (vec3& color : colors) {
+        color = vec3(channel(rng), channel(rng), channel(rng));
+    }
+    return colors;
+}
+
+void BM_BuildLinearEffectLut(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(shaders::buildLinearEffectLut(kEffect, kParams));
+    }
+}
+BENCHMARK(BM_BuildLinearEffectLut)->Unit(benchmark::kMillisecond);
+
+void BM_ApplyLinearEffectEvaluator(benchmark::State& state) {
+    const std::vector<vec3> input = generateColors();
+    const shaders::LinearEffectEvaluator evaluator(kEffect, kParams);
+    std::vector<vec3> colors;
+    for (auto _ : state) {
+        colors = input;
+        evaluator.apply(colors.data(), colors.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * kNumColors);
+}
+BENCHMARK(BM_ApplyLinearEffectEvaluator);
+
+void BM_ApplyLinearEffectLut(benchmark::State& state) {
+    const std::vector<vec3> input = generateColors();
+    const auto lut = shaders::buildLinearEffectLut(kEffect, kParams);
+    std::vector<vec3> colors;
+    for (auto _ : state) {
+        colors = input;
+        lut->apply(colors.data(), colors.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * kNumColors);
+}
+BENCHMARK(BM_ApplyLinearEffectLut);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shaders/lut.h"
+#include <gtest/gtest.h>
+#include <math/mat4.h>
+#include <algorithm>
+#include <random>
+
+namespace android {
+
+using shaders::LinearEffect;
+using shaders::LinearEffectLut;
+using shaders::LinearEffectParams;
+
+namespace {
+
+constexpr size_t kNumColors = 1 << 20;
+
+const LinearEffectParams kParams = {.maxDisplayLuminance = 1000.f,
+                                    .currentDisplayLuminanceNits = 500.f,
+                                    .maxLuminance = 4000.f};
+
+std::vector<vec3> generateColors(size_t count) {
+    std::mt19937 rng(static_cast<uint32_t>(count));
+    std::uniform_real_distribution<float> channel(0.f, 1.f);
+    std::vector<vec3> colors(count);
+    for (vec3& color : colors) {
+        color = vec3(channel(rng), channel(rng), channel(rng));
+    }
+    return colors;
+}
+
+struct Errors {
+    float max;
+    float mean;
+    // Per channel error that 99.9% of the channels stay within.
+    float p999;
+};
+
+Errors compare(const std::vector<vec3>& expected, const std::vector<vec3>& actual) {
+    std::vector<float> errors;
+    errors.reserve(expected.size() * 3);
+    double sum = 0.0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        for (size_t channel = 0; channel < 3; channel++) {
+            errors.push_back(std::abs(expected[i][channel] - actual[i][channel]));
+            sum += errors.back();
+        }
+    }
+    const auto p999 = errors.begin() + errors.size() * 999 / 1000;
+    std::nth_element(errors.begin(), p999, errors.end());
+    return {.max = *std::max_element(p999, errors.end()),
+            .mean = static_cast<float>(sum / static_cast<double>(errors.size())),
+            .p999 = *p999};
+}
+
+} // namespace
+
+struct LinearEffectLutTest : public ::testing::Test {
+    const std::vector<vec3> mColors = generateColors(kNumColors);
+};
+
+TEST_F(LinearEffectLutTest, evaluatorIsIdentityWithoutConversion) {
+    const LinearEffect effect{.inputDataspace = ui::Dataspace::V0_SRGB,
+                              .outputDataspace = ui::Dataspace::V0_SRGB};
+    const shaders::LinearEffectEvaluator evaluator(effect, kParams);
+    EXPECT_TRUE(evaluator.isSeparable());
+
+    std::vector<vec3> colors = mColors;
+    evaluator.apply(colors.data(), colors.size());
+    EXPECT_LT(compare(mColors, colors).max, 1e-4f);
+}
+
+TEST_F(LinearEffectLutTest, separableEffectUsesCompactLut) {
+    const LinearEffect effect{.inputDataspace = ui::Dataspace::V0_SRGB,
+                              .outputDataspace = ui::Dataspace::V0_SRGB};
+    LinearEffectParams params = kParams;
+    params.colorTransform = mat4::scale(vec4(0.5f, 0.8f, 1.f, 1.f));
+    const auto lut = shaders::buildLinearEffectLut(effect, params);
+    ASSERT_EQ(lut->type, LinearEffectLut::Type::Separable);
+    EXPECT_EQ(lut->size, LinearEffectLut::kSeparableSize);
+    EXPECT_EQ(lut->entries.size(), LinearEffectLut::kSeparableSize);
+
+    std::vector<vec3> expected = mColors;
+    shaders::LinearEffectEvaluator(effect, params).apply(expected.data(), expected.size());
+    std::vector<vec3> actual = mColors;
+    lut->apply(actual.data(), actual.size());
+    EXPECT_LT(compare(expected, actual).max, 1e-3f);
+}
+
+TEST_F(LinearEffectLutTest, gamutConversionUsesVolumeLut) {
+    const LinearEffect effect{.inputDataspace = ui::Dataspace::V0_SRGB,
+                              .outputDataspace = ui::Dataspace::DISPLAY_P3};
+    const auto lut = shaders::buildLinearEffectLut(effect, kParams, 17);
+    ASSERT_EQ(lut->type, LinearEffectLut::Type::Volume);
+    EXPECT_EQ(lut->size, 17u);
+    EXPECT_EQ(lut->entries.size(), 17u * 17u * 17u);
+}
+
+TEST_F(LinearEffectLutTest, volumeLutMatchesEvaluator) {
+    for (const auto input : {ui::Dataspace::BT2020_ITU_PQ, ui::Dataspace::BT2020_ITU_HLG}) {
+        for (const auto output : {ui::Dataspace::DISPLAY_P3, ui::Dataspace::BT2020_ITU_PQ,
+                                  ui::Dataspace::BT2020_ITU_HLG}) {
+            if (input == output) {
+                continue;
+            }
+            SCOPED_TRACE(testing::Message() << "input " << static_cast<int32_t>(input)
+                                            << " output " << static_cast<int32_t>(output));
+            const LinearEffect effect{.inputDataspace = input, .outputDataspace = output};
+            const auto lut = shaders::buildLinearEffectLut(effect, kParams);
+            ASSERT_EQ(lut->type, LinearEffectLut::Type::Volume);
+
+            std::vector<vec3> expected = mColors;
+            shaders::LinearEffectEvaluator(effect, kParams).apply(expected.data(),
+                                                                  expected.size());
+            std::vector<vec3> actual = mColors;
+            lut->apply(actual.data(), actual.size());
+
+            const Errors errors = compare(expected, actual);
+            // Errors are well below an 8 bit code value on average. They peak where the tone
+            // mapping curve or the gamut clip bends between samples, which only affects a few
+            // highlights and saturated colors.
+            EXPECT_LT(errors.mean, 0.5f / 255.f);
+            EXPECT_LT(errors.p999, 12.f / 255.f);
+        }
+    }
+}
+
+TEST_F(LinearEffectLutTest, cacheRebuildsWhenParamsChange) {
+    const LinearEffect effect{.inputDataspace = ui::Dataspace::BT2020_ITU_PQ,
+                              .outputDataspace = ui::Dataspace::DISPLAY_P3};
+    shaders::LinearEffectLutCache cache;
+    const auto lut = cache.get(effect, kParams);
+    EXPECT_EQ(cache.get(effect, kParams), lut);
+
+    LinearEffectParams dimmer = kParams;
+    dimmer.maxDisplayLuminance = 500.f;
+    const auto dimmerLut = cache.get(effect, dimmer);
+    EXPECT_NE(dimmerLut, lut);
+    EXPECT_EQ(cache.get(effect, dimmer), dimmerLut);
+
+    cache.clear();
+    EXPECT_NE(cache.get(effect, dimmer), dimmerLut);
+}
+
+TEST_F(LinearEffectLutTest, cacheEvictsLeastRecentlyUsedLut) {
+    const LinearEffect pq{.inputDataspace = ui::Dataspace::BT2020_ITU_PQ,
+                          .outputDataspace = ui::Dataspace::DISPLAY_P3};
+    const LinearEffect hlg{.inputDataspace = ui::Dataspace::BT2020_ITU_HLG,
+                           .outputDataspace = ui::Dataspace::DISPLAY_P3};
+    const LinearEffect srgb{.inputDataspace = ui::Dataspace::V0_SRGB,
+                            .outputDataspace = ui::Dataspace::DISPLAY_P3};
+    shaders::LinearEffectLutCache cache(/*maxEntries*/ 2);
+    const auto pqLut = cache.get(pq, kParams);
+    const auto hlgLut = cache.get(hlg, kParams);
+    // Makes the HLG table the least recently used one.
+    EXPECT_EQ(cache.get(pq, kParams), pqLut);
+
+    cache.get(srgb, kParams);
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.get(pq, kParams), pqLut);
+    EXPECT_NE(cache.get(hlg, kParams), hlgLut);
+    EXPECT_EQ(cache.size(), 2u);
+}
+
+} // namespace android
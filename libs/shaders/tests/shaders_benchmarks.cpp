@@ -0,0 +1,55 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <math/mat4.h>
+#include <shaders/shaders.h>
+
+namespace android {
+namespace {
+
+const shaders::LinearEffect kEffect = {.inputDataspace = ui::Dataspace::BT2020_ITU_PQ,
+                                       .outputDataspace = ui::Dataspace::DISPLAY_P3,
+                                       .undoPremultipliedAlpha = true};
+
+void BM_BuildLinearEffectSkSL(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(shaders::buildLinearEffectSkSL(kEffect));
+    }
+}
+BENCHMARK(BM_BuildLinearEffectSkSL);
+
+// The metadata changes on every frame, like a video with dynamic HDR metadata.
+void BM_BuildLinearEffectUniforms(benchmark::State& state) {
+    float maxLuminance = 0.f;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+                shaders::buildLinearEffectUniforms(kEffect, mat4(), 1000.f, 500.f, maxLuminance++));
+    }
+}
+BENCHMARK(BM_BuildLinearEffectUniforms);
+
+void BM_WriteLinearEffectUniforms(benchmark::State& state) {
+    shaders::LinearEffectUniformWriter writer;
+    float maxLuminance = 0.f;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(writer.write(kEffect, mat4(), 1000.f, 500.f, maxLuminance++));
+    }
+}
+BENCHMARK(BM_WriteLinearEffectUniforms);
+
+} // namespace
+} // namespace android
@@ -20,7 +20,26 @@
 #include <math/mat4.h>
 #include <tonemap/tonemap.h>
 #include <ui/ColorSpace.h>
+#include <atomic>
 #include <cmath>
+#include <cstdlib>
+#include <new>
+
+// Counts the allocations of the test, see LinearEffectUniformWriter_doesNotAllocateOnceWritten.
+static std::atomic<size_t> gAllocationCount{0};
+
+void* operator new(size_t size) {
+    gAllocationCount++;
+    void* ptr = std::malloc(size);
+    if (ptr == nullptr) {
+        std::abort();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
 
 namespace android {
 
@@ -95,4 +114,39 @@ TEST_F(ShadersTest, buildLinearEffectUniforms_respectsFakeInputDataspace) {
     EXPECT_THAT(uniforms, Contains(UniformEq("in_xyzToRgb", buildUniformValue<mat4>(mat4()))));
 }
 
+TEST_F(ShadersTest, LinearEffectUniformWriter_matchesBuildLinearEffectUniforms) {
+    const shaders::LinearEffect effect =
+            shaders::LinearEffect{.inputDataspace = ui::Dataspace::BT2020_ITU_HLG,
+                                  .outputDataspace = ui::Dataspace::DISPLAY_P3};
+    shaders::LinearEffectUniformWriter writer;
+    for (const float maxLuminance : {500.f, 1000.f, 0.f}) {
+        const mat4 colorTransform = mat4::scale(vec4(maxLuminance / 1000.f, 1.f, 1.f, 1.f));
+        const auto expected =
+                shaders::buildLinearEffectUniforms(effect, colorTransform, 1000.f, 500.f,
+                                                   maxLuminance);
+        const auto& uniforms = writer.write(effect, colorTransform, 1000.f, 500.f, maxLuminance);
+        ASSERT_EQ(uniforms.size(), expected.size());
+        for (size_t i = 0; i < uniforms.size(); i++) {
+            EXPECT_EQ(uniforms[i].name, expected[i].name);
+            const uint8_t* value = writer.data() + uniforms[i].offset;
+            EXPECT_EQ(std::vector<uint8_t>(value, value + uniforms[i].size), expected[i].value)
+                    << uniforms[i].name;
+        }
+    }
+}
+
+TEST_F(ShadersTest, LinearEffectUniformWriter_doesNotAllocateOnceWritten) {
+    const shaders::LinearEffect effect =
+            shaders::LinearEffect{.inputDataspace = ui::Dataspace::BT2020_ITU_HLG,
+                                  .outputDataspace = ui::Dataspace::DISPLAY_P3};
+    shaders::LinearEffectUniformWriter writer;
+    writer.write(effect, mat4(), 1000.f, 500.f, 0.f);
+
+    const size_t allocationCount = gAllocationCount;
+    for (const float maxLuminance : {500.f, 1000.f, 0.f}) {
+        writer.write(effect, mat4(), 1000.f, 500.f, maxLuminance);
+    }
+    EXPECT_EQ(gAllocationCount, allocationCount);
+}
+
 } // namespace android
@@ -0,0 +1,311 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ToneMapCurve.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace android::tonemap {
+
+namespace {
+
+// Four single precision lanes, which maps onto both NEON and SSE registers. The arithmetic below
+// only uses the generic vector extensions supported by clang, so no intrinsics are needed.
+using float4 = float __attribute__((__vector_size__(16)));
+using int4 = int32_t __attribute__((__vector_size__(16)));
+constexpr size_t kLanes = 4;
+
+float4 splat(float value) {
+    return float4{value, value, value, value};
+}
+
+float4 select(int4 mask, float4 ifTrue, float4 ifFalse) {
+    return reinterpret_cast<float4>((mask & reinterpret_cast<int4>(ifTrue)) |
+                                    (~mask & reinterpret_cast<int4>(ifFalse)));
+}
+
+float4 min(float4 a, float4 b) {
+    return select(a < b, a, b);
+}
+
+float4 max(float4 a, float4 b) {
+    return select(a > b, a, b);
+}
+
+// log2(x) for x > 0. Splits x into its exponent and a mantissa in [sqrt(2) / 2, sqrt(2)], then
+// evaluates ln(m) = 2 * atanh((m - 1) / (m + 1)) with its series, which converges to within 1e-9
+// over that range.
+float4 log2(float4 x) {
+    // Denormals don't have an implicit leading one, flush them to the smallest normal float.
+    x = max(x, splat(std::numeric_limits<float>::min()));
+    const int4 bits = reinterpret_cast<int4>(x);
+    int4 exponent = ((bits >> 23) & 0xff) - 127;
+    float4 m = reinterpret_cast<float4>((bits & 0x007fffff) | 0x3f800000);
+    const int4 aboveSqrt2 = m > splat(1.41421356f);
+    m = select(aboveSqrt2, m * 0.5f, m);
+    exponent -= aboveSqrt2;
+
+    const float4 t = (m - 1.f) / (m + 1.f);
+    const float4 t2 = t * t;
+    float4 series = splat(2.f / 9.f);
+    series = series * t2 + 2.f / 7.f;
+    series = series * t2 + 2.f / 5.f;
+    series = series * t2 + 2.f / 3.f;
+    series = series * t2 + 2.f;
+    return __builtin_convertvector(exponent, float4) + t * series * 1.44269504f;
+}
+
+// 2^x. Splits x into an integer, applied directly to the exponent bits, and a fraction in
+// [-0.5, 0.5], evaluated with the Taylor series of e^(x * ln(2)) to within 1e-8.
+float4 exp2(float4 x) {
+    x = min(max(x, splat(-126.f)), splat(127.f));
+    // Rounds to the nearest integer, x + 128.5 is positive so truncating is flooring.
+    const int4 n = __builtin_convertvector(x + 128.5f, int4) - 128;
+    const float4 f = (x - __builtin_convertvector(n, float4)) * 0.69314718f;
+    float4 series = splat(1.f / 5040.f);
+    series = series * f + 1.f / 720.f;
+    series = series * f + 1.f / 120.f;
+    series = series * f + 1.f / 24.f;
+    series = series * f + 1.f / 6.f;
+    series = series * f + 1.f / 2.f;
+    series = series * f + 1.f;
+    series = series * f + 1.f;
+    return series * reinterpret_cast<float4>((n + 127) << 23);
+}
+
+// pow(x, y) for x > 0.
+float4 pow(float4 x, float y) {
+    return exp2(log2(x) * y);
+}
+
+float4 OETF_ST2084(float4 nits) {
+    constexpr float m1 = (2610.f / 4096.f) / 4.f;
+    constexpr float m2 = (2523.f / 4096.f) * 128.f;
+    constexpr float c1 = (3424.f / 4096.f);
+    constexpr float c2 = (2413.f / 4096.f) * 32.f;
+    constexpr float c3 = (2392.f / 4096.f) * 32.f;
+
+    float4 tmp = pow(nits / 10000.f, m1);
+    tmp = (c1 + c2 * tmp) / (1.f + c3 * tmp);
+    return pow(tmp, m2);
+}
+
+float4 applyShape(const CurveParams::Identity&, float4 nits) {
+    return nits;
+}
+
+bool none(int4 mask) {
+    return (mask[0] | mask[1] | mask[2] | mask[3]) == 0;
+}
+
+float4 applyShape(const CurveParams::PqToSdr& shape, float4 nits) {
+    // Most pixels are either below x1 or above x3, which skips encoding them to PQ.
+    if (none((nits >= shape.x1) & (nits <= shape.x3))) {
+        return select(nits < shape.x1, nits, splat(shape.y3));
+    }
+
+    const float4 greyNits = OETF_ST2084(nits);
+    float4 targetNits = select(greyNits <= shape.greyNorm2,
+                               (greyNits - shape.greyNorm2) * shape.slope2 + shape.y2,
+                               (greyNits - shape.greyNorm3) * shape.slope3 + shape.y3);
+    targetNits = select(greyNits <= shape.greyNorm3, targetNits, splat(shape.y3));
+    targetNits = select(nits > shape.x3, splat(shape.y3), targetNits);
+    return select(nits < shape.x1, nits, targetNits);
+}
+
+float4 applyShape(const CurveParams::Hermite& shape, float4 nits) {
+    const float h12 = shape.x2 - shape.x1;
+    const float h23 = shape.x3 - shape.x2;
+
+    const float4 linear0 = nits * (shape.y0 / shape.x0);
+    const float4 linear1 =
+            shape.y0 + (nits - shape.x0) * ((shape.y1 - shape.y0) / (shape.x1 - shape.x0));
+
+    float4 t = (nits - shape.x1) / h12;
+    const float4 hermite1 = (shape.y1 * (1.f + 2.f * t) + h12 * shape.m1 * t) * (1.f - t) *
+                    (1.f - t) +
+            (shape.y2 * (3.f - 2.f * t) + h12 * shape.m2 * (t - 1.f)) * t * t;
+
+    t = (nits - shape.x2) / h23;
+    const float4 hermite2 = (shape.y2 * (1.f + 2.f * t) + h23 * shape.m2 * t) * (1.f - t) *
+                    (1.f - t) +
+            (shape.y3 * (3.f - 2.f * t) + h23 * shape.m3 * (t - 1.f)) * t * t;
+
+    return select(nits < shape.x0, linear0,
+                  select(nits < shape.x1, linear1, select(nits < shape.x2, hermite1, hermite2)));
+}
+
+float4 applyShape(const CurveParams::Quadratic& shape, float4 nits) {
+    auto bezier = [](float4 t, float y0, float c, float y1) {
+        return (1.f - t) * (1.f - t) * y0 + 2.f * (1.f - t) * t * c + t * t * y1;
+    };
+
+    const float4 linear0 = nits * (shape.y0 / shape.x0);
+    const float4 curve1 =
+            bezier((nits - shape.x0) / (shape.x1 - shape.x0), shape.y0, shape.c1, shape.y1);
+    const float4 curve2 =
+            bezier((nits - shape.x1) / (shape.x2 - shape.x1), shape.y1, shape.c2, shape.y2);
+    const float4 curve3 =
+            bezier((nits - shape.x2) / (shape.x3 - shape.x2), shape.y2, shape.c3, shape.y3);
+
+    return select(nits <= shape.x0, linear0,
+                  select(nits <= shape.x1, curve1, select(nits <= shape.x2, curve2, curve3)));
+}
+
+// The table covers luminances from 2^-8 to 2^16 nits. Entries are spaced evenly in the float bit
+// representation, i.e. 2^kLutFractionBits entries per octave spaced linearly within the octave,
+// so the index and interpolation weight are read straight from the bits of the luminance. Entries
+// are less than 1/128 of an octave apart, so linearly interpolating over a change of slope of at
+// most 1 in log space, e.g. where the curve starts clipping, errs by less than 2e-3.
+constexpr int kLutMinExponent = -8;
+constexpr int kLutMaxExponent = 16;
+constexpr uint32_t kLutFractionBits = 7;
+constexpr uint32_t kLutIndexShift = 23 - kLutFractionBits;
+constexpr uint32_t kLutFractionMask = (1u << kLutIndexShift) - 1;
+constexpr float kLutFractionScale = 1.f / static_cast<float>(1u << kLutIndexShift);
+constexpr uint32_t kLutMinBits = static_cast<uint32_t>(127 + kLutMinExponent) << 23;
+constexpr uint32_t kLutMaxBits = static_cast<uint32_t>(127 + kLutMaxExponent) << 23;
+constexpr size_t kLutSize = ((kLutMaxBits - kLutMinBits) >> kLutIndexShift) + 1;
+
+template <typename Shape>
+class SimdToneMapCurve final : public ToneMapCurve {
+public:
+    SimdToneMapCurve(const CurveParams& params, const Shape& shape, Mode mode)
+          : mParams(params), mShape(shape) {
+        if (mode == Mode::Lut) {
+            buildLut();
+        }
+    }
+
+    void lookupTonemapGain(const Color* colors, size_t count, float* outGains) const override {
+        size_t i = 0;
+        for (; i + kLanes <= count; i += kLanes) {
+            lookupBatch(colors + i, outGains + i);
+        }
+        if (i < count) {
+            // Pads the last batch with copies of the last color.
+            Color tailColors[kLanes];
+            float tailGains[kLanes];
+            for (size_t lane = 0; lane < kLanes; lane++) {
+                tailColors[lane] = colors[std::min(i + lane, count - 1)];
+            }
+            lookupBatch(tailColors, tailGains);
+            std::copy_n(tailGains, count - i, outGains + i);
+        }
+    }
+
+private:
+    float luminance(const Color& color) const {
+        return mParams.luminance == CurveParams::Luminance::MaxRGB
+                ? std::max({color.linearRGB.r, color.linearRGB.g, color.linearRGB.b})
+                : color.xyz.y;
+    }
+
+    void lookupBatch(const Color* colors, float* outGains) const {
+        if (!mLut.empty() && lookupLut(colors, outGains)) {
+            return;
+        }
+        // Build the vector from scalars rather than lane by lane, so it stays in registers.
+        const float4 nits = {luminance(colors[0]), luminance(colors[1]), luminance(colors[2]),
+                             luminance(colors[3])};
+        const float4 gains = computeGains(nits);
+        std::memcpy(outGains, &gains, sizeof(gains));
+    }
+
+    float4 computeGains(float4 nits) const {
+        // Non positive luminances have a gain of 1, swap them for a positive value so the lanes
+        // don't go through log2(0).
+        const int4 positive = nits > 0.f;
+        const float4 inputNits = select(positive, nits, splat(1.f));
+
+        float4 targetNits = inputNits;
+        if (mParams.preExponent != 0.f) {
+            targetNits *= pow(targetNits, mParams.preExponent);
+        }
+        targetNits = applyShape(mShape, targetNits);
+        targetNits = min(targetNits, splat(mParams.postClampNits));
+        if (mParams.postExponent != 0.f) {
+            targetNits *= pow(targetNits / 1000.f, mParams.postExponent);
+        }
+        targetNits *= mParams.postScale;
+        return select(positive, targetNits / inputNits, splat(1.f));
+    }
+
+    void buildLut() {
+        mLut.resize(kLutSize);
+        for (size_t i = 0; i < kLutSize; i += kLanes) {
+            uint32_t bits[kLanes];
+            for (size_t lane = 0; lane < kLanes; lane++) {
+                bits[lane] = kLutMinBits +
+                        static_cast<uint32_t>(std::min(i + lane, kLutSize - 1) << kLutIndexShift);
+            }
+            float4 nits;
+            std::memcpy(&nits, bits, sizeof(nits));
+            float gains[kLanes];
+            const float4 gainsVector = computeGains(nits);
+            std::memcpy(gains, &gainsVector, sizeof(gains));
+            std::copy_n(gains, std::min(kLanes, kLutSize - i), mLut.begin() + i);
+        }
+    }
+
+    // Looks up the gains of kLanes colors in the table. Returns false when a luminance is out of
+    // the range of the table, in which case the gains are computed exactly instead.
+    bool lookupLut(const Color* colors, float* outGains) const {
+        for (size_t lane = 0; lane < kLanes; lane++) {
+            const float nits = luminance(colors[lane]);
+            if (nits <= 0.f) {
+                outGains[lane] = 1.f;
+                continue;
+            }
+            uint32_t bits;
+            std::memcpy(&bits, &nits, sizeof(bits));
+            // Also catches NaNs, whose bits are above kLutMaxBits.
+            if (bits < kLutMinBits || bits >= kLutMaxBits) {
+                return false;
+            }
+            const uint32_t offset = bits - kLutMinBits;
+            const size_t index = offset >> kLutIndexShift;
+            const float fraction =
+                    static_cast<float>(offset & kLutFractionMask) * kLutFractionScale;
+            outGains[lane] = mLut[index] + (mLut[index + 1] - mLut[index]) * fraction;
+        }
+        return true;
+    }
+
+    const CurveParams mParams;
+    const Shape mShape;
+    std::vector<float> mLut;
+};
+
+} // namespace
+
+std::unique_ptr<ToneMapCurve> createSimdToneMapCurve(const CurveParams& params,
+                                                     ToneMapCurve::Mode mode) {
+    // Instantiates the curve for its shape, so that no per color dispatch is left.
+    return std::visit(
+            [&](const auto& shape) -> std::unique_ptr<ToneMapCurve> {
+                using Shape = std::decay_t<decltype(shape)>;
+                return std::make_unique<SimdToneMapCurve<Shape>>(params, shape, mode);
+            },
+            params.shape);
+}
+
+} // namespace android::tonemap
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <tonemap/tonemap.h>
+
+#include <limits>
+#include <memory>
+#include <variant>
+
+namespace android::tonemap {
+
+// Parameters of a tonemapping curve, resolved by the ToneMapper implementations from the source
+// dataspace, destination dataspace and metadata. The target luminance of a color is computed in
+// three steps:
+//
+//   nits = luminance(color)
+//   nits *= pow(nits, preExponent)
+//   nits = shape(nits)
+//   nits = min(nits, postClampNits)
+//   nits *= pow(nits / 1000, postExponent) * postScale
+//
+// and the gain is the target luminance divided by the luminance of the color.
+struct CurveParams {
+    enum class Luminance {
+        // Largest of the linear RGB channels.
+        MaxRGB,
+        // Y channel of the XYZ color.
+        Y,
+    };
+
+    // Leaves the luminance unchanged.
+    struct Identity {};
+
+    // Piecewise curve of ToneMapper13 from PQ to SDR, linear in the PQ encoded luminance between
+    // x1, x2 and x3.
+    struct PqToSdr {
+        float x1;
+        float x3;
+        float y2;
+        float y3;
+        float greyNorm2;
+        float greyNorm3;
+        float slope2;
+        float slope3;
+    };
+
+    // Curve of ToneMapperO from HDR to SDR: linear up to x1, then Hermite interpolation through
+    // (x1, y1), (x2, y2) and (x3, y3) with tangents m1, m2 and m3.
+    struct Hermite {
+        float x0;
+        float y0;
+        float x1;
+        float y1;
+        float x2;
+        float y2;
+        float x3;
+        float y3;
+        float m1;
+        float m2;
+        float m3;
+    };
+
+    // Curve of ToneMapperO from SDR to HDR: linear up to x0, then quadratic Bezier curves through
+    // (xi, yi) with control points ci.
+    struct Quadratic {
+        float x0;
+        float y0;
+        float x1;
+        float y1;
+        float x2;
+        float y2;
+        float x3;
+        float y3;
+        float c1;
+        float c2;
+        float c3;
+    };
+
+    using Shape = std::variant<Identity, PqToSdr, Hermite, Quadratic>;
+
+    Luminance luminance = Luminance::MaxRGB;
+    float preExponent = 0.f;
+    Shape shape = Identity{};
+    float postClampNits = std::numeric_limits<float>::infinity();
+    float postExponent = 0.f;
+    float postScale = 1.f;
+};
+
+// Creates a curve evaluating params with SIMD arithmetic.
+std::unique_ptr<ToneMapCurve> createSimdToneMapCurve(const CurveParams& params,
+                                                     ToneMapCurve::Mode mode);
+
+} // namespace android::tonemap
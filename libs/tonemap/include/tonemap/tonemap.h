@@ -21,7 +21,10 @@
 #include <android/hardware_buffer.h>
 #include <math/vec3.h>
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace android::tonemap {
@@ -40,6 +43,16 @@ struct ShaderUniform {
     std::vector<uint8_t> value;
 };
 
+// Receives the shader uniforms of a ToneMapper one at a time, so that they can be stored without
+// building a ShaderUniform for each of them.
+class ShaderUniformSink {
+public:
+    virtual ~ShaderUniformSink() {}
+
+    // The value is only valid for the duration of the call.
+    virtual void setUniform(std::string_view name, const void* value, size_t size) = 0;
+};
+
 // Describes metadata which may be used for constructing the shader uniforms.
 // This metadata should not be used for manipulating the source code of the shader program directly,
 // as otherwise caching by other parts of the system using these shaders may break.
@@ -83,6 +96,30 @@ struct Color {
     vec3 xyz;
 };
 
+// Tonemapping curve resolved for one source dataspace, destination dataspace and metadata. All the
+// curve parameters are computed when the curve is created, so evaluating it only runs the
+// arithmetic of the curve itself, on several colors at a time.
+class ToneMapCurve {
+public:
+    enum class Mode {
+        // Evaluates the curve in single precision.
+        Exact,
+        // Interpolates a table sampled from the curve when it is created, which is faster than
+        // Exact. The gain stays within kLutMaxRelativeError of the Exact gain.
+        Lut,
+    };
+
+    // Upper bound of the relative difference between the gains computed in Lut and Exact mode,
+    // reached where the slope of a piecewise curve changes between two table entries.
+    static constexpr float kLutMaxRelativeError = 2e-3f;
+
+    virtual ~ToneMapCurve() {}
+
+    // Batch version of ToneMapper::lookupTonemapGain(). Writes the gain of each of the count
+    // colors into outGains, which must hold at least count elements.
+    virtual void lookupTonemapGain(const Color* colors, size_t count, float* outGains) const = 0;
+};
+
 class ToneMapper {
 public:
     virtual ~ToneMapper() {}
@@ -133,7 +170,11 @@ public:
     // shaders plugging in a tone-mapping shader returned by generateTonemapGainShaderSkSL() may
     // assume that there are predefined floats in_libtonemap_displayMaxLuminance and
     // in_libtonemap_inputMaxLuminance inside of the body of the tone-mapping shader.
-    virtual std::vector<ShaderUniform> generateShaderSkSLUniforms(const Metadata& metadata) = 0;
+    virtual std::vector<ShaderUniform> generateShaderSkSLUniforms(const Metadata& metadata);
+
+    // Same as generateShaderSkSLUniforms(), but hands the uniforms to sink instead of allocating a
+    // ShaderUniform for each of them.
+    virtual void writeShaderSkSLUniforms(const Metadata& metadata, ShaderUniformSink& sink) = 0;
 
     // CPU implementation of the tonemapping gain. This must match the GPU implementation returned
     // by generateTonemapGainShaderSKSL() above, with some epsilon difference to account for
@@ -148,6 +189,14 @@ public:
             aidl::android::hardware::graphics::common::Dataspace sourceDataspace,
             aidl::android::hardware::graphics::common::Dataspace destinationDataspace,
             const std::vector<Color>& colors, const Metadata& metadata) = 0;
+
+    // Resolves the curve applied by lookupTonemapGain() for the given source dataspace,
+    // destination dataspace and metadata, for computing the gain of many colors on the CPU. The
+    // gains match lookupTonemapGain() up to single precision rounding.
+    virtual std::unique_ptr<ToneMapCurve> createToneMapCurve(
+            aidl::android::hardware::graphics::common::Dataspace sourceDataspace,
+            aidl::android::hardware::graphics::common::Dataspace destinationDataspace,
+            const Metadata& metadata, ToneMapCurve::Mode mode) = 0;
 };
 
 // Retrieves a tonemapper instance.
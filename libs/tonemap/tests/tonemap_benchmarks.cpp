@@ -0,0 +1,95 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <tonemap/tonemap.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace android {
+namespace {
+
+using aidl::android::hardware::graphics::common::Dataspace;
+using tonemap::ToneMapCurve;
+
+constexpr size_t kNumColors = 1 << 14;
+
+const tonemap::Metadata kMetadata = {.displayMaxLuminance = 1000.f,
+                                     .contentMaxLuminance = 4000.f,
+                                     .currentDisplayLuminance = 1000.f};
+
+// Colors whose luminance is spread evenly in log space from 2^-10 to 2^14 nits.
+std::vector<tonemap::Color> generateColors() {
+    std::mt19937 rng(kNumColors);
+    std::uniform_real_distribution<float> log2Nits(-10.f, 14.f);
+    std::uniform_real_distribution<float> channel(0.f, 1.f);
+
+    std::vector<tonemap::Color> colors(kNumColors);
+    for (tonemap::Color& color : colors) {
+        const float nits = std::exp2(log2Nits(rng));
+        color = {.linearRGB = vec3(channel(rng), channel(rng), 1.f) * nits,
+                 .xyz = vec3(channel(rng), std::exp2(log2Nits(rng)), channel(rng))};
+    }
+    return colors;
+}
+
+Dataspace getSourceDataspace(const benchmark::State& state) {
+    return state.range(0) == 0 ? Dataspace::BT2020_ITU_PQ : Dataspace::BT2020_ITU_HLG;
+}
+
+void BM_LookupTonemapGainScalar(benchmark::State& state) {
+    const std::vector<tonemap::Color> colors = generateColors();
+    tonemap::ToneMapper* toneMapper = tonemap::getToneMapper();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(toneMapper->lookupTonemapGain(getSourceDataspace(state),
+                                                               Dataspace::DISPLAY_P3, colors,
+                                                               kMetadata));
+    }
+    state.SetItemsProcessed(state.iterations() * kNumColors);
+}
+
+void lookupTonemapGainBatch(benchmark::State& state, ToneMapCurve::Mode mode) {
+    const std::vector<tonemap::Color> colors = generateColors();
+    const auto curve = tonemap::getToneMapper()->createToneMapCurve(getSourceDataspace(state),
+                                                                    Dataspace::DISPLAY_P3,
+                                                                    kMetadata, mode);
+    std::vector<float> gains(colors.size());
+    for (auto _ : state) {
+        curve->lookupTonemapGain(colors.data(), colors.size(), gains.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * kNumColors);
+}
+
+void BM_LookupTonemapGainExact(benchmark::State& state) {
+    lookupTonemapGainBatch(state, ToneMapCurve::Mode::Exact);
+}
+
+void BM_LookupTonemapGainLut(benchmark::State& state) {
+    lookupTonemapGainBatch(state, ToneMapCurve::Mode::Lut);
+}
+
+// Argument 0 tone maps PQ content, 1 tone maps HLG content.
+BENCHMARK(BM_LookupTonemapGainScalar)->Arg(0)->Arg(1);
+BENCHMARK(BM_LookupTonemapGainExact)->Arg(0)->Arg(1);
+BENCHMARK(BM_LookupTonemapGainLut)->Arg(0)->Arg(1);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <tonemap/tonemap.h>
+
+#include <cmath>
+#include <random>
+
+namespace android {
+namespace {
+
+using aidl::android::hardware::graphics::common::Dataspace;
+using tonemap::ToneMapCurve;
+
+constexpr Dataspace kDataspaces[] = {Dataspace::BT2020_ITU_PQ, Dataspace::BT2020_ITU_HLG,
+                                     Dataspace::DISPLAY_P3};
+
+const tonemap::Metadata kMetadata[] = {
+        {.displayMaxLuminance = 500.f, .contentMaxLuminance = 1000.f,
+         .currentDisplayLuminance = 200.f},
+        {.displayMaxLuminance = 1000.f, .contentMaxLuminance = 4000.f,
+         .currentDisplayLuminance = 1000.f},
+        {.displayMaxLuminance = 2000.f, .contentMaxLuminance = 10000.f,
+         .currentDisplayLuminance = 1500.f},
+};
+
+// The batch gains are computed in single precision, the reference in double precision.
+constexpr double kMaxRelativeError = 1e-4;
+
+constexpr size_t kNumColors = 1 << 18;
+
+// Colors whose luminance is spread evenly in log space from 2^-10 to 2^14 nits, which covers
+// anything from SDR shadows up to PQ highlights, with some black colors mixed in.
+std::vector<tonemap::Color> generateColors(size_t count) {
+    std::mt19937 rng(count);
+    std::uniform_real_distribution<float> log2Nits(-10.f, 14.f);
+    std::uniform_real_distribution<float> channel(0.f, 1.f);
+    std::uniform_int_distribution<int> brightestChannel(0, 2);
+
+    std::vector<tonemap::Color> colors(count);
+    for (size_t i = 0; i < count; i++) {
+        if (i % 64 == 0) {
+            continue;
+        }
+        const float nits = std::exp2(log2Nits(rng));
+        vec3 rgb = vec3(channel(rng), channel(rng), channel(rng)) * nits;
+        rgb[brightestChannel(rng)] = nits;
+        colors[i] = {.linearRGB = rgb,
+                     .xyz = vec3(channel(rng), std::exp2(log2Nits(rng)), channel(rng))};
+    }
+    return colors;
+}
+
+std::vector<float> lookupBatch(const ToneMapCurve& curve,
+                               const std::vector<tonemap::Color>& colors) {
+    std::vector<float> gains(colors.size());
+    curve.lookupTonemapGain(colors.data(), colors.size(), gains.data());
+    return gains;
+}
+
+template <typename T>
+double maxRelativeError(const std::vector<T>& expected, const std::vector<float>& actual) {
+    double maxError = 0.0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        const double reference = static_cast<double>(expected[i]);
+        maxError = std::max(maxError, std::abs(actual[i] - reference) / reference);
+    }
+    return maxError;
+}
+
+struct ToneMapCurveTest : public ::testing::Test {
+    tonemap::ToneMapper* mToneMapper = tonemap::getToneMapper();
+    const std::vector<tonemap::Color> mColors = generateColors(kNumColors);
+};
+
+TEST_F(ToneMapCurveTest, exactMatchesLookupTonemapGain) {
+    for (const auto& metadata : kMetadata) {
+        for (const Dataspace source : kDataspaces) {
+            for (const Dataspace destination : kDataspaces) {
+                SCOPED_TRACE(testing::Message()
+                             << "source " << static_cast<int32_t>(source) << " destination "
+                             << static_cast<int32_t>(destination) << " display "
+                             << metadata.displayMaxLuminance);
+                const auto curve = mToneMapper->createToneMapCurve(source, destination, metadata,
+                                                                   ToneMapCurve::Mode::Exact);
+                const auto expected =
+                        mToneMapper->lookupTonemapGain(source, destination, mColors, metadata);
+                EXPECT_LE(maxRelativeError(expected, lookupBatch(*curve, mColors)),
+                          kMaxRelativeError);
+            }
+        }
+    }
+}
+
+TEST_F(ToneMapCurveTest, lutStaysWithinBound) {
+    for (const auto& metadata : kMetadata) {
+        for (const Dataspace source : kDataspaces) {
+            for (const Dataspace destination : kDataspaces) {
+                SCOPED_TRACE(testing::Message()
+                             << "source " << static_cast<int32_t>(source) << " destination "
+                             << static_cast<int32_t>(destination) << " display "
+                             << metadata.displayMaxLuminance);
+                const auto exact = mToneMapper->createToneMapCurve(source, destination, metadata,
+                                                                   ToneMapCurve::Mode::Exact);
+                const auto lut = mToneMapper->createToneMapCurve(source, destination, metadata,
+                                                                 ToneMapCurve::Mode::Lut);
+                EXPECT_LE(maxRelativeError(lookupBatch(*exact, mColors),
+                                           lookupBatch(*lut, mColors)),
+                          ToneMapCurve::kLutMaxRelativeError);
+            }
+        }
+    }
+}
+
+TEST_F(ToneMapCurveTest, handlesPartialBatches) {
+    const auto curve = mToneMapper->createToneMapCurve(Dataspace::BT2020_ITU_PQ,
+                                                       Dataspace::DISPLAY_P3, kMetadata[1],
+                                                       ToneMapCurve::Mode::Exact);
+    const std::vector<tonemap::Color> colors = {
+            {.linearRGB = vec3(0.f), .xyz = vec3(0.f)},
+            {.linearRGB = vec3(100.f), .xyz = vec3(100.f)},
+            {.linearRGB = vec3(1000.f, 10.f, 1.f), .xyz = vec3(500.f)},
+            {.linearRGB = vec3(5000.f), .xyz = vec3(5000.f)},
+            {.linearRGB = vec3(-1.f), .xyz = vec3(-1.f)},
+            {.linearRGB = vec3(0.f, 0.f, 4000.f), .xyz = vec3(400.f)},
+            {.linearRGB = vec3(650.f), .xyz = vec3(650.f)},
+    };
+    std::vector<float> gains(colors.size() + 1, -1.f);
+    curve->lookupTonemapGain(colors.data(), colors.size(), gains.data());
+
+    const auto expected = mToneMapper->lookupTonemapGain(Dataspace::BT2020_ITU_PQ,
+                                                         Dataspace::DISPLAY_P3, colors,
+                                                         kMetadata[1]);
+    for (size_t i = 0; i < colors.size(); i++) {
+        EXPECT_NEAR(gains[i], expected[i], expected[i] * kMaxRelativeError) << "color " << i;
+    }
+    EXPECT_EQ(gains[0], 1.f);
+    EXPECT_EQ(gains[4], 1.f);
+    // Only count gains are written.
+    EXPECT_EQ(gains.back(), -1.f);
+}
+
+} // namespace
+} // namespace android
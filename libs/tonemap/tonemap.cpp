@@ -21,6 +21,8 @@
 #include <mutex>
 #include <type_traits>
 
+#include "ToneMapCurve.h"
+
 namespace android::tonemap {
 
 namespace {
@@ -40,12 +42,8 @@ static const constexpr auto kTransferST2084 =
 static const constexpr auto kTransferHLG =
         static_cast<int32_t>(aidl::android::hardware::graphics::common::Dataspace::TRANSFER_HLG);
 
-template <typename T, std::enable_if_t<std::is_trivially_copyable<T>::value, bool> = true>
-std::vector<uint8_t> buildUniformValue(T value) {
-    std::vector<uint8_t> result;
-    result.resize(sizeof(value));
-    std::memcpy(result.data(), &value, sizeof(value));
-    return result;
+void setFloatUniform(ShaderUniformSink& sink, std::string_view name, float value) {
+    sink.setUniform(name, &value, sizeof(value));
 }
 
 // Refer to BT2100-2
@@ -273,16 +271,9 @@ public:
         return program;
     }
 
-    std::vector<ShaderUniform> generateShaderSkSLUniforms(const Metadata& metadata) override {
-        std::vector<ShaderUniform> uniforms;
-
-        uniforms.reserve(2);
-
-        uniforms.push_back({.name = "in_libtonemap_displayMaxLuminance",
-                            .value = buildUniformValue<float>(metadata.displayMaxLuminance)});
-        uniforms.push_back({.name = "in_libtonemap_inputMaxLuminance",
-                            .value = buildUniformValue<float>(metadata.contentMaxLuminance)});
-        return uniforms;
+    void writeShaderSkSLUniforms(const Metadata& metadata, ShaderUniformSink& sink) override {
+        setFloatUniform(sink, "in_libtonemap_displayMaxLuminance", metadata.displayMaxLuminance);
+        setFloatUniform(sink, "in_libtonemap_inputMaxLuminance", metadata.contentMaxLuminance);
     }
 
     std::vector<Gain> lookupTonemapGain(
@@ -432,6 +423,85 @@ public:
         }
         return gains;
     }
+
+    std::unique_ptr<ToneMapCurve> createToneMapCurve(
+            aidl::android::hardware::graphics::common::Dataspace sourceDataspace,
+            aidl::android::hardware::graphics::common::Dataspace destinationDataspace,
+            const Metadata& metadata, ToneMapCurve::Mode mode) override {
+        // Same curves as lookupTonemapGain()
+        CurveParams params;
+        params.luminance = CurveParams::Luminance::Y;
+
+        const int32_t sourceDataspaceInt = static_cast<int32_t>(sourceDataspace);
+        const int32_t destinationDataspaceInt = static_cast<int32_t>(destinationDataspace);
+        switch (sourceDataspaceInt & kTransferMask) {
+            case kTransferST2084:
+            case kTransferHLG:
+                switch (destinationDataspaceInt & kTransferMask) {
+                    case kTransferST2084:
+                        break;
+                    case kTransferHLG:
+                        params.postClampNits = 1000.f;
+                        params.postExponent = -0.2f / 1.2f;
+                        break;
+                    default:
+                        if ((sourceDataspaceInt & kTransferMask) == kTransferHLG) {
+                            params.preExponent = 0.2f;
+                        }
+                        if (metadata.contentMaxLuminance > metadata.displayMaxLuminance) {
+                            const float x1 = metadata.displayMaxLuminance * 0.75f;
+                            const float x2 = x1 + (metadata.contentMaxLuminance - x1) / 2.f;
+                            const float y2 = x1 + (metadata.displayMaxLuminance - x1) * 0.75f;
+                            const float m1 = (y2 - x1) / (x2 - x1);
+                            const float m3 = (metadata.displayMaxLuminance - y2) /
+                                    (metadata.contentMaxLuminance - x2);
+                            params.shape = CurveParams::Hermite{
+                                    .x0 = 10.f,
+                                    .y0 = 17.f,
+                                    .x1 = x1,
+                                    .y1 = x1,
+                                    .x2 = x2,
+                                    .y2 = y2,
+                                    .x3 = metadata.contentMaxLuminance,
+                                    .y3 = metadata.displayMaxLuminance,
+                                    .m1 = m1,
+                                    .m2 = (m1 + m3) / 2.f,
+                                    .m3 = m3,
+                            };
+                        }
+                        break;
+                }
+                break;
+            default:
+                switch (destinationDataspaceInt & kTransferMask) {
+                    case kTransferST2084:
+                    case kTransferHLG: {
+                        const float maxOutLumi = 3000.f;
+                        const float y1 = maxOutLumi * 0.15f;
+                        const float y2 = maxOutLumi * 0.45f;
+                        params.shape = CurveParams::Quadratic{
+                                .x0 = 5.f,
+                                .y0 = 2.5f,
+                                .x1 = metadata.displayMaxLuminance * 0.7f,
+                                .y1 = y1,
+                                .x2 = metadata.displayMaxLuminance * 0.9f,
+                                .y2 = y2,
+                                .x3 = metadata.displayMaxLuminance,
+                                .y3 = maxOutLumi,
+                                .c1 = y1 / 3.f,
+                                .c2 = y2 / 2.f,
+                                .c3 = maxOutLumi / 1.5f,
+                        };
+                        if ((destinationDataspaceInt & kTransferMask) == kTransferHLG) {
+                            params.postExponent = -0.2f / 1.2f;
+                        }
+                    } break;
+                    default:
+                        break;
+                }
+        }
+        return createSimdToneMapCurve(params, mode);
+    }
 };
 
 class ToneMapper13 : public ToneMapper {
@@ -611,19 +681,13 @@ public:
         return program;
     }
 
-    std::vector<ShaderUniform> generateShaderSkSLUniforms(const Metadata& metadata) override {
+    void writeShaderSkSLUniforms(const Metadata& metadata, ShaderUniformSink& sink) override {
         // Hardcode the max content luminance to a "reasonable" level
         static const constexpr float kContentMaxLuminance = 4000.f;
-        std::vector<ShaderUniform> uniforms;
-        uniforms.reserve(3);
-        uniforms.push_back({.name = "in_libtonemap_displayMaxLuminance",
-                            .value = buildUniformValue<float>(metadata.displayMaxLuminance)});
-        uniforms.push_back({.name = "in_libtonemap_inputMaxLuminance",
-                            .value = buildUniformValue<float>(kContentMaxLuminance)});
-        uniforms.push_back({.name = "in_libtonemap_hlgGamma",
-                            .value = buildUniformValue<float>(
-                                    computeHlgGamma(metadata.currentDisplayLuminance))});
-        return uniforms;
+        setFloatUniform(sink, "in_libtonemap_displayMaxLuminance", metadata.displayMaxLuminance);
+        setFloatUniform(sink, "in_libtonemap_inputMaxLuminance", kContentMaxLuminance);
+        setFloatUniform(sink, "in_libtonemap_hlgGamma",
+                        computeHlgGamma(metadata.currentDisplayLuminance));
     }
 
     std::vector<Gain> lookupTonemapGain(
@@ -726,10 +790,94 @@ public:
         }
         return gains;
     }
+
+    std::unique_ptr<ToneMapCurve> createToneMapCurve(
+            aidl::android::hardware::graphics::common::Dataspace sourceDataspace,
+            aidl::android::hardware::graphics::common::Dataspace destinationDataspace,
+            const Metadata& metadata, ToneMapCurve::Mode mode) override {
+        // Same curves as lookupTonemapGain(), the control points are computed in double precision
+        // before being narrowed.
+        CurveParams params;
+        params.luminance = CurveParams::Luminance::MaxRGB;
+
+        const double hlgGamma = computeHlgGamma(metadata.currentDisplayLuminance);
+
+        const int32_t sourceDataspaceInt = static_cast<int32_t>(sourceDataspace);
+        const int32_t destinationDataspaceInt = static_cast<int32_t>(destinationDataspace);
+        switch (sourceDataspaceInt & kTransferMask) {
+            case kTransferST2084:
+                switch (destinationDataspaceInt & kTransferMask) {
+                    case kTransferST2084:
+                        break;
+                    case kTransferHLG:
+                        params.postClampNits = 1000.f;
+                        params.postExponent = static_cast<float>((1 - hlgGamma) / hlgGamma);
+                        break;
+                    default: {
+                        constexpr double maxInLumi = 4000;
+                        const double maxOutLumi = metadata.displayMaxLuminance;
+
+                        const double x1 = maxOutLumi * 0.65;
+                        const double y1 = x1;
+
+                        const double x3 = maxInLumi;
+                        const double y3 = maxOutLumi;
+
+                        const double x2 = x1 + (x3 - x1) * 4.0 / 17.0;
+                        const double y2 = maxOutLumi * 0.9;
+
+                        const double greyNorm1 = OETF_ST2084(x1);
+                        const double greyNorm2 = OETF_ST2084(x2);
+                        const double greyNorm3 = OETF_ST2084(x3);
+
+                        params.shape = CurveParams::PqToSdr{
+                                .x1 = static_cast<float>(x1),
+                                .x3 = static_cast<float>(x3),
+                                .y2 = static_cast<float>(y2),
+                                .y3 = static_cast<float>(y3),
+                                .greyNorm2 = static_cast<float>(greyNorm2),
+                                .greyNorm3 = static_cast<float>(greyNorm3),
+                                .slope2 = static_cast<float>((y2 - y1) / (greyNorm2 - greyNorm1)),
+                                .slope3 = static_cast<float>((y3 - y2) / (greyNorm3 - greyNorm2)),
+                        };
+                    } break;
+                }
+                break;
+            case kTransferHLG:
+                switch (destinationDataspaceInt & kTransferMask) {
+                    case kTransferST2084:
+                        params.postExponent = static_cast<float>(hlgGamma - 1);
+                        break;
+                    case kTransferHLG:
+                        break;
+                    default:
+                        params.postExponent = static_cast<float>(hlgGamma - 1);
+                        params.postScale = metadata.displayMaxLuminance / 1000.f;
+                        break;
+                }
+                break;
+            default:
+                break;
+        }
+        return createSimdToneMapCurve(params, mode);
+    }
 };
 
 } // namespace
 
+std::vector<ShaderUniform> ToneMapper::generateShaderSkSLUniforms(const Metadata& metadata) {
+    struct VectorSink : public ShaderUniformSink {
+        void setUniform(std::string_view name, const void* value, size_t size) override {
+            const uint8_t* bytes = static_cast<const uint8_t*>(value);
+            uniforms.push_back({.name = std::string(name),
+                                .value = std::vector<uint8_t>(bytes, bytes + size)});
+        }
+        std::vector<ShaderUniform> uniforms;
+    } sink;
+    writeShaderSkSLUniforms(metadata, sink);
+    return sink.uniforms;
+}
+
 ToneMapper* getToneMapper() {
     static std::once_flag sOnce;
     static std::unique_ptr<ToneMapper> sToneMapper;
@@ -177,6 +177,7 @@ std::optional<compositionengine::LayerFE::LayerSettings> BufferLayer::prepareCli
     layer.source.buffer.buffer = mBufferInfo.mBuffer;
     layer.source.buffer.isOpaque = isOpaque(s);
     layer.source.buffer.fence = mBufferInfo.mFence;
+    layer.source.buffer.frameNumber = mCurrentFrameNumber;
     layer.source.buffer.textureName = mTextureName;
     layer.source.buffer.usePremultipliedAlpha = getPremultipledAlpha();
     layer.source.buffer.isY410BT2020 = isHdrY410();
@@ -18,10 +18,12 @@
 
 #include <cstdint>
 #include <deque>
+#include <optional>
 
 #include <compositionengine/LayerFE.h>
 #include <renderengine/DisplaySettings.h>
 #include <renderengine/LayerSettings.h>
+#include <ui/Region.h>
 
 namespace android {
 
@@ -37,12 +39,20 @@ namespace compositionengine::impl {
 // the composition request. We need to make sure the request, including the order of the
 // layers, do not change from call to call. The snapshot removes strong references to the
 // client buffer id so we don't extend the lifetime of the buffer by storing it in the cache.
+//
+// The cache also keeps the previous request, whichever buffer it was rendered into, to compute
+// the damage of each frame. See TiledDamageMap for how the damage accumulates per buffer.
 class ClientCompositionRequestCache {
 public:
     explicit ClientCompositionRequestCache(uint32_t cacheSize) : mMaxCacheSize(cacheSize){};
     ~ClientCompositionRequestCache() = default;
     bool exists(uint64_t bufferId, const renderengine::DisplaySettings& display,
                 const std::vector<LayerFE::LayerSettings>& layerSettings) const;
+    // Returns the region of the layer stack which differs between the request and the previous
+    // one, or nullopt if they differ everywhere. The request becomes the previous one.
+    std::optional<Region> getDamageSincePreviousRequest(
+            const renderengine::DisplaySettings& display,
+            const std::vector<LayerFE::LayerSettings>& layerSettings);
     void add(uint64_t bufferId, const renderengine::DisplaySettings& display,
              const std::vector<LayerFE::LayerSettings>& layerSettings);
     void remove(uint64_t bufferId);
@@ -56,8 +66,13 @@ private:
                                  const std::vector<LayerFE::LayerSettings>& _layerSettings);
         bool equals(const renderengine::DisplaySettings& _display,
                     const std::vector<LayerFE::LayerSettings>& _layerSettings) const;
+        std::optional<Region> getDamage(
+                const renderengine::DisplaySettings& _display,
+                const std::vector<LayerFE::LayerSettings>& _layerSettings) const;
     };
 
+    std::optional<ClientCompositionRequest> mPreviousRequest;
+
     // Cache of requests, keyed by corresponding GraphicBuffer ID.
     std::deque<std::pair<uint64_t /* bufferId */, ClientCompositionRequest>> mCache;
 };
@@ -24,6 +24,7 @@
 #include <compositionengine/impl/HwcAsyncWorker.h>
 #include <compositionengine/impl/OutputCompositionState.h>
 #include <compositionengine/impl/OutputLayerCompositionState.h>
+#include <compositionengine/impl/TiledDamageMap.h>
 #include <compositionengine/impl/planner/Planner.h>
 #include <renderengine/DisplaySettings.h>
 #include <renderengine/LayerSettings.h>
@@ -38,6 +39,19 @@ namespace android::compositionengine::impl {
 // actually contain the final output state.
 class Output : public virtual compositionengine::Output {
 public:
+    // Counts how the frames composed by the client were rendered, see composeSurfaces().
+    struct ClientCompositionStats {
+        // Frames for which the whole buffer was rendered.
+        uint64_t fullRedraws = 0;
+        // Frames for which only the tiles of the buffer damaged since it was last rendered were
+        // rendered.
+        uint64_t partialRedraws = 0;
+        // Frames for which the buffer was reused as is.
+        uint64_t reuses = 0;
+        // Pixels of the buffers not rendered by partial redraws and reuses.
+        uint64_t pixelsSkipped = 0;
+    };
+
     Output() = default;
     ~Output() override;
 
@@ -115,6 +129,9 @@ public:
     void setDisplayColorProfileForTest(std::unique_ptr<compositionengine::DisplayColorProfile>);
     void setRenderSurfaceForTest(std::unique_ptr<compositionengine::RenderSurface>);
     bool plannerEnabled() const { return mPlanner != nullptr; }
+    const ClientCompositionStats& getClientCompositionStatsForTest() const {
+        return mClientCompositionStats;
+    }
     virtual bool anyLayersRequireClientComposition() const;
     virtual void updateProtectedContentState();
     virtual bool dequeueRenderBuffer(base::unique_fd*,
@@ -170,6 +187,9 @@ private:
     ReleasedLayers mReleasedLayers;
     OutputLayer* mLayerRequestingBackgroundBlur = nullptr;
     std::unique_ptr<ClientCompositionRequestCache> mClientCompositionRequestCache;
+    // Tracks the damage of the buffers the client composition requests are cached for.
+    std::unique_ptr<TiledDamageMap> mTiledDamageMap;
+    ClientCompositionStats mClientCompositionStats;
     std::unique_ptr<planner::Planner> mPlanner;
     std::unique_ptr<HwcAsyncWorker> mHwComposerAsyncWorker;
 
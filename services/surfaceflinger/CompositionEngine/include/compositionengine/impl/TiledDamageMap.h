@@ -0,0 +1,74 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+namespace android::compositionengine::impl {
+
+// Tracks which parts of the buffers an output renders into are out of date, so that only those
+// parts are rendered again.
+//
+// The area rendered into is split into fixed size tiles, each holding the generation of the last
+// frame which damaged it. Each buffer holds the generation of the last frame rendered into it, so
+// the tiles a buffer must render again are the ones damaged by a later generation. This accounts
+// for the age of the buffers, whichever order they are rendered into.
+class TiledDamageMap {
+public:
+    static constexpr int32_t kTileSize = 64;
+
+    // At most maxBuffers buffers are tracked, least recently rendered first out.
+    explicit TiledDamageMap(size_t maxBuffers) : mMaxBuffers(maxBuffers) {}
+
+    // Sets the area rendered into. Buffers are no longer up to date if the area changes.
+    void setBounds(const Rect& bounds);
+    const Rect& getBounds() const { return mBounds; }
+
+    // Starts a frame, damaging the tiles intersecting the damage, or all of them if nullopt.
+    void addFrame(const std::optional<Region>& damage);
+
+    // Returns the union of the tiles the buffer must render again for the frame, clipped to the
+    // bounds, or nullopt if the whole buffer must be rendered again.
+    std::optional<Region> getDamage(uint64_t bufferId) const;
+
+    // Marks the buffer as up to date with the frame.
+    void onBufferRendered(uint64_t bufferId);
+    // Marks the buffer as out of date, e.g. if rendering into it failed.
+    void forget(uint64_t bufferId);
+
+private:
+    Rect getTile(size_t index) const;
+
+    const size_t mMaxBuffers;
+    Rect mBounds = Rect::EMPTY_RECT;
+    int32_t mColumns = 0;
+    int32_t mRows = 0;
+    // Generation of the last frame which damaged each tile, row by row.
+    std::vector<uint64_t> mTileGenerations;
+    uint64_t mGeneration = 0;
+    // Generation of the last frame rendered into each buffer, least recently rendered first.
+    std::deque<std::pair<uint64_t /* bufferId */, uint64_t /* generation */>> mBuffers;
+};
+
+} // namespace android::compositionengine::impl
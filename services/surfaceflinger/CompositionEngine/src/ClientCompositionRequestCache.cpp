@@ -15,6 +15,8 @@
  */
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include <compositionengine/impl/ClientCompositionRequestCache.h>
 #include <renderengine/DisplaySettings.h>
@@ -66,6 +68,45 @@ bool layerSettingsAreEqual(const LayerFE::LayerSettings& lhs, const LayerFE::Lay
             equalIgnoringBuffer(lhs, rhs);
 }
 
+// Whether what the layer draws depends on what is drawn below it outside of its bounds.
+bool hasBlur(const renderengine::LayerSettings& settings) {
+    return settings.backgroundBlurRadius > 0 || !settings.blurRegions.empty();
+}
+
+// Whether the layer draws outside of its bounds.
+bool drawsOutsideBounds(const renderengine::LayerSettings& settings) {
+    return settings.shadow.length > 0.f || settings.stretchEffect.hasEffect();
+}
+
+// Returns the bounds of the layer in layer stack space.
+FloatRect getBounds(const renderengine::LayerSettings& settings) {
+    // Pads the bounds so that they cover the pixels blended by antialiasing along the edges.
+    constexpr float kAntialiasingPadding = 2.f;
+
+    const FloatRect& bounds = settings.geometry.boundaries;
+    const mat4& transform = settings.geometry.positionTransform;
+    FloatRect result(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                     std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    for (const vec2& corner : {vec2(bounds.left, bounds.top), vec2(bounds.right, bounds.top),
+                               vec2(bounds.left, bounds.bottom),
+                               vec2(bounds.right, bounds.bottom)}) {
+        const vec4 point = transform * vec4(corner, 0.f, 1.f);
+        result.left = std::min(result.left, point.x);
+        result.top = std::min(result.top, point.y);
+        result.right = std::max(result.right, point.x);
+        result.bottom = std::max(result.bottom, point.y);
+    }
+    return FloatRect(result.left - kAntialiasingPadding, result.top - kAntialiasingPadding,
+                     result.right + kAntialiasingPadding, result.bottom + kAntialiasingPadding);
+}
+
+Rect roundOut(const FloatRect& rect) {
+    return Rect(static_cast<int32_t>(std::floor(rect.left)),
+                static_cast<int32_t>(std::floor(rect.top)),
+                static_cast<int32_t>(std::ceil(rect.right)),
+                static_cast<int32_t>(std::ceil(rect.bottom)));
+}
+
 } // namespace
 
 ClientCompositionRequestCache::ClientCompositionRequest::ClientCompositionRequest(
@@ -86,6 +127,51 @@ bool ClientCompositionRequestCache::ClientCompositionRequest::equals(
                        newLayerSettings.end(), layerSettingsAreEqual);
 }
 
+std::optional<Region> ClientCompositionRequestCache::ClientCompositionRequest::getDamage(
+        const renderengine::DisplaySettings& newDisplay,
+        const std::vector<LayerFE::LayerSettings>& newLayerSettings) const {
+    // Layers are matched by position, so a layer added or removed damages the whole buffer.
+    if (!(newDisplay == display) || newLayerSettings.size() != layerSettings.size()) {
+        return std::nullopt;
+    }
+
+    Region damage;
+    for (size_t i = 0; i < layerSettings.size(); i++) {
+        const LayerFE::LayerSettings& oldLayer = layerSettings[i];
+        const LayerFE::LayerSettings& newLayer = newLayerSettings[i];
+        if (hasBlur(oldLayer) || hasBlur(newLayer)) {
+            return std::nullopt;
+        }
+        if (layerSettingsAreEqual(oldLayer, newLayer)) {
+            continue;
+        }
+        if (drawsOutsideBounds(oldLayer) || drawsOutsideBounds(newLayer)) {
+            return std::nullopt;
+        }
+        // Damage outside of the clip is rendered again with the whole buffer, rather than trusting
+        // that it's invisible.
+        for (const LayerFE::LayerSettings* layer : {&oldLayer, &newLayer}) {
+            Rect bounds;
+            if (!roundOut(getBounds(*layer)).intersect(display.clip, &bounds)) {
+                return std::nullopt;
+            }
+            damage.orSelf(bounds);
+        }
+    }
+    return damage;
+}
+
+std::optional<Region> ClientCompositionRequestCache::getDamageSincePreviousRequest(
+        const renderengine::DisplaySettings& display,
+        const std::vector<LayerFE::LayerSettings>& layerSettings) {
+    std::optional<Region> damage;
+    if (mPreviousRequest) {
+        damage = mPreviousRequest->getDamage(display, layerSettings);
+    }
+    mPreviousRequest.emplace(display, layerSettings);
+    return damage;
+}
+
 bool ClientCompositionRequestCache::exists(
         uint64_t bufferId, const renderengine::DisplaySettings& display,
         const std::vector<LayerFE::LayerSettings>& layerSettings) const {
@@ -31,6 +31,7 @@
 #include <compositionengine/impl/planner/Planner.h>
 #include <ftl/future.h>
 
+#include <cinttypes>
 #include <thread>
 
 #include "renderengine/ExternalTexture.h"
@@ -319,6 +320,15 @@ void Output::dumpBase(std::string& out) const {
         out.append("    No render surface!\n");
     }
 
+    if (mClientCompositionRequestCache) {
+        base::StringAppendF(&out,
+                            "\n   Client composition: %" PRIu64 " full redraws, %" PRIu64
+                            " partial redraws, %" PRIu64 " reuses, %" PRIu64 " pixels skipped\n",
+                            mClientCompositionStats.fullRedraws,
+                            mClientCompositionStats.partialRedraws,
+                            mClientCompositionStats.reuses, mClientCompositionStats.pixelsSkipped);
+    }
+
     base::StringAppendF(&out, "\n   %zu Layers\n", getOutputLayerCount());
     for (const auto* outputLayer : getOutputLayersOrderedByZ()) {
         if (!outputLayer) {
@@ -371,8 +381,10 @@ void Output::setRenderSurface(std::unique_ptr<compositionengine::RenderSurface>
 void Output::cacheClientCompositionRequests(uint32_t cacheSize) {
     if (cacheSize == 0) {
         mClientCompositionRequestCache.reset();
+        mTiledDamageMap.reset();
     } else {
         mClientCompositionRequestCache = std::make_unique<ClientCompositionRequestCache>(cacheSize);
+        mTiledDamageMap = std::make_unique<TiledDamageMap>(cacheSize);
     }
 };
 
@@ -1248,21 +1260,52 @@ std::optional<base::unique_fd> Output::composeSurfaces(
     appendRegionFlashRequests(debugRegion, clientCompositionLayers);
 
     OutputCompositionState& outputCompositionState = editState();
+    const Rect framebuffer = outputState.framebufferSpace.getContent();
+    const uint64_t framebufferArea = static_cast<uint64_t>(framebuffer.getWidth()) *
+            static_cast<uint64_t>(framebuffer.getHeight());
+    const uint64_t bufferId = tex->getBuffer()->getId();
     // Check if the client composition requests were rendered into the provided graphic buffer. If
-    // so, we can reuse the buffer and avoid client composition.
+    // so, we can reuse the buffer and avoid client composition. Otherwise, only the tiles of the
+    // buffer damaged since it was last rendered are rendered again, if RenderEngine supports it.
+    std::optional<Region> bufferDamage;
     if (mClientCompositionRequestCache) {
-        if (mClientCompositionRequestCache->exists(tex->getBuffer()->getId(),
-                                                   clientCompositionDisplay,
+        std::optional<Region> damage =
+                mClientCompositionRequestCache->getDamageSincePreviousRequest(
+                        clientCompositionDisplay, clientCompositionLayers);
+        if (damage) {
+            damage = outputState.transform.transform(*damage);
+        }
+        mTiledDamageMap->setBounds(framebuffer);
+        mTiledDamageMap->addFrame(damage);
+
+        if (mClientCompositionRequestCache->exists(bufferId, clientCompositionDisplay,
                                                    clientCompositionLayers)) {
             ATRACE_NAME("ClientCompositionCacheHit");
             outputCompositionState.reusedClientComposition = true;
+            mTiledDamageMap->onBufferRendered(bufferId);
+            mClientCompositionStats.reuses++;
+            mClientCompositionStats.pixelsSkipped += framebufferArea;
             setExpensiveRenderingExpected(false);
             // b/239944175 pass the fence associated with the buffer.
             return base::unique_fd(std::move(fd));
         }
         ATRACE_NAME("ClientCompositionCacheMiss");
-        mClientCompositionRequestCache->add(tex->getBuffer()->getId(), clientCompositionDisplay,
+        mClientCompositionRequestCache->add(bufferId, clientCompositionDisplay,
                                             clientCompositionLayers);
+        bufferDamage = mTiledDamageMap->getDamage(bufferId);
+    }
+
+    uint64_t redrawnArea = framebufferArea;
+    if (bufferDamage && !bufferDamage->isEmpty() &&
+        !Region(framebuffer).subtract(*bufferDamage).isEmpty() &&
+        renderEngine.supportsPartialRedraw()) {
+        ATRACE_NAME("ClientCompositionPartialRedraw");
+        clientCompositionDisplay.damage = *bufferDamage;
+        redrawnArea = 0;
+        for (const Rect& rect : *bufferDamage) {
+            redrawnArea += static_cast<uint64_t>(rect.getWidth()) *
+                    static_cast<uint64_t>(rect.getHeight());
+        }
     }
 
     // We boost GPU frequency here because there will be color spaces conversion
@@ -1305,9 +1348,23 @@ std::optional<base::unique_fd> Output::composeSurfaces(
                                               tex, useFramebufferCache, std::move(fd))
                                   .get());
 
-    if (mClientCompositionRequestCache && fenceStatus(fenceResult) != NO_ERROR) {
-        // If rendering was not successful, remove the request from the cache.
-        mClientCompositionRequestCache->remove(tex->getBuffer()->getId());
+    const bool rendered = fenceStatus(fenceResult) == NO_ERROR;
+    if (mClientCompositionRequestCache) {
+        if (!rendered) {
+            // If rendering was not successful, remove the request from the cache.
+            mClientCompositionRequestCache->remove(bufferId);
+            mTiledDamageMap->forget(bufferId);
+        } else {
+            mTiledDamageMap->onBufferRendered(bufferId);
+        }
+    }
+
+    // Frames which failed to render are not counted, as the buffer content is unknown.
+    if (rendered && redrawnArea < framebufferArea) {
+        mClientCompositionStats.partialRedraws++;
+        mClientCompositionStats.pixelsSkipped += framebufferArea - redrawnArea;
+    } else if (rendered) {
+        mClientCompositionStats.fullRedraws++;
     }
 
     const auto fence = std::move(fenceResult).value_or(Fence::NO_FENCE);
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include <compositionengine/impl/TiledDamageMap.h>
+
+namespace android::compositionengine::impl {
+
+void TiledDamageMap::setBounds(const Rect& bounds) {
+    if (bounds == mBounds) {
+        return;
+    }
+    mBounds = bounds;
+    mColumns = (bounds.getWidth() + kTileSize - 1) / kTileSize;
+    mRows = (bounds.getHeight() + kTileSize - 1) / kTileSize;
+    mTileGenerations.assign(static_cast<size_t>(std::max(mColumns * mRows, 0)), mGeneration);
+    mBuffers.clear();
+}
+
+void TiledDamageMap::addFrame(const std::optional<Region>& damage) {
+    mGeneration++;
+    if (!damage) {
+        std::fill(mTileGenerations.begin(), mTileGenerations.end(), mGeneration);
+        return;
+    }
+
+    for (const Rect& rect : *damage) {
+        Rect clipped;
+        if (!rect.intersect(mBounds, &clipped)) {
+            continue;
+        }
+        const int32_t firstColumn = (clipped.left - mBounds.left) / kTileSize;
+        const int32_t lastColumn = (clipped.right - 1 - mBounds.left) / kTileSize;
+        const int32_t firstRow = (clipped.top - mBounds.top) / kTileSize;
+        const int32_t lastRow = (clipped.bottom - 1 - mBounds.top) / kTileSize;
+        for (int32_t row = firstRow; row <= lastRow; row++) {
+            for (int32_t column = firstColumn; column <= lastColumn; column++) {
+                mTileGenerations[static_cast<size_t>(row * mColumns + column)] = mGeneration;
+            }
+        }
+    }
+}
+
+std::optional<Region> TiledDamageMap::getDamage(uint64_t bufferId) const {
+    const auto it = std::find_if(mBuffers.begin(), mBuffers.end(),
+                                 [bufferId](const auto& buffer) {
+                                     return buffer.first == bufferId;
+                                 });
+    if (it == mBuffers.end()) {
+        return std::nullopt;
+    }
+
+    Region damage;
+    for (size_t i = 0; i < mTileGenerations.size(); i++) {
+        if (mTileGenerations[i] > it->second) {
+            damage.orSelf(getTile(i));
+        }
+    }
+    return damage;
+}
+
+void TiledDamageMap::onBufferRendered(uint64_t bufferId) {
+    forget(bufferId);
+    if (mBuffers.size() >= mMaxBuffers) {
+        mBuffers.pop_front();
+    }
+    mBuffers.emplace_back(bufferId, mGeneration);
+}
+
+void TiledDamageMap::forget(uint64_t bufferId) {
+    mBuffers.erase(std::remove_if(mBuffers.begin(), mBuffers.end(),
+                                  [bufferId](const auto& buffer) {
+                                      return buffer.first == bufferId;
+                                  }),
+                   mBuffers.end());
+}
+
+Rect TiledDamageMap::getTile(size_t index) const {
+    const int32_t row = static_cast<int32_t>(index) / mColumns;
+    const int32_t column = static_cast<int32_t>(index) % mColumns;
+    const int32_t left = mBounds.left + column * kTileSize;
+    const int32_t top = mBounds.top + row * kTileSize;
+    return Rect(left, top, std::min(left + kTileSize, mBounds.right),
+                std::min(top + kTileSize, mBounds.bottom));
+}
+
+} // namespace android::compositionengine::impl
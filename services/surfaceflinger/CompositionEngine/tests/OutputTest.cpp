@@ -51,6 +51,7 @@ using testing::DoAll;
 using testing::ElementsAre;
 using testing::ElementsAreArray;
 using testing::Eq;
+using testing::Field;
 using testing::InSequence;
 using testing::Invoke;
 using testing::IsEmpty;
@@ -3393,6 +3394,7 @@ struct OutputComposeSurfacesTest : public testing::Test {
                 .WillRepeatedly(ReturnRef(*mTimeStats.get()));
         EXPECT_CALL(*mDisplayColorProfile, getHdrCapabilities())
                 .WillRepeatedly(ReturnRef(kHdrCapabilities));
+        EXPECT_CALL(mRenderEngine, supportsPartialRedraw()).WillRepeatedly(Return(true));
     }
 
     struct ExecuteState : public CallOrderStateMachineHelper<TestType, ExecuteState> {
@@ -3743,6 +3745,186 @@ TEST_F(OutputComposeSurfacesTest, clientCompositionIfRequestChanges) {
     EXPECT_FALSE(mOutput.mState.reusedClientComposition);
 }
 
+TEST_F(OutputComposeSurfacesTest, clientCompositionOfDamageIfSomeLayersChange) {
+    const Rect kBounds(0, 0, 100, 100);
+    mOutput.mState.layerStackSpace.setContent(kBounds);
+    mOutput.mState.framebufferSpace.setContent(kBounds);
+    LayerFE::LayerSettings r1;
+    LayerFE::LayerSettings r2;
+    LayerFE::LayerSettings r3;
+
+    r1.geometry.boundaries = FloatRect{10, 10, 20, 20};
+    r2.geometry.boundaries = FloatRect{50, 50, 60, 60};
+    r3.geometry.boundaries = FloatRect{50, 50, 60, 70};
+
+    EXPECT_CALL(mOutput, getSkipColorTransform()).WillRepeatedly(Return(false));
+    EXPECT_CALL(*mDisplayColorProfile, hasWideColorGamut()).WillRepeatedly(Return(true));
+    EXPECT_CALL(mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mRenderEngine, isProtected()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mOutput, generateClientCompositionRequests(_, kDefaultOutputDataspace, _))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r1, r2}))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r1, r3}));
+    EXPECT_CALL(mOutput, appendRegionFlashRequests(RegionEq(kDebugRegion), _))
+            .WillRepeatedly(Return());
+
+    EXPECT_CALL(*mRenderSurface, dequeueBuffer(_)).WillRepeatedly(Return(mOutputBuffer));
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damage, RegionEq(Region())),
+                           ElementsAre(r1, r2), _, false, _))
+            .WillOnce(Return(ByMove(
+                    futureOf<renderengine::RenderEngineResult>({NO_ERROR, base::unique_fd()}))));
+    // The tiles covering the old and new bounds of the layer which changed, padded for
+    // antialiasing to (48, 48, 62, 72).
+    const Region damage(Rect(0, 0, impl::TiledDamageMap::kTileSize, 100));
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damage, RegionEq(damage)),
+                           ElementsAre(r1, r3), _, false, _))
+            .WillOnce(Return(ByMove(
+                    futureOf<renderengine::RenderEngineResult>({NO_ERROR, base::unique_fd()}))));
+
+    verify().execute().expectAFenceWasReturned();
+    EXPECT_FALSE(mOutput.mState.reusedClientComposition);
+
+    verify().execute().expectAFenceWasReturned();
+    EXPECT_FALSE(mOutput.mState.reusedClientComposition);
+
+    const auto& stats = mOutput.getClientCompositionStatsForTest();
+    EXPECT_EQ(1u, stats.fullRedraws);
+    EXPECT_EQ(1u, stats.partialRedraws);
+    EXPECT_EQ(0u, stats.reuses);
+    EXPECT_EQ(100u * 100u - 64u * 100u, stats.pixelsSkipped);
+}
+
+TEST_F(OutputComposeSurfacesTest, failedClientCompositionIsNotCounted) {
+    const Rect kBounds(0, 0, 100, 100);
+    mOutput.mState.layerStackSpace.setContent(kBounds);
+    mOutput.mState.framebufferSpace.setContent(kBounds);
+    LayerFE::LayerSettings r1;
+    LayerFE::LayerSettings r2;
+    LayerFE::LayerSettings r3;
+
+    r1.geometry.boundaries = FloatRect{10, 10, 20, 20};
+    r2.geometry.boundaries = FloatRect{50, 50, 60, 60};
+    r3.geometry.boundaries = FloatRect{50, 50, 60, 70};
+
+    EXPECT_CALL(mOutput, getSkipColorTransform()).WillRepeatedly(Return(false));
+    EXPECT_CALL(*mDisplayColorProfile, hasWideColorGamut()).WillRepeatedly(Return(true));
+    EXPECT_CALL(mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mRenderEngine, isProtected()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mOutput, generateClientCompositionRequests(_, kDefaultOutputDataspace, _))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r1, r2}))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r1, r3}));
+    EXPECT_CALL(mOutput, appendRegionFlashRequests(RegionEq(kDebugRegion), _))
+            .WillRepeatedly(Return());
+
+    EXPECT_CALL(*mRenderSurface, dequeueBuffer(_)).WillRepeatedly(Return(mOutputBuffer));
+    EXPECT_CALL(mRenderEngine, drawLayers(_, ElementsAre(r1, r2), _, false, _))
+            .WillOnce(Return(ByMove(
+                    futureOf<renderengine::RenderEngineResult>({NO_ERROR, base::unique_fd()}))));
+    EXPECT_CALL(mRenderEngine, drawLayers(_, ElementsAre(r1, r3), _, false, _))
+            .WillOnce(Return(ByMove(
+                    futureOf<renderengine::RenderEngineResult>({BAD_VALUE, base::unique_fd()}))));
+
+    verify().execute().expectAFenceWasReturned();
+    verify().execute().expectAFenceWasReturned();
+
+    const auto& stats = mOutput.getClientCompositionStatsForTest();
+    EXPECT_EQ(1u, stats.fullRedraws);
+    EXPECT_EQ(0u, stats.partialRedraws);
+    EXPECT_EQ(0u, stats.pixelsSkipped);
+}
+
+TEST_F(OutputComposeSurfacesTest, clientCompositionOfEverythingIfPartialRedrawIsNotSupported) {
+    const Rect kBounds(0, 0, 100, 100);
+    mOutput.mState.layerStackSpace.setContent(kBounds);
+    mOutput.mState.framebufferSpace.setContent(kBounds);
+    LayerFE::LayerSettings r1;
+    LayerFE::LayerSettings r2;
+    LayerFE::LayerSettings r3;
+
+    r1.geometry.boundaries = FloatRect{10, 10, 20, 20};
+    r2.geometry.boundaries = FloatRect{50, 50, 60, 60};
+    r3.geometry.boundaries = FloatRect{50, 50, 60, 70};
+
+    EXPECT_CALL(mOutput, getSkipColorTransform()).WillRepeatedly(Return(false));
+    EXPECT_CALL(*mDisplayColorProfile, hasWideColorGamut()).WillRepeatedly(Return(true));
+    EXPECT_CALL(mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mRenderEngine, supportsPartialRedraw()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mRenderEngine, isProtected()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mOutput, generateClientCompositionRequests(_, kDefaultOutputDataspace, _))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r1, r2}))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r1, r3}));
+    EXPECT_CALL(mOutput, appendRegionFlashRequests(RegionEq(kDebugRegion), _))
+            .WillRepeatedly(Return());
+
+    EXPECT_CALL(*mRenderSurface, dequeueBuffer(_)).WillRepeatedly(Return(mOutputBuffer));
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damage, RegionEq(Region())), _,
+                           _, false, _))
+            .Times(2)
+            .WillRepeatedly([&](const renderengine::DisplaySettings&,
+                                const std::vector<renderengine::LayerSettings>&,
+                                const std::shared_ptr<renderengine::ExternalTexture>&, const bool,
+                                base::unique_fd&&)
+                                    -> std::future<renderengine::RenderEngineResult> {
+                return futureOf<renderengine::RenderEngineResult>({NO_ERROR, base::unique_fd()});
+            });
+
+    verify().execute().expectAFenceWasReturned();
+    verify().execute().expectAFenceWasReturned();
+
+    const auto& stats = mOutput.getClientCompositionStatsForTest();
+    EXPECT_EQ(2u, stats.fullRedraws);
+    EXPECT_EQ(0u, stats.partialRedraws);
+    EXPECT_EQ(0u, stats.pixelsSkipped);
+}
+
+TEST_F(OutputComposeSurfacesTest, clientCompositionOfEverythingIfLayerIsBlurred) {
+    const Rect kBounds(0, 0, 100, 100);
+    mOutput.mState.layerStackSpace.setContent(kBounds);
+    mOutput.mState.framebufferSpace.setContent(kBounds);
+    LayerFE::LayerSettings r1;
+    LayerFE::LayerSettings r2;
+    LayerFE::LayerSettings r3;
+
+    // The blur of the first layer samples the layers below it, wherever they are.
+    r1.geometry.boundaries = FloatRect{10, 10, 20, 20};
+    r1.backgroundBlurRadius = 5;
+    r2.geometry.boundaries = FloatRect{50, 50, 60, 60};
+    r3.geometry.boundaries = FloatRect{50, 50, 60, 70};
+
+    EXPECT_CALL(mOutput, getSkipColorTransform()).WillRepeatedly(Return(false));
+    EXPECT_CALL(*mDisplayColorProfile, hasWideColorGamut()).WillRepeatedly(Return(true));
+    EXPECT_CALL(mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mRenderEngine, isProtected()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mOutput, generateClientCompositionRequests(_, kDefaultOutputDataspace, _))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r2, r1}))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r3, r1}));
+    EXPECT_CALL(mOutput, appendRegionFlashRequests(RegionEq(kDebugRegion), _))
+            .WillRepeatedly(Return());
+
+    EXPECT_CALL(*mRenderSurface, dequeueBuffer(_)).WillRepeatedly(Return(mOutputBuffer));
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damage, RegionEq(Region())), _,
+                           _, false, _))
+            .Times(2)
+            .WillRepeatedly([&](const renderengine::DisplaySettings&,
+                                const std::vector<renderengine::LayerSettings>&,
+                                const std::shared_ptr<renderengine::ExternalTexture>&, const bool,
+                                base::unique_fd&&)
+                                    -> std::future<renderengine::RenderEngineResult> {
+                return futureOf<renderengine::RenderEngineResult>({NO_ERROR, base::unique_fd()});
+            });
+
+    verify().execute().expectAFenceWasReturned();
+    verify().execute().expectAFenceWasReturned();
+
+    const auto& stats = mOutput.getClientCompositionStatsForTest();
+    EXPECT_EQ(2u, stats.fullRedraws);
+    EXPECT_EQ(0u, stats.partialRedraws);
+    EXPECT_EQ(0u, stats.pixelsSkipped);
+}
+
 struct OutputComposeSurfacesTest_UsesExpectedDisplaySettings : public OutputComposeSurfacesTest {
     OutputComposeSurfacesTest_UsesExpectedDisplaySettings() {
         EXPECT_CALL(mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(false));
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <compositionengine/impl/TiledDamageMap.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "RegionMatcher.h"
+
+namespace android::compositionengine {
+namespace {
+
+using impl::TiledDamageMap;
+
+constexpr int32_t kTile = TiledDamageMap::kTileSize;
+
+uint64_t getArea(const Region& region) {
+    uint64_t area = 0;
+    for (const Rect& rect : region) {
+        area += static_cast<uint64_t>(rect.getWidth()) * static_cast<uint64_t>(rect.getHeight());
+    }
+    return area;
+}
+
+// Stands in for a display surface cycling through its buffers, and reports how much of each
+// buffer is rendered again per frame.
+class FakeDisplaySurface {
+public:
+    FakeDisplaySurface(TiledDamageMap& map, size_t bufferCount)
+          : mMap(map), mBufferCount(bufferCount) {}
+
+    // Renders a frame damaging the region, and returns the area rendered.
+    uint64_t renderFrame(const std::optional<Region>& damage) {
+        const uint64_t bufferId = mFrame++ % mBufferCount;
+        mMap.addFrame(damage);
+        const std::optional<Region> bufferDamage = mMap.getDamage(bufferId);
+        mMap.onBufferRendered(bufferId);
+        return bufferDamage ? getArea(*bufferDamage) : getArea(Region(mMap.getBounds()));
+    }
+
+private:
+    TiledDamageMap& mMap;
+    const size_t mBufferCount;
+    uint64_t mFrame = 0;
+};
+
+TEST(TiledDamageMapTest, unknownBufferIsRenderedWhole) {
+    TiledDamageMap map(3);
+    map.setBounds(Rect(100, 100));
+    map.addFrame(Region());
+
+    EXPECT_FALSE(map.getDamage(1));
+}
+
+TEST(TiledDamageMapTest, damageIsRoundedOutToTiles) {
+    TiledDamageMap map(3);
+    map.setBounds(Rect(200, 100));
+    map.addFrame(std::nullopt);
+    map.onBufferRendered(1);
+
+    map.addFrame(Region());
+    EXPECT_THAT(map.getDamage(1), testing::Optional(RegionEq(Region())));
+
+    // The tiles at the bottom edge are clipped to the bounds.
+    map.addFrame(Region(Rect(60, 70, 140, 80)));
+    const std::optional<Region> damage = map.getDamage(1);
+    ASSERT_TRUE(damage);
+    EXPECT_THAT(*damage, RegionEq(Region(Rect(0, kTile, 3 * kTile, 100))));
+}
+
+TEST(TiledDamageMapTest, damageAccountsForBufferAge) {
+    TiledDamageMap map(3);
+    map.setBounds(Rect(4 * kTile, kTile));
+    map.addFrame(std::nullopt);
+    map.onBufferRendered(1);
+    map.addFrame(Region(Rect(0, 0, 1, 1)));
+    map.onBufferRendered(2);
+
+    // Buffer 1 missed the damage rendered into buffer 2.
+    map.addFrame(Region(Rect(3 * kTile, 0, 3 * kTile + 1, 1)));
+    Region expected(Rect(0, 0, kTile, kTile));
+    expected.orSelf(Rect(3 * kTile, 0, 4 * kTile, kTile));
+    EXPECT_THAT(map.getDamage(1), testing::Optional(RegionEq(expected)));
+    EXPECT_THAT(map.getDamage(2),
+                testing::Optional(RegionEq(Region(Rect(3 * kTile, 0, 4 * kTile, kTile)))));
+}
+
+TEST(TiledDamageMapTest, forgetsBuffers) {
+    TiledDamageMap map(2);
+    map.setBounds(Rect(100, 100));
+    map.addFrame(std::nullopt);
+    map.onBufferRendered(1);
+    map.onBufferRendered(2);
+    map.onBufferRendered(3);
+
+    // The least recently rendered buffer is out.
+    EXPECT_FALSE(map.getDamage(1));
+    EXPECT_TRUE(map.getDamage(2));
+
+    map.forget(2);
+    EXPECT_FALSE(map.getDamage(2));
+
+    // So is every buffer once the bounds change.
+    map.setBounds(Rect(50, 50));
+    EXPECT_FALSE(map.getDamage(3));
+}
+
+TEST(TiledDamageMapTest, rendersDamageOfEachBufferOfSwapchain) {
+    constexpr int32_t kWidth = 1080;
+    constexpr int32_t kHeight = 2400;
+    constexpr size_t kBufferCount = 3;
+    TiledDamageMap map(kBufferCount);
+    map.setBounds(Rect(kWidth, kHeight));
+    FakeDisplaySurface surface(map, kBufferCount);
+    const uint64_t fullArea = static_cast<uint64_t>(kWidth) * kHeight;
+
+    // Each buffer is rendered whole the first time, even if nothing changed since the first frame.
+    std::vector<uint64_t> areas;
+    areas.push_back(surface.renderFrame(std::nullopt));
+    for (size_t i = 1; i < kBufferCount; i++) {
+        areas.push_back(surface.renderFrame(Region()));
+    }
+    EXPECT_EQ(std::vector<uint64_t>(kBufferCount, fullArea), areas);
+
+    // A blinking cursor, within a single tile, then a still frame.
+    areas.clear();
+    const Region cursor(Rect(10, 10, 12, 40));
+    for (size_t i = 0; i < kBufferCount; i++) {
+        areas.push_back(surface.renderFrame(cursor));
+    }
+    areas.push_back(surface.renderFrame(Region()));
+    // Every buffer is behind by the cursor tile, until each caught up with the last blink.
+    const uint64_t tileArea = kTile * kTile;
+    EXPECT_EQ((std::vector<uint64_t>{tileArea, tileArea, tileArea, tileArea}), areas);
+    areas.clear();
+    for (size_t i = 0; i < kBufferCount; i++) {
+        areas.push_back(surface.renderFrame(Region()));
+    }
+    EXPECT_EQ((std::vector<uint64_t>{tileArea, 0, 0}), areas);
+
+    // A status bar update only renders the tiles it covers.
+    const uint64_t statusBarArea = static_cast<uint64_t>(kWidth) * kTile;
+    EXPECT_EQ(statusBarArea, surface.renderFrame(Region(Rect(0, 0, kWidth, 50))));
+    EXPECT_EQ(statusBarArea, surface.renderFrame(Region()));
+}
+
+} // namespace
+} // namespace android::compositionengine
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+
+namespace android::frametimeline {
+
+/*
+ * Store of fixed size blocks used to back the per-layer, per-frame records created by
+ * FrameTimeline. Blocks are handed out and returned through a lock-free free list, so records can
+ * be created on the main thread and released from any thread (binder threads drop their
+ * references to SurfaceFrames too) without taking a lock or touching the heap.
+ *
+ * The blocks are allocated in chunks of kBlocksPerChunk, when the free list runs out, so that the
+ * memory used follows the number of records actually alive rather than the capacity. Growing takes
+ * a lock, which only happens until the pool reaches its working set.
+ *
+ * The free list head packs a block index together with a generation tag into a single 64 bit word
+ * to avoid the ABA problem of a plain Treiber stack. When the pool is exhausted, or when a request
+ * doesn't fit in a block, allocations fall back to the heap; these are counted so that the pool can
+ * be sized correctly.
+ */
+class FrameRecordPool {
+public:
+    struct Stats {
+        // Number of allocations served from pooled blocks.
+        uint64_t pooledAllocations = 0;
+        // Number of allocations that had to fall back to the heap.
+        uint64_t heapAllocations = 0;
+        // Number of blocks currently handed out.
+        uint32_t blocksInUse = 0;
+        // Number of blocks allocated so far, at most capacity.
+        uint32_t allocatedBlocks = 0;
+        uint32_t capacity = 0;
+    };
+
+    static constexpr uint32_t kBlocksPerChunk = 64;
+
+    FrameRecordPool(size_t blockSize, uint32_t capacity)
+          : mBlockSize(alignUp(blockSize, kBlockAlignment)),
+            mCapacity(capacity),
+            mMaxChunks((capacity + kBlocksPerChunk - 1) / kBlocksPerChunk) {
+        mChunks = std::make_unique<std::atomic<std::byte*>[]>(mMaxChunks);
+        mNext = std::make_unique<std::atomic<uint32_t>[]>(mCapacity);
+        mHead.store(pack(kInvalidIndex, 0), std::memory_order_relaxed);
+    }
+
+    ~FrameRecordPool() {
+        for (uint32_t chunk = 0; chunk < mNumChunks.load(std::memory_order_relaxed); chunk++) {
+            ::operator delete(mChunks[chunk].load(std::memory_order_relaxed),
+                              std::align_val_t(kBlockAlignment));
+        }
+    }
+
+    FrameRecordPool(const FrameRecordPool&) = delete;
+    FrameRecordPool& operator=(const FrameRecordPool&) = delete;
+
+    void* allocate(size_t size) {
+        if (size <= mBlockSize) {
+            do {
+                uint64_t head = mHead.load(std::memory_order_acquire);
+                while (index(head) != kInvalidIndex) {
+                    const uint32_t next = mNext[index(head)].load(std::memory_order_relaxed);
+                    if (mHead.compare_exchange_weak(head, pack(next, tag(head) + 1),
+                                                    std::memory_order_acq_rel,
+                                                    std::memory_order_acquire)) {
+                        mPooledAllocations.fetch_add(1, std::memory_order_relaxed);
+                        mBlocksInUse.fetch_add(1, std::memory_order_relaxed);
+                        return getBlock(index(head));
+                    }
+                }
+            } while (grow());
+        }
+        mHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(size, std::align_val_t(kBlockAlignment));
+    }
+
+    void deallocate(void* ptr) {
+        const auto blockIndex = findBlock(static_cast<std::byte*>(ptr));
+        if (blockIndex == kInvalidIndex) {
+            ::operator delete(ptr, std::align_val_t(kBlockAlignment));
+            return;
+        }
+        push(blockIndex, blockIndex);
+        mBlocksInUse.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    Stats getStats() const {
+        Stats stats;
+        stats.pooledAllocations = mPooledAllocations.load(std::memory_order_relaxed);
+        stats.heapAllocations = mHeapAllocations.load(std::memory_order_relaxed);
+        stats.blocksInUse = mBlocksInUse.load(std::memory_order_relaxed);
+        stats.allocatedBlocks =
+                std::min(mNumChunks.load(std::memory_order_relaxed) * kBlocksPerChunk, mCapacity);
+        stats.capacity = mCapacity;
+        return stats;
+    }
+
+    static constexpr size_t kBlockAlignment = alignof(std::max_align_t);
+
+private:
+    static constexpr uint32_t kInvalidIndex = UINT32_MAX;
+
+    static constexpr size_t alignUp(size_t size, size_t alignment) {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+    static constexpr uint64_t pack(uint32_t index, uint32_t tag) {
+        return (static_cast<uint64_t>(tag) << 32) | index;
+    }
+    static constexpr uint32_t index(uint64_t head) { return static_cast<uint32_t>(head); }
+    static constexpr uint32_t tag(uint64_t head) { return static_cast<uint32_t>(head >> 32); }
+
+    std::byte* getBlock(uint32_t blockIndex) const {
+        return mChunks[blockIndex / kBlocksPerChunk].load(std::memory_order_acquire) +
+                static_cast<size_t>(blockIndex % kBlocksPerChunk) * mBlockSize;
+    }
+
+    // Returns the index of the block at ptr, or kInvalidIndex if ptr was allocated on the heap.
+    uint32_t findBlock(const std::byte* ptr) const {
+        const uint32_t numChunks = mNumChunks.load(std::memory_order_acquire);
+        for (uint32_t chunk = 0; chunk < numChunks; chunk++) {
+            const std::byte* storage = mChunks[chunk].load(std::memory_order_relaxed);
+            if (ptr >= storage && ptr < storage + mBlockSize * kBlocksPerChunk) {
+                return chunk * kBlocksPerChunk +
+                        static_cast<uint32_t>((ptr - storage) / mBlockSize);
+            }
+        }
+        return kInvalidIndex;
+    }
+
+    // Pushes the blocks first to last, already linked to each other, to the free list.
+    void push(uint32_t first, uint32_t last) {
+        uint64_t head = mHead.load(std::memory_order_relaxed);
+        do {
+            mNext[last].store(index(head), std::memory_order_relaxed);
+        } while (!mHead.compare_exchange_weak(head, pack(first, tag(head) + 1),
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+    }
+
+    // Adds a chunk of blocks to the free list. Returns false if the pool is at capacity.
+    bool grow() {
+        std::lock_guard lock(mGrowMutex);
+        if (index(mHead.load(std::memory_order_acquire)) != kInvalidIndex) {
+            // Another thread grew the pool, or released blocks, while this one waited.
+            return true;
+        }
+        const uint32_t chunk = mNumChunks.load(std::memory_order_relaxed);
+        if (chunk == mMaxChunks) {
+            return false;
+        }
+        mChunks[chunk].store(static_cast<std::byte*>(
+                                     ::operator new(mBlockSize * kBlocksPerChunk,
+                                                    std::align_val_t(kBlockAlignment))),
+                             std::memory_order_release);
+        mNumChunks.store(chunk + 1, std::memory_order_release);
+
+        const uint32_t first = chunk * kBlocksPerChunk;
+        const uint32_t last = std::min(first + kBlocksPerChunk, mCapacity) - 1;
+        for (uint32_t i = first; i < last; i++) {
+            mNext[i].store(i + 1, std::memory_order_relaxed);
+        }
+        push(first, last);
+        return true;
+    }
+
+    const size_t mBlockSize;
+    const uint32_t mCapacity;
+    const uint32_t mMaxChunks;
+    std::unique_ptr<std::atomic<std::byte*>[]> mChunks;
+    std::atomic<uint32_t> mNumChunks = 0;
+    std::mutex mGrowMutex;
+    std::unique_ptr<std::atomic<uint32_t>[]> mNext;
+    std::atomic<uint64_t> mHead;
+    std::atomic<uint64_t> mPooledAllocations = 0;
+    std::atomic<uint64_t> mHeapAllocations = 0;
+    std::atomic<uint32_t> mBlocksInUse = 0;
+};
+
+/*
+ * Standard allocator adapter over FrameRecordPool, meant to be used with std::allocate_shared so
+ * that the object and its control block share a single pooled block. The allocator keeps the pool
+ * alive, which lets records outlive the FrameTimeline that created them.
+ */
+template <typename T>
+class FrameRecordAllocator {
+public:
+    using value_type = T;
+
+    explicit FrameRecordAllocator(std::shared_ptr<FrameRecordPool> pool) : mPool(std::move(pool)) {}
+
+    template <typename U>
+    FrameRecordAllocator(const FrameRecordAllocator<U>& other) : mPool(other.mPool) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(mPool->allocate(n * sizeof(T))); }
+    void deallocate(T* ptr, size_t) { mPool->deallocate(ptr); }
+
+    template <typename U>
+    bool operator==(const FrameRecordAllocator<U>& other) const {
+        return mPool == other.mPool;
+    }
+    template <typename U>
+    bool operator!=(const FrameRecordAllocator<U>& other) const {
+        return mPool != other.mPool;
+    }
+
+private:
+    template <typename U>
+    friend class FrameRecordAllocator;
+
+    std::shared_ptr<FrameRecordPool> mPool;
+};
+
+} // namespace android::frametimeline
@@ -24,6 +24,7 @@
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cinttypes>
 #include <numeric>
@@ -742,24 +743,64 @@ namespace impl {
 
 int64_t TokenManager::generateTokenForPredictions(TimelineItem&& predictions) {
     ATRACE_CALL();
-    std::scoped_lock lock(mMutex);
-    while (mPredictions.size() >= kMaxTokens) {
-        mPredictions.erase(mPredictions.begin());
-    }
-    const int64_t assignedToken = mCurrentToken++;
-    mPredictions[assignedToken] = predictions;
+    const int64_t assignedToken = mCurrentToken.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = mPredictions[static_cast<size_t>(assignedToken) % kMaxTokens];
+    // Invalidate the slot before overwriting the timestamps, so that a concurrent reader of the
+    // token being evicted never observes a partial update.
+    slot.token.store(PredictionSlot::kBusyToken, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.startTime.store(predictions.startTime, std::memory_order_relaxed);
+    slot.endTime.store(predictions.endTime, std::memory_order_relaxed);
+    slot.presentTime.store(predictions.presentTime, std::memory_order_relaxed);
+    slot.token.store(assignedToken, std::memory_order_release);
     return assignedToken;
 }
 
 std::optional<TimelineItem> TokenManager::getPredictionsForToken(int64_t token) const {
-    std::scoped_lock lock(mMutex);
-    auto predictionsIterator = mPredictions.find(token);
-    if (predictionsIterator != mPredictions.end()) {
-        return predictionsIterator->second;
+    if (token < 0) {
+        return {};
     }
-    return {};
+    const auto& slot = mPredictions[static_cast<size_t>(token) % kMaxTokens];
+    if (slot.token.load(std::memory_order_acquire) != token) {
+        return {};
+    }
+    TimelineItem predictions(slot.startTime.load(std::memory_order_relaxed),
+                             slot.endTime.load(std::memory_order_relaxed),
+                             slot.presentTime.load(std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.token.load(std::memory_order_relaxed) != token) {
+        // The slot was recycled for a newer token while we were reading it.
+        return {};
+    }
+    return predictions;
+}
+
+size_t TokenManager::getNumberOfPredictions() const {
+    return static_cast<size_t>(
+            std::count_if(mPredictions.begin(), mPredictions.end(), [](const auto& slot) {
+                return slot.token.load(std::memory_order_relaxed) >= 0;
+            }));
 }
 
+namespace {
+
+// Mirrors the control block that std::allocate_shared places next to the SurfaceFrame in the same
+// pooled block: a vtable pointer, the shared and weak counts, and a copy of the allocator.
+struct SurfaceFrameControlBlock {
+    virtual ~SurfaceFrameControlBlock() = default;
+    long sharedCount;
+    long weakCount;
+    FrameRecordAllocator<SurfaceFrame> allocator;
+};
+
+// The allocator copy only holds the pool. Anything bigger would not fit the control block above.
+static_assert(sizeof(FrameRecordAllocator<SurfaceFrame>) ==
+              sizeof(std::shared_ptr<FrameRecordPool>));
+
+constexpr size_t kSurfaceFrameBlockSize = sizeof(SurfaceFrameControlBlock) + sizeof(SurfaceFrame);
+
+} // namespace
+
 FrameTimeline::FrameTimeline(std::shared_ptr<TimeStats> timeStats, pid_t surfaceFlingerPid,
                              JankClassificationThresholds thresholds, bool useBootTimeClock)
       : mUseBootTimeClock(useBootTimeClock),
@@ -767,6 +808,9 @@ FrameTimeline::FrameTimeline(std::shared_ptr<TimeStats> timeStats, pid_t surface
         mTimeStats(std::move(timeStats)),
         mSurfaceFlingerPid(surfaceFlingerPid),
         mJankClassificationThresholds(thresholds) {
+    mSurfaceFramePool =
+            std::make_shared<FrameRecordPool>(kSurfaceFrameBlockSize, kSurfaceFramePoolSize);
+    mDisplayFrames.setCapacity(mMaxDisplayFrames);
     mCurrentDisplayFrame =
             std::make_shared<DisplayFrame>(mTimeStats, thresholds, &mTraceCookieCounter);
 }
@@ -788,27 +832,24 @@ std::shared_ptr<SurfaceFrame> FrameTimeline::createSurfaceFrameForToken(
         const FrameTimelineInfo& frameTimelineInfo, pid_t ownerPid, uid_t ownerUid, int32_t layerId,
         std::string layerName, std::string debugName, bool isBuffer, GameMode gameMode) {
     ATRACE_CALL();
-    if (frameTimelineInfo.vsyncId == FrameTimelineInfo::INVALID_VSYNC_ID) {
-        return std::make_shared<SurfaceFrame>(frameTimelineInfo, ownerPid, ownerUid, layerId,
+    PredictionState predictionState = PredictionState::None;
+    TimelineItem predictions;
+    if (frameTimelineInfo.vsyncId != FrameTimelineInfo::INVALID_VSYNC_ID) {
+        if (auto tokenPredictions =
+                    mTokenManager.getPredictionsForToken(frameTimelineInfo.vsyncId)) {
+            predictionState = PredictionState::Valid;
+            predictions = *tokenPredictions;
+        } else {
+            predictionState = PredictionState::Expired;
+        }
+    }
+    return std::allocate_shared<SurfaceFrame>(FrameRecordAllocator<SurfaceFrame>(
+                                                      mSurfaceFramePool),
+                                              frameTimelineInfo, ownerPid, ownerUid, layerId,
                                               std::move(layerName), std::move(debugName),
-                                              PredictionState::None, TimelineItem(), mTimeStats,
+                                              predictionState, std::move(predictions), mTimeStats,
                                               mJankClassificationThresholds, &mTraceCookieCounter,
                                               isBuffer, gameMode);
-    }
-    std::optional<TimelineItem> predictions =
-            mTokenManager.getPredictionsForToken(frameTimelineInfo.vsyncId);
-    if (predictions) {
-        return std::make_shared<SurfaceFrame>(frameTimelineInfo, ownerPid, ownerUid, layerId,
-                                              std::move(layerName), std::move(debugName),
-                                              PredictionState::Valid, std::move(*predictions),
-                                              mTimeStats, mJankClassificationThresholds,
-                                              &mTraceCookieCounter, isBuffer, gameMode);
-    }
-    return std::make_shared<SurfaceFrame>(frameTimelineInfo, ownerPid, ownerUid, layerId,
-                                          std::move(layerName), std::move(debugName),
-                                          PredictionState::Expired, TimelineItem(), mTimeStats,
-                                          mJankClassificationThresholds, &mTraceCookieCounter,
-                                          isBuffer, gameMode);
 }
 
 FrameTimeline::DisplayFrame::DisplayFrame(std::shared_ptr<TimeStats> timeStats,
@@ -883,6 +924,20 @@ void FrameTimeline::DisplayFrame::setGpuFence(const std::shared_ptr<FenceTime>&
     mGpuFence = gpuFence;
 }
 
+void FrameTimeline::DisplayFrame::reset() {
+    mToken = FrameTimelineInfo::INVALID_VSYNC_ID;
+    mSurfaceFlingerPredictions = TimelineItem();
+    mSurfaceFlingerActuals = TimelineItem();
+    mSurfaceFrames.clear();
+    mPredictionState = PredictionState::None;
+    mJankType = JankType::None;
+    mGpuFence = FenceTime::NO_FENCE;
+    mFramePresentMetadata = FramePresentMetadata::UnknownPresent;
+    mFrameReadyMetadata = FrameReadyMetadata::UnknownFinish;
+    mFrameStartMetadata = FrameStartMetadata::UnknownStart;
+    mRefreshRate = Fps();
+}
+
 void FrameTimeline::DisplayFrame::classifyJank(nsecs_t& deadlineDelta, nsecs_t& deltaToVsync,
                                                nsecs_t previousPresentTime) {
     if (mPredictionState == PredictionState::Expired ||
@@ -1198,14 +1253,24 @@ void FrameTimeline::flushPendingPresentFences() {
 }
 
 void FrameTimeline::finalizeCurrentDisplayFrame() {
-    while (mDisplayFrames.size() >= mMaxDisplayFrames) {
-        // We maintain only a fixed number of frames' data. Pop older frames
-        mDisplayFrames.pop_front();
+    // We maintain only a fixed number of frames' data. The oldest frame is recycled unless it is
+    // still waiting on its present fence.
+    auto evictedFrame = mDisplayFrames.push_back(std::move(mCurrentDisplayFrame));
+    if (evictedFrame && evictedFrame.use_count() == 1) {
+        evictedFrame->reset();
+        mFreeDisplayFrames.push_back(std::move(evictedFrame));
+    }
+    mCurrentDisplayFrame = obtainDisplayFrame();
+}
+
+std::shared_ptr<FrameTimeline::DisplayFrame> FrameTimeline::obtainDisplayFrame() {
+    if (mFreeDisplayFrames.empty()) {
+        return std::make_shared<DisplayFrame>(mTimeStats, mJankClassificationThresholds,
+                                              &mTraceCookieCounter);
     }
-    mDisplayFrames.push_back(mCurrentDisplayFrame);
-    mCurrentDisplayFrame.reset();
-    mCurrentDisplayFrame = std::make_shared<DisplayFrame>(mTimeStats, mJankClassificationThresholds,
-                                                          &mTraceCookieCounter);
+    auto displayFrame = std::move(mFreeDisplayFrames.back());
+    mFreeDisplayFrames.pop_back();
+    return displayFrame;
 }
 
 nsecs_t FrameTimeline::DisplayFrame::getBaseTime() const {
@@ -1311,7 +1376,8 @@ void FrameTimeline::setMaxDisplayFrames(uint32_t size) {
     std::scoped_lock lock(mMutex);
 
     // The size can either increase or decrease, clear everything, to be consistent
-    mDisplayFrames.clear();
+    mDisplayFrames.setCapacity(size);
+    mFreeDisplayFrames.clear();
     mPendingPresentFences.clear();
     mMaxDisplayFrames = size;
 }
@@ -16,13 +16,14 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
-#include <deque>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include <gui/ISurfaceComposer.h>
 #include <gui/JankInfo.h>
@@ -38,6 +39,7 @@
 #include <scheduler/Fps.h>
 
 #include "../TimeStats/TimeStats.h"
+#include "FrameRecordPool.h"
 
 namespace android::frametimeline {
 
@@ -339,12 +341,29 @@ private:
     // Friend class for testing
     friend class android::frametimeline::FrameTimelineTest;
 
-    void flushTokens(nsecs_t flushTime) REQUIRES(mMutex);
-
-    std::map<int64_t, TimelineItem> mPredictions GUARDED_BY(mMutex);
-    int64_t mCurrentToken GUARDED_BY(mMutex);
-    mutable std::mutex mMutex;
     static constexpr size_t kMaxTokens = 500;
+
+    /*
+     * Predictions are stored in a flat ring indexed by token % kMaxTokens, so a token expires once
+     * kMaxTokens newer tokens have been generated. Each slot is a seqlock keyed by the token it
+     * holds: the writer marks the slot as busy, stores the timestamps and then publishes the token,
+     * and readers only accept the timestamps if they observed the same token before and after
+     * reading them. This lets the main thread and the EventThreads share predictions without a lock.
+     */
+    struct PredictionSlot {
+        static constexpr int64_t kBusyToken = FrameTimelineInfo::INVALID_VSYNC_ID - 1;
+
+        std::atomic<int64_t> token = FrameTimelineInfo::INVALID_VSYNC_ID;
+        std::atomic<nsecs_t> startTime = 0;
+        std::atomic<nsecs_t> endTime = 0;
+        std::atomic<nsecs_t> presentTime = 0;
+    };
+
+    // Returns the number of tokens whose predictions are still available. Used only for testing.
+    size_t getNumberOfPredictions() const;
+
+    std::array<PredictionSlot, kMaxTokens> mPredictions;
+    std::atomic<int64_t> mCurrentToken;
 };
 
 class FrameTimeline : public android::frametimeline::FrameTimeline {
@@ -385,6 +404,9 @@ public:
         void setActualStartTime(nsecs_t actualStartTime);
         void setActualEndTime(nsecs_t actualEndTime);
         void setGpuFence(const std::shared_ptr<FenceTime>& gpuFence);
+        // Returns the DisplayFrame to its initial state so that it can be reused for a new frame,
+        // keeping the capacity of its SurfaceFrame list.
+        void reset();
 
         // BaseTime is the smallest timestamp in a DisplayFrame.
         // Used for dumping all timestamps relative to the oldest, making it easy to read.
@@ -473,13 +495,62 @@ private:
     // Friend class for testing
     friend class android::frametimeline::FrameTimelineTest;
 
+    /*
+     * Sliding window of the most recent display frames, stored in a fixed size ring so that
+     * finalizing a frame never reallocates the container.
+     */
+    class DisplayFrameWindow {
+    public:
+        // Changes the capacity of the window. Drops all the frames currently held.
+        void setCapacity(uint32_t capacity) {
+            mFrames.clear();
+            mFrames.resize(capacity);
+            mStart = 0;
+            mSize = 0;
+        }
+        // Appends a frame, returning the oldest one if the window was already full.
+        std::shared_ptr<DisplayFrame> push_back(std::shared_ptr<DisplayFrame> frame) {
+            std::shared_ptr<DisplayFrame> evicted;
+            if (mFrames.empty()) {
+                return frame;
+            }
+            if (mSize == mFrames.size()) {
+                evicted = std::move(mFrames[mStart]);
+                mStart = (mStart + 1) % mFrames.size();
+                mSize--;
+            }
+            mFrames[(mStart + mSize) % mFrames.size()] = std::move(frame);
+            mSize++;
+            return evicted;
+        }
+        void clear() { setCapacity(static_cast<uint32_t>(mFrames.size())); }
+        size_t size() const { return mSize; }
+        bool empty() const { return mSize == 0; }
+        // Index 0 is the oldest frame in the window.
+        const std::shared_ptr<DisplayFrame>& operator[](size_t idx) const {
+            return mFrames[(mStart + idx) % mFrames.size()];
+        }
+
+    private:
+        std::vector<std::shared_ptr<DisplayFrame>> mFrames;
+        size_t mStart = 0;
+        size_t mSize = 0;
+    };
+
     void flushPendingPresentFences() REQUIRES(mMutex);
     void finalizeCurrentDisplayFrame() REQUIRES(mMutex);
+    // Returns a DisplayFrame from the free list, or allocates a new one if the list is empty.
+    std::shared_ptr<DisplayFrame> obtainDisplayFrame() REQUIRES(mMutex);
     void dumpAll(std::string& result);
     void dumpJank(std::string& result);
 
-    // Sliding window of display frames. TODO(b/168072834): compare perf with fixed size array
-    std::deque<std::shared_ptr<DisplayFrame>> mDisplayFrames GUARDED_BY(mMutex);
+    DisplayFrameWindow mDisplayFrames GUARDED_BY(mMutex);
+    // DisplayFrames that dropped out of the window and are not referenced anywhere else. These are
+    // reused for new frames instead of allocating.
+    std::vector<std::shared_ptr<DisplayFrame>> mFreeDisplayFrames GUARDED_BY(mMutex);
+    // Backing store for SurfaceFrames. Shared with the allocators held by the SurfaceFrames so that
+    // it outlives any of them.
+    std::shared_ptr<FrameRecordPool> mSurfaceFramePool;
     std::vector<std::pair<std::shared_ptr<FenceTime>, std::shared_ptr<DisplayFrame>>>
             mPendingPresentFences GUARDED_BY(mMutex);
     std::shared_ptr<DisplayFrame> mCurrentDisplayFrame GUARDED_BY(mMutex);
@@ -498,6 +569,10 @@ private:
     // display frame, this is a good starting size for the vector so that we can avoid the
     // internal vector resizing that happens with push_back.
     static constexpr uint32_t kNumSurfaceFramesInitial = 10;
+    // Maximum number of SurfaceFrames in mSurfaceFramePool, which only grows to the number alive at
+    // once. Enough for the default window of display frames with 16 layers updating in each;
+    // frames past this limit are allocated on the heap.
+    static constexpr uint32_t kSurfaceFramePoolSize = kDefaultMaxDisplayFrames * 16;
 };
 
 } // namespace impl
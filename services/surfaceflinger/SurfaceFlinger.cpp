@@ -61,6 +61,7 @@
 #include <gui/LayerDebugInfo.h>
 #include <gui/LayerMetadata.h>
 #include <gui/LayerState.h>
+#include <gui/OccupancyTracker.h>
 #include <gui/Surface.h>
 #include <gui/TraceUtils.h>
 #include <hidl/ServiceManagement.h>
@@ -771,6 +772,10 @@ chooseRenderEngineTypeViaSysProp() {
         return renderengine::RenderEngine::RenderEngineType::SKIA_GL;
     } else if (strcmp(prop, "skiaglthreaded") == 0) {
         return renderengine::RenderEngine::RenderEngineType::SKIA_GL_THREADED;
+    } else if (strcmp(prop, "skiaraster") == 0) {
+        return renderengine::RenderEngine::RenderEngineType::SKIA_RASTER;
+    } else if (strcmp(prop, "skiarasterthreaded") == 0) {
+        return renderengine::RenderEngine::RenderEngineType::SKIA_RASTER_THREADED;
     } else {
         ALOGE("Unrecognized RenderEngineType %s; ignoring!", prop);
         return {};
@@ -4660,6 +4665,9 @@ uint32_t SurfaceFlinger::setClientStateLocked(const FrameTimelineInfo& frameTime
     }
 
     if (what & layer_state_t::eBufferChanged) {
+        if (s.bufferData->occupancyDelta) {
+            mAppBufferQueueOccupancy.add(*s.bufferData->occupancyDelta);
+        }
         std::shared_ptr<renderengine::ExternalTexture> buffer =
                 getExternalTextureFromBufferData(*s.bufferData, layer->getDebugName());
         if (layer->setBuffer(buffer, *s.bufferData, postTime, desiredPresentTime, isAutoTimestamp,
@@ -5028,6 +5036,7 @@ status_t SurfaceFlinger::doDump(int fd, const DumpArgs& args, bool asProto) {
                       pid, uid);
     } else {
         static const std::unordered_map<std::string, Dumper> dumpers = {
+                {"--buffer-queue-occupancy"s, dumper(&SurfaceFlinger::dumpBufferQueueOccupancy)},
                 {"--comp-displays"s, dumper(&SurfaceFlinger::dumpCompositionDisplays)},
                 {"--display-id"s, dumper(&SurfaceFlinger::dumpDisplayIdentificationData)},
                 {"--displays"s, dumper(&SurfaceFlinger::dumpDisplays)},
@@ -5218,6 +5227,15 @@ void SurfaceFlinger::dumpStaticScreenStats(std::string& result) const {
                   bucketTimeSec, percent);
 }
 
+void SurfaceFlinger::dumpBufferQueueOccupancy(std::string& result) const {
+    result.append("BufferQueue occupancy, queues in the SurfaceFlinger process:\n");
+    OccupancyHistogram::getProcessHistogram().getSnapshot().dump(result, "  ");
+    StringAppendF(&result,
+                  "BufferQueue occupancy, queues in app processes, reported at most every %g s:\n",
+                  OccupancyHistogram::EXPORT_PERIOD / 1e9);
+    mAppBufferQueueOccupancy.getSnapshot().dump(result, "  ");
+}
+
 void SurfaceFlinger::dumpCompositionDisplays(std::string& result) const {
     for (const auto& [token, display] : mDisplays) {
         display->getCompositionDisplay()->dump(result);
@@ -6834,6 +6852,7 @@ ftl::SharedFuture<FenceResult> SurfaceFlinger::renderScreenImpl(
 
     const float colorSaturation = grayscale ? 0 : 1;
     clientCompositionDisplay.colorTransform = calculateColorMatrix(colorSaturation);
+    clientCompositionDisplay.isScreenshot = true;
 
     const float alpha = RenderArea::getCaptureFillValue(renderArea.getCaptureFill());
 
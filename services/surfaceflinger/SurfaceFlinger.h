@@ -35,6 +35,7 @@
 #include <gui/ISurfaceComposerClient.h>
 #include <gui/ITransactionCompletedListener.h>
 #include <gui/LayerState.h>
+#include <gui/OccupancyTracker.h>
 #include <layerproto/LayerProtoHeader.h>
 #include <math/mat4.h>
 #include <renderengine/LayerSettings.h>
@@ -1104,6 +1105,9 @@ private:
 
     void dumpVSync(std::string& result) const REQUIRES(mStateLock);
     void dumpStaticScreenStats(std::string& result) const;
+    // Dumps for --buffer-queue-occupancy the histograms of the BufferQueues living in this
+    // process, e.g. of virtual displays, and separately those reported by apps for theirs.
+    void dumpBufferQueueOccupancy(std::string& result) const;
 
     void dumpCompositionDisplays(std::string& result) const REQUIRES(mStateLock);
     void dumpDisplays(std::string& result) const REQUIRES(mStateLock);
@@ -1283,6 +1287,10 @@ private:
     const std::unique_ptr<FrameTracer> mFrameTracer;
     const std::unique_ptr<frametimeline::FrameTimeline> mFrameTimeline;
 
+    // BufferQueue histograms reported by apps along with their BLAST buffers, aggregated for
+    // --buffer-queue-occupancy.
+    OccupancyHistogram mAppBufferQueueOccupancy;
+
     // If blurs should be enabled on this device.
     bool mSupportsBlur = false;
     // If blurs are considered expensive and should require high GPU frequency.
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace android {
+
+// Bounded multi producer, single consumer queue of preallocated events.
+//
+// Every slot carries a sequence number. A producer claims the slot at mEnqueuePos by advancing the
+// position with a compare_exchange, fills the event in place, and publishes it by bumping the
+// slot's sequence. The consumer only reads a slot once its sequence shows it was published, and
+// hands it back to producers by moving the sequence one lap ahead. Producers never block: when the
+// queue is full tryPush fails and the caller decides how to make room.
+//
+// Events are filled and consumed in place, so members that own memory (e.g. strings) keep their
+// capacity across laps and steady state pushes don't allocate.
+template <typename T>
+class LocklessEventQueue {
+public:
+    // capacity must be a power of two.
+    explicit LocklessEventQueue(size_t capacity)
+          : mMask(capacity - 1), mSlots(std::make_unique<Slot[]>(capacity)) {
+        for (size_t i = 0; i < capacity; i++) {
+            mSlots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LocklessEventQueue(const LocklessEventQueue&) = delete;
+    LocklessEventQueue& operator=(const LocklessEventQueue&) = delete;
+
+    // Claims a slot and calls fill(T&) on it. Returns false without calling fill if the queue is
+    // full. Safe to call from any number of threads.
+    template <typename Fill>
+    bool tryPush(Fill&& fill) {
+        size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &mSlots[pos & mMask];
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        fill(slot->event);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Calls consume(T&) on every published event, in push order, and returns the number of events
+    // consumed. Must only be called by one thread at a time.
+    template <typename Consume>
+    size_t drain(Consume&& consume) {
+        size_t consumed = 0;
+        while (true) {
+            Slot& slot = mSlots[mDequeuePos & mMask];
+            if (slot.sequence.load(std::memory_order_acquire) != mDequeuePos + 1) {
+                break;
+            }
+            consume(slot.event);
+            slot.sequence.store(mDequeuePos + mMask + 1, std::memory_order_release);
+            mDequeuePos++;
+            consumed++;
+        }
+        return consumed;
+    }
+
+    size_t capacity() const { return mMask + 1; }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T event;
+    };
+
+    const size_t mMask;
+    std::unique_ptr<Slot[]> mSlots;
+    // Producers and the consumer update these from different threads, keep them on separate cache
+    // lines.
+    alignas(64) std::atomic<size_t> mEnqueuePos = 0;
+    alignas(64) size_t mDequeuePos = 0;
+};
+
+} // namespace android
@@ -25,6 +25,8 @@
 #include <utils/Timers.h>
 #include <utils/Trace.h>
 
+#include <pthread.h>
+
 #include <algorithm>
 #include <chrono>
 #include <unordered_map>
@@ -90,6 +92,7 @@ SurfaceflingerStatsLayerInfo_SetFrameRateVote frameRateVoteToProto(
 
 bool TimeStats::populateGlobalAtom(std::string* pulledData) {
     std::lock_guard<std::mutex> lock(mMutex);
+    drainEventsLocked();
 
     if (mTimeStats.statsStartLegacy == 0) {
         return false;
@@ -141,6 +144,7 @@ bool TimeStats::populateGlobalAtom(std::string* pulledData) {
 
 bool TimeStats::populateLayerAtom(std::string* pulledData) {
     std::lock_guard<std::mutex> lock(mMutex);
+    drainEventsLocked();
 
     std::vector<TimeStatsHelper::TimeStatsLayer*> dumpStats;
     uint32_t numLayers = 0;
@@ -234,6 +238,9 @@ TimeStats::TimeStats() : TimeStats(std::nullopt, std::nullopt) {}
 
 TimeStats::TimeStats(std::optional<size_t> maxPulledLayers,
                      std::optional<size_t> maxPulledHistogramBuckets) {
+    for (auto& shard : mLayerEventShards) {
+        shard = std::make_unique<LocklessEventQueue<LayerEvent>>(kLayerEventShardCapacity);
+    }
     if (maxPulledLayers) {
         mMaxPulledLayers = *maxPulledLayers;
     }
@@ -243,6 +250,10 @@ TimeStats::TimeStats(std::optional<size_t> maxPulledLayers,
     }
 }
 
+TimeStats::~TimeStats() {
+    stopDrainThread();
+}
+
 bool TimeStats::onPullAtom(const int atomId, std::string* pulledData) {
     bool success = false;
     if (atomId == 10062) { // SURFACEFLINGER_STATS_GLOBAL_INFO
@@ -296,10 +307,15 @@ std::string TimeStats::miniDump() {
 
     std::string result = "TimeStats miniDump:\n";
     std::lock_guard<std::mutex> lock(mMutex);
+    drainEventsLocked();
     android::base::StringAppendF(&result, "Number of layers currently being tracked is %zu\n",
                                  mTimeStatsTracker.size());
     android::base::StringAppendF(&result, "Number of layers in the stats pool is %zu\n",
                                  mTimeStats.stats.size());
+    android::base::StringAppendF(&result, "Number of layer events ingested is %" PRIu64 "\n",
+                                 mDrainedEvents);
+    android::base::StringAppendF(&result, "Number of events dropped is %" PRIu64 "\n",
+                                 mDroppedEvents.load());
     return result;
 }
 
@@ -555,15 +571,13 @@ bool TimeStats::canAddNewAggregatedStats(uid_t uid, const std::string& layerName
     return layerRecords < MAX_NUM_LAYER_STATS;
 }
 
-void TimeStats::setPostTime(int32_t layerId, uint64_t frameNumber, const std::string& layerName,
-                            uid_t uid, nsecs_t postTime, GameMode gameMode) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::setPostTimeLocked(int32_t layerId, uint64_t frameNumber,
+                                  const std::string& layerName, uid_t uid, nsecs_t postTime,
+                                  GameMode gameMode) {
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-[%s]-PostTime[%" PRId64 "]", layerId, frameNumber, layerName.c_str(),
           postTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!canAddNewAggregatedStats(uid, layerName, gameMode)) {
         return;
     }
@@ -600,13 +614,10 @@ void TimeStats::setPostTime(int32_t layerId, uint64_t frameNumber, const std::st
         layerRecord.waitData = layerRecord.timeRecords.size() - 1;
 }
 
-void TimeStats::setLatchTime(int32_t layerId, uint64_t frameNumber, nsecs_t latchTime) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::setLatchTimeLocked(int32_t layerId, uint64_t frameNumber, nsecs_t latchTime) {
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-LatchTime[%" PRId64 "]", layerId, frameNumber, latchTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     if (layerRecord.waitData < 0 ||
@@ -618,14 +629,11 @@ void TimeStats::setLatchTime(int32_t layerId, uint64_t frameNumber, nsecs_t latc
     }
 }
 
-void TimeStats::incrementLatchSkipped(int32_t layerId, LatchSkipReason reason) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::incrementLatchSkippedLocked(int32_t layerId, LatchSkipReason reason) {
     ATRACE_CALL();
     ALOGV("[%d]-LatchSkipped-Reason[%d]", layerId,
           static_cast<std::underlying_type<LatchSkipReason>::type>(reason));
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
 
@@ -636,25 +644,19 @@ void TimeStats::incrementLatchSkipped(int32_t layerId, LatchSkipReason reason) {
     }
 }
 
-void TimeStats::incrementBadDesiredPresent(int32_t layerId) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::incrementBadDesiredPresentLocked(int32_t layerId) {
     ATRACE_CALL();
     ALOGV("[%d]-BadDesiredPresent", layerId);
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     layerRecord.badDesiredPresentFrames++;
 }
 
-void TimeStats::setDesiredTime(int32_t layerId, uint64_t frameNumber, nsecs_t desiredTime) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::setDesiredTimeLocked(int32_t layerId, uint64_t frameNumber, nsecs_t desiredTime) {
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-DesiredTime[%" PRId64 "]", layerId, frameNumber, desiredTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     if (layerRecord.waitData < 0 ||
@@ -666,13 +668,10 @@ void TimeStats::setDesiredTime(int32_t layerId, uint64_t frameNumber, nsecs_t de
     }
 }
 
-void TimeStats::setAcquireTime(int32_t layerId, uint64_t frameNumber, nsecs_t acquireTime) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::setAcquireTimeLocked(int32_t layerId, uint64_t frameNumber, nsecs_t acquireTime) {
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-AcquireTime[%" PRId64 "]", layerId, frameNumber, acquireTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     if (layerRecord.waitData < 0 ||
@@ -684,15 +683,12 @@ void TimeStats::setAcquireTime(int32_t layerId, uint64_t frameNumber, nsecs_t ac
     }
 }
 
-void TimeStats::setAcquireFence(int32_t layerId, uint64_t frameNumber,
-                                const std::shared_ptr<FenceTime>& acquireFence) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::setAcquireFenceLocked(int32_t layerId, uint64_t frameNumber,
+                                      const std::shared_ptr<FenceTime>& acquireFence) {
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-AcquireFenceTime[%" PRId64 "]", layerId, frameNumber,
           acquireFence->getSignalTime());
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     if (layerRecord.waitData < 0 ||
@@ -704,15 +700,12 @@ void TimeStats::setAcquireFence(int32_t layerId, uint64_t frameNumber,
     }
 }
 
-void TimeStats::setPresentTime(int32_t layerId, uint64_t frameNumber, nsecs_t presentTime,
-                               Fps displayRefreshRate, std::optional<Fps> renderRate,
-                               SetFrameRateVote frameRateVote, GameMode gameMode) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::setPresentTimeLocked(int32_t layerId, uint64_t frameNumber, nsecs_t presentTime,
+                                     Fps displayRefreshRate, std::optional<Fps> renderRate,
+                                     SetFrameRateVote frameRateVote, GameMode gameMode) {
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-PresentTime[%" PRId64 "]", layerId, frameNumber, presentTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     if (layerRecord.waitData < 0 ||
@@ -729,17 +722,14 @@ void TimeStats::setPresentTime(int32_t layerId, uint64_t frameNumber, nsecs_t pr
                                        gameMode);
 }
 
-void TimeStats::setPresentFence(int32_t layerId, uint64_t frameNumber,
-                                const std::shared_ptr<FenceTime>& presentFence,
-                                Fps displayRefreshRate, std::optional<Fps> renderRate,
-                                SetFrameRateVote frameRateVote, GameMode gameMode) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::setPresentFenceLocked(int32_t layerId, uint64_t frameNumber,
+                                      const std::shared_ptr<FenceTime>& presentFence,
+                                      Fps displayRefreshRate, std::optional<Fps> renderRate,
+                                      SetFrameRateVote frameRateVote, GameMode gameMode) {
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-PresentFenceTime[%" PRId64 "]", layerId, frameNumber,
           presentFence->getSignalTime());
 
-    std::lock_guard<std::mutex> lock(mMutex);
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     if (layerRecord.waitData < 0 ||
@@ -793,12 +783,8 @@ static void updateJankPayload(T& t, int32_t reasons) {
     }
 }
 
-void TimeStats::incrementJankyFrames(const JankyFramesInfo& info) {
-    if (!mEnabled.load()) return;
-
+void TimeStats::incrementJankyFramesLocked(const JankyFramesInfo& info) {
     ATRACE_CALL();
-    std::lock_guard<std::mutex> lock(mMutex);
-
     // Only update layer stats if we're already tracking the layer in TimeStats.
     // Otherwise, continue tracking the statistic but use a default layer name instead.
     // As an implementation detail, we do this because this method is expected to be
@@ -851,20 +837,324 @@ void TimeStats::incrementJankyFrames(const JankyFramesInfo& info) {
     }
 }
 
+template <typename Fill>
+bool TimeStats::pushLayerEvent(int32_t layerId, Fill&& fill) {
+    auto& shard = *mLayerEventShards[static_cast<uint32_t>(layerId) % kNumLayerEventShards];
+    const bool pushed = shard.tryPush([&](LayerEvent& event) {
+        fill(event);
+        event.sequence = mNextEventSequence.fetch_add(1, std::memory_order_relaxed);
+    });
+    if (!pushed) {
+        onEventDropped();
+    }
+    return pushed;
+}
+
+void TimeStats::onEventDropped() {
+    // The drain thread fell behind. Rather than making room on this thread, which is usually the
+    // main thread, drop the event: a dropped time event leaves a time record incomplete, which is
+    // evicted like any other stale record once the layer queues MAX_NUM_TIME_RECORDS more, and a
+    // dropped jank event goes uncounted. Destroy events are never dropped, see onDestroy. Wake the
+    // drain thread up so that it catches up early.
+    ATRACE_NAME("TimeStats dropped event");
+    mDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+    mDrainThreadCondition.notify_one();
+}
+
+void TimeStats::setPostTime(int32_t layerId, uint64_t frameNumber, const std::string& layerName,
+                            uid_t uid, nsecs_t postTime, GameMode gameMode) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::Post;
+        event.layerId = layerId;
+        event.frameNumber = frameNumber;
+        event.time = postTime;
+        event.layerName.assign(layerName);
+        event.uid = uid;
+        event.gameMode = gameMode;
+    });
+}
+
+void TimeStats::setLatchTime(int32_t layerId, uint64_t frameNumber, nsecs_t latchTime) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::Latch;
+        event.layerId = layerId;
+        event.frameNumber = frameNumber;
+        event.time = latchTime;
+    });
+}
+
+void TimeStats::incrementLatchSkipped(int32_t layerId, LatchSkipReason reason) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::LatchSkipped;
+        event.layerId = layerId;
+        event.latchSkipReason = reason;
+    });
+}
+
+void TimeStats::incrementBadDesiredPresent(int32_t layerId) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::BadDesiredPresent;
+        event.layerId = layerId;
+    });
+}
+
+void TimeStats::setDesiredTime(int32_t layerId, uint64_t frameNumber, nsecs_t desiredTime) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::Desired;
+        event.layerId = layerId;
+        event.frameNumber = frameNumber;
+        event.time = desiredTime;
+    });
+}
+
+void TimeStats::setAcquireTime(int32_t layerId, uint64_t frameNumber, nsecs_t acquireTime) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::Acquire;
+        event.layerId = layerId;
+        event.frameNumber = frameNumber;
+        event.time = acquireTime;
+    });
+}
+
+void TimeStats::setAcquireFence(int32_t layerId, uint64_t frameNumber,
+                                const std::shared_ptr<FenceTime>& acquireFence) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::AcquireFence;
+        event.layerId = layerId;
+        event.frameNumber = frameNumber;
+        event.fence = acquireFence;
+    });
+}
+
+void TimeStats::setPresentTime(int32_t layerId, uint64_t frameNumber, nsecs_t presentTime,
+                               Fps displayRefreshRate, std::optional<Fps> renderRate,
+                               SetFrameRateVote frameRateVote, GameMode gameMode) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::Present;
+        event.layerId = layerId;
+        event.frameNumber = frameNumber;
+        event.time = presentTime;
+        event.displayRefreshRate = displayRefreshRate;
+        event.renderRate = renderRate;
+        event.frameRateVote = frameRateVote;
+        event.gameMode = gameMode;
+    });
+}
+
+void TimeStats::setPresentFence(int32_t layerId, uint64_t frameNumber,
+                                const std::shared_ptr<FenceTime>& presentFence,
+                                Fps displayRefreshRate, std::optional<Fps> renderRate,
+                                SetFrameRateVote frameRateVote, GameMode gameMode) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::PresentFence;
+        event.layerId = layerId;
+        event.frameNumber = frameNumber;
+        event.fence = presentFence;
+        event.displayRefreshRate = displayRefreshRate;
+        event.renderRate = renderRate;
+        event.frameRateVote = frameRateVote;
+        event.gameMode = gameMode;
+    });
+}
+
+void TimeStats::incrementJankyFrames(const JankyFramesInfo& info) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    const bool pushed = mJankEvents.tryPush([&](JankEvent& event) {
+        event.info.refreshRate = info.refreshRate;
+        event.info.renderRate = info.renderRate;
+        event.info.uid = info.uid;
+        event.info.layerName.assign(info.layerName);
+        event.info.gameMode = info.gameMode;
+        event.info.reasons = info.reasons;
+        event.info.displayDeadlineDelta = info.displayDeadlineDelta;
+        event.info.displayPresentJitter = info.displayPresentJitter;
+        event.info.appDeadlineDelta = info.appDeadlineDelta;
+        event.sequence = mNextEventSequence.fetch_add(1, std::memory_order_relaxed);
+    });
+    if (!pushed) {
+        onEventDropped();
+    }
+}
+
+void TimeStats::removeTimeRecord(int32_t layerId, uint64_t frameNumber) {
+    if (!mEnabled.load(std::memory_order_relaxed)) return;
+
+    pushLayerEvent(layerId, [&](LayerEvent& event) {
+        event.type = LayerEvent::Type::RemoveTimeRecord;
+        event.layerId = layerId;
+        event.frameNumber = frameNumber;
+    });
+}
+
 void TimeStats::onDestroy(int32_t layerId) {
+    if (mEnabled.load(std::memory_order_relaxed) &&
+        pushLayerEvent(layerId, [&](LayerEvent& event) {
+            event.type = LayerEvent::Type::Destroy;
+            event.layerId = layerId;
+        })) {
+        return;
+    }
+
+    // Nothing would erase the record of a destroyed layer, and the fences it holds, if the event
+    // were dropped, so erase it here. The queued events of the layer are applied first.
     ATRACE_CALL();
     ALOGV("[%d]-onDestroy", layerId);
     std::lock_guard<std::mutex> lock(mMutex);
+    drainEventsLocked();
     mTimeStatsTracker.erase(layerId);
 }
 
-void TimeStats::removeTimeRecord(int32_t layerId, uint64_t frameNumber) {
-    if (!mEnabled.load()) return;
+void TimeStats::applyLayerEventLocked(const LayerEvent& event) {
+    switch (event.type) {
+        case LayerEvent::Type::Post:
+            setPostTimeLocked(event.layerId, event.frameNumber, event.layerName, event.uid,
+                              event.time, event.gameMode);
+            break;
+        case LayerEvent::Type::Latch:
+            setLatchTimeLocked(event.layerId, event.frameNumber, event.time);
+            break;
+        case LayerEvent::Type::LatchSkipped:
+            incrementLatchSkippedLocked(event.layerId, event.latchSkipReason);
+            break;
+        case LayerEvent::Type::BadDesiredPresent:
+            incrementBadDesiredPresentLocked(event.layerId);
+            break;
+        case LayerEvent::Type::Desired:
+            setDesiredTimeLocked(event.layerId, event.frameNumber, event.time);
+            break;
+        case LayerEvent::Type::Acquire:
+            setAcquireTimeLocked(event.layerId, event.frameNumber, event.time);
+            break;
+        case LayerEvent::Type::AcquireFence:
+            setAcquireFenceLocked(event.layerId, event.frameNumber, event.fence);
+            break;
+        case LayerEvent::Type::Present:
+            setPresentTimeLocked(event.layerId, event.frameNumber, event.time,
+                                 event.displayRefreshRate, event.renderRate, event.frameRateVote,
+                                 event.gameMode);
+            break;
+        case LayerEvent::Type::PresentFence:
+            setPresentFenceLocked(event.layerId, event.frameNumber, event.fence,
+                                  event.displayRefreshRate, event.renderRate,
+                                  event.frameRateVote, event.gameMode);
+            break;
+        case LayerEvent::Type::RemoveTimeRecord:
+            removeTimeRecordLocked(event.layerId, event.frameNumber);
+            break;
+        case LayerEvent::Type::Destroy:
+            ALOGV("[%d]-onDestroy", event.layerId);
+            mTimeStatsTracker.erase(event.layerId);
+            break;
+    }
+}
 
+void TimeStats::drainEventsLocked() {
     ATRACE_CALL();
-    ALOGV("[%d]-[%" PRIu64 "]-removeTimeRecord", layerId, frameNumber);
 
+    // Each queue hands its events out in the order they were claimed, which may differ from the
+    // order they were stamped in under contention, so sort the events of all queues together.
+    size_t layerEventCount = 0;
+    for (auto& shard : mLayerEventShards) {
+        shard->drain([&](LayerEvent& event) {
+            if (layerEventCount == mDrainedLayerEvents.size()) {
+                mDrainedLayerEvents.emplace_back();
+            }
+            std::swap(mDrainedLayerEvents[layerEventCount], event);
+            mDrainOrder.push_back({mDrainedLayerEvents[layerEventCount].sequence, false,
+                                   layerEventCount});
+            layerEventCount++;
+        });
+    }
+    size_t jankEventCount = 0;
+    mJankEvents.drain([&](JankEvent& event) {
+        if (jankEventCount == mDrainedJankEvents.size()) {
+            mDrainedJankEvents.emplace_back();
+        }
+        std::swap(mDrainedJankEvents[jankEventCount], event);
+        mDrainOrder.push_back({mDrainedJankEvents[jankEventCount].sequence, true, jankEventCount});
+        jankEventCount++;
+    });
+
+    std::sort(mDrainOrder.begin(), mDrainOrder.end(),
+              [](const DrainedEvent& lhs, const DrainedEvent& rhs) {
+                  return lhs.sequence < rhs.sequence;
+              });
+    for (const DrainedEvent& drained : mDrainOrder) {
+        if (drained.isJank) {
+            incrementJankyFramesLocked(mDrainedJankEvents[drained.index].info);
+        } else {
+            LayerEvent& event = mDrainedLayerEvents[drained.index];
+            applyLayerEventLocked(event);
+            // Don't hold on to fences until the scratch slot is reused.
+            event.fence = nullptr;
+        }
+    }
+    mDrainedEvents += mDrainOrder.size();
+    mDrainOrder.clear();
+}
+
+void TimeStats::discardEventsLocked() {
+    for (auto& shard : mLayerEventShards) {
+        shard->drain([](LayerEvent& event) { event.fence = nullptr; });
+    }
+    mJankEvents.drain([](JankEvent&) {});
+}
+
+void TimeStats::drainEvents() {
     std::lock_guard<std::mutex> lock(mMutex);
+    drainEventsLocked();
+}
+
+void TimeStats::startDrainThread() {
+    std::lock_guard<std::mutex> lock(mDrainThreadMutex);
+    if (mDrainThreadRunning) return;
+
+    mDrainThreadRunning = true;
+    mDrainThread = std::thread([this]() {
+        pthread_setname_np(pthread_self(), "TimeStatsDrain");
+        std::unique_lock<std::mutex> lock(mDrainThreadMutex);
+        while (mDrainThreadRunning) {
+            mDrainThreadCondition.wait_for(lock, kDrainPeriod);
+            lock.unlock();
+            drainEvents();
+            lock.lock();
+        }
+    });
+}
+
+void TimeStats::stopDrainThread() {
+    {
+        std::lock_guard<std::mutex> lock(mDrainThreadMutex);
+        if (!mDrainThreadRunning) return;
+        mDrainThreadRunning = false;
+    }
+    mDrainThreadCondition.notify_all();
+    mDrainThread.join();
+}
+
+void TimeStats::removeTimeRecordLocked(int32_t layerId, uint64_t frameNumber) {
+    ATRACE_CALL();
+    ALOGV("[%d]-[%" PRIu64 "]-removeTimeRecord", layerId, frameNumber);
+
     if (!mTimeStatsTracker.count(layerId)) return;
     LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     size_t removeAt = 0;
@@ -1015,10 +1305,16 @@ void TimeStats::enable() {
 
     ATRACE_CALL();
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    mEnabled.store(true);
-    mTimeStats.statsStartLegacy = static_cast<int64_t>(std::time(0));
-    mPowerTime.prevTime = systemTime();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        // Calls racing with the last disable() may have recorded events after it drained the
+        // queues. They belong to the previous session.
+        discardEventsLocked();
+        mEnabled.store(true);
+        mTimeStats.statsStartLegacy = static_cast<int64_t>(std::time(0));
+        mPowerTime.prevTime = systemTime();
+    }
+    startDrainThread();
     ALOGD("Enabled");
 }
 
@@ -1027,15 +1323,21 @@ void TimeStats::disable() {
 
     ATRACE_CALL();
 
+    stopDrainThread();
+
     std::lock_guard<std::mutex> lock(mMutex);
-    flushPowerTimeLocked();
     mEnabled.store(false);
+    // Apply whatever was recorded while enabled. Events recorded past this point by calls which
+    // saw TimeStats still enabled are discarded by the next enable().
+    drainEventsLocked();
+    flushPowerTimeLocked();
     mTimeStats.statsEndLegacy = static_cast<int64_t>(std::time(0));
     ALOGD("Disabled");
 }
 
 void TimeStats::clearAll() {
     std::lock_guard<std::mutex> lock(mMutex);
+    drainEventsLocked();
     mTimeStats.stats.clear();
     clearGlobalLocked();
     clearLayersLocked();
@@ -1088,6 +1390,7 @@ void TimeStats::dump(bool asProto, std::optional<uint32_t> maxLayers, std::strin
     ATRACE_CALL();
 
     std::lock_guard<std::mutex> lock(mMutex);
+    drainEventsLocked();
     if (mTimeStats.statsStartLegacy == 0) {
         return;
     }
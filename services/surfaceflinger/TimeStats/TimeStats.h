@@ -16,12 +16,17 @@
 
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <deque>
 #include <mutex>
 #include <optional>
+#include <thread>
 #include <unordered_map>
 #include <variant>
+#include <vector>
 
 #include <android/hardware/graphics/composer/2.4/IComposerClient.h>
 #include <gui/JankInfo.h>
@@ -34,6 +39,8 @@
 
 #include <scheduler/Fps.h>
 
+#include "LocklessEventQueue.h"
+
 using namespace android::surfaceflinger;
 
 namespace android {
@@ -236,11 +243,60 @@ class TimeStats : public android::TimeStats {
         std::deque<RenderEngineDuration> renderEngineDurations;
     };
 
+    // A per-layer call recorded on the calling thread and applied to mTimeStatsTracker later, when
+    // the event queues are drained under mMutex.
+    struct LayerEvent {
+        enum class Type : uint8_t {
+            Post,
+            Latch,
+            LatchSkipped,
+            BadDesiredPresent,
+            Desired,
+            Acquire,
+            AcquireFence,
+            Present,
+            PresentFence,
+            RemoveTimeRecord,
+            Destroy,
+        };
+
+        Type type = Type::Post;
+        // Order of the event among all the queued events, layer and jank ones alike.
+        uint64_t sequence = 0;
+        int32_t layerId = 0;
+        uint64_t frameNumber = 0;
+        nsecs_t time = 0;
+        std::shared_ptr<FenceTime> fence;
+        // Set for Post events only.
+        std::string layerName;
+        uid_t uid = 0;
+        GameMode gameMode = GameMode::Unsupported;
+        LatchSkipReason latchSkipReason = LatchSkipReason::LateAcquire;
+        // Set for Present and PresentFence events only.
+        Fps displayRefreshRate;
+        std::optional<Fps> renderRate;
+        SetFrameRateVote frameRateVote;
+    };
+
+    // An incrementJankyFrames call recorded on the calling thread, ordered like LayerEvent.
+    struct JankEvent {
+        uint64_t sequence = 0;
+        JankyFramesInfo info;
+    };
+
+    // An event taken off the queues by drainEventsLocked, which applies them in sequence order.
+    struct DrainedEvent {
+        uint64_t sequence;
+        bool isJank;
+        size_t index;
+    };
+
 public:
     TimeStats();
     // For testing only for injecting custom dependencies.
     TimeStats(std::optional<size_t> maxPulledLayers,
               std::optional<size_t> maxPulledHistogramBuckets);
+    ~TimeStats() override;
 
     bool onPullAtom(const int atomId, std::string* pulledData) override;
     void parseArgs(bool asProto, const Vector<String16>& args, std::string& result) override;
@@ -289,9 +345,46 @@ public:
 
     static const size_t MAX_NUM_TIME_RECORDS = 64;
 
+    // Applies all the per-layer events recorded so far to the aggregated stats. This happens
+    // periodically on a background thread while TimeStats is enabled, and before stats are dumped
+    // or pulled.
+    void drainEvents();
+
 private:
     bool populateGlobalAtom(std::string* pulledData);
     bool populateLayerAtom(std::string* pulledData);
+
+    // Records a per-layer event in the queue for the layer's shard. If the shard is full, the
+    // event is dropped, counted in mDroppedEvents, and false is returned.
+    template <typename Fill>
+    bool pushLayerEvent(int32_t layerId, Fill&& fill);
+    void onEventDropped();
+    void drainEventsLocked();
+    // Throws away the queued events without applying them.
+    void discardEventsLocked();
+    void applyLayerEventLocked(const LayerEvent& event);
+    void startDrainThread();
+    void stopDrainThread();
+
+    void setPostTimeLocked(int32_t layerId, uint64_t frameNumber, const std::string& layerName,
+                           uid_t uid, nsecs_t postTime, GameMode);
+    void setLatchTimeLocked(int32_t layerId, uint64_t frameNumber, nsecs_t latchTime);
+    void incrementLatchSkippedLocked(int32_t layerId, LatchSkipReason reason);
+    void incrementBadDesiredPresentLocked(int32_t layerId);
+    void setDesiredTimeLocked(int32_t layerId, uint64_t frameNumber, nsecs_t desiredTime);
+    void setAcquireTimeLocked(int32_t layerId, uint64_t frameNumber, nsecs_t acquireTime);
+    void setAcquireFenceLocked(int32_t layerId, uint64_t frameNumber,
+                               const std::shared_ptr<FenceTime>& acquireFence);
+    void setPresentTimeLocked(int32_t layerId, uint64_t frameNumber, nsecs_t presentTime,
+                              Fps displayRefreshRate, std::optional<Fps> renderRate,
+                              SetFrameRateVote, GameMode);
+    void setPresentFenceLocked(int32_t layerId, uint64_t frameNumber,
+                               const std::shared_ptr<FenceTime>& presentFence,
+                               Fps displayRefreshRate, std::optional<Fps> renderRate,
+                               SetFrameRateVote, GameMode);
+    void incrementJankyFramesLocked(const JankyFramesInfo& info);
+    void removeTimeRecordLocked(int32_t layerId, uint64_t frameNumber);
+
     bool recordReadyLocked(int32_t layerId, TimeRecord* timeRecord);
     void flushAvailableRecordsToStatsLocked(int32_t layerId, Fps displayRefreshRate,
                                             std::optional<Fps> renderRate, SetFrameRateVote,
@@ -315,6 +408,33 @@ private:
     PowerTime mPowerTime;
     GlobalRecord mGlobalRecord;
 
+    // Per-layer calls are sharded by layer id, so that producers for different layers rarely
+    // contend on the same queue. Jank events have their own queue. Every event is stamped with
+    // mNextEventSequence, and drainEventsLocked applies the events of all queues in that order,
+    // as if they had been applied by the calls recording them.
+    static constexpr size_t kNumLayerEventShards = 8;
+    static constexpr size_t kLayerEventShardCapacity = 1024;
+    static constexpr size_t kJankEventQueueCapacity = 512;
+    std::array<std::unique_ptr<LocklessEventQueue<LayerEvent>>, kNumLayerEventShards>
+            mLayerEventShards;
+    LocklessEventQueue<JankEvent> mJankEvents{kJankEventQueueCapacity};
+    std::atomic<uint64_t> mNextEventSequence = 0;
+    // Number of events dropped because their queue was full.
+    std::atomic<uint64_t> mDroppedEvents = 0;
+    uint64_t mDrainedEvents = 0;
+    // Scratch storage of drainEventsLocked, kept across drains so that steady state drains don't
+    // allocate. Events are swapped in, so that the queue slots keep their string capacity too.
+    std::vector<LayerEvent> mDrainedLayerEvents;
+    std::vector<JankEvent> mDrainedJankEvents;
+    std::vector<DrainedEvent> mDrainOrder;
+
+    // Drains the event queues off the main thread while TimeStats is enabled.
+    static constexpr std::chrono::milliseconds kDrainPeriod{20};
+    std::thread mDrainThread;
+    std::mutex mDrainThreadMutex;
+    std::condition_variable mDrainThreadCondition;
+    bool mDrainThreadRunning = false;
+
     static const size_t MAX_NUM_LAYER_RECORDS = 200;
 
     static const size_t REFRESH_RATE_BUCKET_WIDTH = 30;
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LayerTraceDelta"
+
+#include <log/log.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "LayerTraceDelta.h"
+
+namespace android {
+
+namespace layertracedelta {
+
+namespace {
+
+enum WireType : uint32_t {
+    VARINT = 0,
+    FIXED64 = 1,
+    LENGTH_DELIMITED = 2,
+    FIXED32 = 5,
+};
+
+bool readVarint(std::string_view message, size_t& offset, uint64_t& value) {
+    value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (offset >= message.size()) {
+            return false;
+        }
+        const auto byte = static_cast<uint8_t>(message[offset++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool skipValue(std::string_view message, uint32_t wireType, size_t& offset) {
+    uint64_t value;
+    switch (wireType) {
+        case VARINT:
+            return readVarint(message, offset, value);
+        case FIXED64:
+            offset += 8;
+            break;
+        case LENGTH_DELIMITED:
+            if (!readVarint(message, offset, value) || value > message.size() - offset) {
+                return false;
+            }
+            offset += static_cast<size_t>(value);
+            break;
+        case FIXED32:
+            offset += 4;
+            break;
+        default:
+            // Groups are not used by the layer protos.
+            return false;
+    }
+    return offset <= message.size();
+}
+
+std::string_view fieldBytes(std::string_view message, const FieldSpan& field) {
+    return message.substr(field.offset, field.size);
+}
+
+} // namespace
+
+bool splitFields(std::string_view message, std::vector<FieldSpan>& outFields) {
+    outFields.clear();
+    size_t offset = 0;
+    while (offset < message.size()) {
+        const size_t start = offset;
+        uint64_t tag;
+        if (!readVarint(message, offset, tag) ||
+            !skipValue(message, static_cast<uint32_t>(tag & 0x7), offset)) {
+            return false;
+        }
+        const auto fieldNumber = static_cast<uint32_t>(tag >> 3);
+        if (!outFields.empty() && outFields.back().fieldNumber == fieldNumber) {
+            outFields.back().size += offset - start;
+        } else if (!outFields.empty() && outFields.back().fieldNumber > fieldNumber) {
+            // Not serialized in field number order.
+            return false;
+        } else {
+            outFields.push_back({fieldNumber, start, offset - start});
+        }
+    }
+    return true;
+}
+
+} // namespace layertracedelta
+
+using layertracedelta::FieldSpan;
+using layertracedelta::fieldBytes;
+using layertracedelta::splitFields;
+
+void LayerTraceDeltaEncoder::reset() {
+    mNeedsKeyframe = true;
+    mLayers.clear();
+    mLayerOrder.clear();
+}
+
+void LayerTraceDeltaEncoder::encode(LayersProto&& layers, LayersTraceProto& entry) {
+    mFrame++;
+    const bool keyframe = mNeedsKeyframe || mEntriesSinceKeyframe >= mKeyframeInterval;
+
+    mCurrentOrder.clear();
+    mCurrentOrder.reserve(static_cast<size_t>(layers.layers_size()));
+    // Computes and caches the size of every layer, so each one is serialized in a single pass.
+    layers.ByteSizeLong();
+    for (const LayerProto& layer : layers.layers()) {
+        mCurrentOrder.push_back(layer.id());
+        mSerializedLayer.resize(static_cast<size_t>(layer.GetCachedSize()));
+        layer.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(mSerializedLayer.data()));
+        LayerState& state = mLayers[layer.id()];
+        state.lastSeenFrame = mFrame;
+        if (!keyframe && state.serialized != mSerializedLayer) {
+            encodeDelta(layer, state, entry);
+        }
+        state.serialized.swap(mSerializedLayer);
+    }
+
+    for (auto it = mLayers.begin(); it != mLayers.end();) {
+        if (it->second.lastSeenFrame != mFrame) {
+            it = mLayers.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    // An empty snapshot can't be told apart from an unchanged layer order, store it as a keyframe.
+    if (keyframe || mCurrentOrder.empty()) {
+        entry.mutable_layers()->Swap(&layers);
+        mEntriesSinceKeyframe = 0;
+        mNeedsKeyframe = false;
+    } else {
+        entry.set_is_delta(true);
+        if (mCurrentOrder != mLayerOrder) {
+            entry.mutable_layer_order()->Add(mCurrentOrder.begin(), mCurrentOrder.end());
+        }
+        mEntriesSinceKeyframe++;
+    }
+    mLayerOrder.swap(mCurrentOrder);
+}
+
+void LayerTraceDeltaEncoder::encodeDelta(const LayerProto& layer, LayerState& state,
+                                         LayersTraceProto& entry) {
+    const std::string_view previous = state.serialized;
+    const std::string_view current = mSerializedLayer;
+    if (!splitFields(previous, mPreviousFields) || !splitFields(current, mCurrentFields)) {
+        ALOGE("Could not split layer %d into fields, storing it whole", layer.id());
+        *entry.mutable_layers()->add_layers() = layer;
+        entry.add_full_layer_ids(layer.id());
+        return;
+    }
+
+    mDeltaLayer.clear();
+    ClearedLayerFieldsProto* cleared = nullptr;
+    auto clearField = [&](const FieldSpan& field) {
+        if (!cleared) {
+            cleared = entry.add_cleared_fields();
+            cleared->set_layer_id(layer.id());
+        }
+        cleared->add_field_numbers(field.fieldNumber);
+    };
+
+    auto previousField = mPreviousFields.begin();
+    for (const FieldSpan& field : mCurrentFields) {
+        for (; previousField != mPreviousFields.end() &&
+             previousField->fieldNumber < field.fieldNumber;
+             previousField++) {
+            clearField(*previousField);
+        }
+        if (previousField != mPreviousFields.end() &&
+            previousField->fieldNumber == field.fieldNumber) {
+            const bool unchanged =
+                    fieldBytes(previous, *previousField) == fieldBytes(current, field);
+            previousField++;
+            if (unchanged) {
+                continue;
+            }
+        }
+        mDeltaLayer.append(fieldBytes(current, field));
+    }
+    for (; previousField != mPreviousFields.end(); previousField++) {
+        clearField(*previousField);
+    }
+
+    LayerProto* deltaLayer = entry.mutable_layers()->add_layers();
+    deltaLayer->ParseFromString(mDeltaLayer);
+    deltaLayer->set_id(layer.id());
+}
+
+bool LayerTraceDeltaDecoder::decode(LayersTraceProto& entry) {
+    if (!entry.is_delta()) {
+        mLayers.clear();
+        mLayerOrder.clear();
+        for (const LayerProto& layer : entry.layers().layers()) {
+            mLayerOrder.push_back(layer.id());
+            layer.SerializeToString(&mLayers[layer.id()]);
+        }
+        mHasKeyframe = true;
+        return true;
+    }
+    if (!mHasKeyframe) {
+        return false;
+    }
+    if (!decodeDelta(entry)) {
+        // The layers may have been partly updated, so the following deltas can't be decoded
+        // until the next keyframe.
+        mLayers.clear();
+        mLayerOrder.clear();
+        mHasKeyframe = false;
+        return false;
+    }
+    return true;
+}
+
+bool LayerTraceDeltaDecoder::decodeDelta(LayersTraceProto& entry) {
+    std::vector<FieldSpan> baseFields;
+    std::vector<FieldSpan> deltaFields;
+    std::string merged;
+    for (const LayerProto& deltaLayer : entry.layers().layers()) {
+        const std::string delta = deltaLayer.SerializeAsString();
+        std::string& base = mLayers[deltaLayer.id()];
+        if (std::find(entry.full_layer_ids().begin(), entry.full_layer_ids().end(),
+                      deltaLayer.id()) != entry.full_layer_ids().end()) {
+            base = delta;
+            continue;
+        }
+        if (!splitFields(base, baseFields) || !splitFields(delta, deltaFields)) {
+            return false;
+        }
+
+        const ClearedLayerFieldsProto* cleared = nullptr;
+        for (const ClearedLayerFieldsProto& clearedFields : entry.cleared_fields()) {
+            if (clearedFields.layer_id() == deltaLayer.id()) {
+                cleared = &clearedFields;
+                break;
+            }
+        }
+        auto isCleared = [&](uint32_t fieldNumber) {
+            return cleared &&
+                    std::find(cleared->field_numbers().begin(), cleared->field_numbers().end(),
+                              fieldNumber) != cleared->field_numbers().end();
+        };
+
+        // Merge both field lists in field number order, changed fields win over the base.
+        merged.clear();
+        auto baseField = baseFields.begin();
+        for (const FieldSpan& field : deltaFields) {
+            for (; baseField != baseFields.end() && baseField->fieldNumber < field.fieldNumber;
+                 baseField++) {
+                if (!isCleared(baseField->fieldNumber)) {
+                    merged.append(fieldBytes(base, *baseField));
+                }
+            }
+            if (baseField != baseFields.end() && baseField->fieldNumber == field.fieldNumber) {
+                baseField++;
+            }
+            merged.append(fieldBytes(delta, field));
+        }
+        for (; baseField != baseFields.end(); baseField++) {
+            if (!isCleared(baseField->fieldNumber)) {
+                merged.append(fieldBytes(base, *baseField));
+            }
+        }
+        base.swap(merged);
+    }
+
+    if (entry.layer_order_size() > 0) {
+        mLayerOrder.assign(entry.layer_order().begin(), entry.layer_order().end());
+        const std::unordered_set<int32_t> layerIds(mLayerOrder.begin(), mLayerOrder.end());
+        for (auto it = mLayers.begin(); it != mLayers.end();) {
+            if (layerIds.count(it->first) == 0) {
+                it = mLayers.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    LayersProto* layers = entry.mutable_layers();
+    layers->Clear();
+    for (const int32_t layerId : mLayerOrder) {
+        const auto it = mLayers.find(layerId);
+        if (it == mLayers.end() || !layers->add_layers()->ParseFromString(it->second)) {
+            return false;
+        }
+    }
+    entry.clear_is_delta();
+    entry.clear_layer_order();
+    entry.clear_cleared_fields();
+    entry.clear_full_layer_ids();
+    return true;
+}
+
+} // namespace android
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <layerproto/LayerProtoHeader.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace android::surfaceflinger;
+
+namespace android {
+
+namespace layertracedelta {
+
+// Byte range of all the occurrences of one field in a serialized message. Protobuf serializes
+// fields in field number order and the elements of repeated fields back to back, so a field is
+// always a single contiguous range.
+struct FieldSpan {
+    uint32_t fieldNumber;
+    size_t offset;
+    size_t size;
+};
+
+// Splits a serialized message into its fields, in field number order. Returns false if the
+// message is malformed.
+bool splitFields(std::string_view message, std::vector<FieldSpan>& outFields);
+
+} // namespace layertracedelta
+
+/*
+ * Encodes the layer snapshots recorded by LayerTracing as periodic keyframes, which hold the full
+ * LayersProto, followed by deltas that only hold the layers that changed since the previous
+ * entry. A changed layer only carries its id and the fields that changed, compared field by field
+ * on the serialized LayerProto so no reflection is needed. Fields that were set and are now cleared
+ * are listed separately, as are layer additions, removals and reorders. A layer that can't be
+ * compared field by field is stored whole.
+ *
+ * Deltas are decoded by LayerTraceDeltaDecoder, see Tracing/tools for the tool that rewrites a
+ * delta encoded trace into full snapshots.
+ */
+class LayerTraceDeltaEncoder {
+public:
+    static constexpr uint32_t kDefaultKeyframeInterval = 64;
+
+    explicit LayerTraceDeltaEncoder(uint32_t keyframeInterval = kDefaultKeyframeInterval)
+          : mKeyframeInterval(keyframeInterval) {}
+
+    // Stores layers into entry, either as a keyframe or as a delta against the previous call.
+    void encode(LayersProto&& layers, LayersTraceProto& entry);
+
+    // Makes the next entry a keyframe.
+    void reset();
+
+private:
+    struct LayerState {
+        std::string serialized;
+        uint64_t lastSeenFrame = 0;
+    };
+
+    void encodeDelta(const LayerProto& layer, LayerState& state, LayersTraceProto& entry);
+
+    const uint32_t mKeyframeInterval;
+    uint32_t mEntriesSinceKeyframe = 0;
+    bool mNeedsKeyframe = true;
+    uint64_t mFrame = 0;
+    std::unordered_map<int32_t, LayerState> mLayers;
+    std::vector<int32_t> mLayerOrder;
+
+    // Scratch space reused across entries.
+    std::string mSerializedLayer;
+    std::string mDeltaLayer;
+    std::vector<int32_t> mCurrentOrder;
+    std::vector<layertracedelta::FieldSpan> mPreviousFields;
+    std::vector<layertracedelta::FieldSpan> mCurrentFields;
+};
+
+/*
+ * Rebuilds full snapshots from entries written by LayerTraceDeltaEncoder. Entries must be decoded
+ * in order.
+ */
+class LayerTraceDeltaDecoder {
+public:
+    // Rewrites entry into a full snapshot. Keyframes are left as is. Returns false when entry is a
+    // delta and no keyframe was decoded before it, e.g. because the keyframe was evicted from the
+    // ring buffer, or when the entry is malformed. In the latter case, the deltas that follow
+    // can't be decoded either, until the next keyframe.
+    bool decode(LayersTraceProto& entry);
+
+private:
+    bool decodeDelta(LayersTraceProto& entry);
+
+    std::unordered_map<int32_t, std::string> mLayers;
+    std::vector<int32_t> mLayerOrder;
+    bool mHasKeyframe = false;
+};
+
+} // namespace android
@@ -41,6 +41,7 @@ bool LayerTracing::enable() {
         return false;
     }
     mBuffer->setSize(mBufferSizeInBytes);
+    mDeltaEncoder.reset();
     mEnabled = true;
     return true;
 }
@@ -73,6 +74,11 @@ status_t LayerTracing::writeToFile() {
 
 void LayerTracing::setTraceFlags(uint32_t flags) {
     std::scoped_lock lock(mTraceLock);
+    if (mFlags != flags) {
+        // The layer protos depend on the flags, don't diff against a snapshot taken with the
+        // previous ones.
+        mDeltaEncoder.reset();
+    }
     mFlags = flags;
 }
 
@@ -118,7 +124,11 @@ void LayerTracing::notify(bool visibleRegionDirty, int64_t time) {
     if (flagIsSet(LayerTracing::TRACE_EXTRA)) {
         mFlinger.dumpOffscreenLayersProto(layers);
     }
-    entry.mutable_layers()->Swap(&layers);
+    if (flagIsSet(LayerTracing::TRACE_DELTAS)) {
+        mDeltaEncoder.encode(std::move(layers), entry);
+    } else {
+        entry.mutable_layers()->Swap(&layers);
+    }
 
     if (flagIsSet(LayerTracing::TRACE_HWC)) {
         std::string hwcDump;
@@ -25,6 +25,8 @@
 #include <memory>
 #include <mutex>
 
+#include "LayerTraceDelta.h"
+
 using namespace android::surfaceflinger;
 
 namespace android {
@@ -55,6 +57,11 @@ public:
         TRACE_EXTRA = 1 << 3,
         TRACE_HWC = 1 << 4,
         TRACE_BUFFERS = 1 << 5,
+        // Record periodic keyframes and, in between, only the layer fields that changed. Use
+        // Tracing/tools/layertracedecoder to turn the trace back into full snapshots. Entries are
+        // much smaller, but take more CPU to record, as every layer is still serialized to be
+        // compared with the previous entry.
+        TRACE_DELTAS = 1 << 6,
         TRACE_ALL = TRACE_INPUT | TRACE_COMPOSITION | TRACE_EXTRA,
     };
     void setTraceFlags(uint32_t flags);
@@ -72,6 +79,7 @@ private:
     std::unique_ptr<RingBuffer<LayersTraceFileProto, LayersTraceProto>> mBuffer
             GUARDED_BY(mTraceLock);
     size_t mBufferSizeInBytes GUARDED_BY(mTraceLock) = 20 * 1024 * 1024;
+    LayerTraceDeltaEncoder mDeltaEncoder GUARDED_BY(mTraceLock);
 };
 
 } // namespace android
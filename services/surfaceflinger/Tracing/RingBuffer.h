@@ -18,88 +18,182 @@
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include <log/log.h>
 #include <utils/Errors.h>
 #include <utils/Timers.h>
 #include <utils/Trace.h>
+#include <algorithm>
+#include <array>
 #include <chrono>
-#include <queue>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
 
 namespace android {
 
 class SurfaceFlinger;
 
+/*
+ * Fixed capacity ring of serialized EntryProtos, stored back to back in a single contiguous
+ * allocation. Each record is a 32-bit length followed by the serialized proto, padded to keep the
+ * length words aligned. Protos are serialized straight into the ring, and evicting old records
+ * only moves the head offset, so steady state tracing doesn't allocate.
+ *
+ * A record never straddles the end of the storage. When the next record doesn't fit in the space
+ * left at the end, the ring wraps and the data ends at mWrapOffset.
+ */
 template <typename FileProto, typename EntryProto>
 class RingBuffer {
 public:
     size_t size() const { return mSizeInBytes; }
     size_t used() const { return mUsedInBytes; }
-    size_t frameCount() const { return mStorage.size(); }
-    void setSize(size_t newSize) { mSizeInBytes = newSize; }
-    const std::string& front() const { return mStorage.front(); }
-    const std::string& back() const { return mStorage.back(); }
+    size_t frameCount() const { return mFrameCount; }
+    // The oldest and newest records. Only valid while frameCount() > 0, and until the next
+    // modification of the buffer.
+    std::string_view front() const { return recordAt(mHead); }
+    std::string_view back() const { return recordAt(mLastRecord); }
+
+    // Changes the capacity of the buffer, keeping as many of the newest records as fit.
+    // onEvicted(std::string_view) is called for each record dropped, oldest first.
+    template <typename EvictFn>
+    void setSize(size_t newSize, EvictFn&& onEvicted) {
+        if (newSize == mSizeInBytes) {
+            return;
+        }
+        if (mStorage == nullptr) {
+            mSizeInBytes = newSize;
+            return;
+        }
+
+        RingBuffer resized;
+        resized.mSizeInBytes = newSize;
+        resized.allocateStorage();
+        while (mFrameCount > 0 && mUsedInBytes > newSize) {
+            onEvicted(front());
+            evictFront();
+        }
+        forEach([&](std::string_view record) {
+            uint8_t* dest = resized.reserve(record.size(), onEvicted);
+            if (dest) {
+                std::memcpy(dest, record.data(), record.size());
+            }
+        });
+        *this = std::move(resized);
+    }
+
+    void setSize(size_t newSize) {
+        setSize(newSize, [](std::string_view) {});
+    }
 
     void reset() {
-        // use the swap trick to make sure memory is released
-        std::deque<std::string>().swap(mStorage);
+        // Release the storage, it's reallocated on the next emplace.
+        mStorage.reset();
+        mHead = 0;
+        mTail = 0;
+        mLastRecord = 0;
+        mWrapOffset = 0;
+        mFrameCount = 0;
         mUsedInBytes = 0U;
     }
 
-    void writeToProto(FileProto& fileProto) {
-        fileProto.mutable_entry()->Reserve(static_cast<int>(mStorage.size()) +
+    // Calls fn(std::string_view) for each record, oldest first.
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        size_t offset = mHead;
+        for (size_t i = 0; i < mFrameCount; i++) {
+            if (offset == mWrapOffset) {
+                offset = 0;
+            }
+            std::string_view record = recordAt(offset);
+            fn(record);
+            offset += recordSize(record.size());
+        }
+    }
+
+    void writeToProto(FileProto& fileProto) const {
+        fileProto.mutable_entry()->Reserve(static_cast<int>(mFrameCount) +
                                            fileProto.entry().size());
-        for (const std::string& entry : mStorage) {
+        forEach([&](std::string_view record) {
             EntryProto* entryProto = fileProto.add_entry();
-            entryProto->ParseFromString(entry);
-        }
+            entryProto->ParseFromArray(record.data(), static_cast<int>(record.size()));
+        });
     }
 
-    status_t writeToFile(FileProto& fileProto, std::string filename) {
+    // Writes fileProto followed by every record in the buffer as entries of fileProto. The records
+    // are streamed from the ring with writev rather than being parsed and re-serialized.
+    status_t writeToFile(const FileProto& fileProto, std::string filename) const {
         ATRACE_CALL();
-        writeToProto(fileProto);
-        std::string output;
-        if (!fileProto.SerializeToString(&output)) {
+        std::string header;
+        if (!fileProto.SerializeToString(&header)) {
             ALOGE("Could not serialize proto.");
             return UNKNOWN_ERROR;
         }
 
         // -rw-r--r--
         const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
-        if (!android::base::WriteStringToFile(output, filename, mode, getuid(), getgid(), true)) {
+        base::unique_fd fd(TEMP_FAILURE_RETRY(open(filename.c_str(),
+                                                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC |
+                                                           O_NOFOLLOW,
+                                                   mode)));
+        if (fd == -1) {
             ALOGE("Could not save the proto file %s", filename.c_str());
             return PERMISSION_DENIED;
         }
+        if (fchmod(fd.get(), mode) == -1 || fchown(fd.get(), getuid(), getgid()) == -1) {
+            ALOGE("Could not set permissions on the proto file %s", filename.c_str());
+            return PERMISSION_DENIED;
+        }
+
+        // Each record needs a field tag and a length prefix to form a valid entry field.
+        std::vector<std::array<uint8_t, kMaxFieldPrefixSize>> prefixes(mFrameCount);
+        std::vector<iovec> iovecs;
+        iovecs.reserve(1 + 2 * mFrameCount);
+        iovecs.push_back({header.data(), header.size()});
+        size_t recordIndex = 0;
+        forEach([&](std::string_view record) {
+            auto& prefix = prefixes[recordIndex++];
+            const size_t prefixSize = writeFieldPrefix(record.size(), prefix.data());
+            iovecs.push_back({prefix.data(), prefixSize});
+            iovecs.push_back({const_cast<char*>(record.data()), record.size()});
+        });
+
+        if (!writeAll(fd.get(), iovecs)) {
+            ALOGE("Could not write the proto file %s", filename.c_str());
+            return UNKNOWN_ERROR;
+        }
         return NO_ERROR;
     }
 
-    std::vector<std::string> emplace(std::string&& serializedProto) {
-        std::vector<std::string> replacedEntries;
-        size_t protoSize = static_cast<size_t>(serializedProto.size());
-        while (mUsedInBytes + protoSize > mSizeInBytes) {
-            if (mStorage.empty()) {
-                return {};
-            }
-            mUsedInBytes -= static_cast<size_t>(mStorage.front().size());
-            replacedEntries.emplace_back(mStorage.front());
-            mStorage.pop_front();
+    // Serializes proto directly into the buffer, evicting the oldest records to make room.
+    // onEvicted(std::string_view) is called for each evicted record before it is overwritten.
+    template <typename EvictFn>
+    void emplace(const EntryProto& proto, EvictFn&& onEvicted) {
+        const size_t protoSize = proto.ByteSizeLong();
+        uint8_t* dest = reserve(protoSize, onEvicted);
+        if (dest) {
+            proto.SerializeWithCachedSizesToArray(dest);
         }
-        mUsedInBytes += protoSize;
-        mStorage.emplace_back(serializedProto);
-        return replacedEntries;
     }
 
-    std::vector<std::string> emplace(EntryProto&& proto) {
-        std::string serializedProto;
-        proto.SerializeToString(&serializedProto);
-        return emplace(std::move(serializedProto));
+    void emplace(const EntryProto& proto) {
+        emplace(proto, [](std::string_view) {});
     }
 
     void dump(std::string& result) const {
         std::chrono::milliseconds duration(0);
         if (frameCount() > 0) {
             EntryProto entry;
-            entry.ParseFromString(mStorage.front());
+            const std::string_view record = front();
+            entry.ParseFromArray(record.data(), static_cast<int>(record.size()));
             duration = std::chrono::duration_cast<std::chrono::milliseconds>(
                     std::chrono::nanoseconds(systemTime() - entry.elapsed_realtime_nanos()));
         }
@@ -111,9 +205,127 @@ public:
     }
 
 private:
+    using RecordHeader = uint32_t;
+    static constexpr size_t kHeaderSize = sizeof(RecordHeader);
+    // One byte for the field tag and up to five bytes for the varint length.
+    static constexpr size_t kMaxFieldPrefixSize = 6;
+
+    static constexpr size_t recordSize(size_t payloadSize) {
+        return (kHeaderSize + payloadSize + kHeaderSize - 1) & ~(kHeaderSize - 1);
+    }
+
+    static size_t writeFieldPrefix(size_t payloadSize, uint8_t* out) {
+        static_assert(FileProto::kEntryFieldNumber < 16, "entry tag must fit in a single byte");
+        size_t size = 0;
+        out[size++] = static_cast<uint8_t>(FileProto::kEntryFieldNumber << 3 |
+                                           2 /* WIRETYPE_LENGTH_DELIMITED */);
+        do {
+            const auto byte = static_cast<uint8_t>(payloadSize & 0x7f);
+            payloadSize >>= 7;
+            out[size++] = payloadSize ? static_cast<uint8_t>(byte | 0x80) : byte;
+        } while (payloadSize);
+        return size;
+    }
+
+    static bool writeAll(int fd, std::vector<iovec>& iovecs) {
+        size_t index = 0;
+        while (index < iovecs.size()) {
+            const int count = static_cast<int>(std::min<size_t>(IOV_MAX, iovecs.size() - index));
+            ssize_t written = TEMP_FAILURE_RETRY(writev(fd, &iovecs[index], count));
+            if (written < 0) {
+                return false;
+            }
+            // Skip the fully written buffers and adjust a partially written one.
+            while (index < iovecs.size() && static_cast<size_t>(written) >= iovecs[index].iov_len) {
+                written -= static_cast<ssize_t>(iovecs[index].iov_len);
+                index++;
+            }
+            if (written > 0) {
+                iovecs[index].iov_base = static_cast<uint8_t*>(iovecs[index].iov_base) + written;
+                iovecs[index].iov_len -= static_cast<size_t>(written);
+            }
+        }
+        return true;
+    }
+
+    std::string_view recordAt(size_t offset) const {
+        RecordHeader length;
+        std::memcpy(&length, &mStorage[offset], kHeaderSize);
+        return {reinterpret_cast<const char*>(&mStorage[offset + kHeaderSize]), length};
+    }
+
+    void allocateStorage() {
+        mStorage = std::make_unique<uint8_t[]>(mSizeInBytes);
+        mWrapOffset = mSizeInBytes;
+    }
+
+    void evictFront() {
+        const size_t evictedSize = recordSize(recordAt(mHead).size());
+        mHead += evictedSize;
+        mUsedInBytes -= evictedSize;
+        mFrameCount--;
+        if (mHead == mWrapOffset) {
+            mHead = 0;
+            mWrapOffset = mSizeInBytes;
+        }
+    }
+
+    // Makes room for a record with payloadSize bytes and returns where to write the payload, or
+    // nullptr if the record can never fit.
+    template <typename EvictFn>
+    uint8_t* reserve(size_t payloadSize, EvictFn& onEvicted) {
+        const size_t needed = recordSize(payloadSize);
+        if (needed > mSizeInBytes) {
+            return nullptr;
+        }
+        if (mStorage == nullptr) {
+            allocateStorage();
+        }
+
+        while (true) {
+            if (mFrameCount == 0) {
+                mHead = 0;
+                mTail = 0;
+                mWrapOffset = mSizeInBytes;
+                break;
+            }
+            if (mTail > mHead) {
+                if (mSizeInBytes - mTail >= needed) {
+                    break;
+                }
+                // Not enough room left at the end, continue from the start of the storage.
+                mWrapOffset = mTail;
+                mTail = 0;
+                continue;
+            }
+            if (mHead - mTail >= needed) {
+                break;
+            }
+            onEvicted(front());
+            evictFront();
+        }
+
+        const RecordHeader length = static_cast<RecordHeader>(payloadSize);
+        std::memcpy(&mStorage[mTail], &length, kHeaderSize);
+        mLastRecord = mTail;
+        mTail += needed;
+        mUsedInBytes += needed;
+        mFrameCount++;
+        return &mStorage[mLastRecord + kHeaderSize];
+    }
+
+    std::unique_ptr<uint8_t[]> mStorage;
+    // Offset of the oldest record.
+    size_t mHead = 0;
+    // Offset where the next record is written.
+    size_t mTail = 0;
+    // Offset of the newest record.
+    size_t mLastRecord = 0;
+    // Offset where the data stops before wrapping to the start of the storage.
+    size_t mWrapOffset = 0;
+    size_t mFrameCount = 0;
     size_t mUsedInBytes = 0U;
     size_t mSizeInBytes = 0U;
-    std::deque<std::string> mStorage;
 };
 
 } // namespace android
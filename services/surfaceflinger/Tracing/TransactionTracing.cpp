@@ -127,7 +127,10 @@ status_t TransactionTracing::writeToFile(std::string filename) {
 void TransactionTracing::setBufferSize(size_t bufferSizeInBytes) {
     std::scoped_lock lock(mTraceLock);
     mBufferSizeInBytes = bufferSizeInBytes;
-    mBuffer.setSize(mBufferSizeInBytes);
+    mBuffer.setSize(mBufferSizeInBytes, [&](std::string_view removedEntry) {
+        base::ScopedLockAssertion assumeLocked(mTraceLock);
+        onEntryEvictedLocked(removedEntry);
+    });
 }
 
 proto::TransactionTraceFile TransactionTracing::createTraceFileProto() const {
@@ -198,8 +201,11 @@ void TransactionTracing::addEntry(const std::vector<CommittedTransactions>& comm
                                   const std::vector<int32_t>& removedLayers) {
     ATRACE_CALL();
     std::scoped_lock lock(mTraceLock);
-    std::vector<std::string> removedEntries;
     proto::TransactionTraceEntry entryProto;
+    auto onEvicted = [&](std::string_view removedEntry) {
+        base::ScopedLockAssertion assumeLocked(mTraceLock);
+        onEntryEvictedLocked(removedEntry);
+    };
 
     while (auto incomingTransaction = mTransactionQueue.pop()) {
         auto transaction = *incomingTransaction;
@@ -256,13 +262,8 @@ void TransactionTracing::addEntry(const std::vector<CommittedTransactions>& comm
             }
         }
 
-        std::string serializedProto;
-        entryProto.SerializeToString(&serializedProto);
+        mBuffer.emplace(entryProto, onEvicted);
         entryProto.Clear();
-        std::vector<std::string> entries = mBuffer.emplace(std::move(serializedProto));
-        removedEntries.reserve(removedEntries.size() + entries.size());
-        removedEntries.insert(removedEntries.end(), std::make_move_iterator(entries.begin()),
-                              std::make_move_iterator(entries.end()));
 
         entryProto.mutable_removed_layer_handles()->Reserve(
                 static_cast<int32_t>(mRemovedLayerHandles.size()));
@@ -272,12 +273,6 @@ void TransactionTracing::addEntry(const std::vector<CommittedTransactions>& comm
         mRemovedLayerHandles.clear();
     }
 
-    proto::TransactionTraceEntry removedEntryProto;
-    for (const std::string& removedEntry : removedEntries) {
-        removedEntryProto.ParseFromString(removedEntry);
-        updateStartingStateLocked(removedEntryProto);
-        removedEntryProto.Clear();
-    }
     mTransactionsAddedToBufferCv.notify_one();
 }
 
@@ -290,7 +285,8 @@ void TransactionTracing::flush(int64_t vsyncId) {
     mTransactionsAddedToBufferCv.wait(lock, [&]() REQUIRES(mTraceLock) {
         proto::TransactionTraceEntry entry;
         if (mBuffer.used() > 0) {
-            entry.ParseFromString(mBuffer.back());
+            const std::string_view lastEntry = mBuffer.back();
+            entry.ParseFromArray(lastEntry.data(), static_cast<int>(lastEntry.size()));
         }
         return mBuffer.used() > 0 && entry.vsync_id() >= vsyncId;
     });
@@ -353,6 +349,14 @@ void TransactionTracing::tryPushToTracingThread() {
     }
 }
 
+void TransactionTracing::onEntryEvictedLocked(std::string_view removedEntry) {
+    // The entry is overwritten once the eviction callback returns, so fold it into the starting
+    // state now.
+    proto::TransactionTraceEntry removedEntryProto;
+    removedEntryProto.ParseFromArray(removedEntry.data(), static_cast<int>(removedEntry.size()));
+    updateStartingStateLocked(removedEntryProto);
+}
+
 void TransactionTracing::updateStartingStateLocked(
         const proto::TransactionTraceEntry& removedEntry) {
     mStartingTimestamp = removedEntry.elapsed_realtime_nanos();
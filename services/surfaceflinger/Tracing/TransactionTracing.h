@@ -23,6 +23,7 @@
 
 #include <memory>
 #include <mutex>
+#include <string_view>
 #include <thread>
 
 #include "RingBuffer.h"
@@ -116,6 +117,7 @@ private:
     int32_t getLayerIdLocked(const sp<IBinder>& layerHandle) REQUIRES(mTraceLock);
     void tryPushToTracingThread() EXCLUDES(mMainThreadLock);
     void addStartingStateToProtoLocked(proto::TransactionTraceFile& proto) REQUIRES(mTraceLock);
+    void onEntryEvictedLocked(std::string_view removedEntry) REQUIRES(mTraceLock);
     void updateStartingStateLocked(const proto::TransactionTraceEntry& entry) REQUIRES(mTraceLock);
 
     // TEST
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LayerTraceDecoder"
+
+#include <Tracing/LayerTraceDelta.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace android;
+
+int main(int argc, char** argv) {
+    if (argc > 3) {
+        std::cout << "Usage: " << argv[0] << " [layers-trace-path] [output-layers-trace-path]\n";
+        return -1;
+    }
+
+    const char* inputPath = (argc > 1) ? argv[1] : "/data/misc/wmtrace/layers_trace.winscope";
+    std::cout << "Parsing " << inputPath << "\n";
+    std::fstream input(inputPath, std::ios::in | std::ios::binary);
+    if (!input) {
+        std::cout << "Error: Could not open " << inputPath;
+        return -1;
+    }
+
+    LayersTraceFileProto traceFile;
+    if (!traceFile.ParseFromIstream(&input)) {
+        std::cout << "Error: Failed to parse " << inputPath;
+        return -1;
+    }
+
+    // Deltas recorded before the first keyframe left in the ring buffer can't be decoded, drop
+    // them.
+    LayerTraceDeltaDecoder decoder;
+    LayersTraceFileProto outputFile;
+    outputFile.set_magic_number(traceFile.magic_number());
+    int droppedEntries = 0;
+    for (LayersTraceProto& entry : *traceFile.mutable_entry()) {
+        if (!decoder.decode(entry)) {
+            droppedEntries++;
+            continue;
+        }
+        outputFile.add_entry()->Swap(&entry);
+    }
+    std::cout << "Decoded " << outputFile.entry_size() << " entries, dropped " << droppedEntries
+              << "\n";
+
+    const char* outputPath =
+            (argc == 3) ? argv[2] : "/data/misc/wmtrace/layers_trace_decoded.winscope";
+    std::cout << "Writing " << outputPath << "\n";
+    std::fstream output(outputPath, std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!output || !outputFile.SerializeToOstream(&output)) {
+        std::cout << "Error: Failed to write " << outputPath;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "TransactionTraceBenchmark"
+
+#include <log/log.h>
+#include <utils/Timers.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "TransactionTraceReplayer.h"
+
+// Counts the C++ heap allocations made while replaying. Allocations made through malloc directly
+// are not counted.
+namespace {
+std::atomic<uint64_t> gAllocations = 0;
+std::atomic<uint64_t> gAllocatedBytes = 0;
+
+void* countedAllocate(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    LOG_ALWAYS_FATAL_IF(ptr == nullptr, "Out of memory allocating %zu bytes", size);
+    return ptr;
+}
+} // namespace
+
+void* operator new(size_t size) {
+    return countedAllocate(size);
+}
+void* operator new[](size_t size) {
+    return countedAllocate(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+using namespace android;
+
+namespace {
+
+struct Sample {
+    nsecs_t commitWallTime;
+    nsecs_t commitCpuTime;
+    uint64_t commitAllocations;
+};
+
+nsecs_t percentile(std::vector<nsecs_t> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    const auto index = static_cast<size_t>(p * static_cast<double>(values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + static_cast<ptrdiff_t>(index), values.end());
+    return values[index];
+}
+
+void printDistribution(const char* name, const std::vector<nsecs_t>& values) {
+    nsecs_t total = 0;
+    for (const nsecs_t value : values) {
+        total += value;
+    }
+    const nsecs_t mean = values.empty() ? 0 : total / static_cast<nsecs_t>(values.size());
+    std::cout << "  " << name << " (us): mean " << ns2us(mean) << " p50 "
+              << ns2us(percentile(values, 0.5)) << " p90 " << ns2us(percentile(values, 0.9))
+              << " p99 " << ns2us(percentile(values, 0.99)) << " max "
+              << ns2us(values.empty() ? 0 : *std::max_element(values.begin(), values.end()))
+              << "\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool composite = true;
+    const char* transactionTracePath = "/data/misc/wmtrace/transactions_trace.winscope";
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--no-composite") == 0) {
+            composite = false;
+        } else if (argv[i][0] == '-') {
+            std::cout << "Usage: " << argv[0] << " [--no-composite] [transaction-trace-path]\n";
+            return -1;
+        } else {
+            transactionTracePath = argv[i];
+        }
+    }
+
+    std::cout << "Parsing " << transactionTracePath << "\n";
+    std::fstream input(transactionTracePath, std::ios::in | std::ios::binary);
+    if (!input) {
+        std::cout << "Error: Could not open " << transactionTracePath;
+        return -1;
+    }
+    proto::TransactionTraceFile traceFile;
+    if (!traceFile.ParseFromIstream(&input)) {
+        std::cout << "Error: Failed to parse " << transactionTracePath;
+        return -1;
+    }
+    if (traceFile.entry_size() == 0) {
+        std::cout << "Error: No entries in " << transactionTracePath;
+        return -1;
+    }
+
+    TransactionTraceReplayer replayer(composite);
+    std::vector<Sample> samples;
+    samples.reserve(static_cast<size_t>(traceFile.entry_size()));
+    uint64_t transactions = 0;
+    nsecs_t queueTime = 0;
+    uint64_t queueAllocations = 0;
+    const uint64_t allocatedBytesBefore = gAllocatedBytes.load();
+
+    ALOGD("Replaying %d entries...", traceFile.entry_size());
+    for (const proto::TransactionTraceEntry& entry : traceFile.entry()) {
+        transactions += static_cast<uint64_t>(entry.transactions_size());
+
+        uint64_t allocations = gAllocations.load(std::memory_order_relaxed);
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        replayer.queueEntry(entry);
+        queueTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        queueAllocations += gAllocations.load(std::memory_order_relaxed) - allocations;
+
+        allocations = gAllocations.load(std::memory_order_relaxed);
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        const nsecs_t cpuStart = systemTime(SYSTEM_TIME_THREAD);
+        replayer.commit(entry);
+        samples.push_back({systemTime(SYSTEM_TIME_MONOTONIC) - start,
+                           systemTime(SYSTEM_TIME_THREAD) - cpuStart,
+                           gAllocations.load(std::memory_order_relaxed) - allocations});
+    }
+    const uint64_t allocatedBytes = gAllocatedBytes.load() - allocatedBytesBefore;
+
+    std::vector<nsecs_t> wallTimes;
+    std::vector<nsecs_t> cpuTimes;
+    std::vector<nsecs_t> allocationCounts;
+    nsecs_t commitTime = 0;
+    uint64_t commitAllocations = 0;
+    for (const Sample& sample : samples) {
+        wallTimes.push_back(sample.commitWallTime);
+        cpuTimes.push_back(sample.commitCpuTime);
+        allocationCounts.push_back(static_cast<nsecs_t>(sample.commitAllocations));
+        commitTime += sample.commitWallTime;
+        commitAllocations += sample.commitAllocations;
+    }
+
+    const double seconds = static_cast<double>(queueTime + commitTime) / 1e9;
+    std::cout << "Replayed " << samples.size() << " vsyncs, " << transactions
+              << " transactions (composition " << (composite ? "on" : "off") << ")\n";
+    std::cout << "Main thread per vsync:\n";
+    printDistribution("wall time", wallTimes);
+    printDistribution("cpu time", cpuTimes);
+    std::cout << "  allocations: mean " << commitAllocations / samples.size() << " p99 "
+              << percentile(allocationCounts, 0.99) << "\n";
+    std::cout << "Transactions per second: "
+              << (seconds > 0 ? static_cast<double>(transactions) / seconds : 0) << "\n";
+    std::cout << "Allocations: " << commitAllocations << " on commit, " << queueAllocations
+              << " queueing transactions, " << allocatedBytes << " bytes total\n";
+    return 0;
+}
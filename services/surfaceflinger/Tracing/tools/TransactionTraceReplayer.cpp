@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "TransactionTraceReplayer"
+
+#include <TestableSurfaceFlinger.h>
+#include <Tracing/TransactionProtoParser.h>
+#include <binder/IPCThreadState.h>
+#include <compositionengine/Display.h>
+#include <compositionengine/mock/DisplaySurface.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <gui/LayerState.h>
+#include <log/log.h>
+#include <mock/DisplayHardware/MockComposer.h>
+#include <mock/DisplayHardware/MockPowerAdvisor.h>
+#include <mock/MockEventThread.h>
+#include <mock/system/window/MockNativeWindow.h>
+#include <renderengine/ExternalTexture.h>
+#include <renderengine/mock/FakeExternalTexture.h>
+#include <renderengine/mock/RenderEngine.h>
+#include <utils/String16.h>
+#include <string>
+
+#include "TransactionTraceReplayer.h"
+
+namespace android {
+
+class Factory final : public surfaceflinger::Factory {
+public:
+    ~Factory() = default;
+
+    std::unique_ptr<HWComposer> createHWComposer(const std::string&) override { return nullptr; }
+
+    std::unique_ptr<scheduler::VsyncConfiguration> createVsyncConfiguration(
+            Fps /*currentRefreshRate*/) override {
+        return std::make_unique<scheduler::FakePhaseOffsets>();
+    }
+
+    sp<SurfaceInterceptor> createSurfaceInterceptor() override {
+        return new android::impl::SurfaceInterceptor();
+    }
+
+    sp<StartPropertySetThread> createStartPropertySetThread(
+            bool /* timestampPropertyValue */) override {
+        return nullptr;
+    }
+
+    sp<DisplayDevice> createDisplayDevice(DisplayDeviceCreationArgs& /* creationArgs */) override {
+        return nullptr;
+    }
+
+    sp<GraphicBuffer> createGraphicBuffer(uint32_t /* width */, uint32_t /* height */,
+                                          PixelFormat /* format */, uint32_t /* layerCount */,
+                                          uint64_t /* usage */,
+                                          std::string /* requestorName */) override {
+        return nullptr;
+    }
+
+    void createBufferQueue(sp<IGraphicBufferProducer>* /* outProducer */,
+                           sp<IGraphicBufferConsumer>* /* outConsumer */,
+                           bool /* consumerIsSurfaceFlinger */) override {}
+
+    sp<IGraphicBufferProducer> createMonitoredProducer(
+            const sp<IGraphicBufferProducer>& /* producer */,
+            const sp<SurfaceFlinger>& /* flinger */, const wp<Layer>& /* layer */) override {
+        return nullptr;
+    }
+
+    sp<BufferLayerConsumer> createBufferLayerConsumer(
+            const sp<IGraphicBufferConsumer>& /* consumer */,
+            renderengine::RenderEngine& /* renderEngine */, uint32_t /* textureName */,
+            Layer* /* layer */) override {
+        return nullptr;
+    }
+
+    std::unique_ptr<surfaceflinger::NativeWindowSurface> createNativeWindowSurface(
+            const sp<IGraphicBufferProducer>& /* producer */) override {
+        return nullptr;
+    }
+
+    std::unique_ptr<compositionengine::CompositionEngine> createCompositionEngine() override {
+        return compositionengine::impl::createCompositionEngine();
+    }
+
+    sp<ContainerLayer> createContainerLayer(const LayerCreationArgs& args) {
+        return sp<ContainerLayer>::make(args);
+    }
+
+    sp<BufferStateLayer> createBufferStateLayer(const LayerCreationArgs& args) {
+        return new BufferStateLayer(args);
+    }
+
+    sp<EffectLayer> createEffectLayer(const LayerCreationArgs& args) {
+        return new EffectLayer(args);
+    }
+
+    sp<BufferQueueLayer> createBufferQueueLayer(const LayerCreationArgs&) override {
+        return nullptr;
+    }
+
+    std::unique_ptr<FrameTracer> createFrameTracer() override {
+        return std::make_unique<testing::NiceMock<mock::FrameTracer>>();
+    }
+
+    std::unique_ptr<frametimeline::FrameTimeline> createFrameTimeline(
+            std::shared_ptr<TimeStats> timeStats, pid_t surfaceFlingerPid = 0) override {
+        return std::make_unique<testing::NiceMock<mock::FrameTimeline>>(timeStats,
+                                                                        surfaceFlingerPid);
+    }
+};
+
+class MockSurfaceFlinger : public SurfaceFlinger {
+public:
+    MockSurfaceFlinger(Factory& factory)
+          : SurfaceFlinger(factory, SurfaceFlinger::SkipInitialization) {}
+    std::shared_ptr<renderengine::ExternalTexture> getExternalTextureFromBufferData(
+            const BufferData& bufferData, const char* /* layerName */) const override {
+        return std::make_shared<renderengine::mock::FakeExternalTexture>(bufferData.getWidth(),
+                                                                         bufferData.getHeight(),
+                                                                         bufferData.getId(),
+                                                                         bufferData
+                                                                                 .getPixelFormat(),
+                                                                         bufferData.getUsage());
+    };
+
+    // b/220017192 migrate from transact codes to ISurfaceComposer apis
+    void setLayerTracingFlags(int32_t flags) {
+        Parcel data;
+        Parcel reply;
+        data.writeInterfaceToken(String16("android.ui.ISurfaceComposer"));
+        data.writeInt32(flags);
+        transact(1033, data, &reply, 0 /* flags */);
+    }
+
+    void startLayerTracing(int64_t traceStartTime) {
+        Parcel data;
+        Parcel reply;
+        data.writeInterfaceToken(String16("android.ui.ISurfaceComposer"));
+        data.writeInt32(1);
+        data.writeInt64(traceStartTime);
+        transact(1025, data, &reply, 0 /* flags */);
+    }
+
+    void stopLayerTracing(const char* tracePath) {
+        Parcel data;
+        Parcel reply;
+        data.writeInterfaceToken(String16("android.ui.ISurfaceComposer"));
+        data.writeInt32(2);
+        data.writeCString(tracePath);
+        transact(1025, data, &reply, 0 /* flags */);
+    }
+};
+
+class TraceGenFlingerDataMapper : public TransactionProtoParser::FlingerDataMapper {
+public:
+    std::unordered_map<int32_t /*layerId*/, sp<IBinder> /* handle */> mLayerHandles;
+    sp<IBinder> getLayerHandle(int32_t layerId) const override {
+        if (layerId == -1) {
+            ALOGE("Error: Called with layer=%d", layerId);
+            return nullptr;
+        }
+        auto it = mLayerHandles.find(layerId);
+        if (it == mLayerHandles.end()) {
+            ALOGE("Error: Could not find handle for layer=%d", layerId);
+            return nullptr;
+        }
+        return it->second;
+    }
+};
+
+TransactionTraceReplayer::TransactionTraceReplayer(bool composite)
+      : mComposite(composite), mFactory(std::make_unique<Factory>()) {
+    mFlinger = new MockSurfaceFlinger(*mFactory);
+    mTestableFlinger = std::make_unique<TestableSurfaceFlinger>(mFlinger);
+    mTestableFlinger->setupRenderEngine(
+            std::make_unique<testing::NiceMock<renderengine::mock::RenderEngine>>());
+    mock::VsyncController* vsyncController = new testing::NiceMock<mock::VsyncController>();
+    mock::VSyncTracker* vsyncTracker = new testing::NiceMock<mock::VSyncTracker>();
+    mock::EventThread* eventThread = new testing::NiceMock<mock::EventThread>();
+    mock::EventThread* sfEventThread = new testing::NiceMock<mock::EventThread>();
+    mTestableFlinger->setupScheduler(std::unique_ptr<scheduler::VsyncController>(vsyncController),
+                                     std::unique_ptr<scheduler::VSyncTracker>(vsyncTracker),
+                                     std::unique_ptr<EventThread>(eventThread),
+                                     std::unique_ptr<EventThread>(sfEventThread),
+                                     TestableSurfaceFlinger::SchedulerCallbackImpl::kNoOp,
+                                     TestableSurfaceFlinger::kOneDisplayMode,
+                                     true /* useNiceMock */);
+
+    mComposer = new testing::NiceMock<Hwc2::mock::Composer>();
+    mTestableFlinger->setupComposer(std::unique_ptr<Hwc2::Composer>(mComposer));
+    mTestableFlinger->mutableMaxRenderTargetSize() = 16384;
+    if (mComposite) {
+        injectDisplay();
+    }
+
+    std::unique_ptr<TraceGenFlingerDataMapper> mapper =
+            std::make_unique<TraceGenFlingerDataMapper>();
+    mDataMapper = mapper.get();
+    mParser = std::make_unique<TransactionProtoParser>(std::move(mapper));
+}
+
+TransactionTraceReplayer::~TransactionTraceReplayer() {
+    mDataMapper->mLayerHandles.clear();
+}
+
+void TransactionTraceReplayer::injectDisplay() {
+    using FakeHwcDisplayInjector = TestableSurfaceFlinger::FakeHwcDisplayInjector;
+    using FakeDisplayDeviceInjector = TestableSurfaceFlinger::FakeDisplayDeviceInjector;
+    constexpr PhysicalDisplayId kDisplayId = PhysicalDisplayId::fromPort(42u);
+    constexpr bool kIsPrimary = true;
+
+    auto* powerAdvisor = new testing::NiceMock<Hwc2::mock::PowerAdvisor>();
+    mTestableFlinger->setupPowerAdvisor(std::unique_ptr<Hwc2::PowerAdvisor>(powerAdvisor));
+    FakeHwcDisplayInjector(kDisplayId, hal::DisplayType::PHYSICAL, kIsPrimary)
+            .setPowerMode(hal::PowerMode::ON)
+            .inject(mTestableFlinger.get(), mComposer);
+    const ui::Size resolution = FakeHwcDisplayInjector::DEFAULT_RESOLUTION;
+    auto compositionDisplay = compositionengine::impl::
+            createDisplay(mTestableFlinger->getCompositionEngine(),
+                          compositionengine::DisplayCreationArgsBuilder()
+                                  .setId(kDisplayId)
+                                  .setPixels(resolution)
+                                  .setPowerAdvisor(powerAdvisor)
+                                  .setName("replay display")
+                                  .build());
+    sp<compositionengine::mock::DisplaySurface> displaySurface =
+            new testing::NiceMock<compositionengine::mock::DisplaySurface>();
+    sp<mock::NativeWindow> nativeWindow = new testing::NiceMock<mock::NativeWindow>();
+    sp<DisplayDevice> display =
+            FakeDisplayDeviceInjector(*mTestableFlinger, compositionDisplay,
+                                      ui::DisplayConnectionType::Internal,
+                                      FakeHwcDisplayInjector::DEFAULT_HWC_DISPLAY_ID, kIsPrimary)
+                    .setDisplaySurface(displaySurface)
+                    .setNativeWindow(nativeWindow)
+                    .setPowerMode(hal::PowerMode::ON)
+                    .inject();
+    mTestableFlinger->mutableActiveDisplayToken() = display->getDisplayToken();
+}
+
+void TransactionTraceReplayer::startLayerTracing(int32_t flags, int64_t traceStartTime) {
+    mFlinger->setLayerTracingFlags(flags);
+    mFlinger->startLayerTracing(traceStartTime);
+}
+
+void TransactionTraceReplayer::stopLayerTracing(const char* tracePath) {
+    mFlinger->stopLayerTracing(tracePath);
+}
+
+void TransactionTraceReplayer::queueEntry(const proto::TransactionTraceEntry& entry) {
+    for (int j = 0; j < entry.added_layers_size(); j++) {
+        // create layers
+        TracingLayerCreationArgs tracingArgs;
+        mParser->fromProto(entry.added_layers(j), tracingArgs);
+
+        sp<IBinder> outHandle;
+        int32_t outLayerId;
+        LayerCreationArgs args(mTestableFlinger->flinger(), nullptr /* client */,
+                               tracingArgs.name, tracingArgs.flags, LayerMetadata());
+        args.sequence = std::make_optional<int32_t>(tracingArgs.layerId);
+
+        if (tracingArgs.mirrorFromId == -1) {
+            sp<IBinder> parentHandle = nullptr;
+            if ((tracingArgs.parentId != -1) &&
+                (mDataMapper->mLayerHandles.find(tracingArgs.parentId) ==
+                 mDataMapper->mLayerHandles.end())) {
+                args.addToRoot = false;
+            } else {
+                parentHandle = mDataMapper->getLayerHandle(tracingArgs.parentId);
+            }
+            mTestableFlinger->createLayer(args, &outHandle, parentHandle, &outLayerId,
+                                          nullptr /* parentLayer */,
+                                          nullptr /* outTransformHint */);
+        } else {
+            sp<IBinder> mirrorFromHandle = mDataMapper->getLayerHandle(tracingArgs.mirrorFromId);
+            mTestableFlinger->mirrorLayer(args, mirrorFromHandle, &outHandle, &outLayerId);
+        }
+        LOG_ALWAYS_FATAL_IF(outLayerId != tracingArgs.layerId,
+                            "Could not create layer expected:%d actual:%d", tracingArgs.layerId,
+                            outLayerId);
+        mDataMapper->mLayerHandles[tracingArgs.layerId] = outHandle;
+    }
+
+    for (int j = 0; j < entry.transactions_size(); j++) {
+        // apply transactions
+        TransactionState transaction = mParser->fromProto(entry.transactions(j));
+        mTestableFlinger->setTransactionState(transaction.frameTimelineInfo, transaction.states,
+                                              transaction.displays, transaction.flags,
+                                              transaction.applyToken,
+                                              transaction.inputWindowCommands,
+                                              transaction.desiredPresentTime,
+                                              transaction.isAutoTimestamp, {},
+                                              transaction.hasListenerCallbacks,
+                                              transaction.listenerCallbacks, transaction.id);
+    }
+
+    for (int j = 0; j < entry.removed_layer_handles_size(); j++) {
+        mDataMapper->mLayerHandles.erase(entry.removed_layer_handles(j));
+    }
+}
+
+void TransactionTraceReplayer::commit(const proto::TransactionTraceEntry& entry) {
+    const nsecs_t frameTime = entry.elapsed_realtime_nanos();
+    const int64_t vsyncId = entry.vsync_id();
+    if (mComposite) {
+        mTestableFlinger->commitAndComposite(frameTime, vsyncId, frameTime + ms2ns(10));
+    } else {
+        mTestableFlinger->commit(frameTime, vsyncId);
+    }
+}
+
+} // namespace android
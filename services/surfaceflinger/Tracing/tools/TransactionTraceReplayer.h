@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <Tracing/TransactionTracing.h>
+
+#include <memory>
+
+namespace android {
+
+namespace Hwc2::mock {
+class Composer;
+} // namespace Hwc2::mock
+
+class Factory;
+class MockSurfaceFlinger;
+class TestableSurfaceFlinger;
+class TraceGenFlingerDataMapper;
+
+/*
+ * Drives a headless SurfaceFlinger with the entries of a transaction trace. Everything apart from
+ * the front end is mocked out: the HWC is a mock composer and the RenderEngine a mock that draws
+ * nothing. When composition is requested, a fake primary display is injected so that every vsync
+ * also goes through composition.
+ */
+class TransactionTraceReplayer {
+public:
+    explicit TransactionTraceReplayer(bool composite = false);
+    ~TransactionTraceReplayer();
+
+    void startLayerTracing(int32_t flags, int64_t traceStartTime);
+    void stopLayerTracing(const char* tracePath);
+
+    // Creates the layers added by entry and queues its transactions, as binder threads would.
+    void queueEntry(const proto::TransactionTraceEntry& entry);
+
+    // Runs the main thread work for the vsync of entry: commit, and composition if enabled.
+    void commit(const proto::TransactionTraceEntry& entry);
+
+private:
+    void injectDisplay();
+
+    const bool mComposite;
+    std::unique_ptr<Factory> mFactory;
+    sp<MockSurfaceFlinger> mFlinger;
+    std::unique_ptr<TestableSurfaceFlinger> mTestableFlinger;
+    Hwc2::mock::Composer* mComposer = nullptr;
+    TraceGenFlingerDataMapper* mDataMapper = nullptr;
+    std::unique_ptr<surfaceflinger::TransactionProtoParser> mParser;
+};
+
+} // namespace android
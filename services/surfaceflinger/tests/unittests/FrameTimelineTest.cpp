@@ -25,6 +25,7 @@
 #include <log/log.h>
 #include <perfetto/trace/trace.pb.h>
 #include <cinttypes>
+#include <thread>
 
 using namespace std::chrono_literals;
 using testing::_;
@@ -116,7 +117,7 @@ public:
         for (size_t i = 0; i < maxTokens; i++) {
             mTokenManager->generateTokenForPredictions({});
         }
-        EXPECT_EQ(getPredictions().size(), maxTokens);
+        EXPECT_EQ(getNumberOfPredictions(), maxTokens);
     }
 
     SurfaceFrame& getSurfaceFrame(size_t displayFrameIdx, size_t surfaceFrameIdx) {
@@ -135,8 +136,37 @@ public:
                 a.presentTime == b.presentTime;
     }
 
-    const std::map<int64_t, TimelineItem>& getPredictions() const {
-        return mTokenManager->mPredictions;
+    size_t getNumberOfPredictions() const { return mTokenManager->getNumberOfPredictions(); }
+
+    FrameRecordPool::Stats getSurfaceFramePoolStats() const {
+        return mFrameTimeline->mSurfaceFramePool->getStats();
+    }
+
+    // Runs numFrames display frames with numLayers presented SurfaceFrames each, mimicking the
+    // calls SurfaceFlinger makes on the main thread.
+    void runDisplayFrames(size_t numFrames, size_t numLayers) {
+        EXPECT_CALL(*mTimeStats, incrementJankyFrames(_)).Times(testing::AnyNumber());
+        auto presentFence = fenceFactory.createFenceTimeForTest(Fence::NO_FENCE);
+        presentFence->signalForTest(30);
+        for (size_t i = 0; i < numFrames; i++) {
+            int64_t surfaceFrameToken = mTokenManager->generateTokenForPredictions({10, 20, 30});
+            int64_t sfToken = mTokenManager->generateTokenForPredictions({22, 26, 30});
+            mFrameTimeline->setSfWakeUp(sfToken, 22, Fps::fromPeriodNsecs(11));
+            for (size_t layer = 0; layer < numLayers; layer++) {
+                FrameTimelineInfo ftInfo;
+                ftInfo.vsyncId = surfaceFrameToken;
+                ftInfo.inputEventId = sInputEventId;
+                auto surfaceFrame =
+                        mFrameTimeline->createSurfaceFrameForToken(ftInfo, sPidOne, sUidOne,
+                                                                   static_cast<int32_t>(layer),
+                                                                   sLayerNameOne, sLayerNameOne,
+                                                                   /*isBuffer*/ true, sGameMode);
+                surfaceFrame->setAcquireFenceTime(20);
+                surfaceFrame->setPresentState(SurfaceFrame::PresentState::Presented);
+                mFrameTimeline->addSurfaceFrame(surfaceFrame);
+            }
+            mFrameTimeline->setSfPresent(26, presentFence);
+        }
     }
 
     uint32_t getNumberOfDisplayFrames() const {
@@ -181,7 +211,7 @@ constexpr GameMode sGameMode = GameMode::Unsupported;
 
 TEST_F(FrameTimelineTest, tokenManagerRemovesStalePredictions) {
     int64_t token1 = mTokenManager->generateTokenForPredictions({0, 0, 0});
-    EXPECT_EQ(getPredictions().size(), 1u);
+    EXPECT_EQ(getNumberOfPredictions(), 1u);
     flushTokens();
     int64_t token2 = mTokenManager->generateTokenForPredictions({10, 20, 30});
     std::optional<TimelineItem> predictions = mTokenManager->getPredictionsForToken(token1);
@@ -436,6 +466,81 @@ TEST_F(FrameTimelineTest, setMaxDisplayFramesSetsSizeProperly) {
     EXPECT_EQ(getNumberOfDisplayFrames(), *maxDisplayFrames);
 }
 
+TEST_F(FrameTimelineTest, tokenManagerConcurrentReadsSeeConsistentPredictions) {
+    std::atomic<bool> done = false;
+    std::atomic<int64_t> latestToken = mTokenManager->generateTokenForPredictions({1, 2, 3});
+    std::thread writer([&] {
+        for (nsecs_t i = 0; i < 100000; i++) {
+            latestToken = mTokenManager->generateTokenForPredictions({i, i + 1, i + 2});
+        }
+        done = true;
+    });
+
+    size_t numInconsistent = 0;
+    while (!done) {
+        const auto predictions = mTokenManager->getPredictionsForToken(latestToken);
+        if (predictions &&
+            (predictions->endTime != predictions->startTime + 1 ||
+             predictions->presentTime != predictions->startTime + 2)) {
+            numInconsistent++;
+        }
+    }
+    writer.join();
+    EXPECT_EQ(numInconsistent, 0u);
+}
+
+TEST_F(FrameTimelineTest, surfaceFramesAreServedFromPoolInSteadyState) {
+    constexpr size_t kNumLayers = 8;
+    // Fill the display frame window so that the steady state is reached.
+    runDisplayFrames(*maxDisplayFrames, kNumLayers);
+    const auto warmStats = getSurfaceFramePoolStats();
+
+    runDisplayFrames(*maxDisplayFrames * 4, kNumLayers);
+    const auto stats = getSurfaceFramePoolStats();
+    EXPECT_EQ(stats.heapAllocations, warmStats.heapAllocations);
+    EXPECT_EQ(stats.pooledAllocations - warmStats.pooledAllocations,
+              *maxDisplayFrames * 4 * kNumLayers);
+    // Only the frames in the window are alive.
+    EXPECT_EQ(stats.blocksInUse, *maxDisplayFrames * kNumLayers);
+    // The pool only grew to hold them and the frame being composed, rounded up to a chunk.
+    EXPECT_EQ(stats.allocatedBlocks, warmStats.allocatedBlocks);
+    EXPECT_LT(stats.allocatedBlocks,
+              stats.blocksInUse + kNumLayers + FrameRecordPool::kBlocksPerChunk);
+}
+
+TEST_F(FrameTimelineTest, surfaceFramePoolGrowsOnDemand) {
+    EXPECT_EQ(getSurfaceFramePoolStats().allocatedBlocks, 0u);
+
+    auto surfaceFrame =
+            mFrameTimeline->createSurfaceFrameForToken({}, sPidOne, sUidOne, sLayerIdOne,
+                                                       sLayerNameOne, sLayerNameOne,
+                                                       /*isBuffer*/ true, sGameMode);
+    const auto stats = getSurfaceFramePoolStats();
+    EXPECT_EQ(stats.allocatedBlocks, FrameRecordPool::kBlocksPerChunk);
+    EXPECT_EQ(stats.pooledAllocations, 1u);
+    EXPECT_EQ(stats.heapAllocations, 0u);
+}
+
+TEST_F(FrameTimelineTest, surfaceFramesFallBackToHeapWhenPoolIsExhausted) {
+    // Keep every SurfaceFrame alive so the pool has to overflow.
+    std::vector<std::shared_ptr<SurfaceFrame>> surfaceFrames;
+    const uint32_t capacity = getSurfaceFramePoolStats().capacity;
+    for (uint32_t i = 0; i < capacity + 10; i++) {
+        surfaceFrames.push_back(
+                mFrameTimeline->createSurfaceFrameForToken({}, sPidOne, sUidOne, sLayerIdOne,
+                                                           sLayerNameOne, sLayerNameOne,
+                                                           /*isBuffer*/ true, sGameMode));
+    }
+    auto stats = getSurfaceFramePoolStats();
+    EXPECT_EQ(stats.blocksInUse, capacity);
+    EXPECT_EQ(stats.allocatedBlocks, capacity);
+    EXPECT_EQ(stats.heapAllocations, 10u);
+
+    surfaceFrames.clear();
+    stats = getSurfaceFramePoolStats();
+    EXPECT_EQ(stats.blocksInUse, 0u);
+}
+
 TEST_F(FrameTimelineTest, presentFenceSignaled_invalidSignalTime) {
     Fps refreshRate = Fps::fromPeriodNsecs(11);
 
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "FrameTimeline_benchmarks"
+
+#include <FrameTimeline/FrameTimeline.h>
+#include <benchmark/benchmark.h>
+#include <ui/FenceTime.h>
+
+#include <memory>
+#include <string>
+
+#include "mock/MockTimeStats.h"
+
+namespace android::frametimeline {
+namespace {
+
+using testing::NiceMock;
+
+const std::string kLayerName = "layer";
+constexpr pid_t kSurfaceFlingerPid = 666;
+constexpr pid_t kPid = 10;
+constexpr uid_t kUid = 0;
+constexpr int32_t kInputEventId = 5;
+constexpr uint32_t kMaxDisplayFrames = 64;
+
+std::unique_ptr<impl::FrameTimeline> createFrameTimeline() {
+    auto frameTimeline =
+            std::make_unique<impl::FrameTimeline>(std::make_shared<NiceMock<mock::TimeStats>>(),
+                                                  kSurfaceFlingerPid);
+    frameTimeline->setMaxDisplayFrames(kMaxDisplayFrames);
+    return frameTimeline;
+}
+
+// Runs a display frame with numLayers presented SurfaceFrames, mimicking the calls
+// SurfaceFlinger makes on the main thread.
+void runDisplayFrame(impl::FrameTimeline& frameTimeline, size_t numLayers,
+                     const std::shared_ptr<FenceTime>& presentFence) {
+    TokenManager* tokenManager = frameTimeline.getTokenManager();
+    const int64_t surfaceFrameToken = tokenManager->generateTokenForPredictions({10, 20, 30});
+    const int64_t sfToken = tokenManager->generateTokenForPredictions({22, 26, 30});
+    frameTimeline.setSfWakeUp(sfToken, 22, Fps::fromPeriodNsecs(11));
+    for (size_t layer = 0; layer < numLayers; layer++) {
+        FrameTimelineInfo ftInfo;
+        ftInfo.vsyncId = surfaceFrameToken;
+        ftInfo.inputEventId = kInputEventId;
+        auto surfaceFrame =
+                frameTimeline.createSurfaceFrameForToken(ftInfo, kPid, kUid,
+                                                         static_cast<int32_t>(layer), kLayerName,
+                                                         kLayerName, /*isBuffer*/ true,
+                                                         GameMode::Unsupported);
+        surfaceFrame->setAcquireFenceTime(20);
+        surfaceFrame->setPresentState(SurfaceFrame::PresentState::Presented);
+        frameTimeline.addSurfaceFrame(surfaceFrame);
+    }
+    frameTimeline.setSfPresent(26, presentFence);
+}
+
+void BM_DisplayFrameThroughput(benchmark::State& state) {
+    const auto numLayers = static_cast<size_t>(state.range(0));
+    auto frameTimeline = createFrameTimeline();
+    FenceToFenceTimeMap fenceFactory;
+    auto presentFence = fenceFactory.createFenceTimeForTest(Fence::NO_FENCE);
+    presentFence->signalForTest(30);
+
+    // Fill the display frame window so that the steady state is measured.
+    for (uint32_t i = 0; i < kMaxDisplayFrames; i++) {
+        runDisplayFrame(*frameTimeline, numLayers, presentFence);
+    }
+
+    for (auto _ : state) {
+        runDisplayFrame(*frameTimeline, numLayers, presentFence);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DisplayFrameThroughput)->Arg(1)->Arg(8)->Arg(32);
+
+void BM_TokenGenerationThroughput(benchmark::State& state) {
+    auto frameTimeline = createFrameTimeline();
+    TokenManager* tokenManager = frameTimeline->getTokenManager();
+    for (auto _ : state) {
+        const int64_t token = tokenManager->generateTokenForPredictions({10, 20, 30});
+        benchmark::DoNotOptimize(tokenManager->getPredictionsForToken(token));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TokenGenerationThroughput);
+
+} // namespace
+} // namespace android::frametimeline
+
+BENCHMARK_MAIN();
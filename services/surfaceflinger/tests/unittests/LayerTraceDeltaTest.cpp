@@ -0,0 +1,247 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LayerTraceDeltaTest"
+
+#include <gtest/gtest.h>
+
+#include "Tracing/LayerTraceDelta.h"
+
+namespace android {
+namespace {
+
+class LayerTraceDeltaTest : public testing::Test {
+protected:
+    static LayerProto* addLayer(LayersProto& layers, int32_t id) {
+        LayerProto* layer = layers.add_layers();
+        layer->set_id(id);
+        layer->set_name("layer#" + std::to_string(id));
+        layer->set_type("BufferStateLayer");
+        layer->set_z(id);
+        layer->set_layer_stack(0);
+        layer->mutable_position()->set_x(static_cast<float>(id));
+        layer->mutable_position()->set_y(static_cast<float>(id));
+        layer->mutable_bounds()->set_right(1080.f);
+        layer->mutable_bounds()->set_bottom(2340.f);
+        layer->mutable_screen_bounds()->set_right(1080.f);
+        layer->mutable_screen_bounds()->set_bottom(2340.f);
+        layer->mutable_visible_region()->add_rect()->set_right(1080);
+        layer->set_pixel_format("RGBA_8888");
+        layer->set_dataspace("BT709 sRGB Full range");
+        for (int32_t child = 0; child < 3; child++) {
+            layer->add_children(id * 10 + child);
+        }
+        return layer;
+    }
+
+    static LayersProto createLayers(int32_t numLayers) {
+        LayersProto layers;
+        for (int32_t id = 1; id <= numLayers; id++) {
+            addLayer(layers, id);
+        }
+        return layers;
+    }
+
+    // Encodes layers, serializes the entry like the ring buffer does, then decodes it and checks
+    // the full snapshot is restored. Returns the size of the encoded entry.
+    size_t encodeAndVerify(const LayersProto& layers) {
+        LayersProto copy = layers;
+        LayersTraceProto entry;
+        mEncoder.encode(std::move(copy), entry);
+        const std::string serialized = entry.SerializeAsString();
+
+        LayersTraceProto decoded;
+        EXPECT_TRUE(decoded.ParseFromString(serialized));
+        EXPECT_TRUE(mDecoder.decode(decoded));
+        EXPECT_FALSE(decoded.is_delta());
+        EXPECT_EQ(decoded.layers().SerializeAsString(), layers.SerializeAsString());
+        return serialized.size();
+    }
+
+    LayerTraceDeltaEncoder mEncoder{/*keyframeInterval*/ 8};
+    LayerTraceDeltaDecoder mDecoder;
+};
+
+TEST_F(LayerTraceDeltaTest, firstEntryIsKeyframe) {
+    LayersProto layers = createLayers(4);
+    LayersTraceProto entry;
+    mEncoder.encode(std::move(layers), entry);
+    EXPECT_FALSE(entry.is_delta());
+    EXPECT_EQ(entry.layers().layers_size(), 4);
+}
+
+TEST_F(LayerTraceDeltaTest, deltaOnlyHoldsChangedFields) {
+    LayersProto layers = createLayers(4);
+    encodeAndVerify(layers);
+
+    layers.mutable_layers(2)->set_z(42);
+    LayersProto copy = layers;
+    LayersTraceProto entry;
+    mEncoder.encode(std::move(copy), entry);
+    EXPECT_TRUE(entry.is_delta());
+    EXPECT_EQ(entry.layer_order_size(), 0);
+    ASSERT_EQ(entry.layers().layers_size(), 1);
+    const LayerProto& delta = entry.layers().layers(0);
+    EXPECT_EQ(delta.id(), 3);
+    EXPECT_EQ(delta.z(), 42);
+    EXPECT_TRUE(delta.name().empty());
+    EXPECT_FALSE(delta.has_position());
+}
+
+TEST_F(LayerTraceDeltaTest, restoresClearedFields) {
+    LayersProto layers = createLayers(4);
+    encodeAndVerify(layers);
+
+    layers.mutable_layers(0)->clear_position();
+    layers.mutable_layers(1)->clear_children();
+    layers.mutable_layers(2)->set_name("");
+    encodeAndVerify(layers);
+}
+
+TEST_F(LayerTraceDeltaTest, restoresAddedRemovedAndReorderedLayers) {
+    LayersProto layers = createLayers(4);
+    encodeAndVerify(layers);
+
+    addLayer(layers, 5);
+    encodeAndVerify(layers);
+
+    layers.mutable_layers()->DeleteSubrange(1, 1);
+    encodeAndVerify(layers);
+
+    layers.mutable_layers()->SwapElements(0, 2);
+    encodeAndVerify(layers);
+
+    layers.Clear();
+    encodeAndVerify(layers);
+
+    addLayer(layers, 6);
+    encodeAndVerify(layers);
+}
+
+TEST_F(LayerTraceDeltaTest, emitsPeriodicKeyframes) {
+    LayersProto layers = createLayers(4);
+    int keyframes = 0;
+    for (int i = 0; i < 32; i++) {
+        layers.mutable_layers(i % 4)->set_z(i);
+        LayersProto copy = layers;
+        LayersTraceProto entry;
+        mEncoder.encode(std::move(copy), entry);
+        if (!entry.is_delta()) {
+            keyframes++;
+        }
+    }
+    // One keyframe followed by 8 deltas.
+    EXPECT_EQ(keyframes, 4);
+}
+
+TEST_F(LayerTraceDeltaTest, resetStartsNewKeyframe) {
+    LayersProto layers = createLayers(4);
+    encodeAndVerify(layers);
+    mEncoder.reset();
+
+    LayersTraceProto entry;
+    mEncoder.encode(std::move(layers), entry);
+    EXPECT_FALSE(entry.is_delta());
+}
+
+TEST_F(LayerTraceDeltaTest, deltaWithoutKeyframeCannotBeDecoded) {
+    LayersProto layers = createLayers(4);
+    encodeAndVerify(layers);
+
+    layers.mutable_layers(0)->set_z(7);
+    LayersTraceProto entry;
+    mEncoder.encode(std::move(layers), entry);
+    ASSERT_TRUE(entry.is_delta());
+
+    LayerTraceDeltaDecoder decoder;
+    EXPECT_FALSE(decoder.decode(entry));
+}
+
+TEST_F(LayerTraceDeltaTest, restoresLayersStoredWhole) {
+    LayersProto layers = createLayers(2);
+    encodeAndVerify(layers);
+
+    // A delta holding the second layer whole, as the encoder writes it when it can't compare the
+    // layer field by field.
+    LayerProto* layer = layers.mutable_layers(1);
+    layer->clear_pixel_format();
+    layer->set_z(7);
+    LayersTraceProto entry;
+    entry.set_is_delta(true);
+    *entry.mutable_layers()->add_layers() = *layer;
+    entry.add_full_layer_ids(layer->id());
+
+    ASSERT_TRUE(mDecoder.decode(entry));
+    EXPECT_EQ(entry.layers().SerializeAsString(), layers.SerializeAsString());
+}
+
+TEST_F(LayerTraceDeltaTest, malformedDeltaRequiresNewKeyframe) {
+    LayersProto layers = createLayers(2);
+    encodeAndVerify(layers);
+
+    // The order refers to a layer the decoder never saw.
+    LayersTraceProto malformed;
+    malformed.set_is_delta(true);
+    LayerProto* changed = malformed.mutable_layers()->add_layers();
+    changed->set_id(1);
+    changed->set_z(7);
+    malformed.add_layer_order(1);
+    malformed.add_layer_order(42);
+    EXPECT_FALSE(mDecoder.decode(malformed));
+
+    // The first layer was updated before the failure, the next delta can't be applied on top.
+    layers.mutable_layers(0)->set_z(8);
+    LayersTraceProto entry;
+    mEncoder.encode(LayersProto(layers), entry);
+    ASSERT_TRUE(entry.is_delta());
+    EXPECT_FALSE(mDecoder.decode(entry));
+
+    mEncoder.reset();
+    encodeAndVerify(layers);
+}
+
+TEST_F(LayerTraceDeltaTest, deltasAreSmallerThanFullSnapshots) {
+    constexpr int32_t kNumLayers = 100;
+    constexpr int kNumFrames = 100;
+    // Returns the bytes needed to store frames where a few layers move or latch a new buffer.
+    const auto encodeFrames = [&](bool deltas) {
+        LayerTraceDeltaEncoder encoder;
+        LayersProto layers = createLayers(kNumLayers);
+        size_t bytes = 0;
+        for (int frame = 0; frame < kNumFrames; frame++) {
+            for (int i = 0; i < 3; i++) {
+                LayerProto* layer = layers.mutable_layers((frame * 7 + i * 31) % kNumLayers);
+                layer->set_curr_frame(layer->curr_frame() + 1);
+                layer->mutable_position()->set_y(static_cast<float>(frame));
+            }
+            LayersProto copy = layers;
+            LayersTraceProto entry;
+            if (deltas) {
+                encoder.encode(std::move(copy), entry);
+            } else {
+                entry.mutable_layers()->Swap(&copy);
+            }
+            bytes += entry.ByteSizeLong();
+        }
+        return bytes;
+    };
+
+    EXPECT_LT(encodeFrames(/*deltas*/ true) * 4, encodeFrames(/*deltas*/ false));
+}
+
+} // namespace
+} // namespace android
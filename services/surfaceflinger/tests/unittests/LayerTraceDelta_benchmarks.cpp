@@ -0,0 +1,91 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LayerTraceDelta_benchmarks"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "Tracing/LayerTraceDelta.h"
+
+namespace android {
+namespace {
+
+constexpr int32_t kNumLayers = 100;
+
+LayersProto createLayers() {
+    LayersProto layers;
+    for (int32_t id = 1; id <= kNumLayers; id++) {
+        LayerProto* layer = layers.add_layers();
+        layer->set_id(id);
+        layer->set_name("layer#" + std::to_string(id));
+        layer->set_type("BufferStateLayer");
+        layer->set_z(id);
+        layer->mutable_position()->set_x(static_cast<float>(id));
+        layer->mutable_bounds()->set_right(1080.f);
+        layer->mutable_bounds()->set_bottom(2340.f);
+        layer->mutable_screen_bounds()->set_right(1080.f);
+        layer->mutable_screen_bounds()->set_bottom(2340.f);
+        layer->mutable_visible_region()->add_rect()->set_right(1080);
+        layer->set_pixel_format("RGBA_8888");
+        layer->set_dataspace("BT709 sRGB Full range");
+        for (int32_t child = 0; child < 3; child++) {
+            layer->add_children(id * 10 + child);
+        }
+    }
+    return layers;
+}
+
+// Stores the layer snapshot of a typical frame, where a few layers move or latch a new buffer,
+// either whole or as a delta against the previous frame.
+void BM_StoreLayersSnapshot(benchmark::State& state) {
+    const bool deltas = state.range(0) != 0;
+    LayerTraceDeltaEncoder encoder;
+    LayersProto layers = createLayers();
+    std::string serialized;
+    size_t bytes = 0;
+    int frame = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int i = 0; i < 3; i++) {
+            LayerProto* layer = layers.mutable_layers((frame * 7 + i * 31) % kNumLayers);
+            layer->set_curr_frame(layer->curr_frame() + 1);
+            layer->mutable_position()->set_y(static_cast<float>(frame));
+        }
+        frame++;
+        LayersProto copy = layers;
+        state.ResumeTiming();
+
+        LayersTraceProto entry;
+        if (deltas) {
+            encoder.encode(std::move(copy), entry);
+        } else {
+            entry.mutable_layers()->Swap(&copy);
+        }
+        // Account for serializing the entry into the ring buffer.
+        entry.SerializeToString(&serialized);
+        bytes += serialized.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["bytes_per_frame"] =
+            benchmark::Counter(static_cast<double>(bytes), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_StoreLayersSnapshot)->ArgName("deltas")->Arg(0)->Arg(1);
+
+} // namespace
+} // namespace android
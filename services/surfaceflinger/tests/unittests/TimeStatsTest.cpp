@@ -32,6 +32,7 @@
 
 #include <chrono>
 #include <random>
+#include <thread>
 #include <unordered_set>
 
 #include "libsurfaceflinger_unittest_main.h"
@@ -158,6 +159,14 @@ public:
         }
     }
 
+    // Applies the queued per-layer events, as the drain thread does periodically. Tests pushing
+    // more events than a shard holds drain in between, so that none is dropped.
+    void drainEvents() { static_cast<impl::TimeStats&>(*mTimeStats).drainEvents(); }
+
+    void expectNoDroppedEvents() {
+        EXPECT_THAT(mTimeStats->miniDump(), HasSubstr("Number of events dropped is 0\n"));
+    }
+
     std::mt19937 mRandomEngine = std::mt19937(std::random_device()());
     std::unique_ptr<TimeStats> mTimeStats =
             std::make_unique<impl::TimeStats>(std::nullopt, std::nullopt);
@@ -832,6 +841,20 @@ TEST_F(TimeStatsTest, canRecoverFromIncompleteTimeRecordError) {
     EXPECT_EQ(1, layerProto.total_frames());
 }
 
+TEST_F(TimeStatsTest, layerRecordIsErasedOnDestroyWhenShardIsFull) {
+    EXPECT_TRUE(inputCommand(InputCommand::ENABLE, FMT_STRING).empty());
+
+    insertTimeRecord(NORMAL_SEQUENCE, LAYER_ID_0, 1, 1000000);
+    // Overflows the shard of the layer, unless the drain thread catches up in between.
+    for (int i = 0; i < 2048; i++) {
+        mTimeStats->incrementBadDesiredPresent(LAYER_ID_0);
+    }
+    ASSERT_NO_FATAL_FAILURE(mTimeStats->onDestroy(LAYER_ID_0));
+
+    EXPECT_THAT(mTimeStats->miniDump(),
+                HasSubstr("Number of layers currently being tracked is 0\n"));
+}
+
 TEST_F(TimeStatsTest, layerTimeStatsOnDestroy) {
     EXPECT_TRUE(inputCommand(InputCommand::ENABLE, FMT_STRING).empty());
 
@@ -1517,6 +1540,60 @@ TEST_F(TimeStatsTest, refreshRateIsClampedToNearestBucket) {
     verifyRefreshRateBucket(29_Hz, 30);
 }
 
+TEST_F(TimeStatsTest, layerEventsFromMultipleThreadsAreAggregated) {
+    constexpr int32_t kNumThreads = 4;
+    constexpr uint64_t kNumFrames = 500;
+    // Well under the 1024 events a shard holds, at 5 events per frame.
+    constexpr uint64_t kFramesPerDrain = 50;
+
+    EXPECT_TRUE(inputCommand(InputCommand::ENABLE, FMT_STRING).empty());
+
+    std::vector<std::thread> producers;
+    for (int32_t layerId = 0; layerId < kNumThreads; layerId++) {
+        producers.emplace_back([this, layerId] {
+            for (uint64_t frameNumber = 1; frameNumber <= kNumFrames; frameNumber++) {
+                insertTimeRecord(NORMAL_SEQUENCE, layerId, frameNumber,
+                                 static_cast<nsecs_t>(frameNumber) * 16000000);
+                if (frameNumber % kFramesPerDrain == 0) {
+                    drainEvents();
+                }
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    expectNoDroppedEvents();
+
+    SFTimeStatsGlobalProto globalProto;
+    ASSERT_TRUE(globalProto.ParseFromString(inputCommand(InputCommand::DUMP_ALL, FMT_PROTO)));
+    ASSERT_EQ(kNumThreads, globalProto.stats_size());
+    for (const auto& layerProto : globalProto.stats()) {
+        // The first frame of each layer has no previous present to compare against.
+        EXPECT_EQ(static_cast<int32_t>(kNumFrames - 1), layerProto.total_frames());
+    }
+}
+
+TEST_F(TimeStatsTest, recordsEveryLayerAt200Layers) {
+    constexpr int32_t kNumLayers = 200;
+    constexpr uint64_t kNumFrames = 10;
+
+    EXPECT_TRUE(inputCommand(InputCommand::ENABLE, FMT_STRING).empty());
+    for (uint64_t frameNumber = 1; frameNumber <= kNumFrames; frameNumber++) {
+        const nsecs_t ts = static_cast<nsecs_t>(frameNumber) * 16000000;
+        for (int32_t layerId = 0; layerId < kNumLayers; layerId++) {
+            insertTimeRecord(NORMAL_SEQUENCE_2, layerId, frameNumber, ts);
+        }
+        // A frame of 200 layers fills a shard to an eighth, drain it like the drain thread would.
+        drainEvents();
+    }
+    expectNoDroppedEvents();
+
+    SFTimeStatsGlobalProto globalProto;
+    ASSERT_TRUE(globalProto.ParseFromString(inputCommand(InputCommand::DUMP_ALL, FMT_PROTO)));
+    EXPECT_EQ(kNumLayers, globalProto.stats_size());
+}
+
 } // namespace
 } // namespace android
 
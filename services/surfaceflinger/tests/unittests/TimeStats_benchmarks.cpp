@@ -0,0 +1,83 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "TimeStats_benchmarks"
+
+#include <TimeStats/TimeStats.h>
+#include <benchmark/benchmark.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace {
+
+constexpr int32_t kNumLayers = 200;
+constexpr uid_t kUid = 0;
+constexpr Fps kRefreshRate = Fps::fromValue(60.f);
+constexpr nsecs_t kFrameInterval = 16000000;
+
+// Reports the timestamps of a frame of each layer, mirroring the per-layer calls SurfaceFlinger
+// makes on the main thread. The events are drained after each frame outside of the timed region,
+// as the drain thread would, so that the cost measured is the one of queueing them.
+void BM_MainThreadCostPerLayerFrame(benchmark::State& state) {
+    const bool enabled = state.range(0) != 0;
+    impl::TimeStats timeStats(std::nullopt, std::nullopt);
+    if (enabled) {
+        Vector<String16> args;
+        args.push_back(String16("-enable"));
+        std::string result;
+        timeStats.parseArgs(/*asProto*/ false, args, result);
+    }
+
+    std::vector<std::string> layerNames;
+    for (int32_t layerId = 0; layerId < kNumLayers; layerId++) {
+        layerNames.push_back("com.example.fake#" + std::to_string(layerId));
+    }
+
+    uint64_t frameNumber = 1;
+    for (auto _ : state) {
+        nsecs_t ts = static_cast<nsecs_t>(frameNumber) * kFrameInterval;
+        for (int32_t layerId = 0; layerId < kNumLayers; layerId++) {
+            timeStats.setPostTime(layerId, frameNumber, layerNames[layerId], kUid, ts,
+                                  GameMode::Unsupported);
+            timeStats.setAcquireFence(layerId, frameNumber,
+                                      std::make_shared<FenceTime>(ts + 1000000));
+            timeStats.setLatchTime(layerId, frameNumber, ts + 2000000);
+            timeStats.setDesiredTime(layerId, frameNumber, ts + 3000000);
+            timeStats.setPresentFence(layerId, frameNumber,
+                                      std::make_shared<FenceTime>(ts + 4000000), kRefreshRate,
+                                      kRefreshRate, {}, GameMode::Unsupported);
+        }
+        frameNumber++;
+
+        state.PauseTiming();
+        timeStats.drainEvents();
+        state.ResumeTiming();
+    }
+    if (timeStats.miniDump().find("Number of events dropped is 0\n") == std::string::npos) {
+        state.SkipWithError("TimeStats dropped events");
+    }
+    state.SetItemsProcessed(state.iterations() * kNumLayers);
+}
+BENCHMARK(BM_MainThreadCostPerLayerFrame)->ArgName("enabled")->Arg(0)->Arg(1);
+
+} // namespace
+} // namespace android
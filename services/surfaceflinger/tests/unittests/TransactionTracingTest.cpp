@@ -14,10 +14,12 @@
  * limitations under the License.
  */
 
+#include <android-base/file.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 #include <gui/SurfaceComposerClient.h>
+#include <utils/Timers.h>
 
 #include "Tracing/RingBuffer.h"
 #include "Tracing/TransactionTracing.h"
@@ -37,7 +39,8 @@ protected:
     proto::TransactionTraceEntry bufferFront() {
         std::scoped_lock<std::mutex> lock(mTracing.mTraceLock);
         proto::TransactionTraceEntry entry;
-        entry.ParseFromString(mTracing.mBuffer.front());
+        const std::string_view front = mTracing.mBuffer.front();
+        entry.ParseFromArray(front.data(), static_cast<int>(front.size()));
         return entry;
     }
 
@@ -96,6 +99,67 @@ TEST_F(TransactionTracingTest, addTransactions) {
     verifyEntry(proto.entry(1), secondTransactionSet, secondTransactionSetVsyncId);
 }
 
+TEST_F(TransactionTracingTest, writeToFileStreamsBufferedEntries) {
+    mTracing.setBufferSize(SMALL_BUFFER_SIZE);
+    // Wrap around the buffer a few times.
+    for (int64_t vsyncId = 1; vsyncId <= 100; vsyncId++) {
+        queueAndCommitTransaction(vsyncId);
+    }
+    const proto::TransactionTraceFile expected = writeToProto();
+    ASSERT_GT(expected.entry().size(), 0);
+    EXPECT_EQ(expected.entry(expected.entry().size() - 1).vsync_id(), 100);
+
+    TemporaryFile tmp;
+    ASSERT_EQ(NO_ERROR, mTracing.writeToFile(tmp.path));
+    std::string contents;
+    ASSERT_TRUE(base::ReadFileToString(tmp.path, &contents));
+    proto::TransactionTraceFile actual;
+    ASSERT_TRUE(actual.ParseFromString(contents));
+    EXPECT_EQ(actual.magic_number(), expected.magic_number());
+    ASSERT_EQ(actual.entry().size(), expected.entry().size());
+    for (int i = 0; i < expected.entry().size(); i++) {
+        EXPECT_EQ(actual.entry(i).vsync_id(), expected.entry(i).vsync_id());
+        EXPECT_EQ(actual.entry(i).transactions().size(), expected.entry(i).transactions().size());
+    }
+}
+
+TEST(TransactionTracingRingBufferTest, continuousTracingEvictsOldestFrames) {
+    // A typical frame: a handful of transactions, each touching a few layers.
+    proto::TransactionTraceEntry entry;
+    entry.set_elapsed_realtime_nanos(systemTime());
+    for (int t = 0; t < 4; t++) {
+        proto::TransactionState* transaction = entry.add_transactions();
+        transaction->set_pid(t);
+        transaction->set_uid(t);
+        transaction->set_transaction_id(static_cast<uint64_t>(t));
+        for (int l = 0; l < 4; l++) {
+            proto::LayerState* layer = transaction->add_layer_changes();
+            layer->set_layer_id(l);
+            layer->set_what(layer_state_t::ePositionChanged | layer_state_t::eLayerChanged);
+            layer->set_x(static_cast<float>(l));
+            layer->set_y(static_cast<float>(t));
+            layer->set_z(l);
+        }
+    }
+
+    constexpr size_t kNumFrames = 100000;
+    RingBuffer<proto::TransactionTraceFile, proto::TransactionTraceEntry> buffer;
+    buffer.setSize(TransactionTracing::CONTINUOUS_TRACING_BUFFER_SIZE);
+    size_t evicted = 0;
+    for (size_t i = 0; i < kNumFrames; i++) {
+        entry.set_vsync_id(static_cast<int64_t>(i));
+        buffer.emplace(entry, [&](std::string_view) { evicted++; });
+    }
+
+    EXPECT_GT(evicted, 0u);
+    EXPECT_EQ(evicted + buffer.frameCount(), kNumFrames);
+    EXPECT_LE(buffer.used(), buffer.size());
+    proto::TransactionTraceEntry last;
+    const std::string_view back = buffer.back();
+    ASSERT_TRUE(last.ParseFromArray(back.data(), static_cast<int>(back.size())));
+    EXPECT_EQ(last.vsync_id(), static_cast<int64_t>(kNumFrames - 1));
+}
+
 class TransactionTracingLayerHandlingTest : public TransactionTracingTest {
 protected:
     void SetUp() override {
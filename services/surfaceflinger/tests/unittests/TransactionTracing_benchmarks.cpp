@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "TransactionTracing_benchmarks"
+
+#include <benchmark/benchmark.h>
+#include <gui/LayerState.h>
+#include <utils/Timers.h>
+
+#include "Tracing/RingBuffer.h"
+#include "Tracing/TransactionTracing.h"
+
+namespace android {
+namespace {
+
+// Stores the entries of continuous tracing, each a typical frame with a handful of transactions
+// touching a few layers, into the continuous tracing ring buffer.
+void BM_ContinuousTracingPerFrame(benchmark::State& state) {
+    proto::TransactionTraceEntry entry;
+    entry.set_elapsed_realtime_nanos(systemTime());
+    for (int t = 0; t < 4; t++) {
+        proto::TransactionState* transaction = entry.add_transactions();
+        transaction->set_pid(t);
+        transaction->set_uid(t);
+        transaction->set_transaction_id(static_cast<uint64_t>(t));
+        for (int l = 0; l < 4; l++) {
+            proto::LayerState* layer = transaction->add_layer_changes();
+            layer->set_layer_id(l);
+            layer->set_what(layer_state_t::ePositionChanged | layer_state_t::eLayerChanged);
+            layer->set_x(static_cast<float>(l));
+            layer->set_y(static_cast<float>(t));
+            layer->set_z(l);
+        }
+    }
+
+    RingBuffer<proto::TransactionTraceFile, proto::TransactionTraceEntry> buffer;
+    buffer.setSize(TransactionTracing::CONTINUOUS_TRACING_BUFFER_SIZE);
+    int64_t vsyncId = 0;
+    for (auto _ : state) {
+        entry.set_vsync_id(vsyncId++);
+        buffer.emplace(entry);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ContinuousTracingPerFrame);
+
+} // namespace
+} // namespace android